@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+
+/**
+ * @file coopstats_bench.c
+ * @brief So sánh tính COOPSTATS: duyệt `struct Device` (AoS) với bản sao dạng cột + kernel SIMD.
+ *
+ * Chạy: `make bench && bin/coopstats_bench [coops] [sensors_per_coop] [rounds]`.
+ */
+
+#include "coop_stats.h"
+#include "devices.h"
+#include "simd_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/** @brief Cách cũ: một lượt qua mọi thiết bị, lọc theo chuồng/loại. */
+static void aos_query(const struct DevicesContext *devices, int coop_id, struct CoopStats *out) {
+    double t_sum = 0.0, t_min = 1e300, t_max = -1e300, eggs = 0.0;
+    size_t sensors = 0, heaters_on = 0;
+    for (size_t i = 0; i < devices->count; ++i) {
+        const struct Device *d = &devices->devices[i];
+        if (d->identity.coop_id != coop_id) continue;
+        if (d->identity.type == DEVICE_SENSOR) {
+            double t = d->data.sensor.temperature;
+            t_sum += t;
+            t_min = t < t_min ? t : t_min;
+            t_max = t > t_max ? t : t_max;
+            sensors++;
+        } else if (d->identity.type == DEVICE_EGG_COUNTER) {
+            eggs += d->data.egg_counter.egg_count;
+        } else if (d->identity.type == DEVICE_HEATER) {
+            heaters_on += d->data.heater.state == DEVICE_ON;
+        }
+    }
+    out->devices[COOP_STATS_SENSOR] = sensors;
+    out->devices_on[COOP_STATS_HEATER] = heaters_on;
+    out->temp_min = t_min;
+    out->temp_max = t_max;
+    out->temp_avg = sensors ? t_sum / (double)sensors : 0.0;
+    out->eggs_total = eggs;
+}
+
+int main(int argc, char **argv) {
+    int coops = argc > 1 ? atoi(argv[1]) : 16;
+    int per_coop = argc > 2 ? atoi(argv[2]) : 4096;
+    int rounds = argc > 3 ? atoi(argv[3]) : 200;
+    if (coops <= 0 || per_coop <= 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [coops] [sensors_per_coop] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    struct DevicesContext devices;
+    devices_context_init(&devices);
+    srand(42);
+    char id[32];
+    for (int c = 1; c <= coops; ++c) {
+        for (int i = 0; i < per_coop; ++i) {
+            /* Xen ke loai de mo phong farm that: 4 cam bien, 1 bo dem trung, 1 heater */
+            static const enum DeviceType mix[] = { DEVICE_SENSOR, DEVICE_SENSOR, DEVICE_EGG_COUNTER,
+                                                   DEVICE_SENSOR, DEVICE_HEATER, DEVICE_SENSOR };
+            enum DeviceType type = mix[i % 6];
+            snprintf(id, sizeof(id), "B%d_%d", c, i);
+            if (devices_add(&devices, id, type, "pw", c) != 0) {
+                fprintf(stderr, "devices_add failed\n");
+                return 1;
+            }
+            struct Device *d = devices_find(&devices, id);
+            if (type == DEVICE_SENSOR) {
+                (void)devices_report_sensor(d, 15.0 + (rand() % 2000) / 100.0, 40.0 + (rand() % 4000) / 100.0);
+            } else if (type == DEVICE_EGG_COUNTER) {
+                (void)devices_report_eggs(d, rand() % 500);
+            } else {
+                (void)devices_set_state(d, (rand() & 1) ? DEVICE_ON : DEVICE_OFF);
+            }
+        }
+    }
+    printf("devices=%zu coops=%d rounds=%d\n", devices.count, coops, rounds);
+
+    struct CoopStats st;
+    double checksum = 0.0;
+    double t0 = now_s();
+    for (int r = 0; r < rounds; ++r) {
+        for (int c = 1; c <= coops; ++c) {
+            aos_query(&devices, c, &st);
+            checksum += st.temp_avg + st.eggs_total;
+        }
+    }
+    double aos = now_s() - t0;
+    printf("%-8s %10.1f us/query  checksum=%.3f\n", "aos", aos * 1e6 / ((double)rounds * coops), checksum);
+
+    struct CoopStatsMirror mirror;
+    coop_stats_init(&mirror);
+    t0 = now_s();
+    if (coop_stats_query(&mirror, &devices, 1, &st) != 0) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    printf("%-8s %10.1f us\n", "rebuild", (now_s() - t0) * 1e6);
+
+    static const enum SimdLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l) {
+        enum SimdLevel got = simd_set_level(levels[l]);
+        if (got != levels[l]) {
+            printf("%-8s (khong ho tro tren CPU nay)\n", simd_level_name(levels[l]));
+            continue;
+        }
+        checksum = 0.0;
+        t0 = now_s();
+        for (int r = 0; r < rounds; ++r) {
+            for (int c = 1; c <= coops; ++c) {
+                (void)coop_stats_query(&mirror, &devices, c, &st);
+                checksum += st.temp_avg + st.eggs_total;
+            }
+        }
+        double soa = now_s() - t0;
+        printf("%-8s %10.1f us/query  checksum=%.3f  speedup=%.1fx\n", simd_level_name(got),
+               soa * 1e6 / ((double)rounds * coops), checksum, aos / soa);
+    }
+
+    coop_stats_free(&mirror);
+    devices_context_free(&devices);
+    return 0;
+}
@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 200809L
+
+/**
+ * @file device_layout_bench.c
+ * @brief So sánh layout `struct Device` cũ (mật khẩu/lịch/đơn vị nằm chung) với layout nóng/lạnh.
+ *
+ * Layout cũ được chép lại ở đây (`LegacyDevice`) kèm bảng băm ID giống
+ * `devices_find`, nên hai bên chỉ khác nhau ở kích thước phần tử.
+ * Chạy: `make bench && bin/device_layout_bench [devices] [rounds]`.
+ */
+
+#include "devices.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief Dữ liệu theo type của layout cũ (FeederData kéo theo cả lịch 10 mốc). */
+union LegacyDeviceData {
+    struct { double temperature, humidity; char unit_temperature[4], unit_humidity[4]; } sensor;
+    struct {
+        enum DevicePowerState state;
+        double W, Vw;
+        char unit_food[8], unit_water[8];
+        struct ScheduleEntry schedule[MAX_SCHEDULE_ENTRIES];
+        size_t schedule_count;
+    } feeder;
+    struct { enum DevicePowerState state; double Tmin, Tp2; char mode[8], unit_temp[4]; } heater;
+};
+
+struct LegacyDevice {
+    struct DeviceIdentity identity;
+    char password[MAX_PASSWORD_LEN];
+    union LegacyDeviceData data;
+    unsigned long long version;
+    unsigned long long seq;
+    unsigned sched_gen;
+    unsigned long long telemetry_counter;
+};
+
+struct LegacyContext {
+    struct LegacyDevice *devices;
+    size_t count;
+    size_t *slots;
+    size_t mask;
+};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t id_hash(const char *id) {
+    size_t h = (size_t)2166136261u;
+    for (size_t i = 0; i < MAX_ID_LEN && id[i] != '\0'; ++i) {
+        h ^= (unsigned char)id[i];
+        h *= (size_t)16777619u;
+    }
+    return h;
+}
+
+static const struct LegacyDevice *legacy_find(const struct LegacyContext *ctx, const char *id) {
+    for (size_t slot = id_hash(id) & ctx->mask; ctx->slots[slot] != 0; slot = (slot + 1) & ctx->mask) {
+        const struct LegacyDevice *dev = &ctx->devices[ctx->slots[slot] - 1];
+        if (strncmp(dev->identity.id, id, sizeof(dev->identity.id)) == 0) return dev;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    if (n == 0 || n > MAX_FARM_DEVICES || rounds <= 0) {
+        fprintf(stderr, "usage: %s [devices<=%d] [rounds]\n", argv[0], MAX_FARM_DEVICES);
+        return 1;
+    }
+
+    static const enum DeviceType mix[] = { DEVICE_SENSOR, DEVICE_FEEDER, DEVICE_HEATER, DEVICE_SENSOR };
+    struct DevicesContext devices;
+    devices_context_init(&devices);
+    struct LegacyContext legacy = {0};
+    legacy.devices = (struct LegacyDevice *)calloc(n, sizeof(*legacy.devices));
+    size_t slots = 64;
+    while (slots < n * 2) slots *= 2;
+    legacy.slots = (size_t *)calloc(slots, sizeof(*legacy.slots));
+    legacy.mask = slots - 1;
+    char (*ids)[MAX_ID_LEN] = malloc(n * sizeof(*ids));
+    if (!legacy.devices || !legacy.slots || !ids) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(ids[i], MAX_ID_LEN, "DEV%06zu", i);
+        enum DeviceType type = mix[i % 4];
+        int coop = (int)(i % 32) + 1;
+        if (devices_add(&devices, ids[i], type, "pw", coop) != 0) {
+            fprintf(stderr, "devices_add failed\n");
+            return 1;
+        }
+        struct LegacyDevice *l = &legacy.devices[legacy.count++];
+        l->identity = devices_find(&devices, ids[i])->identity;
+        l->seq = i + 1;
+        size_t slot = id_hash(ids[i]) & legacy.mask;
+        while (legacy.slots[slot] != 0) slot = (slot + 1) & legacy.mask;
+        legacy.slots[slot] = legacy.count;
+    }
+    printf("devices=%zu sizeof(LegacyDevice)=%zu sizeof(Device)=%zu sizeof(DeviceCold)=%zu\n", n,
+           sizeof(struct LegacyDevice), sizeof(struct Device), sizeof(struct DeviceCold));
+
+    /* Tra cuu theo thu tu ngau nhien de khong duoc loi tu prefetch tuan tu */
+    size_t lookups = n * (size_t)rounds;
+    size_t *order = malloc(lookups * sizeof(*order));
+    if (!order) return 1;
+    srand(7);
+    for (size_t i = 0; i < lookups; ++i) order[i] = ((size_t)rand() * 31u + (size_t)rand()) % n;
+
+    /* Chay lan luot hai lan de khong phu thuoc ben nao chay truoc */
+    unsigned long long check = 0, check_new = 0;
+    double legacy_find_s = 0.0, find_s = 0.0, t0;
+    for (int pass = 0; pass < 2; ++pass) {
+        t0 = now_s();
+        for (size_t i = 0; i < lookups; ++i) check += legacy_find(&legacy, ids[order[i]])->identity.coop_id;
+        legacy_find_s += now_s() - t0;
+        t0 = now_s();
+        for (size_t i = 0; i < lookups; ++i) check_new += devices_find(&devices, ids[order[i]])->identity.coop_id;
+        find_s += now_s() - t0;
+    }
+    lookups *= 2;
+    printf("%-20s legacy %8.1f ns  split %8.1f ns  speedup %.2fx  (check %s)\n", "lookup", legacy_find_s * 1e9 / lookups,
+           find_s * 1e9 / lookups, legacy_find_s / find_s, check == check_new ? "ok" : "MISMATCH");
+
+    /* Quet: loc theo chuong + doc trang thai, giong MINFO/MCONTROL/STATS */
+    check = check_new = 0;
+    t0 = now_s();
+    for (int r = 0; r < rounds; ++r) {
+        int coop = r % 32 + 1;
+        for (size_t i = 0; i < legacy.count; ++i) {
+            const struct LegacyDevice *d = &legacy.devices[i];
+            if (d->identity.coop_id == coop) check += d->identity.type + (d->seq & 1);
+        }
+    }
+    double legacy_scan_s = now_s() - t0;
+    t0 = now_s();
+    for (int r = 0; r < rounds; ++r) {
+        int coop = r % 32 + 1;
+        for (size_t i = 0; i < devices.count; ++i) {
+            const struct Device *d = &devices.devices[i];
+            if (d->identity.coop_id == coop) check_new += d->identity.type + (d->seq & 1);
+        }
+    }
+    double scan_s = now_s() - t0;
+    double scanned = (double)n * rounds;
+    printf("%-20s legacy %8.1f M/s  split %8.1f M/s  speedup %.2fx  (check %s)\n", "coop scan",
+           scanned / legacy_scan_s / 1e6, scanned / scan_s / 1e6, legacy_scan_s / scan_s,
+           check == check_new ? "ok" : "MISMATCH");
+
+    /* devices_scan: copy identity ra mang */
+    struct DeviceIdentity *out = malloc(n * sizeof(*out));
+    if (!out) return 1;
+    t0 = now_s();
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < legacy.count; ++i) out[i] = legacy.devices[i].identity;
+    }
+    legacy_scan_s = now_s() - t0;
+    t0 = now_s();
+    for (int r = 0; r < rounds; ++r) (void)devices_scan(&devices, out, n);
+    scan_s = now_s() - t0;
+    printf("%-20s legacy %8.1f M/s  split %8.1f M/s  speedup %.2fx\n", "identity copy",
+           scanned / legacy_scan_s / 1e6, scanned / scan_s / 1e6, legacy_scan_s / scan_s);
+
+    free(out);
+    free(order);
+    free(ids);
+    free(legacy.devices);
+    free(legacy.slots);
+    devices_context_free(&devices);
+    return 0;
+}
@@ -0,0 +1,170 @@
+#define _POSIX_C_SOURCE 200809L
+
+/**
+ * @file load_bench.c
+ * @brief Đo thời gian nạp farm lúc khởi động theo số worker của work pool.
+ *
+ * Sinh một farm N thiết bị / C chuồng, ghi ra cả hai format (`farm_state.json`
+ * một file và `farm_state.d/` chia theo chuồng), rồi với mỗi số worker nạp lại
+ * trong một tiến trình con mới (bảng intern và registry rỗng như lúc server
+ * khởi động). Format một file được đọc tuần tự theo luồng (số worker không
+ * ảnh hưởng); format chia chuồng đọc song song từng shard.
+ * Chạy: `make bench && bin/load_bench [devices] [coops] [max_threads]`.
+ */
+
+#include "coops.h"
+#include "devices.h"
+#include "storage.h"
+#include "work_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/** @brief Tiến trình con: dựng farm và ghi ra hai format. */
+static int generate(const char *dir, size_t n, int coops_n) {
+    static const enum DeviceType mix[] = { DEVICE_SENSOR, DEVICE_FEEDER, DEVICE_HEATER, DEVICE_FAN,
+                                           DEVICE_SPRAYER, DEVICE_DRINKER };
+    struct CoopsContext coops;
+    struct DevicesContext devices;
+    coops_init(&coops);
+    devices_context_init(&devices);
+    for (int c = 1; c <= coops_n; ++c) {
+        char name[MAX_COOP_NAME];
+        snprintf(name, sizeof(name), "Chuong %d", c);
+        if (coops_upsert(&coops, c, name) != 0) return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        char id[MAX_ID_LEN];
+        snprintf(id, sizeof(id), "DEV%06zu", i);
+        if (devices_add(&devices, id, mix[i % 6], "pw", (int)(i % (size_t)coops_n) + 1) != 0) return -1;
+    }
+
+    char path[STORAGE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/farm_state.json", dir);
+    if (storage_save_farm(&coops, &devices, path) != 0) return -1;
+    struct StorageShards shards;
+    struct StorageWrite write;
+    snprintf(path, sizeof(path), "%s/farm_state.d", dir);
+    if (storage_shards_init(&shards, path) != 0 || storage_shards_render(&shards, &coops, &devices, &write) <= 0) {
+        return -1;
+    }
+    int rc = storage_write_files(&write);
+    storage_write_free(&write);
+    storage_shards_free(&shards);
+    coops_free(&coops);
+    devices_context_free(&devices);
+    return rc;
+}
+
+/** @brief Tiến trình con: nạp một format với `threads` worker; in ms ra `out`. */
+static int load_once(const char *dir, int sharded, unsigned threads, size_t expect, int out) {
+    if (threads > 0 && work_pool_start(threads) != 0) return -1;
+    struct CoopsContext coops;
+    struct DevicesContext devices;
+    char path[STORAGE_PATH_MAX];
+    double t0 = now_s();
+    int rc;
+    if (sharded) {
+        struct StorageShards shards;
+        snprintf(path, sizeof(path), "%s/farm_state.d", dir);
+        rc = storage_shards_init(&shards, path) == 0 ? storage_shards_load(&shards, &coops, &devices) : -1;
+    } else {
+        snprintf(path, sizeof(path), "%s/farm_state.json", dir);
+        rc = storage_load_farm(&coops, &devices, path);
+    }
+    double ms = (now_s() - t0) * 1e3;
+    if (rc != 0 || devices.count != expect) {
+        fprintf(stderr, "load failed: rc=%d devices=%zu\n", rc, rc == 0 ? devices.count : 0);
+        return -1;
+    }
+    return write(out, &ms, sizeof(ms)) == (ssize_t)sizeof(ms) ? 0 : -1;
+}
+
+/** @brief Chạy `load_once()` trong tiến trình con; trả về ms (âm nếu lỗi). */
+static double measure(const char *dir, int sharded, unsigned threads, size_t expect) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1.0;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        _exit(load_once(dir, sharded, threads, expect, fds[1]) == 0 ? 0 : 1);
+    }
+    close(fds[1]);
+    double ms = -1.0;
+    if (pid < 0 || read(fds[0], &ms, sizeof(ms)) != (ssize_t)sizeof(ms)) ms = -1.0;
+    close(fds[0]);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    return ms;
+}
+
+static void cleanup(const char *dir, int coops_n) {
+    char path[STORAGE_PATH_MAX];
+    for (int c = 1; c <= coops_n; ++c) {
+        snprintf(path, sizeof(path), "%s/farm_state.d/coop-%d.json", dir, c);
+        (void)remove(path);
+    }
+    snprintf(path, sizeof(path), "%s/farm_state.d/manifest.json", dir);
+    (void)remove(path);
+    snprintf(path, sizeof(path), "%s/farm_state.d", dir);
+    (void)remove(path);
+    snprintf(path, sizeof(path), "%s/farm_state.json", dir);
+    (void)remove(path);
+    (void)remove(dir);
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+    int coops_n = argc > 2 ? atoi(argv[2]) : 100;
+    unsigned max_threads = argc > 3 ? (unsigned)atoi(argv[3]) : 8;
+    if (n == 0 || n > MAX_FARM_DEVICES || coops_n <= 0 || coops_n > MAX_FARM_COOPS || max_threads == 0) {
+        fprintf(stderr, "usage: %s [devices<=%d] [coops] [max_threads]\n", argv[0], MAX_FARM_DEVICES);
+        return 1;
+    }
+
+    char dir[] = "/tmp/load_bench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(generate(dir, n, coops_n) == 0 ? 0 : 1);
+    }
+    int status = 1;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || status != 0) {
+        fprintf(stderr, "generate failed\n");
+        cleanup(dir, coops_n);
+        return 1;
+    }
+    printf("devices=%zu coops=%d cpus=%ld chunk=%d\n", n, coops_n, sysconf(_SC_NPROCESSORS_ONLN), FARM_LOAD_CHUNK);
+
+    double base_file = 0.0, base_shard = 0.0;
+    for (unsigned t = 0; t <= max_threads; t = t ? t * 2 : 1) {
+        double file = measure(dir, 0, t, n);
+        double shard = measure(dir, 1, t, n);
+        if (file < 0 || shard < 0) {
+            cleanup(dir, coops_n);
+            return 1;
+        }
+        if (t == 0) {
+            base_file = file;
+            base_shard = shard;
+        }
+        printf("threads=%u  farm_state.json %8.1f ms (x%.2f)  farm_state.d %8.1f ms (x%.2f)\n", t, file,
+               base_file / file, shard, base_shard / shard);
+    }
+    cleanup(dir, coops_n);
+    return 0;
+}
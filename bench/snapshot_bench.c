@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+
+/**
+ * @file snapshot_bench.c
+ * @brief Đo INFO đọc song song: snapshot RCU (`farm_snapshot.h`) so với registry sống dưới `pthread_rwlock`.
+ *
+ * K thread đọc tra ID ngẫu nhiên và chép JSON INFO, trong khi một thread ghi
+ * đổi trạng thái vài thiết bị rồi công bố (snapshot) hoặc giữ write lock
+ * (rwlock) theo nhịp lô của actor. Số đọc/giây theo K cho thấy reader của
+ * snapshot không tranh chấp nhau (không ghi vào cache line chung nào ngoài ô
+ * epoch riêng), còn rwlock dồn mọi reader vào cùng một bộ đếm.
+ * Chạy: `make bench && bin/snapshot_bench [devices] [ms_per_run]`.
+ */
+
+#include "devices.h"
+#include "farm_snapshot.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+    MAX_BENCH_READERS = 8,
+    WRITER_BATCH = 4,             /* so thiet bi doi moi lo */
+    WRITER_PERIOD_US = 200        /* nhip lo cua thread ghi */
+};
+
+struct BenchState {
+    struct DevicesContext devices;
+    char (*ids)[MAX_ID_LEN];
+    size_t n;
+    pthread_rwlock_t lock;
+    int use_snapshot;
+    int readers[MAX_BENCH_READERS];
+    volatile int stop;
+    unsigned long long version;
+};
+
+struct ReaderArg {
+    struct BenchState *st;
+    int idx;
+    unsigned long long reads;
+    unsigned long long bytes;
+};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint32_t xorshift(uint32_t *s) {
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *s = x;
+}
+
+static int publish(struct BenchState *st) {
+    struct FarmSnapshotSource src = {&st->devices, NULL, NULL, 0, st->version};
+    return farm_snapshot_publish(&src);
+}
+
+static void *reader_main(void *arg) {
+    struct ReaderArg *ra = (struct ReaderArg *)arg;
+    struct BenchState *st = ra->st;
+    uint32_t seed = 2463534242u + (uint32_t)ra->idx * 7919u;
+    char json[MAX_JSON_LEN];
+    while (!st->stop) {
+        const char *id = st->ids[xorshift(&seed) % st->n];
+        if (st->use_snapshot) {
+            int r = st->readers[ra->idx];
+            const struct FarmSnapshot *snap = farm_snapshot_enter(r);
+            const struct SnapDevice *rec = farm_snapshot_find(snap, id);
+            size_t len = rec ? strlen(rec->json) : 0;
+            if (rec) memcpy(json, rec->json, len + 1);
+            farm_snapshot_exit(r);
+            ra->bytes += len;
+        } else {
+            pthread_rwlock_rdlock(&st->lock);
+            const struct Device *dev = devices_find(&st->devices, id);
+            if (dev && devices_info_json(dev, json, sizeof(json)) == 0) {
+                ra->bytes += strlen(json);
+            }
+            pthread_rwlock_unlock(&st->lock);
+        }
+        ra->reads++;
+    }
+    return NULL;
+}
+
+static void *writer_main(void *arg) {
+    struct BenchState *st = (struct BenchState *)arg;
+    uint32_t seed = 88675123u;
+    struct timespec period = {0, WRITER_PERIOD_US * 1000L};
+    while (!st->stop) {
+        if (!st->use_snapshot) pthread_rwlock_wrlock(&st->lock);
+        for (int i = 0; i < WRITER_BATCH; ++i) {
+            struct Device *dev = &st->devices.devices[xorshift(&seed) % st->n];
+            if (dev->identity.type == DEVICE_SENSOR) {
+                (void)devices_report_sensor(dev, 20.0 + (double)(xorshift(&seed) % 100) / 10.0, 55.0);
+            } else {
+                (void)devices_set_state(dev, (xorshift(&seed) & 1) ? DEVICE_ON : DEVICE_OFF);
+            }
+            dev->version = ++st->version;
+        }
+        if (st->use_snapshot) {
+            (void)publish(st);
+        } else {
+            pthread_rwlock_unlock(&st->lock);
+        }
+        nanosleep(&period, NULL);
+    }
+    return NULL;
+}
+
+/** @brief Một lượt đo với `k` reader; trả về số đọc/giây. */
+static double run(struct BenchState *st, int k, int use_snapshot, int ms) {
+    struct ReaderArg args[MAX_BENCH_READERS];
+    pthread_t threads[MAX_BENCH_READERS], writer;
+    st->use_snapshot = use_snapshot;
+    st->stop = 0;
+    double t0 = now_s();
+    for (int i = 0; i < k; ++i) {
+        args[i].st = st;
+        args[i].idx = i;
+        args[i].reads = 0;
+        args[i].bytes = 0;
+        pthread_create(&threads[i], NULL, reader_main, &args[i]);
+    }
+    pthread_create(&writer, NULL, writer_main, st);
+    struct timespec dur = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    nanosleep(&dur, NULL);
+    st->stop = 1;
+    unsigned long long reads = 0;
+    for (int i = 0; i < k; ++i) {
+        pthread_join(threads[i], NULL);
+        reads += args[i].reads;
+    }
+    pthread_join(writer, NULL);
+    return (double)reads / (now_s() - t0);
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+    int ms = argc > 2 ? atoi(argv[2]) : 1000;
+    if (n == 0 || n > MAX_FARM_DEVICES || ms <= 0) {
+        fprintf(stderr, "usage: %s [devices<=%d] [ms_per_run]\n", argv[0], MAX_FARM_DEVICES);
+        return 1;
+    }
+
+    static const enum DeviceType mix[] = { DEVICE_SENSOR, DEVICE_FEEDER, DEVICE_HEATER, DEVICE_FAN };
+    static struct BenchState st;
+    devices_context_init(&st.devices);
+    st.ids = malloc(n * sizeof(*st.ids));
+    if (!st.ids) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    st.n = n;
+    st.version = 1;
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(st.ids[i], MAX_ID_LEN, "DEV%06zu", i);
+        if (devices_add(&st.devices, st.ids[i], mix[i % 4], "pw", (int)(i % 32) + 1) != 0) {
+            fprintf(stderr, "devices_add failed\n");
+            return 1;
+        }
+        st.devices.devices[i].version = st.version;
+    }
+    pthread_rwlock_init(&st.lock, NULL);
+    for (int i = 0; i < MAX_BENCH_READERS; ++i) {
+        st.readers[i] = farm_snapshot_reader_register();
+    }
+    double t0 = now_s();
+    if (publish(&st) != 0) {
+        fprintf(stderr, "publish failed\n");
+        return 1;
+    }
+    printf("devices=%zu cpus=%ld first publish %.1f ms, writer %d devices / %d us\n", n,
+           sysconf(_SC_NPROCESSORS_ONLN), (now_s() - t0) * 1e3, WRITER_BATCH, WRITER_PERIOD_US);
+
+    double base_snap = 0.0, base_lock = 0.0;
+    for (int k = 1; k <= MAX_BENCH_READERS; k *= 2) {
+        double snap = run(&st, k, 1, ms);
+        double lock = run(&st, k, 0, ms);
+        if (k == 1) {
+            base_snap = snap;
+            base_lock = lock;
+        }
+        printf("readers=%d  snapshot %8.2f M/s (x%.2f)  rwlock %8.2f M/s (x%.2f)\n", k, snap / 1e6, snap / base_snap,
+               lock / 1e6, lock / base_lock);
+    }
+
+    struct FarmSnapshotStats stats;
+    farm_snapshot_get_stats(&stats);
+    printf("publishes=%lu rendered=%lu limbo=%zu\n", stats.publishes, stats.rendered, stats.limbo);
+    pthread_rwlock_destroy(&st.lock);
+    free(st.ids);
+    devices_context_free(&st.devices);
+    return 0;
+}
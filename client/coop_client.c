@@ -39,3 +39,20 @@ int coop_add_device(struct CoopList *list, size_t coop_index, const char *device
     d->type = type;
     return 0;
 }
+
+int coop_remove_device(struct CoopList *list, const char *device_id) {
+    if (!list || !device_id) {
+        return -1;
+    }
+    for (size_t i = 0; i < list->count; ++i) {
+        struct Coop *c = &list->coops[i];
+        for (size_t j = 0; j < c->device_count; ++j) {
+            if (strncmp(c->devices[j].device_id, device_id, sizeof(c->devices[j].device_id)) == 0) {
+                memmove(&c->devices[j], &c->devices[j + 1], (c->device_count - j - 1) * sizeof(c->devices[j]));
+                c->device_count--;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
@@ -37,4 +37,10 @@ void coop_list_init(struct CoopList *list);
  */
 int coop_add_device(struct CoopList *list, size_t coop_index, const char *device_id, enum DeviceType type);
 
+/**
+ * @brief Gỡ thiết bị khỏi mọi chuồng trong danh sách (nếu có).
+ * @return 0 nếu đã gỡ, -1 nếu không chuồng nào chứa thiết bị.
+ */
+int coop_remove_device(struct CoopList *list, const char *device_id);
+
 #endif /* CLIENT_COOP_CLIENT_H */
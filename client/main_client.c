@@ -29,52 +29,127 @@ static int parse_response(const char *line, int *code, char *text, size_t text_l
     return 0;
 }
 
-/** @brief Backend UI: SCAN (đọc nhiều dòng RESP_DEVICE cho tới khi timeout). */
+/** @brief Parse payload dòng DEVICE: "<id> <type> [coop_id] [version]". */
+static int parse_device_payload(const char *payload, struct DeviceIdentity *out) {
+    char id[MAX_ID_LEN], type_str[MAX_TYPE_LEN];
+    int coop_id = 0;
+    int n = sscanf(payload, "%31s %15s %d", id, type_str, &coop_id);
+    if (n < 2) return -1;
+    memset(out, 0, sizeof(*out));
+    memcpy(out->id, id, sizeof(out->id));
+    out->type = device_type_from_string(type_str);
+    out->coop_id = (n == 3) ? coop_id : 0;
+    return 0;
+}
+
+/**
+ * @brief Gửi một trang SCAN: "SCAN [SINCE v] limit=N [cursor=X]".
+ *
+ * `cursor` rỗng = trang đầu.
+ */
+static int send_scan_page(int fd, int since_set, unsigned long long since, size_t limit, const char *cursor) {
+    char cmd[MAX_LINE_LEN];
+    int written;
+    if (since_set) {
+        written = snprintf(cmd, sizeof(cmd), "SCAN SINCE %llu limit=%zu", since, limit);
+    } else {
+        written = snprintf(cmd, sizeof(cmd), "SCAN limit=%zu", limit);
+    }
+    if (written < 0 || (size_t)written >= sizeof(cmd)) return -1;
+    if (cursor[0] != '\0') {
+        size_t used = (size_t)written;
+        written = snprintf(cmd + used, sizeof(cmd) - used, " cursor=%s", cursor);
+        if (written < 0 || (size_t)written >= sizeof(cmd) - used) return -1;
+    }
+    return client_send_line(fd, cmd);
+}
+
+/**
+ * @brief Backend UI: SCAN phân trang (mỗi trang tối đa phần còn trống của `out`).
+ *
+ * Dừng khi gặp SCAN_END hoặc `out` đã đầy, nên bộ nhớ không phụ thuộc số thiết bị của farm.
+ */
 static int backend_scan(void *user_data, struct DeviceIdentity *out, size_t max_out, size_t *found) {
     struct NetBackend *b = (struct NetBackend *)user_data;
     *found = 0;
-    if (client_send_line(b->fd, "SCAN") != 0) return -1;
-
+    char cursor[64] = "";
     char buf[MAX_LINE_LEN];
-    while (1) {
-        int r = client_recv_line_timeout(b->fd, buf, sizeof(buf), 200);
-        if (r == 1) { /* het du lieu */
-            break;
-        } else if (r < 0) {
-            return -1;
-        }
-        int code = 0;
-        char text[64], payload[MAX_LINE_LEN] = {0};
-        if (parse_response(buf, &code, text, sizeof(text), payload, sizeof(payload)) != 0) {
-            continue;
-        }
-        if (code == RESP_DEVICE) {
-            char id[MAX_ID_LEN], type_str[MAX_TYPE_LEN];
-            int coop_id = 0;
-            if (strcmp(text, "DEVICE") != 0) {
+    while (*found < max_out) {
+        size_t room = max_out - *found;
+        if (send_scan_page(b->fd, 0, 0, room > SCAN_PAGE_MAX ? SCAN_PAGE_MAX : room, cursor) != 0) return -1;
+        while (1) {
+            if (client_recv_line(b->fd, buf, sizeof(buf)) != 0) return -1;
+            int code = 0;
+            char text[64], payload[MAX_LINE_LEN] = {0};
+            if (parse_response(buf, &code, text, sizeof(text), payload, sizeof(payload)) != 0) {
                 continue;
             }
-            int n = sscanf(payload, "%31s %15s %d", id, type_str, &coop_id);
-            if (n >= 2) {
-                if (*found < max_out) {
-                    strncpy(out[*found].id, id, sizeof(out[*found].id) - 1);
-                    out[*found].id[sizeof(out[*found].id) - 1] = '\0';
-                    out[*found].type = device_type_from_string(type_str);
-                    out[*found].coop_id = (n == 3) ? coop_id : 0;
+            if (code == RESP_DEVICE && strcmp(text, "DEVICE") == 0) {
+                if (*found < max_out && parse_device_payload(payload, &out[*found]) == 0) {
                     (*found)++;
                 }
+            } else if (code == RESP_SCAN_MORE) {
+                if (sscanf(payload, "%63s", cursor) != 1) return -1;
+                break;
+            } else if (code == RESP_SCAN_END) {
+                return 0;
+            } else {
+                return -1;
             }
-        } else if (code == RESP_NO_DEVICE_SCAN) {
-            *found = 0;
-            break;
-        } else {
-            /* response khac => ket thuc vong */
-            break;
         }
     }
     return 0;
 }
 
+/**
+ * @brief Backend UI: SCAN SINCE (chỉ nhận thiết bị thêm/đổi/xoá sau `since`), phân trang.
+ *
+ * Đọc tới dòng SCAN_END; trả -1 nếu server không hỗ trợ (vd trả BAD_REQUEST)
+ * hoặc delta vượt quá sức chứa của `out` (UI sẽ quét lại toàn bộ).
+ */
+static int backend_scan_since(void *user_data, unsigned long long since, struct ScanDelta *out) {
+    struct NetBackend *b = (struct NetBackend *)user_data;
+    memset(out, 0, sizeof(*out));
+    char cursor[64] = "";
+    char buf[MAX_LINE_LEN];
+    while (1) {
+        size_t room = MAX_DEVICES - out->changed_count;
+        if (room == 0) return -1;
+        /* Sau SCAN_RESET cac trang tiep theo phai lay lai toan bo: SINCE 0 */
+        if (send_scan_page(b->fd, 1, out->reset ? 0 : since, room, cursor) != 0) return -1;
+        int more = 0;
+        while (!more) {
+            if (client_recv_line(b->fd, buf, sizeof(buf)) != 0) return -1;
+            int code = 0;
+            char text[64], payload[MAX_LINE_LEN] = {0};
+            if (parse_response(buf, &code, text, sizeof(text), payload, sizeof(payload)) != 0) {
+                continue;
+            }
+            if (code == RESP_SCAN_END) {
+                out->version = strtoull(payload, NULL, 10);
+                return 0;
+            } else if (code == RESP_SCAN_MORE) {
+                if (sscanf(payload, "%63s", cursor) != 1) return -1;
+                more = 1;
+            } else if (code == RESP_SCAN_RESET) {
+                out->reset = 1;
+            } else if (code == RESP_REMOVED) {
+                char id[MAX_ID_LEN];
+                if (sscanf(payload, "%31s", id) == 1 && out->removed_count < MAX_DEVICES) {
+                    memcpy(out->removed[out->removed_count++], id, sizeof(id));
+                }
+            } else if (code == RESP_DEVICE && strcmp(text, "DEVICE") == 0) {
+                if (out->changed_count < MAX_DEVICES &&
+                    parse_device_payload(payload, &out->changed[out->changed_count]) == 0) {
+                    out->changed_count++;
+                }
+            } else {
+                return -1;
+            }
+        }
+    }
+}
+
 /** @brief Backend UI: CONNECT (lấy token). */
 static int backend_connect(void *user_data, const char *device_id, const char *password, char *out_token, size_t token_len, enum DeviceType *out_type) {
     struct NetBackend *b = (struct NetBackend *)user_data;
@@ -162,44 +237,89 @@ static int backend_assign(void *user_data, const char *device_id, int coop_id) {
     return code == RESP_ASSIGN_OK ? 0 : -1;
 }
 
-/** @brief Backend UI: COOPLIST (đọc nhiều dòng RESP_COOP cho tới khi timeout). */
+/** @brief Backend UI: COOPLIST phân trang (đọc tới COOP_END hoặc khi `out` đầy). */
 static int backend_coop_list(void *user_data, struct CoopList *out) {
     struct NetBackend *b = (struct NetBackend *)user_data;
     if (!out) return -1;
     coop_list_init(out);
-    if (client_send_line(b->fd, "COOPLIST") != 0) return -1;
 
+    size_t cursor = 0;
     char buf[MAX_LINE_LEN];
-    while (1) {
-        int r = client_recv_line_timeout(b->fd, buf, sizeof(buf), 200);
-        if (r == 1) break;
-        if (r < 0) return -1;
-        int code = 0;
-        char text[64], payload[MAX_LINE_LEN] = {0};
-        if (parse_response(buf, &code, text, sizeof(text), payload, sizeof(payload)) != 0) continue;
-        if (code == RESP_NO_COOP) {
-            break;
-        }
-        if (code != RESP_COOP) {
-            break;
+    while (out->count < MAX_COOPS) {
+        snprintf(buf, sizeof(buf), "COOPLIST limit=%d cursor=%zu", MAX_COOPS - (int)out->count, cursor);
+        if (client_send_line(b->fd, buf) != 0) return -1;
+        int more = 0;
+        while (!more) {
+            if (client_recv_line(b->fd, buf, sizeof(buf)) != 0) return -1;
+            int code = 0;
+            char text[64], payload[MAX_LINE_LEN] = {0};
+            if (parse_response(buf, &code, text, sizeof(text), payload, sizeof(payload)) != 0) continue;
+            if (code == RESP_COOP_END) {
+                return 0;
+            }
+            if (code == RESP_COOP_MORE) {
+                cursor = (size_t)strtoull(payload, NULL, 10);
+                more = 1;
+                continue;
+            }
+            if (code != RESP_COOP) {
+                return -1;
+            }
+            if (strcmp(text, "COOP") != 0) {
+                continue;
+            }
+            int id = 0;
+            char name[MAX_COOP_NAME] = {0};
+            if (sscanf(payload, "%d %63[^\n]", &id, name) == 2) {
+                if (out->count < MAX_COOPS) {
+                    if (strcmp(name, "0") == 0) {
+                        continue;
+                    }
+                    struct Coop *c = &out->coops[out->count++];
+                    memset(c, 0, sizeof(*c));
+                    c->id = id;
+                    strncpy(c->name, name, sizeof(c->name) - 1);
+                    c->name[sizeof(c->name) - 1] = '\0';
+                }
+            }
         }
-        if (strcmp(text, "COOP") != 0) {
-            continue;
+    }
+    return 0;
+}
+
+/**
+ * @brief Backend UI: COOPDEVICES phân trang (chỉ thiết bị của chuồng `coop_id`).
+ *
+ * Đọc tới trang cuối (cursor 0) hoặc khi `out` đầy.
+ */
+static int backend_coop_devices(void *user_data, int coop_id, struct DeviceIdentity *out, size_t max_out, size_t *found) {
+    struct NetBackend *b = (struct NetBackend *)user_data;
+    *found = 0;
+    unsigned long long cursor = 0;
+    char line[MAX_LINE_LEN];
+    while (*found < max_out) {
+        size_t room = max_out - *found;
+        snprintf(line, sizeof(line), "COOPDEVICES %d limit=%zu cursor=%llu", coop_id,
+                 room > SCAN_PAGE_MAX ? SCAN_PAGE_MAX : room, cursor);
+        if (client_send_line(b->fd, line) != 0) return -1;
+        if (client_recv_line(b->fd, line, sizeof(line)) != 0) return -1;
+        int code = 0;
+        char text[64], payload[64] = {0};
+        size_t count = 0;
+        if (parse_response(line, &code, text, sizeof(text), payload, sizeof(payload)) != 0 ||
+            code != RESP_COOPDEVICES || sscanf(payload, "%zu %llu", &count, &cursor) != 2) {
+            return -1;
         }
-        int id = 0;
-        char name[MAX_COOP_NAME] = {0};
-        if (sscanf(payload, "%d %63[^\n]", &id, name) == 2) {
-            if (out->count < MAX_COOPS) {
-                if (strcmp(name, "0") == 0) {
-                    continue;
-                }
-                struct Coop *c = &out->coops[out->count++];
-                memset(c, 0, sizeof(*c));
-                c->id = id;
-                strncpy(c->name, name, sizeof(c->name) - 1);
-                c->name[sizeof(c->name) - 1] = '\0';
+        for (size_t i = 0; i < count; ++i) {
+            if (client_recv_line(b->fd, line, sizeof(line)) != 0) return -1;
+            char body[MAX_LINE_LEN] = {0};
+            if (parse_response(line, &code, text, sizeof(text), body, sizeof(body)) != 0) continue;
+            if (code == RESP_DEVICE && strcmp(text, "DEVICE") == 0 && *found < max_out &&
+                parse_device_payload(body, &out[*found]) == 0) {
+                (*found)++;
             }
         }
+        if (cursor == 0) break;
     }
     return 0;
 }
@@ -221,6 +341,57 @@ static int backend_coop_add(void *user_data, const char *name, int *out_id) {
     return 0;
 }
 
+/** @brief Đọc header batch "<code> <text> <count>" và trả về `count`. */
+static int recv_batch_header(int fd, int expected_code, size_t *count) {
+    char line[MAX_LINE_LEN];
+    if (client_recv_line(fd, line, sizeof(line)) != 0) return -1;
+    int code = 0;
+    char text[64], payload[64] = {0};
+    if (parse_response(line, &code, text, sizeof(text), payload, sizeof(payload)) != 0) return -1;
+    if (code != expected_code) return -1;
+    *count = (size_t)strtoul(payload, NULL, 10);
+    return 0;
+}
+
+/** @brief Backend UI: MINFO COOP (trạng thái mọi thiết bị trong chuồng trong 1 lượt). */
+static int backend_minfo_coop(void *user_data, int coop_id, const char *token, char (*out_json)[MAX_JSON_LEN], size_t max_out, size_t *found) {
+    struct NetBackend *b = (struct NetBackend *)user_data;
+    *found = 0;
+    char line[MAX_LINE_LEN];
+    snprintf(line, sizeof(line), "MINFO COOP %d %s", coop_id, token);
+    if (client_send_line(b->fd, line) != 0) return -1;
+    size_t count = 0;
+    if (recv_batch_header(b->fd, RESP_MINFO_OK, &count) != 0) return -1;
+    for (size_t i = 0; i < count; ++i) {
+        if (client_recv_line(b->fd, line, sizeof(line)) != 0) return -1;
+        int code = 0; char text[64]; char payload[MAX_JSON_LEN] = {0};
+        if (parse_response(line, &code, text, sizeof(text), payload, sizeof(payload)) != 0) continue;
+        if (code != RESP_INFO_OK || *found >= max_out) continue;
+        strncpy(out_json[*found], payload, MAX_JSON_LEN - 1);
+        out_json[*found][MAX_JSON_LEN - 1] = '\0';
+        (*found)++;
+    }
+    return 0;
+}
+
+/** @brief Backend UI: MCONTROL COOP (bật/tắt mọi quạt + đèn sưởi trong chuồng). */
+static int backend_mcontrol_coop(void *user_data, int coop_id, const char *token, const char *action, size_t *applied) {
+    struct NetBackend *b = (struct NetBackend *)user_data;
+    *applied = 0;
+    char line[MAX_LINE_LEN];
+    snprintf(line, sizeof(line), "MCONTROL %s COOP %d %s", action, coop_id, token);
+    if (client_send_line(b->fd, line) != 0) return -1;
+    size_t count = 0;
+    if (recv_batch_header(b->fd, RESP_MCONTROL_OK, &count) != 0) return -1;
+    for (size_t i = 0; i < count; ++i) {
+        if (client_recv_line(b->fd, line, sizeof(line)) != 0) return -1;
+        int code = 0; char text[64]; char payload[64] = {0};
+        if (parse_response(line, &code, text, sizeof(text), payload, sizeof(payload)) != 0) continue;
+        if (code == RESP_CONTROL_OK) (*applied)++;
+    }
+    return 0;
+}
+
 /** @brief Đọc input từ stdin với prompt và hỗ trợ default nếu người dùng bỏ trống. */
 static void read_input_line(const char *prompt, char *out, size_t out_len, const char *default_val) {
     printf("%s", prompt);
@@ -272,6 +443,7 @@ int main(int argc, char **argv) {
     struct UiBackendOps ops = {
         .user_data = &backend,
         .scan = backend_scan,
+        .scan_since = backend_scan_since,
         .connect = backend_connect,
         .info = backend_info,
         .control = backend_control,
@@ -279,7 +451,10 @@ int main(int argc, char **argv) {
         .add_device = backend_add_device,
         .assign = backend_assign,
         .coop_list = backend_coop_list,
-        .coop_add = backend_coop_add
+        .coop_devices = backend_coop_devices,
+        .coop_add = backend_coop_add,
+        .minfo_coop = backend_minfo_coop,
+        .mcontrol_coop = backend_mcontrol_coop
     };
 
     struct UiContext ui;
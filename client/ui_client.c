@@ -155,30 +155,150 @@ static int select_coop_index(const struct CoopList *list, size_t *out_index) {
     return 0;
 }
 
-/** @brief Đồng bộ danh sách chuồng và gán thiết bị vào chuồng dựa trên kết quả SCAN. */
-static void refresh_coops(struct UiContext *ctx) {
-    if (!ctx || !ctx->ops.coop_list || !ctx->ops.scan) return;
-    if (ctx->ops.coop_list(ctx->ops.user_data, &ctx->coop_list) != 0) {
-        return;
+/** @brief Gán thiết bị vào chuồng có ID tương ứng (bỏ qua nếu chuồng không có trong danh sách). */
+static void place_device_in_coop(struct CoopList *list, const struct DeviceIdentity *d) {
+    for (size_t j = 0; j < list->count; ++j) {
+        if (d->coop_id == list->coops[j].id) {
+            coop_add_device(list, j, d->id, d->type);
+            return;
+        }
     }
+}
+
+/** @brief Xoá thiết bị khỏi cache SCAN của client. */
+static void forget_known_device(struct UiContext *ctx, const char *id) {
+    for (size_t i = 0; i < ctx->known_count; ++i) {
+        if (strncmp(ctx->known[i].id, id, sizeof(ctx->known[i].id)) == 0) {
+            ctx->known[i] = ctx->known[--ctx->known_count];
+            return;
+        }
+    }
+}
+
+/** @brief Thêm/cập nhật thiết bị trong cache SCAN của client. */
+static void remember_known_device(struct UiContext *ctx, const struct DeviceIdentity *d) {
+    for (size_t i = 0; i < ctx->known_count; ++i) {
+        if (strncmp(ctx->known[i].id, d->id, sizeof(ctx->known[i].id)) == 0) {
+            ctx->known[i] = *d;
+            return;
+        }
+    }
+    if (ctx->known_count < MAX_DEVICES) {
+        ctx->known[ctx->known_count++] = *d;
+    }
+}
+
+/** @brief Hai danh sách chuồng có cùng ID theo cùng thứ tự hay không. */
+static int same_coop_ids(const struct CoopList *a, const struct CoopList *b) {
+    if (a->count != b->count) return 0;
+    for (size_t i = 0; i < a->count; ++i) {
+        if (a->coops[i].id != b->coops[i].id) return 0;
+    }
+    return 1;
+}
+
+/** @brief Đồng bộ thiết bị bằng SCAN đầy đủ (backend không hỗ trợ SCAN SINCE). */
+static void refresh_devices_full(struct UiContext *ctx) {
     for (size_t i = 0; i < ctx->coop_list.count; ++i) {
         ctx->coop_list.coops[i].device_count = 0;
     }
+    size_t found = 0;
+    if (ctx->ops.scan(ctx->ops.user_data, ctx->known, MAX_DEVICES, &found) != 0) {
+        found = 0;
+    }
+    ctx->known_count = found;
+    for (size_t i = 0; i < found; ++i) {
+        place_device_in_coop(&ctx->coop_list, &ctx->known[i]);
+    }
+}
 
-    struct DeviceIdentity devices[MAX_DEVICES];
+/**
+ * @brief Nạp lại thiết bị của một chuồng bằng COOPDEVICES (chỉ thiết bị của chuồng đó).
+ * @return 0 nếu đã nạp, -1 nếu backend không hỗ trợ hoặc lỗi (giữ danh sách cũ).
+ */
+static int refresh_coop_devices(struct UiContext *ctx, size_t coop_index) {
+    if (!ctx->ops.coop_devices || coop_index >= ctx->coop_list.count) return -1;
+    struct Coop *c = &ctx->coop_list.coops[coop_index];
+    static struct DeviceIdentity members[MAX_DEVICES];
     size_t found = 0;
-    if (ctx->ops.scan(ctx->ops.user_data, devices, MAX_DEVICES, &found) != 0 || found == 0) {
+    if (ctx->ops.coop_devices(ctx->ops.user_data, c->id, members, MAX_DEVICES, &found) != 0) {
+        return -1;
+    }
+    c->device_count = 0;
+    for (size_t i = 0; i < found; ++i) {
+        struct CoopDevice *d = &c->devices[c->device_count++];
+        memset(d, 0, sizeof(*d));
+        memcpy(d->device_id, members[i].id, sizeof(d->device_id));
+        d->type = members[i].type;
+    }
+    return 0;
+}
+
+/**
+ * @brief Đồng bộ danh sách chuồng và gán thiết bị vào chuồng dựa trên kết quả SCAN.
+ *
+ * Khi backend hỗ trợ COOPDEVICES, chỉ danh sách chuồng được đồng bộ ở đây:
+ * thiết bị của một chuồng được nạp khi chuồng đó được chọn (`select_coop()`).
+ * Khi backend hỗ trợ SCAN SINCE, chỉ áp dụng phần thay đổi kể từ `scan_version`
+ * lên cache `known` và danh sách thiết bị của từng chuồng.
+ */
+static void refresh_coops(struct UiContext *ctx) {
+    if (!ctx || !ctx->ops.coop_list || !ctx->ops.scan) return;
+    struct CoopList fresh;
+    if (ctx->ops.coop_list(ctx->ops.user_data, &fresh) != 0) {
         return;
     }
+    if (same_coop_ids(&fresh, &ctx->coop_list)) {
+        for (size_t i = 0; i < fresh.count; ++i) {
+            memcpy(ctx->coop_list.coops[i].name, fresh.coops[i].name, sizeof(fresh.coops[i].name));
+        }
+    } else {
+        ctx->coop_list = fresh;
+        for (size_t i = 0; !ctx->ops.coop_devices && i < ctx->known_count; ++i) {
+            place_device_in_coop(&ctx->coop_list, &ctx->known[i]);
+        }
+    }
 
-    for (size_t i = 0; i < found; ++i) {
-        for (size_t j = 0; j < ctx->coop_list.count; ++j) {
-            if (devices[i].coop_id == ctx->coop_list.coops[j].id) {
-                coop_add_device(&ctx->coop_list, j, devices[i].id, devices[i].type);
-                break;
-            }
+    if (ctx->ops.coop_devices) {
+        return;
+    }
+    if (!ctx->ops.scan_since) {
+        refresh_devices_full(ctx);
+        return;
+    }
+
+    static struct ScanDelta delta;
+    if (ctx->ops.scan_since(ctx->ops.user_data, ctx->scan_version, &delta) != 0) {
+        refresh_devices_full(ctx);
+        ctx->scan_version = 0;
+        return;
+    }
+    if (delta.reset) {
+        ctx->known_count = 0;
+        for (size_t i = 0; i < ctx->coop_list.count; ++i) {
+            ctx->coop_list.coops[i].device_count = 0;
         }
     }
+    for (size_t i = 0; i < delta.removed_count; ++i) {
+        forget_known_device(ctx, delta.removed[i]);
+        (void)coop_remove_device(&ctx->coop_list, delta.removed[i]);
+    }
+    for (size_t i = 0; i < delta.changed_count; ++i) {
+        const struct DeviceIdentity *d = &delta.changed[i];
+        remember_known_device(ctx, d);
+        (void)coop_remove_device(&ctx->coop_list, d->id);
+        place_device_in_coop(&ctx->coop_list, d);
+    }
+    ctx->scan_version = delta.version;
+}
+
+/** @brief Chọn chuồng rồi nạp thiết bị của chuồng đó (nếu backend có COOPDEVICES). */
+static int select_coop(struct UiContext *ctx, size_t *out_index) {
+    if (select_coop_index(&ctx->coop_list, out_index) != 0) {
+        return -1;
+    }
+    (void)refresh_coop_devices(ctx, *out_index);
+    return 0;
 }
 
 static int select_device_in_coop_impl(const struct UiContext *ctx,
@@ -341,7 +461,7 @@ static void display_info(const char *json) {
 static void menu_connect(struct UiContext *ctx) {
     refresh_coops(ctx);
     size_t coop_idx = 0;
-    if (select_coop_index(&ctx->coop_list, &coop_idx) != 0) {
+    if (select_coop(ctx, &coop_idx) != 0) {
         return;
     }
     char id[MAX_ID_LEN];
@@ -384,7 +504,7 @@ static const struct ClientDevice *select_connected_device(struct UiContext *ctx,
     if (!ctx || !out_id || out_id_len == 0) return NULL;
     refresh_coops(ctx);
     size_t coop_idx = 0;
-    if (select_coop_index(&ctx->coop_list, &coop_idx) != 0) {
+    if (select_coop(ctx, &coop_idx) != 0) {
         return NULL;
     }
     enum DeviceType type = DEVICE_UNKNOWN;
@@ -458,6 +578,76 @@ static void menu_control(struct UiContext *ctx, int direct_mode) {
     printf("Da gui lenh %s cho %s.\n", action, id);
 }
 
+/** @brief Tìm token của một thiết bị đã CONNECT trong chuồng (dùng làm credential cấp chuồng). */
+static const char *find_coop_token(const struct UiContext *ctx, size_t coop_index) {
+    const struct Coop *c = &ctx->coop_list.coops[coop_index];
+    for (size_t i = 0; i < c->device_count; ++i) {
+        const struct ClientDevice *cd = find_client_device_const(ctx, c->devices[i].device_id);
+        if (cd && cd->connected) {
+            return cd->token;
+        }
+    }
+    printf("Chua ket noi thiet bi nao trong chuong %s.\n", c->name);
+    return NULL;
+}
+
+/** @brief Menu: xem trạng thái mọi thiết bị trong chuồng bằng một lệnh MINFO. */
+static void menu_coop_overview(struct UiContext *ctx) {
+    if (!ctx->ops.minfo_coop) {
+        printf("Client chua ho tro xem tong quan chuong.\n");
+        return;
+    }
+    refresh_coops(ctx);
+    size_t coop_idx = 0;
+    if (select_coop(ctx, &coop_idx) != 0) {
+        return;
+    }
+    const char *token = find_coop_token(ctx, coop_idx);
+    if (!token) {
+        return;
+    }
+    static char infos[MAX_DEVICES][MAX_JSON_LEN];
+    size_t found = 0;
+    const struct Coop *c = &ctx->coop_list.coops[coop_idx];
+    if (ctx->ops.minfo_coop(ctx->ops.user_data, c->id, token, infos, MAX_DEVICES, &found) != 0) {
+        printf("Khong lay duoc thong tin chuong %s.\n", c->name);
+        return;
+    }
+    printf("Tong quan chuong %s (%zu thiet bi):\n", c->name, found);
+    for (size_t i = 0; i < found; ++i) {
+        display_info(infos[i]);
+        printf("\n");
+    }
+}
+
+/** @brief Menu: bật/tắt mọi quạt và đèn sưởi trong chuồng bằng một lệnh MCONTROL. */
+static void menu_coop_power(struct UiContext *ctx) {
+    if (!ctx->ops.mcontrol_coop) {
+        printf("Client chua ho tro dieu khien ca chuong.\n");
+        return;
+    }
+    refresh_coops(ctx);
+    size_t coop_idx = 0;
+    if (select_coop(ctx, &coop_idx) != 0) {
+        return;
+    }
+    const char *token = find_coop_token(ctx, coop_idx);
+    if (!token) {
+        return;
+    }
+    printf("Chon hanh dong cho quat + den suoi (1=ON, 0=OFF): ");
+    char line[8];
+    if (read_line(line, sizeof(line)) != 0) return;
+    const char *action = atoi(line) ? "ON" : "OFF";
+    size_t applied = 0;
+    const struct Coop *c = &ctx->coop_list.coops[coop_idx];
+    if (ctx->ops.mcontrol_coop(ctx->ops.user_data, c->id, token, action, &applied) != 0) {
+        printf("Dieu khien chuong that bai.\n");
+        return;
+    }
+    printf("Da gui lenh %s cho %zu thiet bi trong chuong %s.\n", action, applied, c->name);
+}
+
 /* Thiet lap tham so theo tung loai thiet bi */
 /** @brief Menu: SETCFG thiết bị đã CONNECT (tuỳ theo type). */
 static void menu_setcfg(struct UiContext *ctx) {
@@ -553,6 +743,9 @@ static void menu_manage_coop(struct UiContext *ctx) {
             break;
         }
         case 2:
+            for (size_t i = 0; i < ctx->coop_list.count; ++i) {
+                (void)refresh_coop_devices(ctx, i);
+            }
             print_coops_with_connection(ctx);
             break;
         case 3: {
@@ -632,6 +825,8 @@ void ui_run(struct UiContext *ctx) {
         printf("4. Thiet lap tham so\n");
         printf("5. Dieu khien truc tiep\n");
         printf("6. Quan ly chuong nuoi\n");
+        printf("7. Tong quan chuong\n");
+        printf("8. Bat/tat quat + den suoi ca chuong\n");
         printf("0. Thoat\n");
         printf("Chon: ");
 
@@ -660,6 +855,12 @@ void ui_run(struct UiContext *ctx) {
         case 6:
             menu_manage_coop(ctx);
             break;
+        case 7:
+            menu_coop_overview(ctx);
+            break;
+        case 8:
+            menu_coop_power(ctx);
+            break;
         case 0:
             running = 0;
             break;
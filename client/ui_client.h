@@ -6,9 +6,20 @@
 #include "../shared/config.h"
 #include "coop_client.h"
 
+/** @brief Kết quả SCAN SINCE: thiết bị thêm/đổi, thiết bị bị xoá và version mới. */
+struct ScanDelta {
+    int reset;  /* 1 = server yeu cau bo cache, `changed` la toan bo thiet bi */
+    struct DeviceIdentity changed[MAX_DEVICES];
+    size_t changed_count;
+    char removed[MAX_DEVICES][MAX_ID_LEN];
+    size_t removed_count;
+    unsigned long long version;
+};
+
 struct UiBackendOps {
     void *user_data;
     int (*scan)(void *user_data, struct DeviceIdentity *out, size_t max_out, size_t *found);
+    int (*scan_since)(void *user_data, unsigned long long since, struct ScanDelta *out);
     int (*connect)(void *user_data, const char *device_id, const char *password, char *out_token, size_t token_len, enum DeviceType *out_type);
     int (*info)(void *user_data, const char *device_id, const char *token, char *out_json, size_t json_len);
     int (*control)(void *user_data, const char *device_id, const char *token, const char *action, const char *payload);
@@ -16,7 +27,11 @@ struct UiBackendOps {
     int (*add_device)(void *user_data, const char *device_id, enum DeviceType type, const char *password, int coop_id);
     int (*assign)(void *user_data, const char *device_id, int coop_id);
     int (*coop_list)(void *user_data, struct CoopList *out);
+    /* NULL: thiet bi duoc gan vao chuong theo ket qua SCAN */
+    int (*coop_devices)(void *user_data, int coop_id, struct DeviceIdentity *out, size_t max_out, size_t *found);
     int (*coop_add)(void *user_data, const char *name, int *out_id);
+    int (*minfo_coop)(void *user_data, int coop_id, const char *token, char (*out_json)[MAX_JSON_LEN], size_t max_out, size_t *found);
+    int (*mcontrol_coop)(void *user_data, int coop_id, const char *token, const char *action, size_t *applied);
 };
 
 /** @brief Trạng thái thiết bị phía client (token + đã kết nối hay chưa). */
@@ -33,6 +48,9 @@ struct UiContext {
     struct ClientDevice devices[MAX_DEVICES];
     size_t device_count;
     struct CoopList coop_list;
+    struct DeviceIdentity known[MAX_DEVICES];  /* cache ket qua SCAN, cap nhat bang SCAN SINCE */
+    size_t known_count;
+    unsigned long long scan_version;  /* 0 = chua dong bo lan nao */
 };
 
 /**
@@ -0,0 +1,201 @@
+#include "climate.h"
+#include "monitor_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file climate.c
+ * @brief Chỉ số thiết bị khí hậu theo chuồng và luật bật/tắt.
+ */
+
+enum {
+    CLIMATE_SENSOR = 0,
+    CLIMATE_HEATER = 1,
+    CLIMATE_SPRAYER = 2
+};
+
+/** @brief Một dòng tạm khi dựng chỉ số. */
+struct ClimateRow {
+    int coop_id;
+    int kind;
+    unsigned long long seq;
+};
+
+static int compare_row(const void *a, const void *b) {
+    const struct ClimateRow *x = (const struct ClimateRow *)a;
+    const struct ClimateRow *y = (const struct ClimateRow *)b;
+    if (x->coop_id != y->coop_id) return x->coop_id < y->coop_id ? -1 : 1;
+    if (x->kind != y->kind) return x->kind - y->kind;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+static int climate_kind(enum DeviceType type) {
+    switch (type) {
+    case DEVICE_SENSOR:
+        return CLIMATE_SENSOR;
+    case DEVICE_HEATER:
+        return CLIMATE_HEATER;
+    case DEVICE_SPRAYER:
+        return CLIMATE_SPRAYER;
+    default:
+        return -1;
+    }
+}
+
+/** @see climate_init() */
+void climate_init(struct ClimateIndex *idx) {
+    memset(idx, 0, sizeof(*idx));
+    idx->dirty = 1;
+}
+
+/** @see climate_free() */
+void climate_free(struct ClimateIndex *idx) {
+    free(idx->coops);
+    free(idx->members);
+    climate_init(idx);
+}
+
+/** @see climate_invalidate() */
+void climate_invalidate(struct ClimateIndex *idx) {
+    idx->dirty = 1;
+}
+
+/** @brief Dựng lại chỉ số: một lượt qua thiết bị, sort, rồi cắt thành khoảng theo chuồng. */
+static int climate_rebuild(struct ClimateIndex *idx, const struct DevicesContext *devices) {
+    size_t n = 0;
+    for (size_t i = 0; i < devices->count; ++i) {
+        const struct DeviceIdentity *id = &devices->devices[i].identity;
+        if (id->coop_id > 0 && climate_kind(id->type) >= 0) n++;
+    }
+    struct ClimateRow *rows = (struct ClimateRow *)malloc((n ? n : 1) * sizeof(*rows));
+    unsigned long long *members = (unsigned long long *)malloc((n ? n : 1) * sizeof(*members));
+    struct ClimateCoop *coops = (struct ClimateCoop *)malloc((n ? n : 1) * sizeof(*coops));
+    if (!rows || !members || !coops) {
+        free(rows);
+        free(members);
+        free(coops);
+        return -1;
+    }
+    size_t r = 0;
+    for (size_t i = 0; i < devices->count; ++i) {
+        const struct Device *dev = &devices->devices[i];
+        int kind = climate_kind(dev->identity.type);
+        if (dev->identity.coop_id <= 0 || kind < 0) continue;
+        rows[r].coop_id = dev->identity.coop_id;
+        rows[r].kind = kind;
+        rows[r].seq = dev->seq;
+        r++;
+    }
+    qsort(rows, n, sizeof(*rows), compare_row);
+
+    size_t coop_count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (coop_count == 0 || coops[coop_count - 1].coop_id != rows[i].coop_id) {
+            struct ClimateCoop *c = &coops[coop_count++];
+            memset(c, 0, sizeof(*c));
+            c->coop_id = rows[i].coop_id;
+            c->first = i;
+        }
+        struct ClimateCoop *c = &coops[coop_count - 1];
+        if (rows[i].kind == CLIMATE_SENSOR) c->sensors++;
+        else if (rows[i].kind == CLIMATE_HEATER) c->heaters++;
+        else c->sprayers++;
+        members[i] = rows[i].seq;
+    }
+    free(rows);
+
+    free(idx->coops);
+    free(idx->members);
+    idx->coops = coops;
+    idx->coop_count = coop_count;
+    idx->members = members;
+    idx->member_count = n;
+    idx->dirty = 0;
+    return 0;
+}
+
+static const struct ClimateCoop *find_coop(const struct ClimateIndex *idx, int coop_id) {
+    size_t lo = 0, hi = idx->coop_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->coops[mid].coop_id < coop_id) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < idx->coop_count && idx->coops[lo].coop_id == coop_id) ? &idx->coops[lo] : NULL;
+}
+
+/** @brief Lấy thiết bị theo seq, bỏ qua nếu đã xoá hoặc đã chuyển chuồng khác. */
+static struct Device *member_device(struct DevicesContext *devices, unsigned long long seq, int coop_id) {
+    struct Device *dev = devices_find_seq(devices, seq);
+    return (dev && dev->identity.coop_id == coop_id) ? dev : NULL;
+}
+
+/** @brief Luật trễ chung: dưới `low` thì bật, từ `high` trở lên thì tắt, ở giữa giữ nguyên. */
+static enum DevicePowerState hysteresis(double value, double low, double high, enum DevicePowerState current) {
+    if (value < low) return DEVICE_ON;
+    if (value >= high) return DEVICE_OFF;
+    return current;
+}
+
+static int apply_state(struct Device *dev, enum DevicePowerState current, enum DevicePowerState want,
+                       const char *what, double value,
+                       void (*switched)(struct Device *dev, void *user_data), void *user_data) {
+    if (want == current || devices_set_state(dev, want) != 0) {
+        return 0;
+    }
+    char message[64];
+    snprintf(message, sizeof(message), "AUTO %s (%s=%.1f)", want == DEVICE_ON ? "ON" : "OFF", what, value);
+    log_device_event(dev->identity.id, message);
+    if (switched) switched(dev, user_data);
+    return 1;
+}
+
+/** @see climate_evaluate_coop() */
+int climate_evaluate_coop(struct ClimateIndex *idx, struct DevicesContext *devices, int coop_id,
+                          void (*switched)(struct Device *dev, void *user_data), void *user_data) {
+    if (idx->dirty && climate_rebuild(idx, devices) != 0) {
+        return -1;
+    }
+    const struct ClimateCoop *c = find_coop(idx, coop_id);
+    if (!c || c->sensors == 0 || (c->heaters == 0 && c->sprayers == 0)) {
+        return 0;
+    }
+
+    const unsigned long long *seqs = &idx->members[c->first];
+    double temp_sum = 0.0, hum_sum = 0.0;
+    size_t readings = 0;
+    for (size_t i = 0; i < c->sensors; ++i) {
+        const struct Device *s = member_device(devices, seqs[i], coop_id);
+        if (!s) continue;
+        temp_sum += s->data.sensor.temperature;
+        hum_sum += s->data.sensor.humidity;
+        readings++;
+    }
+    if (readings == 0) {
+        return 0;
+    }
+    double temperature = temp_sum / (double)readings;
+    double humidity = hum_sum / (double)readings;
+
+    int changed = 0;
+    seqs += c->sensors;
+    for (size_t i = 0; i < c->heaters; ++i) {
+        struct Device *h = member_device(devices, seqs[i], coop_id);
+        /* Chi dieu khien heater o che do AUTO; MANUAL do nguoi dung bat/tat */
+        if (!h || h->data.heater.mode != INTERN_AUTO) continue;
+        struct HeaterData *hd = &h->data.heater;
+        changed += apply_state(h, hd->state, hysteresis(temperature, hd->Tmin, hd->Tp2, hd->state),
+                               "T", temperature, switched, user_data);
+    }
+    seqs += c->heaters;
+    for (size_t i = 0; i < c->sprayers; ++i) {
+        struct Device *p = member_device(devices, seqs[i], coop_id);
+        if (!p) continue;
+        struct SprayerData *sd = &p->data.sprayer;
+        changed += apply_state(p, sd->state, hysteresis(humidity, sd->Hmin, sd->Hp, sd->state),
+                               "H", humidity, switched, user_data);
+    }
+    return changed;
+}
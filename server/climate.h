@@ -0,0 +1,57 @@
+#ifndef SERVER_CLIMATE_H
+#define SERVER_CLIMATE_H
+
+#include <stddef.h>
+#include "devices.h"
+
+/**
+ * @file climate.h
+ * @brief Điều khiển vòng kín cho đèn sưởi/máy phun sương theo cảm biến của chuồng.
+ *
+ * Luật trễ (hysteresis), nhiệt độ/độ ẩm của chuồng là trung bình các cảm biến:
+ *  - Heater ở mode AUTO: T < Tmin -> ON, T >= Tp2 -> OFF, ở giữa giữ nguyên.
+ *  - Sprayer: H < Hmin -> ON, H >= Hp -> OFF, ở giữa giữ nguyên.
+ *
+ * Chỉ số theo chuồng lưu `seq` của cảm biến/heater/sprayer trong một mảng phẳng,
+ * nên mỗi lần đánh giá chỉ chạm tới thiết bị của đúng chuồng đó. Chỉ số được
+ * dựng lại lười sau `climate_invalidate()` (thêm thiết bị, đổi chuồng); thiết
+ * bị đã xoá tự bị bỏ qua vì không còn tìm thấy theo `seq`.
+ */
+
+/** @brief Khoảng của một chuồng trong `ClimateIndex.members`. */
+struct ClimateCoop {
+    int coop_id;
+    size_t first;       /* vi tri dau tien trong members */
+    size_t sensors;     /* so cam bien, tiep theo la heaters roi sprayers */
+    size_t heaters;
+    size_t sprayers;
+};
+
+/** @brief Chỉ số thiết bị khí hậu theo chuồng. */
+struct ClimateIndex {
+    struct ClimateCoop *coops;      /* sap xep theo coop_id */
+    size_t coop_count;
+    unsigned long long *members;    /* seq thiet bi, gom theo chuong roi theo loai */
+    size_t member_count;
+    int dirty;
+};
+
+/** @brief Khởi tạo chỉ số rỗng (đánh dấu cần dựng). */
+void climate_init(struct ClimateIndex *idx);
+
+/** @brief Giải phóng chỉ số. */
+void climate_free(struct ClimateIndex *idx);
+
+/** @brief Báo chỉ số cần dựng lại (thiết bị mới hoặc đổi chuồng). */
+void climate_invalidate(struct ClimateIndex *idx);
+
+/**
+ * @brief Đánh giá luật của một chuồng và bật/tắt thiết bị qua `devices_set_state()`.
+ *
+ * `switched` (có thể NULL) được gọi cho mỗi thiết bị thực sự đổi trạng thái.
+ * @return Số thiết bị đã đổi trạng thái, -1 nếu hết bộ nhớ khi dựng chỉ số.
+ */
+int climate_evaluate_coop(struct ClimateIndex *idx, struct DevicesContext *devices, int coop_id,
+                          void (*switched)(struct Device *dev, void *user_data), void *user_data);
+
+#endif /* SERVER_CLIMATE_H */
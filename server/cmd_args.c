@@ -0,0 +1,60 @@
+#include "cmd_args.h"
+#include "../shared/config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** @see cmd_next_word() */
+char *cmd_next_word(char **cursor) {
+    char *p = *cursor;
+    while (*p == ' ') p++;
+    if (*p == '\0') {
+        *cursor = p;
+        return NULL;
+    }
+    char *start = p;
+    while (*p != '\0' && *p != ' ') p++;
+    if (*p != '\0') *p++ = '\0';
+    *cursor = p;
+    return start;
+}
+
+/** @see cmd_parse_ull() */
+int cmd_parse_ull(const char *s, unsigned long long *out) {
+    if (!s || *s < '0' || *s > '9') return -1;
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (!end || (*end != '\0' && *end != ':')) return -1;
+    *out = v;
+    return 0;
+}
+
+/** @see parse_scan_query() */
+int parse_scan_query(char *args, struct ScanQuery *q) {
+    memset(q, 0, sizeof(*q));
+    if (!args) return 0;
+    char *cursor = args;
+    char *word;
+    while ((word = cmd_next_word(&cursor)) != NULL) {
+        unsigned long long v = 0;
+        if (strcmp(word, "SINCE") == 0) {
+            if (cmd_parse_ull(cmd_next_word(&cursor), &q->since) != 0) return -1;
+            q->since_set = 1;
+        } else if (strncmp(word, "coop=", 5) == 0) {
+            if (cmd_parse_ull(word + 5, &v) != 0 || v == 0 || v > 0x7fffffffULL) return -1;
+            q->coop_id = (int)v;
+        } else if (strncmp(word, "limit=", 6) == 0) {
+            if (cmd_parse_ull(word + 6, &v) != 0 || v == 0) return -1;
+            q->limit = v > SCAN_PAGE_MAX ? SCAN_PAGE_MAX : (size_t)v;
+        } else if (strncmp(word, "cursor=", 7) == 0) {
+            /* Cursor SCAN: "<seq>:<version>", cursor COOPLIST: "<index>" */
+            char *sep = strchr(word + 7, ':');
+            if (cmd_parse_ull(word + 7, &q->after_seq) != 0) return -1;
+            if (sep && cmd_parse_ull(sep + 1, &q->snapshot) != 0) return -1;
+            q->has_cursor = 1;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef SERVER_CMD_ARGS_H
+#define SERVER_CMD_ARGS_H
+
+#include <stddef.h>
+
+/**
+ * @file cmd_args.h
+ * @brief Tách tham số dòng lệnh dùng chung cho actor (`coop_logic.c`) và snapshot đọc (`farm_snapshot.c`).
+ *
+ * Mọi hàm sửa chuỗi in-place và không cấp phát, nên gọi được từ thread bất kỳ.
+ */
+
+/** @brief Tham số của SCAN/COOPLIST sau khi parse. */
+struct ScanQuery {
+    int since_set;
+    unsigned long long since;
+    int coop_id;                  /* 0 = moi chuong */
+    size_t limit;                 /* 0 = khong gioi han */
+    int has_cursor;
+    unsigned long long after_seq; /* SCAN: seq cuoi da gui; COOPLIST: index tiep theo */
+    unsigned long long snapshot;  /* version tai trang dau, tra ve o SCAN_END */
+};
+
+/** @brief Tách từ tiếp theo (phân cách bởi dấu cách) từ `*cursor`, sửa in-place. */
+char *cmd_next_word(char **cursor);
+
+/**
+ * @brief Parse số nguyên không dấu thập phân; cả chuỗi phải là số (cho phép dừng ở `:`).
+ * @return 0 nếu hợp lệ, -1 nếu không.
+ */
+int cmd_parse_ull(const char *s, unsigned long long *out);
+
+/**
+ * @brief Parse `[SINCE <v>] [coop=<id>] [limit=N] [cursor=X]` (thứ tự tuỳ ý).
+ * @return 0 nếu hợp lệ, -1 nếu sai format.
+ */
+int parse_scan_query(char *args, struct ScanQuery *q);
+
+#endif /* SERVER_CMD_ARGS_H */
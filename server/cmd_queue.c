@@ -0,0 +1,196 @@
+#include "cmd_queue.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file cmd_queue.c
+ * @brief MPSC có giới hạn (sequence theo từng ô) và ring byte SPSC, dùng builtin `__atomic`.
+ */
+
+static int is_power_of_two(size_t n) {
+    return n >= 2 && (n & (n - 1)) == 0;
+}
+
+/** @see cmd_queue_init() */
+int cmd_queue_init(struct CmdQueue *q, size_t capacity) {
+    if (!q || !is_power_of_two(capacity)) {
+        return -1;
+    }
+    memset(q, 0, sizeof(*q));
+    q->cells = (struct CmdQueueCell *)malloc(capacity * sizeof(*q->cells));
+    if (!q->cells) {
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        q->cells[i].seq = i;
+    }
+    q->mask = capacity - 1;
+    return 0;
+}
+
+/** @see cmd_queue_free() */
+void cmd_queue_free(struct CmdQueue *q) {
+    if (!q) {
+        return;
+    }
+    free(q->cells);
+    memset(q, 0, sizeof(*q));
+}
+
+/** @see cmd_queue_reserve() */
+struct CmdRequest *cmd_queue_reserve(struct CmdQueue *q) {
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        struct CmdQueueCell *cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        long dif = (long)(seq - pos);
+        if (dif == 0) {
+            /* O trong dung luot: gianh vi tri, that bai thi pos da duoc nap lai */
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                return &cell->req;
+            }
+        } else if (dif < 0) {
+            return NULL; /* consumer chua tra o nay: day */
+        } else {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/** @see cmd_queue_commit() */
+void cmd_queue_commit(struct CmdQueue *q, struct CmdRequest *req) {
+    (void)q;
+    struct CmdQueueCell *cell = (struct CmdQueueCell *)((char *)req - offsetof(struct CmdQueueCell, req));
+    /* seq dang bang vi tri da gianh; +1 bao cho consumer o da co du lieu */
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&cell->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/** @see cmd_queue_peek() */
+struct CmdRequest *cmd_queue_peek(struct CmdQueue *q) {
+    size_t pos = q->dequeue_pos;
+    struct CmdQueueCell *cell = &q->cells[pos & q->mask];
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return NULL;
+    }
+    return &cell->req;
+}
+
+/** @see cmd_queue_release() */
+void cmd_queue_release(struct CmdQueue *q) {
+    size_t pos = q->dequeue_pos;
+    struct CmdQueueCell *cell = &q->cells[pos & q->mask];
+    /* O tro lai trang thai trong cho vong tiep theo cua producer */
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    q->dequeue_pos = pos + 1;
+}
+
+/** @see byte_ring_init() */
+int byte_ring_init(struct ByteRing *r, size_t capacity) {
+    if (!r || !is_power_of_two(capacity)) {
+        return -1;
+    }
+    memset(r, 0, sizeof(*r));
+    r->data = (char *)malloc(capacity);
+    if (!r->data) {
+        return -1;
+    }
+    r->mask = capacity - 1;
+    return 0;
+}
+
+/** @see byte_ring_free() */
+void byte_ring_free(struct ByteRing *r) {
+    if (!r) {
+        return;
+    }
+    free(r->data);
+    memset(r, 0, sizeof(*r));
+}
+
+/** @see byte_ring_capacity() */
+size_t byte_ring_capacity(const struct ByteRing *r) {
+    return r->mask + 1;
+}
+
+/** @see byte_ring_space() */
+size_t byte_ring_space(const struct ByteRing *r) {
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    return r->mask + 1 - (r->pending - head);
+}
+
+/** @see byte_ring_put() */
+int byte_ring_put(struct ByteRing *r, const void *data, size_t len) {
+    if (len > byte_ring_space(r)) {
+        return -1;
+    }
+    size_t at = r->pending & r->mask;
+    size_t first = r->mask + 1 - at;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(r->data + at, data, first);
+    memcpy(r->data, (const char *)data + first, len - first);
+    r->pending += len;
+    return 0;
+}
+
+/** @see byte_ring_publish() */
+int byte_ring_publish(struct ByteRing *r) {
+    return byte_ring_publish_to(r, r->pending);
+}
+
+/** @see byte_ring_mark() */
+size_t byte_ring_mark(const struct ByteRing *r) {
+    return r->pending;
+}
+
+/** @see byte_ring_publish_to() */
+int byte_ring_publish_to(struct ByteRing *r, size_t mark) {
+    /* Moc cu hon phan da cong bo (hoac vuot phan da ghi) thi khong lam gi */
+    if (mark - r->tail == 0 || mark - r->tail > r->pending - r->tail) {
+        return 0;
+    }
+    __atomic_store_n(&r->tail, mark, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/** @see byte_ring_readable() */
+size_t byte_ring_readable(const struct ByteRing *r) {
+    return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - r->head;
+}
+
+/** @see byte_ring_peek() */
+size_t byte_ring_peek(const struct ByteRing *r, const char **out, size_t max) {
+    size_t avail = byte_ring_readable(r);
+    size_t at = r->head & r->mask;
+    size_t n = r->mask + 1 - at;
+    if (n > avail) n = avail;
+    if (n > max) n = max;
+    *out = r->data + at;
+    return n;
+}
+
+/** @see byte_ring_consume() */
+void byte_ring_consume(struct ByteRing *r, size_t len) {
+    __atomic_store_n(&r->head, r->head + len, __ATOMIC_RELEASE);
+}
+
+/** @see byte_ring_read() */
+int byte_ring_read(struct ByteRing *r, void *out, size_t len) {
+    if (byte_ring_readable(r) < len) {
+        return -1;
+    }
+    size_t done = 0;
+    while (done < len) {
+        const char *p;
+        size_t n = byte_ring_peek(r, &p, len - done);
+        memcpy((char *)out + done, p, n);
+        byte_ring_consume(r, n);
+        done += n;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef SERVER_CMD_QUEUE_H
+#define SERVER_CMD_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../shared/config.h"
+#include "../shared/protocol.h"
+
+/**
+ * @file cmd_queue.h
+ * @brief Hàng đợi lock-free giữa thread mạng và state actor.
+ *
+ * - `CmdQueue`: MPSC có giới hạn (kiểu Vyukov), mỗi ô chứa sẵn một dòng lệnh
+ *   nên producer ghi thẳng vào ô (`reserve`/`commit`) và consumer đọc tại chỗ
+ *   (`peek`/`release`), không copy và không cấp phát.
+ * - `ByteRing`: SPSC theo byte cho response/event đã render; producer ghi dần
+ *   và chỉ công bố (`publish`) ở ranh giới bản ghi, consumer luôn thấy bản ghi trọn vẹn.
+ *
+ * Dung lượng phải là lũy thừa của 2.
+ */
+
+/** @brief Loại message từ thread mạng gửi cho actor. */
+enum CmdMessageKind {
+    CMD_MSG_LINE = 0,   /* mot dong lenh da tach cmd/args */
+    CMD_MSG_CLOSED,     /* ket noi da dong: actor bo subscription cua slot */
+    CMD_MSG_DRAINED,    /* buffer gui vua xuong duoi high-water: gui tiep event dang cho */
+    CMD_MSG_IMPORT      /* dong du lieu giua IMPORT BEGIN/END (nguyen van, khong co response) */
+};
+
+/** @brief Một message trong `CmdQueue`. */
+struct CmdRequest {
+    enum CmdMessageKind kind;
+    uint32_t slot;              // Slot kết nối phía thread mạng
+    uint32_t gen;               // Thế hệ của slot (tăng mỗi lần đóng kết nối)
+    enum CommandType cmd;
+    int has_args;               // `line` chứa args (đã bỏ tên lệnh) hay không
+    char line[MAX_LINE_LEN];
+};
+
+/** @brief Một ô của `CmdQueue`; `seq` cho biết ô đang trống hay đã có dữ liệu. */
+struct CmdQueueCell {
+    size_t seq;
+    struct CmdRequest req;
+};
+
+/** @brief Hàng đợi MPSC; hai chỉ số nằm trên hai cache line khác nhau. */
+struct CmdQueue {
+    struct CmdQueueCell *cells;
+    size_t mask;
+    char pad0[64 - sizeof(void *) - sizeof(size_t)];
+    size_t enqueue_pos;
+    char pad1[64 - sizeof(size_t)];
+    size_t dequeue_pos;
+    char pad2[64 - sizeof(size_t)];
+};
+
+/**
+ * @brief Khởi tạo hàng đợi `capacity` ô (lũy thừa của 2).
+ * @return 0 nếu thành công, -1 nếu dung lượng sai hoặc hết bộ nhớ.
+ */
+int cmd_queue_init(struct CmdQueue *q, size_t capacity);
+
+/** @brief Giải phóng hàng đợi. */
+void cmd_queue_free(struct CmdQueue *q);
+
+/**
+ * @brief Producer: giữ một ô trống để ghi (an toàn với nhiều producer).
+ * @return Ô để ghi, hoặc NULL nếu hàng đợi đầy.
+ */
+struct CmdRequest *cmd_queue_reserve(struct CmdQueue *q);
+
+/** @brief Producer: công bố ô đã ghi xong cho consumer. */
+void cmd_queue_commit(struct CmdQueue *q, struct CmdRequest *req);
+
+/** @brief Consumer: message đầu hàng đợi (đọc tại chỗ), NULL nếu rỗng. */
+struct CmdRequest *cmd_queue_peek(struct CmdQueue *q);
+
+/** @brief Consumer: trả ô đầu hàng đợi sau khi xử lý xong `cmd_queue_peek()`. */
+void cmd_queue_release(struct CmdQueue *q);
+
+/** @brief Ring byte SPSC. */
+struct ByteRing {
+    char *data;
+    size_t mask;
+    size_t pending;             // Chỉ producer: vị trí ghi (chưa công bố)
+    char pad0[64 - sizeof(void *) - 2 * sizeof(size_t)];
+    size_t tail;                // Vị trí đã công bố (producer ghi, consumer đọc)
+    char pad1[64 - sizeof(size_t)];
+    size_t head;                // Vị trí đã đọc (consumer ghi, producer đọc)
+    char pad2[64 - sizeof(size_t)];
+};
+
+/**
+ * @brief Khởi tạo ring `capacity` byte (lũy thừa của 2).
+ * @return 0 nếu thành công, -1 nếu dung lượng sai hoặc hết bộ nhớ.
+ */
+int byte_ring_init(struct ByteRing *r, size_t capacity);
+
+/** @brief Giải phóng ring. */
+void byte_ring_free(struct ByteRing *r);
+
+/** @brief Dung lượng ring (byte). */
+size_t byte_ring_capacity(const struct ByteRing *r);
+
+/** @brief Producer: số byte còn ghi được (tính cả phần chưa công bố). */
+size_t byte_ring_space(const struct ByteRing *r);
+
+/**
+ * @brief Producer: ghi `len` byte vào phần chưa công bố.
+ * @return 0 nếu thành công, -1 nếu không đủ chỗ (không ghi gì).
+ */
+int byte_ring_put(struct ByteRing *r, const void *data, size_t len);
+
+/**
+ * @brief Producer: công bố mọi byte đã ghi.
+ * @return 1 nếu có byte mới được công bố, 0 nếu không.
+ */
+int byte_ring_publish(struct ByteRing *r);
+
+/** @brief Producer: vị trí ghi hiện tại, dùng làm mốc cho `byte_ring_publish_to()`. */
+size_t byte_ring_mark(const struct ByteRing *r);
+
+/**
+ * @brief Producer: chỉ công bố các byte đã ghi trước mốc `mark` (phải là ranh giới bản ghi).
+ * @return 1 nếu có byte mới được công bố, 0 nếu mốc đã công bố rồi.
+ */
+int byte_ring_publish_to(struct ByteRing *r, size_t mark);
+
+/** @brief Consumer: số byte đã công bố chưa đọc. */
+size_t byte_ring_readable(const struct ByteRing *r);
+
+/**
+ * @brief Consumer: copy `len` byte đầu ring vào `out` và bỏ chúng khỏi ring.
+ * @return 0 nếu thành công, -1 nếu chưa đủ byte.
+ */
+int byte_ring_read(struct ByteRing *r, void *out, size_t len);
+
+/**
+ * @brief Consumer: đoạn liền mạch đầu ring (tối đa `max` byte) để đọc tại chỗ.
+ * @return Số byte trong `*out`; gọi `byte_ring_consume()` sau khi dùng xong.
+ */
+size_t byte_ring_peek(const struct ByteRing *r, const char **out, size_t max);
+
+/** @brief Consumer: bỏ `len` byte đầu ring. */
+void byte_ring_consume(struct ByteRing *r, size_t len);
+
+#endif /* SERVER_CMD_QUEUE_H */
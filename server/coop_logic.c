@@ -1,40 +1,152 @@
 #include "../server/coop_logic.h"
+#include "climate.h"
+#include "cmd_args.h"
+#include "coop_stats.h"
 #include "coops.h"
+#include "device_import.h"
 #include "devices.h"
+#include "farm_snapshot.h"
 #include "session_auth.h"
 #include "monitor_log.h"
-#include "net_server.h"
+#include "metrics.h"
+#include "req_arena.h"
+#include "scheduler.h"
+#include "state_actor.h"
 #include "storage.h"
+#include "telemetry.h"
+#include "telemetry_udp.h"
+#include "tsdb.h"
+#include "work_pool.h"
 #include "../shared/protocol.h"
 
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <jansson.h>
 
 static struct CoopsContext g_coops;
 static struct DevicesContext g_devices;
+static struct Scheduler g_scheduler;
+static struct ClimateIndex g_climate;
+static struct CoopStatsMirror g_coop_stats;
+static int g_farm_dirty;        /* co thay doi chua ghi ra farm_state.d */
+static int g_farm_save_pending; /* lenh trong lo hien tai can ghi farm truoc khi tra response */
+static time_t g_last_flush;
+static struct StorageShards g_shards;      /* farm tren dia, moi chuong mot file */
+static struct StorageStamp g_farm_stamp;  /* dau farm_state.json (format mot file) lan doc cuoi */
+static int g_farm_stamp_ok;
+static struct DeviceImport *g_imports[MAX_DEVICES]; /* lo IMPORT dang mo cua tung ket noi */
+static struct Tsdb g_history;   /* lich su so do (fd < 0 neu khong mo duoc) */
+static time_t g_last_history_flush;
+
+/* Trang thai cua snapshot doc da cong bo (xem coop_logic_publish_snapshot) */
+static unsigned long long g_snapshot_version; /* state version luc cong bo */
+static unsigned long g_snapshot_sessions;     /* session_generation() luc cong bo */
+static int g_snapshot_coops_dirty = 1;        /* danh sach chuong doi tu lan cong bo truoc */
+static uint64_t g_snapshot_next_ns;           /* som nhat duoc dung snapshot lan tiep */
+
+/** @brief Một lần ghi farm: shard đổi render trên actor, ghi file trên work pool (mỗi lúc tối đa một). */
+struct FarmSaveTask {
+    struct WorkTask task;
+    struct StorageWrite write;
+    uint64_t render_ns;         /* render tren actor */
+    uint64_t write_ns;          /* ghi file tren worker */
+    int rc;
+    int snapshot;               /* 1: snapshot da dung san, cong bo khi ghi xong */
+    int mark_valid;             /* snapshot phan anh toi het lo `batch` khi ghi xong */
+    unsigned long long batch;
+};
+
+static struct FarmSaveTask g_save;
+static int g_save_in_flight;
 
 static const char *FARM_STATE_PATH = "farm_state.json";
+static const char *FARM_SHARD_DIR = "farm_state.d";
+static const char *HISTORY_PATH = "sensor_history.tsdb";
+
+enum {
+    MAX_TOMBSTONES = 64
+};
+
+/** @brief Dấu vết thiết bị đã xoá, để SCAN SINCE báo lại cho client. */
+struct DeviceTombstone {
+    char id[MAX_ID_LEN];
+    unsigned long long version;
+};
+
+/*
+ * State version tang don dieu sau moi thay doi farm. Gia tri khoi dau lay tu
+ * thoi gian khoi dong (<< 32) de version cua process moi luon lon hon process
+ * truoc; client gui SINCE nho hon g_version_floor se nhan SCAN_RESET.
+ */
+static unsigned long long g_state_version;
+static unsigned long long g_version_floor;
+static struct DeviceTombstone g_tombstones[MAX_TOMBSTONES];
+static size_t g_tombstone_count;
+static size_t g_tombstone_head; /* vi tri ghi tiep theo trong ring */
+
+/** @brief Tăng state version (vd khi thêm chuồng). */
+static unsigned long long bump_state_version(void) {
+    return ++g_state_version;
+}
+
+/** @brief Đánh dấu thiết bị vừa thay đổi ở version mới. */
+static void touch_device(struct Device *dev) {
+    dev->version = bump_state_version();
+}
+
+/** @brief Ghi tombstone cho thiết bị vừa xoá; tombstone cũ nhất bị đẩy ra sẽ nâng floor. */
+static void record_tombstone(const char *id) {
+    struct DeviceTombstone *t = &g_tombstones[g_tombstone_head];
+    if (g_tombstone_count == MAX_TOMBSTONES) {
+        g_version_floor = t->version;
+    } else {
+        g_tombstone_count++;
+    }
+    memset(t, 0, sizeof(*t));
+    snprintf(t->id, sizeof(t->id), "%s", id);
+    t->version = bump_state_version();
+    g_tombstone_head = (g_tombstone_head + 1) % MAX_TOMBSTONES;
+}
 
 /** @brief Nạp thêm dữ liệu farm từ đĩa và merge vào state hiện tại. */
 static void merge_farm_from_disk(void) {
+    /* Server chi ghi farm_state.d; file mot file khong ai sua tu lan doc cuoi thi khong co gi de merge */
+    struct StorageStamp stamp;
+    int stamp_ok = storage_stamp(FARM_STATE_PATH, &stamp) == 0;
+    if ((stamp_ok && g_farm_stamp_ok && memcmp(&stamp, &g_farm_stamp, sizeof(stamp)) == 0)) {
+        return;
+    }
     struct CoopsContext file_coops;
     struct DevicesContext file_devices;
     if (storage_load_farm(&file_coops, &file_devices, FARM_STATE_PATH) != 0) {
         return;
     }
+    g_farm_stamp = stamp;
+    g_farm_stamp_ok = stamp_ok;
 
     for (size_t i = 0; i < file_coops.count; ++i) {
         (void)coops_upsert(&g_coops, file_coops.coops[i].id, file_coops.coops[i].name);
+        g_snapshot_coops_dirty = 1;
     }
 
     for (size_t i = 0; i < file_devices.count; ++i) {
-        if (g_devices.count >= MAX_DEVICES) break;
         const struct Device *d = &file_devices.devices[i];
         if (devices_find(&g_devices, d->identity.id)) continue;
-        g_devices.devices[g_devices.count++] = *d;
+        struct Device *added = devices_insert(&g_devices, d);
+        if (!added) break;
+        touch_device(added);
+        (void)scheduler_sync_device(&g_scheduler, added, time(NULL));
+        climate_invalidate(&g_climate);
+        coop_stats_invalidate(&g_coop_stats);
     }
+
+    coops_free(&file_coops);
+    devices_context_free(&file_devices);
 }
 
 /** @brief Chuẩn hoá tên chuồng: nếu rỗng/"0" thì gán mặc định "Chuong <id>". */
@@ -46,24 +158,309 @@ static void sanitize_coop_names(void) {
     }
 }
 
+/** @brief Hook của devices.c: chuyển thay đổi thành push event cho các kết nối SUBSCRIBE. */
+static void on_device_change(const struct Device *dev, enum DeviceChangeKind kind, void *user_data) {
+    (void)user_data;
+    if (kind == DEVICE_CHANGE_REMOVED) {
+        coop_stats_invalidate(&g_coop_stats);
+    } else {
+        coop_stats_update(&g_coop_stats, dev);
+    }
+    server_publish_device_change(dev->id_handle, dev->identity.coop_id);
+}
+
+int coop_logic_format_event(uint32_t device, char *out, size_t len) {
+    const struct Device *dev = devices_find_handle(&g_devices, device);
+    if (!dev) {
+        return protocol_format_event_gone(out, len, intern_cstr(device));
+    }
+    char json[MAX_JSON_LEN];
+    if (devices_info_json(dev, json, sizeof(json)) != 0) {
+        return -1;
+    }
+    return protocol_format_event(out, len, dev->identity.id, json);
+}
+
 void coop_logic_init(void) {
-    /* Thu tai tu file farm_state.json, neu khong co thi khoi tao mac dinh */
-    if (storage_load_farm(&g_coops, &g_devices, FARM_STATE_PATH) != 0) {
+    /* Uu tien farm_state.d; chua co thi tai farm_state.json (lan ghi dau se tach
+     * ra farm_state.d, file cu giu nguyen), khong co ca hai thi khoi tao mac dinh */
+    (void)storage_shards_init(&g_shards, FARM_SHARD_DIR);
+    int sharded = storage_shards_load(&g_shards, &g_coops, &g_devices) == 0;
+    g_farm_stamp_ok = storage_stamp(FARM_STATE_PATH, &g_farm_stamp) == 0;
+    if (!sharded && storage_load_farm(&g_coops, &g_devices, FARM_STATE_PATH) != 0) {
+        /* Co file ma khong doc duoc thi phai bao, khong am tham chay voi farm rong */
+        if (g_farm_stamp_ok) {
+            fprintf(stderr, "farm: khong doc duoc %s (JSON/CRC sai), bat dau voi farm rong\n", FARM_STATE_PATH);
+        }
         coops_init(&g_coops);
         devices_context_init(&g_devices);
     }
     sanitize_coop_names();
+
+    g_state_version = (unsigned long long)time(NULL) << 32;
+    g_version_floor = g_state_version;
+    for (size_t i = 0; i < g_devices.count; ++i) {
+        g_devices.devices[i].version = g_state_version;
+    }
+    if (sharded) {
+        (void)storage_shards_sync(&g_shards, &g_coops, &g_devices);
+    }
+    devices_set_change_hook(on_device_change, NULL);
+
+    climate_init(&g_climate);
+    coop_stats_init(&g_coop_stats);
+    if (tsdb_open(&g_history, HISTORY_PATH) != 0) {
+        fprintf(stderr, "history: khong mo duoc %s, tat luu lich su\n", HISTORY_PATH);
+    }
+    scheduler_init(&g_scheduler);
+    if (scheduler_rebuild(&g_scheduler, &g_devices, time(NULL)) != 0) {
+        fprintf(stderr, "scheduler: out of memory, schedules disabled\n");
+    }
+    (void)coop_logic_publish_snapshot(0);
+}
+
+/** @brief Callback của bộ điều khiển khí hậu: thiết bị vừa được bật/tắt tự động. */
+static void on_climate_switched(struct Device *dev, void *user_data) {
+    (void)user_data;
+    touch_device(dev);
+}
+
+/** @brief Đánh giá lại heater/sprayer của một chuồng sau khi cảm biến hoặc cấu hình đổi. */
+static int evaluate_climate(int coop_id) {
+    if (coop_id <= 0) {
+        return 0;
+    }
+    return climate_evaluate_coop(&g_climate, &g_devices, coop_id, on_climate_switched, NULL);
+}
+
+/** @brief Ghi lượng thức ăn/nước vừa cấp vào lịch sử. */
+static void record_dispense(const struct Device *dev) {
+    int64_t now = (int64_t)time(NULL);
+    if (dev->identity.type == DEVICE_FEEDER) {
+        (void)tsdb_append(&g_history, dev->identity.id, TSDB_METRIC_FEED, now, dev->data.feeder.W);
+        (void)tsdb_append(&g_history, dev->identity.id, TSDB_METRIC_WATER, now, dev->data.feeder.Vw);
+    } else if (dev->identity.type == DEVICE_DRINKER) {
+        (void)tsdb_append(&g_history, dev->identity.id, TSDB_METRIC_WATER, now, dev->data.drinker.Vw);
+    }
+}
+
+/** @brief Ghi số đo hiện tại của cảm biến/bộ đếm trứng vào lịch sử. */
+static void record_reading(const struct Device *dev, unsigned fields) {
+    int64_t now = (int64_t)time(NULL);
+    if (dev->identity.type == DEVICE_SENSOR) {
+        if (fields & TELEMETRY_TEMPERATURE) {
+            (void)tsdb_append(&g_history, dev->identity.id, TSDB_METRIC_TEMPERATURE, now, dev->data.sensor.temperature);
+        }
+        if (fields & TELEMETRY_HUMIDITY) {
+            (void)tsdb_append(&g_history, dev->identity.id, TSDB_METRIC_HUMIDITY, now, dev->data.sensor.humidity);
+        }
+    } else if (dev->identity.type == DEVICE_EGG_COUNTER) {
+        (void)tsdb_append(&g_history, dev->identity.id, TSDB_METRIC_EGGS, now, (double)dev->data.egg_counter.egg_count);
+    }
+}
+
+/** @brief Callback của scheduler: thiết bị vừa chạy lịch. */
+static void on_schedule_fired(struct Device *dev, void *user_data) {
+    (void)user_data;
+    touch_device(dev);
+    record_dispense(dev);
+}
+
+/** @brief Snapshot đã công bố có còn sau state hiện tại không. */
+static int snapshot_stale(void) {
+    return g_snapshot_version != g_state_version || g_snapshot_coops_dirty ||
+           session_generation() != g_snapshot_sessions;
+}
+
+/** @brief Dựng snapshot từ state hiện tại; `commit` = 0 thì chỉ chuẩn bị (`farm_snapshot_prepare()`). */
+static int snapshot_build(int commit) {
+    unsigned long sessions_gen = session_generation();
+    struct Session sessions[MAX_DEVICES];
+    struct FarmSnapshotSource src = {&g_devices, g_snapshot_coops_dirty ? &g_coops : NULL, NULL, 0, g_state_version};
+    if (sessions_gen != g_snapshot_sessions) {
+        src.session_count = session_export(sessions, MAX_DEVICES);
+        src.sessions = sessions;
+    }
+    if ((commit ? farm_snapshot_publish(&src) : farm_snapshot_prepare(&src)) != 0) {
+        return -1;
+    }
+    g_snapshot_version = g_state_version;
+    g_snapshot_sessions = sessions_gen;
+    g_snapshot_coops_dirty = 0;
+    return 0;
+}
+
+/** @brief Worker: ghi các shard đã render (file tạm + rename). */
+static void farm_save_run(struct WorkTask *task) {
+    struct FarmSaveTask *save = (struct FarmSaveTask *)((char *)task - offsetof(struct FarmSaveTask, task));
+    uint64_t started = metrics_now_ns();
+    save->rc = storage_write_files(&save->write);
+    save->write_ns = metrics_now_ns() - started;
+}
+
+/** @brief Actor: lần ghi farm đã xong; công bố snapshot đi kèm (state của nó giờ đã nằm trên đĩa). */
+static void farm_save_done(struct WorkTask *task) {
+    struct FarmSaveTask *save = (struct FarmSaveTask *)((char *)task - offsetof(struct FarmSaveTask, task));
+    storage_write_free(&save->write);
+    g_save_in_flight = 0;
+    metrics_record_flush(save->render_ns + save->write_ns);
+    if (save->rc != 0) {
+        /* Khong biet shard nao da len dia: chu ky flush sau ghi lai tat ca */
+        storage_shards_invalidate(&g_shards);
+        g_farm_dirty = 1;
+    }
+    if (save->snapshot) {
+        farm_snapshot_commit();
+        save->snapshot = 0;
+    }
+    if (save->mark_valid) {
+        farm_snapshot_mark_valid(save->batch);
+    }
+}
+
+/**
+ * @brief Render các shard đổi và giao việc ghi file cho work pool.
+ *
+ * `durable`: response của lô `batch` đang chờ lần ghi này, nên snapshot của
+ * state lúc render cũng chỉ được công bố khi ghi xong. Pool không chạy thì ghi tại chỗ.
+ * @return 1 nếu việc ghi đang chạy trên pool, 0 nếu đã xong (hoặc không có gì để ghi, lỗi render).
+ */
+static int start_save(int durable, unsigned long long batch) {
+    uint64_t started = metrics_now_ns();
+    struct FarmSaveTask *save = &g_save;
+    int files = storage_shards_render(&g_shards, &g_coops, &g_devices, &save->write);
+    save->render_ns = metrics_now_ns() - started;
+    g_farm_save_pending = 0;
+    g_farm_dirty = 0;
+    g_last_flush = time(NULL);
+    if (files <= 0) {
+        if (files < 0) metrics_record_flush(save->render_ns);
+        return 0;
+    }
+    save->task.run = farm_save_run;
+    save->task.done = farm_save_done;
+    save->rc = -1;
+    save->write_ns = 0;
+    save->snapshot = 0;
+    save->mark_valid = 0;
+    save->batch = batch;
+    if (durable) {
+        if (!snapshot_stale()) {
+            save->mark_valid = 1;
+        } else if (snapshot_build(0) == 0) {
+            save->snapshot = 1;
+            save->mark_valid = 1;
+        }
+    }
+    g_save_in_flight = 1;
+    if (work_pool_submit(state_actor_reactor(), &save->task) != 0) {
+        farm_save_run(&save->task);
+        farm_save_done(&save->task);
+        return 0;
+    }
+    return 1;
+}
+
+void coop_logic_tick(void) {
+    time_t now = time(NULL);
+    if (scheduler_run_due(&g_scheduler, &g_devices, now, on_schedule_fired, NULL) > 0) {
+        g_farm_dirty = 1;
+    }
+    /* Gom moi thay doi (lich, so do) trong mot chu ky vao mot lan ghi file */
+    if (g_farm_dirty && !g_save_in_flight && now - g_last_flush >= FARM_FLUSH_INTERVAL_S) {
+        (void)start_save(0, 0);
+    }
+    if (now - g_last_history_flush >= FARM_FLUSH_INTERVAL_S) {
+        (void)tsdb_flush(&g_history);
+        g_last_history_flush = now;
+    }
+}
+
+int coop_logic_end_batch(unsigned long long batch) {
+    if (g_save_in_flight) {
+        return 1;
+    }
+    if (!g_farm_save_pending) {
+        return 0;
+    }
+    /* Mot lan ghi cho ca lo; ghi ca cac so do dang cho chu ky flush */
+    return start_save(1, batch);
+}
+
+int coop_logic_save_pending(void) {
+    return g_farm_save_pending;
+}
+
+int coop_logic_save_in_flight(void) {
+    return g_save_in_flight;
+}
+
+void coop_logic_save_now(void) {
+    while (g_save_in_flight) {
+        (void)work_reactor_wait(state_actor_reactor(), 100);
+    }
+    if (!g_farm_save_pending) {
+        return;
+    }
+    uint64_t started = metrics_now_ns();
+    struct StorageWrite write;
+    int files = storage_shards_render(&g_shards, &g_coops, &g_devices, &write);
+    if (files > 0 && storage_write_files(&write) != 0) {
+        storage_shards_invalidate(&g_shards);
+    }
+    storage_write_free(&write);
+    if (files != 0) {
+        metrics_record_flush(metrics_now_ns() - started);
+    }
+    g_farm_save_pending = 0;
+    g_farm_dirty = 0;
+    g_last_flush = time(NULL);
+}
+
+int coop_logic_publish_snapshot(unsigned long long batch) {
+    if (g_save_in_flight && g_save.snapshot) {
+        return -1; /* snapshot cua lan ghi dang chay se duoc cong bo khi ghi xong */
+    }
+    if (!snapshot_stale()) {
+        farm_snapshot_mark_valid(batch);
+        return -1;
+    }
+    uint64_t now = metrics_now_ns();
+    if (now < g_snapshot_next_ns) {
+        /* Doc trong luc cho van dung: ket noi da thay lo moi hon thi di qua actor */
+        return (int)((g_snapshot_next_ns - now + 999999) / 1000000);
+    }
+    if (snapshot_build(1) != 0) {
+        g_snapshot_next_ns = now + 1000000; /* het bo nho: thu lai sau 1 ms */
+        return 1;
+    }
+    uint64_t done = metrics_now_ns();
+    g_snapshot_next_ns = done + (done - now) * FARM_SNAPSHOT_COST_RATIO;
+    farm_snapshot_mark_valid(batch);
+    return -1;
+}
+
+int coop_logic_next_timeout_ms(void) {
+    long long next = scheduler_next_fire(&g_scheduler);
+    if (g_farm_dirty && !g_save_in_flight) {
+        long long flush_at = (long long)g_last_flush + FARM_FLUSH_INTERVAL_S;
+        if (next < 0 || flush_at < next) next = flush_at;
+    }
+    if (next < 0) {
+        return -1;
+    }
+    long long wait = next - (long long)time(NULL);
+    if (wait <= 0) {
+        return 0;
+    }
+    /* Thuc day it nhat moi phut de kip phat hien dong ho bi chinh */
+    return wait >= 60 ? 60000 : (int)(wait * 1000);
 }
 
 /* Tiện ích cấp phát response */
-/** @brief Cấp phát và copy một dòng response (caller phải `free()`). */
+/** @brief Copy một dòng response vào arena của lượt (không cần `free()`). */
 static char *alloc_line(const char *src) {
-    size_t len = strlen(src) + 1;
-    char *buf = (char *)malloc(len);
-    if (buf) {
-        memcpy(buf, src, len);
-    }
-    return buf;
+    return req_arena_strdup(src);
 }
 
 static json_t *parse_payload_object(const char *payload) {
@@ -100,40 +497,1119 @@ static int require_int(json_t *obj, const char *key, int *out) {
     return -1;
 }
 
+/**
+ * @brief Thiết bị đầu tiên có `seq > after_seq` (index + 1, 0 = hết) của một trang.
+ *
+ * `coop_id > 0` đi theo danh sách của chuồng: thiết bị cursor còn trong
+ * chuồng thì trang tiếp bắt đầu ngay sau nó (tìm nhị phân theo seq), chỉ khi
+ * nó đã bị xoá hoặc chuyển chuồng mới duyệt lại danh sách từ đầu.
+ */
+static uint32_t page_first(int coop_id, unsigned long long after_seq) {
+    if (coop_id <= 0) {
+        size_t i = devices_index_after_seq(&g_devices, after_seq);
+        return i < g_devices.count ? (uint32_t)(i + 1) : 0;
+    }
+    const struct Device *cursor = after_seq > 0 ? devices_find_seq(&g_devices, after_seq) : NULL;
+    if (cursor && cursor->identity.coop_id == coop_id) {
+        return cursor->coop_next;
+    }
+    const struct DeviceCoopList *members = devices_coop_list(&g_devices, coop_id);
+    uint32_t k = members ? members->head : 0;
+    while (k != 0 && g_devices.devices[k - 1].seq <= after_seq) {
+        k = g_devices.devices[k - 1].coop_next;
+    }
+    return k;
+}
+
+/** @brief Thiết bị kế tiếp sau `k` trong cùng phạm vi với `page_first()`. */
+static uint32_t page_next(int coop_id, uint32_t k) {
+    if (coop_id > 0) return g_devices.devices[k - 1].coop_next;
+    return k < g_devices.count ? k + 1 : 0;
+}
+
+/**
+ * @brief SCAN phân trang (và/hoặc SINCE): gửi trực tiếp từ registry, không copy.
+ *
+ * Trang đầu (không có cursor) có thể gửi SCAN_RESET và các dòng REMOVED; mỗi
+ * trang gửi tối đa `limit` dòng DEVICE rồi kết thúc bằng SCAN_MORE <cursor>
+ * hoặc SCAN_END <version>. Cursor là `seq` của thiết bị cuối đã gửi nên vẫn
+ * đúng khi có thiết bị được thêm/xoá giữa các trang; version trong cursor là
+ * state version lúc trang đầu, nên thay đổi trong lúc phân trang sẽ được
+ * trả về ở lần SCAN SINCE kế tiếp. Sau SCAN_RESET, client xin các trang tiếp
+ * theo với `SINCE 0`.
+ */
+static void handle_scan_paged(int fd, struct ScanQuery *q) {
+    char line[MAX_LINE_LEN];
+    if (q->coop_id > 0 && !coops_find(&g_coops, q->coop_id)) {
+        protocol_format_no_coop(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    if (!q->has_cursor) {
+        q->snapshot = g_state_version;
+        if (q->since_set && (q->since < g_version_floor || q->since > g_state_version)) {
+            protocol_format_scan_reset(line, sizeof(line));
+            send_line(fd, line);
+            q->since = 0;
+        } else if (q->since_set) {
+            for (size_t i = 0; i < g_tombstone_count; ++i) {
+                const struct DeviceTombstone *t = &g_tombstones[i];
+                if (t->version <= q->since) continue;
+                protocol_format_removed(line, sizeof(line), t->id, t->version);
+                send_line(fd, line);
+            }
+        }
+    } else if (q->snapshot == 0) {
+        q->snapshot = g_state_version;
+    }
+
+    size_t sent = 0;
+    unsigned long long last_seq = q->after_seq;
+    for (uint32_t k = page_first(q->coop_id, q->after_seq); k != 0; k = page_next(q->coop_id, k)) {
+        const struct Device *dev = &g_devices.devices[k - 1];
+        if (dev->version <= q->since) {
+            last_seq = dev->seq;
+            continue;
+        }
+        if (q->limit > 0 && sent == q->limit) {
+            /* Con thiet bi phu hop phia sau: tra cursor cho trang tiep */
+            protocol_format_scan_more(line, sizeof(line), last_seq, q->snapshot);
+            send_line(fd, line);
+            return;
+        }
+        last_seq = dev->seq;
+        if (q->since_set) {
+            protocol_format_device_delta(line, sizeof(line), dev->identity.id, dev->identity.type,
+                                         dev->identity.coop_id, dev->version);
+        } else {
+            protocol_format_device_ex(line, sizeof(line), dev->identity.id, dev->identity.type,
+                                      dev->identity.coop_id);
+        }
+        send_line(fd, line);
+        sent++;
+    }
+    protocol_format_scan_end(line, sizeof(line), q->snapshot);
+    send_line(fd, line);
+}
+
 /* Gửi nhiều dòng cho SCAN */
-/** @brief Xử lý command SCAN: gửi 0..N dòng RESP_DEVICE trực tiếp về client. */
-static void handle_scan(int fd) {
-    /* Neu user edit farm_state.json ben ngoai, SCAN se nap them cac thiet bi moi */
-    merge_farm_from_disk();
-
-    struct DeviceIdentity list[MAX_DEVICES];
-    size_t found = devices_scan(&g_devices, list, MAX_DEVICES);
-    if (found == 0) {
+/**
+ * @brief Xử lý command SCAN: gửi 0..N dòng RESP_DEVICE trực tiếp về client.
+ *
+ * `SCAN` không tham số giữ format cũ (không có dòng kết thúc); có tham số
+ * (`SINCE`, `coop=`, `limit=`, `cursor=`) thì chuyển sang `handle_scan_paged()`.
+ */
+static void handle_scan(int fd, char *args) {
+    struct ScanQuery q;
+    if (parse_scan_query(args, &q) != 0) {
+        char line[MAX_LINE_LEN];
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+
+    /* Neu user edit farm_state.json ben ngoai, SCAN se nap them cac thiet bi moi
+     * (chi o trang dau de cac trang sau khong phai doc lai file) */
+    if (!q.has_cursor) {
+        merge_farm_from_disk();
+    }
+
+    if (args && *args != '\0') {
+        handle_scan_paged(fd, &q);
+        return;
+    }
+
+    if (g_devices.count == 0) {
         char line[MAX_LINE_LEN];
         protocol_format_no_device_scan(line, sizeof(line));
         send_line(fd, line);
         return;
     }
-    for (size_t i = 0; i < found; ++i) {
+    for (size_t i = 0; i < g_devices.count; ++i) {
+        const struct DeviceIdentity *id = &g_devices.devices[i].identity;
         char line[MAX_LINE_LEN];
-        protocol_format_device_ex(line, sizeof(line), list[i].id, list[i].type, list[i].coop_id);
+        protocol_format_device_ex(line, sizeof(line), id->id, id->type, id->coop_id);
         send_line(fd, line);
     }
 }
 
-/** @brief Xử lý command COOPLIST: gửi 0..N dòng RESP_COOP trực tiếp về client. */
-static void handle_coop_list(int fd) {
-    if (g_coops.count == 0) {
-        char line[MAX_LINE_LEN];
+/**
+ * @brief Xử lý command COOPLIST: gửi 0..N dòng RESP_COOP trực tiếp về client.
+ *
+ * `COOPLIST [limit=N] [cursor=<index>]` phân trang theo index (chuồng không bị
+ * xoá nên index ổn định), kết thúc bằng COOP_MORE <cursor> hoặc COOP_END.
+ */
+static void handle_coop_list(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    struct ScanQuery q;
+    if (parse_scan_query(args, &q) != 0 || q.since_set || q.coop_id > 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    int paged = args && *args != '\0';
+    if (!paged && g_coops.count == 0) {
         protocol_format_no_coop(line, sizeof(line));
         send_line(fd, line);
         return;
     }
-    for (size_t i = 0; i < g_coops.count; ++i) {
-        char line[MAX_LINE_LEN];
+    size_t start = q.after_seq < g_coops.count ? (size_t)q.after_seq : g_coops.count;
+    size_t end = g_coops.count;
+    if (q.limit > 0 && end - start > q.limit) {
+        end = start + q.limit;
+    }
+    for (size_t i = start; i < end; ++i) {
         protocol_format_coop(line, sizeof(line), g_coops.coops[i].id, g_coops.coops[i].name);
         send_line(fd, line);
     }
+    if (!paged) return;
+    if (end < g_coops.count) {
+        protocol_format_coop_more(line, sizeof(line), end);
+    } else {
+        protocol_format_coop_end(line, sizeof(line));
+    }
+    send_line(fd, line);
+}
+
+/** @brief Buffer nhiều dòng response, gửi một lần sau khi duyệt xong. */
+struct BatchBody {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+/** @brief Nối một dòng vào body (ngăn cách bằng `\n`). */
+static int batch_body_append(struct BatchBody *body, const char *line) {
+    size_t line_len = strlen(line);
+    size_t need = body->len + line_len + 2;
+    if (need > body->cap) {
+        size_t cap = body->cap ? body->cap : MAX_LINE_LEN;
+        while (cap < need) cap *= 2;
+        char *grown = (char *)realloc(body->data, cap);
+        if (!grown) return -1;
+        body->data = grown;
+        body->cap = cap;
+    }
+    if (body->len > 0) body->data[body->len++] = '\n';
+    memcpy(body->data + body->len, line, line_len + 1);
+    body->len += line_len;
+    return 0;
+}
+
+/** @brief Một phần tử `<device_id>:<token>` trong MINFO/MCONTROL. */
+struct BatchTarget {
+    char id[MAX_ID_LEN];
+    char token[MAX_TOKEN_LEN];
+    struct Device *dev;
+    enum ResponseCode status;
+};
+
+/** @brief Phạm vi của một lệnh batch: danh sách cặp hoặc cả chuồng. */
+struct BatchScope {
+    int coop_id;  /* > 0 neu dang "COOP <id> <token>" */
+    struct BatchTarget targets[MAX_BATCH_DEVICES];
+    size_t count;
+};
+
+/**
+ * @brief Parse phạm vi batch: `COOP <coop_id> <token>` hoặc `<id>:<token> [<id>:<token> ...]`.
+ *
+ * Với dạng chuồng, token phải là session của một thiết bị thuộc chuồng đó.
+ * Với dạng danh sách, mỗi token được kiểm tra riêng; cặp sai được đánh dấu
+ * `RESP_NOT_CONNECTED` để trả về theo từng dòng thay vì huỷ cả lệnh.
+ *
+ * @return 0 nếu hợp lệ, `RESP_BAD_REQUEST`/`RESP_NOT_CONNECTED` nếu lỗi cả lệnh.
+ */
+static int parse_batch_scope(char *cursor, struct BatchScope *scope) {
+    memset(scope, 0, sizeof(*scope));
+    char *word = cmd_next_word(&cursor);
+    if (!word) return RESP_BAD_REQUEST;
+
+    if (strcmp(word, "COOP") == 0) {
+        char *id_str = cmd_next_word(&cursor);
+        char *token = cmd_next_word(&cursor);
+        if (!id_str || !token || cmd_next_word(&cursor)) return RESP_BAD_REQUEST;
+        int coop_id = atoi(id_str);
+        if (coop_id <= 0 || !coops_find(&g_coops, coop_id)) return RESP_BAD_REQUEST;
+        char validated[MAX_ID_LEN];
+        if (validate_session(token, validated) != 0) return RESP_NOT_CONNECTED;
+        const struct Device *owner = devices_find(&g_devices, validated);
+        if (!owner || owner->identity.coop_id != coop_id) return RESP_NOT_CONNECTED;
+        scope->coop_id = coop_id;
+        return 0;
+    }
+
+    for (; word; word = cmd_next_word(&cursor)) {
+        if (scope->count >= MAX_BATCH_DEVICES) return RESP_BAD_REQUEST;
+        char *sep = strchr(word, ':');
+        if (!sep || sep == word || sep[1] == '\0') return RESP_BAD_REQUEST;
+        *sep = '\0';
+        struct BatchTarget *t = &scope->targets[scope->count++];
+        strncpy(t->id, word, sizeof(t->id) - 1);
+        strncpy(t->token, sep + 1, sizeof(t->token) - 1);
+        char validated[MAX_ID_LEN];
+        if (validate_session(t->token, validated) != 0 || strncmp(validated, t->id, sizeof(validated)) != 0) {
+            t->status = RESP_NOT_CONNECTED;
+        } else {
+            t->status = RESP_NO_DEVICE; /* doi den khi tim thay trong g_devices */
+        }
+    }
+    return 0;
+}
+
+/** @brief Gán `dev` cho các target đã xác thực qua bảng băm ID của `g_devices`. */
+static void resolve_batch_targets(struct BatchScope *scope) {
+    for (size_t i = 0; i < scope->count; ++i) {
+        struct BatchTarget *t = &scope->targets[i];
+        if (t->status == RESP_NO_DEVICE) t->dev = devices_find(&g_devices, t->id);
+    }
+}
+
+/** @brief Gửi header + body của response batch rồi giải phóng body. */
+static void send_batch(int fd, const char *header, struct BatchBody *body) {
+    send_line(fd, header);
+    if (body->len > 0) {
+        send_line(fd, body->data);
+    }
+    free(body->data);
+}
+
+/**
+ * @brief Xử lý command MINFO: trả trạng thái nhiều thiết bị trong một response.
+ *
+ * Format: `MINFO COOP <coop_id> <token>` hoặc `MINFO <id>:<token> [...]`.
+ * Response: "135 MINFO_OK <n>" rồi n dòng "130 INFO_OK <json>" hoặc lỗi theo thiết bị.
+ */
+static void handle_minfo(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    struct BatchScope scope;
+    int rc = args ? parse_batch_scope(args, &scope) : RESP_BAD_REQUEST;
+    if (rc == RESP_NOT_CONNECTED) {
+        protocol_format_not_connected(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    if (rc != 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+
+    struct BatchBody body = {0};
+    size_t count = 0;
+    char json[MAX_JSON_LEN];
+    if (scope.coop_id > 0) {
+        const struct DeviceCoopList *members = devices_coop_list(&g_devices, scope.coop_id);
+        for (uint32_t k = members ? members->head : 0; k != 0; k = g_devices.devices[k - 1].coop_next) {
+            const struct Device *dev = &g_devices.devices[k - 1];
+            if (devices_info_json(dev, json, sizeof(json)) != 0 ||
+                protocol_format_info_ok(line, sizeof(line), json) != 0) {
+                protocol_format_device_result(line, sizeof(line), RESP_BAD_REQUEST, dev->identity.id);
+            }
+            if (batch_body_append(&body, line) == 0) count++;
+        }
+    } else {
+        resolve_batch_targets(&scope);
+        for (size_t i = 0; i < scope.count; ++i) {
+            const struct BatchTarget *t = &scope.targets[i];
+            if (!t->dev) {
+                protocol_format_device_result(line, sizeof(line), t->status, t->id);
+            } else if (devices_info_json(t->dev, json, sizeof(json)) != 0 ||
+                       protocol_format_info_ok(line, sizeof(line), json) != 0) {
+                protocol_format_device_result(line, sizeof(line), RESP_BAD_REQUEST, t->id);
+            }
+            if (batch_body_append(&body, line) == 0) count++;
+        }
+    }
+
+    char header[MAX_LINE_LEN];
+    protocol_format_minfo_ok(header, sizeof(header), count);
+    send_batch(fd, header, &body);
+}
+
+/** @brief Chỉ bật/tắt hàng loạt quạt và đèn sưởi khi dùng dạng `COOP`. */
+static int is_coop_climate_device(enum DeviceType type) {
+    return type == DEVICE_FAN || type == DEVICE_HEATER;
+}
+
+/**
+ * @brief Xử lý command MCONTROL: áp dụng một action ON/OFF cho nhiều thiết bị.
+ *
+ * Format: `MCONTROL <ON|OFF> COOP <coop_id> <token>` (mọi quạt/đèn sưởi trong chuồng)
+ * hoặc `MCONTROL <ON|OFF> <id>:<token> [...]`. Chỉ lưu farm một lần ở cuối lệnh.
+ * Response: "145 MCONTROL_OK <n>" rồi n dòng "140 CONTROL_OK <id>" hoặc lỗi theo thiết bị.
+ */
+static void handle_mcontrol(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    struct BatchScope scope;
+    char *cursor = args;
+    char *action = cursor ? cmd_next_word(&cursor) : NULL;
+    enum DevicePowerState state = DEVICE_OFF;
+    int rc = RESP_BAD_REQUEST;
+    if (action && (strcmp(action, "ON") == 0 || strcmp(action, "OFF") == 0)) {
+        state = strcmp(action, "ON") == 0 ? DEVICE_ON : DEVICE_OFF;
+        rc = parse_batch_scope(cursor, &scope);
+    }
+    if (rc == RESP_NOT_CONNECTED) {
+        protocol_format_not_connected(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    if (rc != 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+
+    struct BatchBody body = {0};
+    size_t count = 0;
+    size_t applied = 0;
+    if (scope.coop_id > 0) {
+        const struct DeviceCoopList *members = devices_coop_list(&g_devices, scope.coop_id);
+        for (uint32_t k = members ? members->head : 0; k != 0; k = g_devices.devices[k - 1].coop_next) {
+            struct Device *dev = &g_devices.devices[k - 1];
+            if (!is_coop_climate_device(dev->identity.type)) continue;
+            enum ResponseCode code = RESP_BAD_REQUEST;
+            if (devices_set_state(dev, state) == 0) {
+                code = RESP_CONTROL_OK;
+                applied++;
+                touch_device(dev);
+                log_device_event(dev->identity.id, action);
+            }
+            protocol_format_device_result(line, sizeof(line), code, dev->identity.id);
+            if (batch_body_append(&body, line) == 0) count++;
+        }
+    } else {
+        resolve_batch_targets(&scope);
+        for (size_t i = 0; i < scope.count; ++i) {
+            const struct BatchTarget *t = &scope.targets[i];
+            enum ResponseCode code = t->status;
+            if (t->dev) {
+                code = RESP_BAD_REQUEST;
+                if (devices_set_state(t->dev, state) == 0) {
+                    code = RESP_CONTROL_OK;
+                    applied++;
+                    touch_device(t->dev);
+                    log_device_event(t->id, action);
+                }
+            }
+            protocol_format_device_result(line, sizeof(line), code, t->id);
+            if (batch_body_append(&body, line) == 0) count++;
+        }
+    }
+    if (applied > 0) {
+        g_farm_save_pending = 1;
+    }
+
+    char header[MAX_LINE_LEN];
+    protocol_format_mcontrol_ok(header, sizeof(header), count);
+    send_batch(fd, header, &body);
+}
+
+void coop_logic_collect_gauges(struct MetricsGauges *gauges) {
+    memset(gauges, 0, sizeof(*gauges));
+    gauges->sessions = session_count();
+    gauges->devices = g_devices.count;
+    gauges->coops = g_coops.count;
+    gauges->log_queue = monitor_log_queue_depth();
+    gauges->events_dropped = server_events_dropped();
+    telemetry_udp_stats(&gauges->udp);
+    tsdb_get_stats(&g_history, &gauges->history);
+    req_arena_get_stats(&gauges->arena);
+    farm_snapshot_get_stats(&gauges->snapshot);
+    work_pool_get_stats(&gauges->pool);
+}
+
+/** @brief Trạng thái gom dòng STAT cho `metrics_render()`. */
+struct StatsBody {
+    struct BatchBody body;
+    size_t count;
+};
+
+static void emit_stat_line(const char *metric, void *user_data) {
+    struct StatsBody *stats = (struct StatsBody *)user_data;
+    char line[MAX_LINE_LEN];
+    if (protocol_format_stat(line, sizeof(line), metric) == 0 && batch_body_append(&stats->body, line) == 0) {
+        stats->count++;
+    }
+}
+
+/** @brief STATS: "175 STATS <n>" rồi n dòng "176 STAT <tên> <giá trị...>". */
+static void handle_stats(int fd) {
+    struct MetricsGauges gauges;
+    coop_logic_collect_gauges(&gauges);
+    struct StatsBody stats = {{0}, 0};
+    metrics_render(&gauges, emit_stat_line, &stats);
+
+    char header[MAX_LINE_LEN];
+    protocol_format_stats(header, sizeof(header), stats.count);
+    send_batch(fd, header, &stats.body);
+}
+
+unsigned long long coop_logic_state_version(void) {
+    return g_state_version;
+}
+
+/** @brief Cặp coop_id -> vị trí hàng đếm, sắp theo id để tìm nhị phân. */
+struct CoopRow {
+    int coop_id;
+    size_t row;
+};
+
+static int compare_coop_row(const void *a, const void *b) {
+    int x = ((const struct CoopRow *)a)->coop_id;
+    int y = ((const struct CoopRow *)b)->coop_id;
+    return (x > y) - (x < y);
+}
+
+int coop_logic_visit_device_counts(void (*visit)(int coop_id, enum DeviceType type, size_t count, void *user_data),
+                                   void *user_data) {
+    /* Hang 0: thiet bi chua gan chuong (hoac chuong khong con), hang i+1: g_coops.coops[i] */
+    size_t types = (size_t)DEVICE_UNKNOWN + 1;
+    size_t rows = g_coops.count + 1;
+    size_t *counts = (size_t *)calloc(rows * types, sizeof(*counts));
+    struct CoopRow *index = (struct CoopRow *)malloc((g_coops.count ? g_coops.count : 1) * sizeof(*index));
+    if (!counts || !index) {
+        free(counts);
+        free(index);
+        return -1;
+    }
+    for (size_t i = 0; i < g_coops.count; ++i) {
+        index[i].coop_id = g_coops.coops[i].id;
+        index[i].row = i + 1;
+    }
+    qsort(index, g_coops.count, sizeof(*index), compare_coop_row);
+
+    for (size_t i = 0; i < g_devices.count; ++i) {
+        const struct DeviceIdentity *id = &g_devices.devices[i].identity;
+        struct CoopRow key = { id->coop_id, 0 };
+        const struct CoopRow *hit = g_coops.count
+            ? (const struct CoopRow *)bsearch(&key, index, g_coops.count, sizeof(*index), compare_coop_row)
+            : NULL;
+        size_t type = (size_t)id->type < types ? (size_t)id->type : (size_t)DEVICE_UNKNOWN;
+        counts[(hit ? hit->row : 0) * types + type]++;
+    }
+
+    for (size_t r = 0; r < rows; ++r) {
+        int coop_id = r == 0 ? 0 : g_coops.coops[r - 1].id;
+        for (size_t t = 0; t < types; ++t) {
+            if (counts[r * types + t] > 0) {
+                visit(coop_id, (enum DeviceType)t, counts[r * types + t], user_data);
+            }
+        }
+    }
+    free(counts);
+    free(index);
+    return 0;
+}
+
+static void emit_dump_line(const char *metric, void *user_data) {
+    (void)user_data;
+    printf("[stats] %s\n", metric);
+}
+
+void coop_logic_dump_stats(void) {
+    struct MetricsGauges gauges;
+    coop_logic_collect_gauges(&gauges);
+    metrics_render(&gauges, emit_dump_line, NULL);
+    fflush(stdout);
+}
+
+/**
+ * @brief SUBSCRIBE: theo dõi thay đổi của thiết bị/chuồng trên kết nối hiện tại.
+ *
+ * Cú pháp như MINFO: `SUBSCRIBE COOP <coop_id> <token>` hoặc `SUBSCRIBE <id>:<token> [...]`.
+ * Sau đó server push "116 EVENT <id> <json>" (trạng thái mới nhất, đã gộp) và
+ * "117 EVENT_GONE <id>" khi thiết bị bị xoá.
+ */
+static char *handle_subscribe(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    struct BatchScope scope;
+    int rc = args ? parse_batch_scope(args, &scope) : RESP_BAD_REQUEST;
+    if (rc == RESP_NOT_CONNECTED) {
+        protocol_format_not_connected(line, sizeof(line));
+        return alloc_line(line);
+    }
+    if (rc != 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        return alloc_line(line);
+    }
+
+    int active = 0;
+    if (scope.coop_id > 0) {
+        active = server_subscribe(fd, INTERN_EMPTY, scope.coop_id);
+    } else {
+        resolve_batch_targets(&scope);
+        /* Kiem tra het truoc: mot thiet bi loi thi khong dang ky thiet bi nao */
+        for (size_t i = 0; i < scope.count; ++i) {
+            if (!scope.targets[i].dev) {
+                protocol_format_device_result(line, sizeof(line), scope.targets[i].status, scope.targets[i].id);
+                return alloc_line(line);
+            }
+        }
+        for (size_t i = 0; i < scope.count && active >= 0; ++i) {
+            active = server_subscribe(fd, scope.targets[i].dev->id_handle, 0);
+        }
+    }
+    if (active < 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        return alloc_line(line);
+    }
+    protocol_format_subscribe_ok(line, sizeof(line), (size_t)active);
+    return alloc_line(line);
+}
+
+/**
+ * @brief UNSUBSCRIBE [COOP <coop_id> | <id>[:<token>] ...]: bỏ subscription; không tham số thì bỏ hết.
+ */
+static char *handle_unsubscribe(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    char *cursor = args ? args : "";
+    char *word = cmd_next_word(&cursor);
+    int remaining = 0;
+    if (!word) {
+        remaining = server_unsubscribe(fd, NULL, 0);
+    } else if (strcmp(word, "COOP") == 0) {
+        char *id_str = cmd_next_word(&cursor);
+        int coop_id = id_str ? atoi(id_str) : 0;
+        if (coop_id <= 0) {
+            protocol_format_bad_request(line, sizeof(line));
+            return alloc_line(line);
+        }
+        remaining = server_unsubscribe(fd, NULL, coop_id);
+    } else {
+        for (; word && remaining >= 0; word = cmd_next_word(&cursor)) {
+            char *sep = strchr(word, ':');
+            if (sep) *sep = '\0';
+            if (word[0] == '\0') continue;
+            remaining = server_unsubscribe(fd, word, 0);
+        }
+    }
+    if (remaining < 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        return alloc_line(line);
+    }
+    protocol_format_unsubscribe_ok(line, sizeof(line), (size_t)remaining);
+    return alloc_line(line);
+}
+
+/**
+ * @brief Áp dụng một bản ghi số đo cho thiết bị đã xác thực.
+ *
+ * Thiết bị đổi giá trị được đánh dấu version mới và farm được đánh dấu bẩn;
+ * cảm biến đổi giá trị thì chuồng của nó được thêm vào `coops` (không trùng)
+ * để caller đánh giá bộ điều khiển khí hậu một lần sau cả batch.
+ *
+ * @return `RESP_REPORT_OK` hoặc mã lỗi theo thiết bị.
+ */
+static enum ResponseCode apply_report(struct Device *dev, const char *readings, size_t len,
+                                      int *coops, size_t *coop_count, size_t coop_cap) {
+    struct TelemetryReading reading;
+    if (telemetry_parse_readings(readings, len, &reading) != 0) {
+        return RESP_BAD_REQUEST;
+    }
+    int rc = telemetry_apply(dev, &reading);
+    if (rc < 0) {
+        return RESP_BAD_REQUEST;
+    }
+    /* Lich su ghi ca khi gia tri khong doi (nen Gorilla gan nhu mien phi) */
+    record_reading(dev, reading.fields);
+    if (rc == 0) {
+        return RESP_REPORT_OK;
+    }
+    touch_device(dev);
+    g_farm_dirty = 1;
+    int coop_id = dev->identity.coop_id;
+    if (dev->identity.type == DEVICE_SENSOR && coop_id > 0) {
+        size_t i = 0;
+        while (i < *coop_count && coops[i] != coop_id) i++;
+        if (i == *coop_count) {
+            if (*coop_count == coop_cap) {
+                /* Het cho: danh gia ngay cac chuong dang gom */
+                for (size_t j = 0; j < *coop_count; ++j) (void)evaluate_climate(coops[j]);
+                *coop_count = 0;
+            }
+            coops[(*coop_count)++] = coop_id;
+        }
+    }
+    return RESP_REPORT_OK;
+}
+
+/* Chuong cho danh gia khi hau sau mot dot datagram UDP */
+static int g_ingest_coops[64];
+static size_t g_ingest_coop_count;
+
+enum TelemetryVerdict coop_logic_ingest_datagram(const char *buf, size_t len) {
+    struct TelemetryDatagram dg;
+    if (telemetry_parse_datagram(buf, len, &dg) != 0) {
+        return TELEMETRY_PARSE_ERROR;
+    }
+    struct Device *dev = devices_find(&g_devices, dg.id);
+    if (!dev) {
+        return TELEMETRY_UNKNOWN_DEVICE;
+    }
+    unsigned char key[16];
+    telemetry_device_key(dev->cold->password, key);
+    if (!telemetry_tag_equal(telemetry_siphash24(key, buf, dg.signed_len), dg.tag)) {
+        return TELEMETRY_AUTH_FAILED;
+    }
+    /* Chi kiem tra counter sau khi xac thuc, de datagram gia khong day duoc counter len */
+    if (dg.counter <= dev->telemetry_counter) {
+        return TELEMETRY_REPLAY;
+    }
+    dev->telemetry_counter = dg.counter;
+    /* Counter duoc luu cung farm (khong nang version: snapshot khong doi) */
+    g_farm_dirty = 1;
+    if (apply_report(dev, dg.readings, dg.readings_len, g_ingest_coops, &g_ingest_coop_count,
+                     sizeof(g_ingest_coops) / sizeof(g_ingest_coops[0])) != RESP_REPORT_OK) {
+        return TELEMETRY_REJECTED;
+    }
+    return TELEMETRY_APPLIED;
+}
+
+void coop_logic_ingest_end(void) {
+    for (size_t i = 0; i < g_ingest_coop_count; ++i) {
+        (void)evaluate_climate(g_ingest_coops[i]);
+    }
+    g_ingest_coop_count = 0;
+}
+
+/**
+ * @brief Xử lý command REPORT: `REPORT <id> <token> <key>=<value>[,| ]...`.
+ *
+ * Không ghi file ngay và không ghi log theo từng số đo; farm được lưu gom bởi
+ * `coop_logic_tick()`.
+ */
+static char *handle_report(char *args) {
+    char line[MAX_LINE_LEN];
+    char *cursor = args;
+    char *dev_id = cursor ? cmd_next_word(&cursor) : NULL;
+    char *token = dev_id ? cmd_next_word(&cursor) : NULL;
+    if (!token || !cursor || *cursor == '\0') {
+        protocol_format_bad_request(line, sizeof(line));
+        return alloc_line(line);
+    }
+    char validated[MAX_ID_LEN];
+    if (validate_session(token, validated) != 0 || strncmp(validated, dev_id, sizeof(validated)) != 0) {
+        protocol_format_not_connected(line, sizeof(line));
+        return alloc_line(line);
+    }
+    struct Device *dev = devices_find(&g_devices, dev_id);
+    if (!dev) {
+        protocol_format_no_device_err(line, sizeof(line));
+        return alloc_line(line);
+    }
+    int coop_id = 0;
+    size_t coop_count = 0;
+    if (apply_report(dev, cursor, strlen(cursor), &coop_id, &coop_count, 1) != RESP_REPORT_OK) {
+        protocol_format_bad_request(line, sizeof(line));
+        return alloc_line(line);
+    }
+    if (coop_count > 0) {
+        (void)evaluate_climate(coop_id);
+    }
+    protocol_format_report_ok(line, sizeof(line));
+    return alloc_line(line);
+}
+
+/**
+ * @brief Xử lý command MREPORT: nhiều bản ghi số đo trong một dòng.
+ *
+ * Format: `MREPORT <id>:<token> <readings> [<id>:<token> <readings> ...]` hoặc
+ * `MREPORT COOP <coop_id> <token> <id> <readings> [...]` (gateway của chuồng,
+ * token là session của một thiết bị trong chuồng). `<readings>` là một từ,
+ * các cặp ngăn cách bằng dấu phẩy (vd `t=25.1,h=61`).
+ * Response: "156 MREPORT_OK <applied> <failed>" rồi `failed` dòng lỗi theo thiết bị.
+ */
+static void handle_mreport(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    char *cursor = args;
+    char *word = cursor ? cmd_next_word(&cursor) : NULL;
+    if (!word) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+
+    int scope_coop = 0;
+    if (strcmp(word, "COOP") == 0) {
+        char *id_str = cmd_next_word(&cursor);
+        char *token = id_str ? cmd_next_word(&cursor) : NULL;
+        int coop_id = id_str ? atoi(id_str) : 0;
+        char validated[MAX_ID_LEN];
+        if (!token || coop_id <= 0) {
+            protocol_format_bad_request(line, sizeof(line));
+            send_line(fd, line);
+            return;
+        }
+        const struct Device *owner = validate_session(token, validated) == 0 ? devices_find(&g_devices, validated) : NULL;
+        if (!owner || owner->identity.coop_id != coop_id) {
+            protocol_format_not_connected(line, sizeof(line));
+            send_line(fd, line);
+            return;
+        }
+        scope_coop = coop_id;
+        word = cmd_next_word(&cursor);
+    }
+
+    struct BatchBody body = {0};
+    int coops[64];
+    size_t coop_count = 0;
+    size_t applied = 0, failed = 0;
+    const char *last_token = NULL;
+    char last_validated[MAX_ID_LEN] = "";
+    for (; word; word = cmd_next_word(&cursor)) {
+        char *readings = cmd_next_word(&cursor);
+        enum ResponseCode code = RESP_BAD_REQUEST;
+        char *id = word;
+        struct Device *dev = NULL;
+        if (scope_coop > 0) {
+            dev = devices_find(&g_devices, id);
+            code = (dev && dev->identity.coop_id == scope_coop) ? RESP_REPORT_OK : RESP_NO_DEVICE;
+        } else {
+            char *sep = strchr(word, ':');
+            if (sep && sep != word && sep[1] != '\0') {
+                *sep = '\0';
+                const char *token = sep + 1;
+                /* Gateway thuong gui nhieu ban ghi cung token: chi xac thuc lai khi token doi */
+                if (!last_token || strcmp(last_token, token) != 0) {
+                    if (validate_session(token, last_validated) != 0) last_validated[0] = '\0';
+                    last_token = token;
+                }
+                if (strncmp(last_validated, id, sizeof(last_validated)) != 0) {
+                    code = RESP_NOT_CONNECTED;
+                } else {
+                    dev = devices_find(&g_devices, id);
+                    code = dev ? RESP_REPORT_OK : RESP_NO_DEVICE;
+                }
+            }
+        }
+        if (code == RESP_REPORT_OK) {
+            code = readings ? apply_report(dev, readings, strlen(readings), coops, &coop_count,
+                                           sizeof(coops) / sizeof(coops[0]))
+                            : RESP_BAD_REQUEST;
+        }
+        if (code == RESP_REPORT_OK) {
+            applied++;
+            continue;
+        }
+        protocol_format_device_result(line, sizeof(line), code, id);
+        if (batch_body_append(&body, line) == 0) failed++;
+        if (!readings) break;
+    }
+    for (size_t i = 0; i < coop_count; ++i) {
+        (void)evaluate_climate(coops[i]);
+    }
+
+    char header[MAX_LINE_LEN];
+    protocol_format_mreport_ok(header, sizeof(header), applied, failed);
+    send_batch(fd, header, &body);
+}
+
+/**
+ * @brief Xử lý command HISTORY: `HISTORY <device> <metric> <from> <to> <step>`.
+ *
+ * `from`/`to` là epoch giây, `step` là độ rộng bucket (giây, căn theo epoch).
+ * Response: "136 HISTORY <n>" rồi n dòng "137 POINT <start> <min> <max> <avg> <count>"
+ * cho các bucket có dữ liệu.
+ */
+static void handle_history(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    char *cursor = args;
+    char *id = cursor ? cmd_next_word(&cursor) : NULL;
+    char *metric_str = id ? cmd_next_word(&cursor) : NULL;
+    char *from_str = metric_str ? cmd_next_word(&cursor) : NULL;
+    char *to_str = from_str ? cmd_next_word(&cursor) : NULL;
+    char *step_str = to_str ? cmd_next_word(&cursor) : NULL;
+    unsigned long long from = 0, to = 0, step = 0;
+    int metric = tsdb_metric_from_string(metric_str);
+    if (!step_str || cmd_next_word(&cursor) || metric < 0 || cmd_parse_ull(from_str, &from) != 0 ||
+        cmd_parse_ull(to_str, &to) != 0 || cmd_parse_ull(step_str, &step) != 0 || step == 0 || to < from ||
+        to > (unsigned long long)INT64_MAX || (to - from) / step + 1 > HISTORY_MAX_POINTS) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    if (!devices_find(&g_devices, id)) {
+        protocol_format_no_device_err(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+
+    struct TsdbBucket *buckets = (struct TsdbBucket *)req_arena_alloc((HISTORY_MAX_POINTS + 1) * sizeof(*buckets));
+    long n = buckets ? tsdb_aggregate(&g_history, id, (enum TsdbMetric)metric, (int64_t)from, (int64_t)to,
+                                      (int64_t)step, buckets, HISTORY_MAX_POINTS + 1)
+                     : -2;
+    if (n == -2) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    struct BatchBody body = {0};
+    size_t count = 0;
+    for (long i = 0; i < n; ++i) {
+        const struct TsdbBucket *b = &buckets[i];
+        if (b->count == 0) continue;
+        if (protocol_format_point(line, sizeof(line), (long long)b->start, b->min, b->max,
+                                  b->sum / (double)b->count, b->count) == 0 &&
+            batch_body_append(&body, line) == 0) {
+            count++;
+        }
+    }
+    char header[MAX_LINE_LEN];
+    protocol_format_history(header, sizeof(header), count);
+    send_batch(fd, header, &body);
+}
+
+/** @brief Ghi một số vào JSON; NAN (chuồng không có cảm biến) thành `null`. */
+static int append_json_number(char *out, size_t len, size_t *pos, const char *key, double value) {
+    int written = isnan(value) ? snprintf(out + *pos, len - *pos, ",\"%s\":null", key)
+                               : snprintf(out + *pos, len - *pos, ",\"%s\":%.2f", key, value);
+    if (written < 0 || (size_t)written >= len - *pos) return -1;
+    *pos += (size_t)written;
+    return 0;
+}
+
+/**
+ * @brief Xử lý command COOPSTATS: số liệu tổng hợp của một chuồng.
+ *
+ * Format: `COOPSTATS <coop_id>`. Response: "195 COOPSTATS <json>" với số thiết bị
+ * theo loại, số actuator đang bật, min/max/avg nhiệt độ và độ ẩm, tổng số trứng.
+ */
+static char *handle_coopstats(char *args) {
+    char line[MAX_LINE_LEN];
+    char *cursor = args;
+    char *coop_str = cursor ? cmd_next_word(&cursor) : NULL;
+    unsigned long long coop_id = 0;
+    if (!coop_str || cmd_next_word(&cursor) || cmd_parse_ull(coop_str, &coop_id) != 0 || coop_id == 0 ||
+        coop_id > INT32_MAX) {
+        protocol_format_bad_request(line, sizeof(line));
+        return alloc_line(line);
+    }
+    if (!coops_find(&g_coops, (int)coop_id)) {
+        protocol_format_no_coop(line, sizeof(line));
+        return alloc_line(line);
+    }
+    struct CoopStats stats;
+    if (coop_stats_query(&g_coop_stats, &g_devices, (int)coop_id, &stats) != 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        return alloc_line(line);
+    }
+
+    char json[MAX_JSON_LEN];
+    size_t pos = 0;
+    int failed = 0;
+    int written = snprintf(json, sizeof(json), "{\"coop_id\":%d", stats.coop_id);
+    if (written < 0 || (size_t)written >= sizeof(json)) failed = 1;
+    else pos = (size_t)written;
+    for (int k = 0; k < COOP_STATS_KIND_COUNT && !failed; ++k) {
+        const char *name = coop_stats_kind_name((enum CoopStatsKind)k);
+        written = k >= COOP_STATS_FEEDER
+                      ? snprintf(json + pos, sizeof(json) - pos, ",\"%s\":%zu,\"%s_on\":%zu", name,
+                                 stats.devices[k], name, stats.devices_on[k])
+                      : snprintf(json + pos, sizeof(json) - pos, ",\"%s\":%zu", name, stats.devices[k]);
+        if (written < 0 || (size_t)written >= sizeof(json) - pos) failed = 1;
+        else pos += (size_t)written;
+    }
+    failed = failed || append_json_number(json, sizeof(json), &pos, "temp_min", stats.temp_min) != 0 ||
+             append_json_number(json, sizeof(json), &pos, "temp_max", stats.temp_max) != 0 ||
+             append_json_number(json, sizeof(json), &pos, "temp_avg", stats.temp_avg) != 0 ||
+             append_json_number(json, sizeof(json), &pos, "hum_min", stats.hum_min) != 0 ||
+             append_json_number(json, sizeof(json), &pos, "hum_max", stats.hum_max) != 0 ||
+             append_json_number(json, sizeof(json), &pos, "hum_avg", stats.hum_avg) != 0;
+    if (!failed) {
+        written = snprintf(json + pos, sizeof(json) - pos, ",\"eggs_total\":%.0f}", stats.eggs_total);
+        failed = written < 0 || (size_t)written >= sizeof(json) - pos;
+    }
+    if (failed || protocol_format_coopstats(line, sizeof(line), json) != 0) {
+        protocol_format_bad_request(line, sizeof(line));
+    }
+    return alloc_line(line);
+}
+
+/** @brief Callback của `device_import_apply()`: thiết bị mới như sau ADD (trừ hook thay đổi). */
+static void on_device_imported(struct Device *dev, void *user_data) {
+    (void)user_data;
+    touch_device(dev);
+    (void)scheduler_sync_device(&g_scheduler, dev, time(NULL));
+    server_publish_device_change(dev->id_handle, dev->identity.coop_id);
+    log_device_event(dev->identity.id, "IMPORT_DEVICE");
+}
+
+/**
+ * @brief Xử lý command IMPORT: thêm danh sách thiết bị lớn trong một lô.
+ *
+ * `IMPORT BEGIN [coop_id]` mở lô (`coop_id`: chuồng cho bản ghi thiếu coop_id
+ * hoặc 0); thread mạng chuyển mọi dòng tiếp theo tới `IMPORT END` thành dòng
+ * dữ liệu, NDJSON hoặc mảng JSON như `scan_devices.json` (xem device_import.h).
+ * Lúc END cả lô được kiểm tra và chèn một lần, farm được lưu một lần cùng lô
+ * (group commit) thay vì một lần mỗi ADD. Đóng kết nối là huỷ lô.
+ * Response: BEGIN -> "185 IMPORT_READY"; END -> "186 IMPORT_OK <added> <failed>"
+ * rồi `failed` dòng lỗi theo bản ghi; lô hỏng (cú pháp, quá `IMPORT_MAX_RECORDS`)
+ * hoặc END không có lô -> 400, không chèn gì. BEGIN bị từ chối (400) thì kết
+ * nối vẫn ở chế độ lệnh: thread mạng giữ các dòng sau BEGIN tới khi có kết quả.
+ */
+static void handle_import(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    char *cursor = args;
+    char *word = cursor ? cmd_next_word(&cursor) : NULL;
+    struct DeviceImport **pending = fd >= 0 && fd < MAX_DEVICES ? &g_imports[fd] : NULL;
+    if (word && pending && !*pending && strcmp(word, "BEGIN") == 0) {
+        char *coop_str = cmd_next_word(&cursor);
+        unsigned long long coop_id = 0;
+        if ((coop_str && (cmd_parse_ull(coop_str, &coop_id) != 0 || coop_id == 0 || coop_id > INT_MAX ||
+                          !coops_find(&g_coops, (int)coop_id))) ||
+            cmd_next_word(&cursor) || !(*pending = (struct DeviceImport *)malloc(sizeof(**pending)))) {
+            protocol_format_bad_request(line, sizeof(line));
+            send_line(fd, line);
+            return;
+        }
+        device_import_init(*pending, (int)coop_id);
+        protocol_format_import_ready(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    if (!word || !pending || !*pending || strcmp(word, "END") != 0 || cmd_next_word(&cursor)) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+
+    struct DeviceImport *imp = *pending;
+    *pending = NULL;
+    if (device_import_finish(imp) != 0) {
+        device_import_free(imp);
+        free(imp);
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    size_t added = device_import_apply(imp, &g_coops, &g_devices, on_device_imported, NULL);
+    if (added > 0) {
+        /* Chi so theo chuong dung lai mot lan cho ca lo */
+        climate_invalidate(&g_climate);
+        coop_stats_invalidate(&g_coop_stats);
+        g_farm_save_pending = 1;
+    }
+    struct BatchBody body = {0};
+    size_t failed = 0;
+    for (size_t i = 0; i < imp->count; ++i) {
+        const struct DeviceImportRecord *rec = &imp->records[i];
+        if (rec->status == 0) continue;
+        protocol_format_device_result(line, sizeof(line), (enum ResponseCode)rec->status, rec->id);
+        if (batch_body_append(&body, line) == 0) failed++;
+    }
+    device_import_free(imp);
+    free(imp);
+
+    char header[MAX_LINE_LEN];
+    protocol_format_import_ok(header, sizeof(header), added, failed);
+    send_batch(fd, header, &body);
+}
+
+void coop_logic_import_line(int conn, const char *line) {
+    /* Thread mang chi gui dong du lieu sau khi BEGIN duoc nhan; lo da bi huy thi bo dong */
+    if (conn >= 0 && conn < MAX_DEVICES && g_imports[conn]) {
+        (void)device_import_feed(g_imports[conn], line, strlen(line));
+    }
+}
+
+void coop_logic_import_drop(int conn) {
+    if (conn >= 0 && conn < MAX_DEVICES && g_imports[conn]) {
+        device_import_free(g_imports[conn]);
+        free(g_imports[conn]);
+        g_imports[conn] = NULL;
+    }
+}
+
+/**
+ * @brief Xử lý command EXPORT: `EXPORT [coop=<id>] [limit=N] [cursor=<seq>]`.
+ *
+ * Mỗi thiết bị một dòng "187 RECORD <json>" theo thứ tự thêm vào, json cùng
+ * schema với IMPORT nhưng không có `password`: lệnh không cần session nên
+ * không được lộ credential (xuất đủ mật khẩu chỉ qua tool offline). Mỗi trang tối
+ * đa `limit` dòng (mặc định và trần `SCAN_PAGE_MAX`), kết thúc bằng
+ * "188 EXPORT_MORE <cursor>" hoặc "189 EXPORT_END <n>".
+ */
+static void handle_export(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    struct ScanQuery q;
+    if (parse_scan_query(args, &q) != 0 || q.since_set) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    if (q.coop_id > 0 && !coops_find(&g_coops, q.coop_id)) {
+        protocol_format_no_coop(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    size_t limit = q.limit > 0 ? q.limit : SCAN_PAGE_MAX;
+    size_t sent = 0;
+    unsigned long long last_seq = q.after_seq;
+    char json[MAX_JSON_LEN];
+    for (uint32_t k = page_first(q.coop_id, q.after_seq); k != 0; k = page_next(q.coop_id, k)) {
+        const struct Device *dev = &g_devices.devices[k - 1];
+        if (sent == limit) {
+            protocol_format_export_more(line, sizeof(line), last_seq);
+            send_line(fd, line);
+            return;
+        }
+        last_seq = dev->seq;
+        if (device_import_format(dev, 0, json, sizeof(json)) != 0 ||
+            protocol_format_record(line, sizeof(line), json) != 0) {
+            protocol_format_device_result(line, sizeof(line), RESP_BAD_REQUEST, dev->identity.id);
+        }
+        send_line(fd, line);
+        sent++;
+    }
+    protocol_format_export_end(line, sizeof(line), sent);
+    send_line(fd, line);
+}
+
+/**
+ * @brief Xử lý command COOPDEVICES: thiết bị của một chuồng, O(số thiết bị của chuồng).
+ *
+ * Format: `COOPDEVICES <coop_id> [limit=N] [cursor=<seq>]`. Đi theo danh sách
+ * chuồng của devices.c thay vì lọc cả registry. Response: "196 COOPDEVICES <n> <next>"
+ * rồi n dòng "110 DEVICE <id> <type> <coop_id>" theo thứ tự thêm vào; `next`
+ * là cursor cho trang tiếp, 0 nếu hết. Mỗi trang tối đa `limit` dòng (mặc
+ * định và trần `SCAN_PAGE_MAX`).
+ */
+static void handle_coop_devices(int fd, char *args) {
+    char line[MAX_LINE_LEN];
+    char *cursor = args;
+    char *coop_str = cursor ? cmd_next_word(&cursor) : NULL;
+    unsigned long long coop_id = 0;
+    struct ScanQuery q;
+    if (!coop_str || cmd_parse_ull(coop_str, &coop_id) != 0 || coop_id == 0 || coop_id > INT32_MAX ||
+        parse_scan_query(cursor, &q) != 0 || q.since_set || q.coop_id > 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    if (!coops_find(&g_coops, (int)coop_id)) {
+        protocol_format_no_coop(line, sizeof(line));
+        send_line(fd, line);
+        return;
+    }
+    size_t limit = q.limit > 0 ? q.limit : SCAN_PAGE_MAX;
+    struct BatchBody body = {0};
+    size_t count = 0;
+    unsigned long long last_seq = q.after_seq, next = 0;
+    for (uint32_t k = page_first((int)coop_id, q.after_seq); k != 0; k = page_next((int)coop_id, k)) {
+        const struct Device *dev = &g_devices.devices[k - 1];
+        if (count == limit) {
+            next = last_seq;
+            break;
+        }
+        last_seq = dev->seq;
+        protocol_format_device_ex(line, sizeof(line), dev->identity.id, dev->identity.type, dev->identity.coop_id);
+        if (batch_body_append(&body, line) == 0) count++;
+    }
+    char header[MAX_LINE_LEN];
+    protocol_format_coopdevices(header, sizeof(header), count, next);
+    send_batch(fd, header, &body);
 }
 
 /**
@@ -143,11 +1619,43 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
     char line[MAX_LINE_LEN];
     switch (cmd) {
     case CMD_SCAN:
-        handle_scan(fd);
+        handle_scan(fd, args);
         return NULL;
     case CMD_COOP_LIST:
-        handle_coop_list(fd);
+        handle_coop_list(fd, args);
+        return NULL;
+    case CMD_MINFO:
+        handle_minfo(fd, args);
+        return NULL;
+    case CMD_MCONTROL:
+        handle_mcontrol(fd, args);
+        return NULL;
+    case CMD_STATS:
+        handle_stats(fd);
+        return NULL;
+    case CMD_REPORT:
+        return handle_report(args);
+    case CMD_MREPORT:
+        handle_mreport(fd, args);
+        return NULL;
+    case CMD_HISTORY:
+        handle_history(fd, args);
+        return NULL;
+    case CMD_COOPSTATS:
+        return handle_coopstats(args);
+    case CMD_IMPORT:
+        handle_import(fd, args);
+        return NULL;
+    case CMD_EXPORT:
+        handle_export(fd, args);
+        return NULL;
+    case CMD_COOPDEVICES:
+        handle_coop_devices(fd, args);
         return NULL;
+    case CMD_SUBSCRIBE:
+        return handle_subscribe(fd, args);
+    case CMD_UNSUBSCRIBE:
+        return handle_unsubscribe(fd, args);
     case CMD_COOP_ADD: {
         if (!args || args[0] == '\0') {
             protocol_format_bad_request(line, sizeof(line));
@@ -158,7 +1666,9 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
             protocol_format_bad_request(line, sizeof(line));
             return alloc_line(line);
         }
-        (void)storage_save_farm(&g_coops, &g_devices, FARM_STATE_PATH);
+        bump_state_version();
+        g_snapshot_coops_dirty = 1;
+        g_farm_save_pending = 1;
         protocol_format_coopadd_ok(line, sizeof(line), new_id);
         return alloc_line(line);
     }
@@ -174,7 +1684,7 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
             protocol_format_no_device_err(line, sizeof(line));
             return alloc_line(line);
         }
-        if (strncmp(dev->password, password, sizeof(dev->password)) != 0) {
+        if (strncmp(dev->cold->password, password, sizeof(dev->cold->password)) != 0) {
             protocol_format_wrong_password(line, sizeof(line));
             return alloc_line(line);
         }
@@ -281,8 +1791,12 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
             protocol_format_bad_request(line, sizeof(line));
             return alloc_line(line);
         }
+        touch_device(dev);
+        if (strcmp(action, "FEED_NOW") == 0 || strcmp(action, "DRINK_NOW") == 0) {
+            record_dispense(dev);
+        }
         log_device_event(dev_id, action);
-        (void)storage_save_farm(&g_coops, &g_devices, FARM_STATE_PATH);
+        g_farm_save_pending = 1;
         protocol_format_control_ok(line, sizeof(line));
         return alloc_line(line);
     }
@@ -334,7 +1848,7 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
                 return alloc_line(line);
             }
             json_decref(payload);
-            rc = devices_set_config_heater(dev, Tmin, Tp2, dev->data.heater.mode);
+            rc = devices_set_config_heater(dev, Tmin, Tp2, INTERN_EMPTY);
         } else if (dev->identity.type == DEVICE_SPRAYER) {
             json_t *payload = parse_payload_object(json_payload);
             double Hmin = 0.0, Hp = 0.0, Vh = 0.0;
@@ -359,7 +1873,7 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
                 return alloc_line(line);
             }
             json_decref(payload);
-            rc = devices_set_config_feeder(dev, W, Vw, dev->data.feeder.schedule, dev->data.feeder.schedule_count);
+            rc = devices_set_config_feeder(dev, W, Vw, dev->cold->data.feeder.schedule, dev->cold->data.feeder.schedule_count);
         } else if (dev->identity.type == DEVICE_DRINKER) {
             json_t *payload = parse_payload_object(json_payload);
             double Vw = 0.0;
@@ -369,17 +1883,24 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
                 return alloc_line(line);
             }
             json_decref(payload);
-            rc = devices_set_config_drinker(dev, Vw, dev->data.drinker.schedule, dev->data.drinker.schedule_count);
+            rc = devices_set_config_drinker(dev, Vw, dev->cold->data.drinker.schedule, dev->cold->data.drinker.schedule_count);
         }
         if (rc != 0) {
             protocol_format_bad_request(line, sizeof(line));
             return alloc_line(line);
         }
+        touch_device(dev);
+        if (dev->identity.type == DEVICE_FEEDER || dev->identity.type == DEVICE_DRINKER) {
+            (void)scheduler_sync_device(&g_scheduler, dev, time(NULL));
+        } else if (dev->identity.type == DEVICE_HEATER || dev->identity.type == DEVICE_SPRAYER) {
+            /* Nguong moi co the lam doi trang thai ngay, tra ve JSON sau khi danh gia */
+            (void)evaluate_climate(dev->identity.coop_id);
+        }
         char json[MAX_JSON_LEN];
         devices_info_json(dev, json, sizeof(json));
         protocol_format_setcfg_ok(line, sizeof(line), json);
         log_device_event(dev_id, "SETCFG");
-        (void)storage_save_farm(&g_coops, &g_devices, FARM_STATE_PATH);
+        g_farm_save_pending = 1;
         return alloc_line(line);
     }
     case CMD_CHPASS: {
@@ -402,8 +1923,9 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
             protocol_format_wrong_password(line, sizeof(line));
             return alloc_line(line);
         }
+        touch_device(dev);
         log_device_event(dev_id, "CHPASS");
-        (void)storage_save_farm(&g_coops, &g_devices, FARM_STATE_PATH);
+        g_farm_save_pending = 1;
         protocol_format_pass_ok(line, sizeof(line));
         return alloc_line(line);
     }
@@ -448,7 +1970,11 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
             protocol_format_bad_request(line, sizeof(line));
             return alloc_line(line);
         }
-        (void)storage_save_farm(&g_coops, &g_devices, FARM_STATE_PATH);
+        struct Device *added = devices_find(&g_devices, dev_id);
+        touch_device(added);
+        (void)scheduler_sync_device(&g_scheduler, added, time(NULL));
+        climate_invalidate(&g_climate);
+        g_farm_save_pending = 1;
         log_device_event(dev_id, "ADD_DEVICE");
         protocol_format_add_ok(line, sizeof(line));
         return alloc_line(line);
@@ -473,12 +1999,41 @@ char *handle_command(int fd, enum CommandType cmd, char *args) {
             protocol_format_no_device_err(line, sizeof(line));
             return alloc_line(line);
         }
-        dev->identity.coop_id = coop_id;
-        (void)storage_save_farm(&g_coops, &g_devices, FARM_STATE_PATH);
+        int old_coop = dev->identity.coop_id;
+        if (devices_set_coop(&g_devices, dev, coop_id) != 0) {
+            protocol_format_bad_request(line, sizeof(line));
+            return alloc_line(line);
+        }
+        touch_device(dev);
+        /* Ca nguoi theo doi chuong cu va chuong moi deu nhan event */
+        server_publish_device_change(dev->id_handle, old_coop);
+        server_publish_device_change(dev->id_handle, coop_id);
+        climate_invalidate(&g_climate);
+        coop_stats_invalidate(&g_coop_stats);
+        (void)evaluate_climate(old_coop);
+        (void)evaluate_climate(coop_id);
+        g_farm_save_pending = 1;
         log_device_event(dev_id, "ASSIGN_DEVICE");
         protocol_format_assign_ok(line, sizeof(line));
         return alloc_line(line);
     }
+    case CMD_REMOVE_DEVICE: {
+        char dev_id[MAX_ID_LEN];
+        if (!args || sscanf(args, "%31s", dev_id) != 1) {
+            protocol_format_bad_request(line, sizeof(line));
+            return alloc_line(line);
+        }
+        if (devices_remove(&g_devices, dev_id) != 0) {
+            protocol_format_no_device_err(line, sizeof(line));
+            return alloc_line(line);
+        }
+        end_device_sessions(dev_id);
+        record_tombstone(dev_id);
+        g_farm_save_pending = 1;
+        log_device_event(dev_id, "REMOVE_DEVICE");
+        protocol_format_remove_ok(line, sizeof(line));
+        return alloc_line(line);
+    }
     default:
         protocol_format_bad_request(line, sizeof(line));
         return alloc_line(line);
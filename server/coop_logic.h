@@ -1,7 +1,12 @@
 #ifndef SERVER_COOP_LOGIC_H
 #define SERVER_COOP_LOGIC_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include "../shared/protocol.h"
+#include "../shared/types.h"
+#include "metrics.h"
+#include "telemetry.h"
 
 /**
  * @brief Khởi tạo lớp xử lý logic chuồng/trại phía server.
@@ -9,11 +14,106 @@
 void coop_logic_init(void);
 
 /**
- * @brief Xử lý một lệnh (command) nhận từ client và tạo response.
- * @return Con trỏ `char*` được cấp phát bằng `malloc()` chứa 1 dòng response
- *         (không gồm ký tự xuống dòng). Caller phải `free()` sau khi gửi.
- *         Trả NULL cho các lệnh tự gửi nhiều dòng (vd `SCAN`, `COOPLIST`).
+ * @brief Xử lý một lệnh (command) nhận từ client và tạo response (chỉ gọi từ state actor).
+ *
+ * `fd` là slot kết nối do actor truyền vào, dùng lại cho `send_line()`/`server_subscribe()`.
+ * @return Con trỏ `char*` trong arena của lượt (`req_arena.h`) chứa 1 dòng response
+ *         (không gồm ký tự xuống dòng), hợp lệ tới `req_arena_end()`; không `free()`.
+ *         Trả NULL cho các lệnh tự gửi nhiều dòng (xem `protocol_command_is_streamed()`).
  */
 char *handle_command(int fd, enum CommandType cmd, char *args);
 
+/** @brief Dòng dữ liệu của lô IMPORT đang mở trên kết nối `conn` (không có response). */
+void coop_logic_import_line(int conn, const char *line);
+
+/** @brief Kết nối `conn` đã đóng: bỏ lô IMPORT dở dang của nó. */
+void coop_logic_import_drop(int conn);
+
+/**
+ * @brief Format push event cho thiết bị (handle intern của ID): "EVENT <id> <json>" với
+ *        trạng thái hiện tại, hoặc "EVENT_GONE <id>" nếu thiết bị không còn
+ *        (caller phải còn giữ tham chiếu intern tới `device`).
+ * @return 0 nếu thành công, -1 nếu lỗi.
+ */
+int coop_logic_format_event(uint32_t device, char *out, size_t len);
+
+/**
+ * @brief Xác thực và áp dụng một datagram telemetry UDP (xem `telemetry.h`).
+ *
+ * Không cấp phát; bộ điều khiển khí hậu của các chuồng bị ảnh hưởng chỉ chạy
+ * khi gọi `coop_logic_ingest_end()` sau cả đợt datagram.
+ */
+enum TelemetryVerdict coop_logic_ingest_datagram(const char *buf, size_t len);
+
+/** @brief Kết thúc một đợt datagram: đánh giá khí hậu cho các chuồng có số đo mới. */
+void coop_logic_ingest_end(void);
+
+/**
+ * @brief Chạy các mốc lịch cho ăn/uống đã tới hạn (gọi mỗi vòng lặp của server).
+ */
+void coop_logic_tick(void);
+
+/**
+ * @brief Bắt đầu ghi farm nếu lô `batch` vừa xử lý có lệnh cần lưu (group commit).
+ *
+ * Text JSON được render trên actor, việc ghi file chạy trên work pool; actor
+ * giữ response của lô (và snapshot đọc của state lúc render) tới khi ghi
+ * xong, nên client vẫn chỉ nhận response sau khi thay đổi đã nằm trên đĩa.
+ * Pool không chạy thì ghi tại chỗ như trước.
+ * @return 1 nếu đang có lần ghi chạy trên pool (response phải chờ), 0 nếu không.
+ */
+int coop_logic_end_batch(unsigned long long batch);
+
+/** @brief Có lệnh đã xử lý cần lưu farm mà chưa bắt đầu ghi không. */
+int coop_logic_save_pending(void);
+
+/** @brief Có lần ghi farm nào đang chạy trên work pool không (xong khi actor chạy completion). */
+int coop_logic_save_in_flight(void);
+
+/**
+ * @brief Chờ lần ghi đang chạy rồi ghi tại chỗ phần còn cần lưu.
+ *
+ * Chỉ dùng khi actor buộc phải công bố response giữa lô (ring response đầy).
+ */
+void coop_logic_save_now(void);
+
+/**
+ * @brief Công bố snapshot đọc (`farm_snapshot.h`) nếu farm đã đổi từ lần công bố trước.
+ *
+ * State actor gọi ở cuối mỗi lô `batch` không có response đang chờ ghi farm. Snapshot được dựng lại tối đa một lần
+ * mỗi `FARM_SNAPSHOT_COST_RATIO` lần thời gian dựng, nên dưới tải ghi liên tục
+ * việc dựng snapshot không chiếm quá phần nhỏ thời gian của actor.
+ * @return Số ms tới lần công bố đang hoãn, -1 nếu snapshot đã phản ánh state hiện tại.
+ */
+int coop_logic_publish_snapshot(unsigned long long batch);
+
+/**
+ * @brief Số ms tới mốc lịch kế tiếp (tối đa 60000), -1 nếu không có lịch nào.
+ */
+int coop_logic_next_timeout_ms(void);
+
+/**
+ * @brief In toàn bộ số liệu STATS ra stdout (dump định kỳ của server).
+ */
+void coop_logic_dump_stats(void);
+
+/**
+ * @brief Điền các số liệu do coop_logic/session/log/net sở hữu cho `metrics_render()`.
+ */
+void coop_logic_collect_gauges(struct MetricsGauges *gauges);
+
+/**
+ * @brief State version hiện tại của farm (tăng mỗi khi có thiết bị/chuồng thay đổi).
+ */
+unsigned long long coop_logic_state_version(void);
+
+/**
+ * @brief Đếm thiết bị theo (chuồng, loại) trong một lượt và gọi `visit` cho từng cặp có thiết bị.
+ *
+ * `coop_id = 0` gom các thiết bị chưa gán chuồng.
+ * @return 0 nếu thành công, -1 nếu hết bộ nhớ.
+ */
+int coop_logic_visit_device_counts(void (*visit)(int coop_id, enum DeviceType type, size_t count, void *user_data),
+                                   void *user_data);
+
 #endif /* SERVER_COOP_LOGIC_H */
@@ -0,0 +1,258 @@
+#include "coop_stats.h"
+#include "simd_kernels.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file coop_stats.c
+ * @brief Dựng/cập nhật bản sao dạng cột và tính số liệu chuồng bằng kernel SIMD.
+ */
+
+/** @brief Một dòng tạm khi dựng bản sao. */
+struct CoopStatsRow {
+    int coop_id;
+    int kind;
+    unsigned long long seq;
+    size_t index;   /* vi tri trong DevicesContext.devices */
+};
+
+static int compare_row(const void *a, const void *b) {
+    const struct CoopStatsRow *x = (const struct CoopStatsRow *)a;
+    const struct CoopStatsRow *y = (const struct CoopStatsRow *)b;
+    if (x->coop_id != y->coop_id) return x->coop_id < y->coop_id ? -1 : 1;
+    if (x->kind != y->kind) return x->kind - y->kind;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+static int stats_kind(enum DeviceType type) {
+    switch (type) {
+    case DEVICE_SENSOR:
+        return COOP_STATS_SENSOR;
+    case DEVICE_EGG_COUNTER:
+        return COOP_STATS_EGGS;
+    case DEVICE_FEEDER:
+        return COOP_STATS_FEEDER;
+    case DEVICE_DRINKER:
+        return COOP_STATS_DRINKER;
+    case DEVICE_FAN:
+        return COOP_STATS_FAN;
+    case DEVICE_HEATER:
+        return COOP_STATS_HEATER;
+    case DEVICE_SPRAYER:
+        return COOP_STATS_SPRAYER;
+    default:
+        return -1;
+    }
+}
+
+static uint8_t actuator_on(const struct Device *dev) {
+    enum DevicePowerState state = DEVICE_OFF;
+    switch (dev->identity.type) {
+    case DEVICE_FEEDER: state = dev->data.feeder.state; break;
+    case DEVICE_DRINKER: state = dev->data.drinker.state; break;
+    case DEVICE_FAN: state = dev->data.fan.state; break;
+    case DEVICE_HEATER: state = dev->data.heater.state; break;
+    case DEVICE_SPRAYER: state = dev->data.sprayer.state; break;
+    default: break;
+    }
+    return state == DEVICE_ON;
+}
+
+/** @brief Ghi giá trị của thiết bị vào dòng `row` của cột `kind`. */
+static void store_row(struct CoopStatsMirror *m, int kind, size_t row, const struct Device *dev) {
+    if (kind == COOP_STATS_SENSOR) {
+        m->temperature[row] = dev->data.sensor.temperature;
+        m->humidity[row] = dev->data.sensor.humidity;
+    } else if (kind == COOP_STATS_EGGS) {
+        m->eggs[row] = (double)dev->data.egg_counter.egg_count;
+    } else {
+        m->on[kind][row] = actuator_on(dev);
+    }
+}
+
+static void free_columns(struct CoopStatsMirror *m) {
+    free(m->coops);
+    for (int k = 0; k < COOP_STATS_KIND_COUNT; ++k) {
+        free(m->seq[k]);
+        free(m->on[k]);
+    }
+    free(m->temperature);
+    free(m->humidity);
+    free(m->eggs);
+}
+
+/** @see coop_stats_init() */
+void coop_stats_init(struct CoopStatsMirror *m) {
+    memset(m, 0, sizeof(*m));
+    m->dirty = 1;
+}
+
+/** @see coop_stats_free() */
+void coop_stats_free(struct CoopStatsMirror *m) {
+    free_columns(m);
+    coop_stats_init(m);
+}
+
+/** @see coop_stats_invalidate() */
+void coop_stats_invalidate(struct CoopStatsMirror *m) {
+    m->dirty = 1;
+}
+
+/** @brief Dựng lại: một lượt qua thiết bị, sort theo (chuồng, loại, seq), rồi rải vào từng cột. */
+static int coop_stats_rebuild(struct CoopStatsMirror *m, const struct DevicesContext *devices) {
+    struct CoopStatsMirror next;
+    memset(&next, 0, sizeof(next));
+    size_t n = 0;
+    for (size_t i = 0; i < devices->count; ++i) {
+        const struct DeviceIdentity *id = &devices->devices[i].identity;
+        int kind = stats_kind(id->type);
+        if (id->coop_id <= 0 || kind < 0) continue;
+        next.rows[kind]++;
+        n++;
+    }
+    struct CoopStatsRow *rows = (struct CoopStatsRow *)malloc((n ? n : 1) * sizeof(*rows));
+    next.coops = (struct CoopStatsRange *)malloc((n ? n : 1) * sizeof(*next.coops));
+    int failed = !rows || !next.coops;
+    for (int k = 0; k < COOP_STATS_KIND_COUNT && !failed; ++k) {
+        size_t cap = next.rows[k] ? next.rows[k] : 1;
+        next.seq[k] = (unsigned long long *)malloc(cap * sizeof(*next.seq[k]));
+        failed = !next.seq[k];
+        if (!failed && k >= COOP_STATS_FEEDER) {
+            next.on[k] = (uint8_t *)malloc(cap);
+            failed = !next.on[k];
+        }
+    }
+    if (!failed) {
+        size_t sensors = next.rows[COOP_STATS_SENSOR] ? next.rows[COOP_STATS_SENSOR] : 1;
+        size_t eggs = next.rows[COOP_STATS_EGGS] ? next.rows[COOP_STATS_EGGS] : 1;
+        next.temperature = (double *)malloc(sensors * sizeof(double));
+        next.humidity = (double *)malloc(sensors * sizeof(double));
+        next.eggs = (double *)malloc(eggs * sizeof(double));
+        failed = !next.temperature || !next.humidity || !next.eggs;
+    }
+    if (failed) {
+        free(rows);
+        free_columns(&next);
+        return -1;
+    }
+
+    size_t r = 0;
+    for (size_t i = 0; i < devices->count; ++i) {
+        const struct Device *dev = &devices->devices[i];
+        int kind = stats_kind(dev->identity.type);
+        if (dev->identity.coop_id <= 0 || kind < 0) continue;
+        rows[r].coop_id = dev->identity.coop_id;
+        rows[r].kind = kind;
+        rows[r].seq = dev->seq;
+        rows[r].index = i;
+        r++;
+    }
+    qsort(rows, n, sizeof(*rows), compare_row);
+
+    /* Sort theo chuong truoc nen trong moi cot cac chuong cung xuat hien theo thu tu tang dan */
+    size_t cursor[COOP_STATS_KIND_COUNT] = {0};
+    for (size_t i = 0; i < n; ++i) {
+        if (next.coop_count == 0 || next.coops[next.coop_count - 1].coop_id != rows[i].coop_id) {
+            struct CoopStatsRange *c = &next.coops[next.coop_count++];
+            c->coop_id = rows[i].coop_id;
+            for (int k = 0; k < COOP_STATS_KIND_COUNT; ++k) {
+                c->first[k] = cursor[k];
+                c->count[k] = 0;
+            }
+        }
+        int kind = rows[i].kind;
+        size_t row = cursor[kind]++;
+        next.coops[next.coop_count - 1].count[kind]++;
+        next.seq[kind][row] = rows[i].seq;
+        store_row(&next, kind, row, &devices->devices[rows[i].index]);
+    }
+    free(rows);
+
+    free_columns(m);
+    *m = next;
+    m->dirty = 0;
+    return 0;
+}
+
+static const struct CoopStatsRange *find_coop(const struct CoopStatsMirror *m, int coop_id) {
+    size_t lo = 0, hi = m->coop_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m->coops[mid].coop_id < coop_id) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < m->coop_count && m->coops[lo].coop_id == coop_id) ? &m->coops[lo] : NULL;
+}
+
+/** @see coop_stats_update() */
+void coop_stats_update(struct CoopStatsMirror *m, const struct Device *dev) {
+    int kind = stats_kind(dev->identity.type);
+    if (m->dirty || kind < 0 || dev->identity.coop_id <= 0) {
+        return;
+    }
+    const struct CoopStatsRange *c = find_coop(m, dev->identity.coop_id);
+    size_t lo = c ? c->first[kind] : 0, hi = c ? c->first[kind] + c->count[kind] : 0;
+    const unsigned long long *seq = m->seq[kind];
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (seq[mid] < dev->seq) lo = mid + 1;
+        else hi = mid;
+    }
+    if (!c || lo >= c->first[kind] + c->count[kind] || seq[lo] != dev->seq) {
+        /* Thiet bi moi hoac vua doi chuong: dung lai o lan truy van sau */
+        m->dirty = 1;
+        return;
+    }
+    store_row(m, kind, lo, dev);
+}
+
+/** @see coop_stats_query() */
+int coop_stats_query(struct CoopStatsMirror *m, const struct DevicesContext *devices, int coop_id,
+                     struct CoopStats *out) {
+    if (m->dirty && coop_stats_rebuild(m, devices) != 0) {
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    out->coop_id = coop_id;
+    out->temp_min = out->temp_max = out->temp_avg = NAN;
+    out->hum_min = out->hum_max = out->hum_avg = NAN;
+    const struct CoopStatsRange *c = find_coop(m, coop_id);
+    if (!c) {
+        return 0;
+    }
+    for (int k = 0; k < COOP_STATS_KIND_COUNT; ++k) {
+        out->devices[k] = c->count[k];
+        if (k >= COOP_STATS_FEEDER) {
+            out->devices_on[k] = simd_count_nonzero_u8(m->on[k] + c->first[k], c->count[k]);
+        }
+    }
+    size_t sensors = c->count[COOP_STATS_SENSOR];
+    if (sensors > 0) {
+        const double *t = m->temperature + c->first[COOP_STATS_SENSOR];
+        const double *h = m->humidity + c->first[COOP_STATS_SENSOR];
+        out->temp_min = simd_min_f64(t, sensors);
+        out->temp_max = simd_max_f64(t, sensors);
+        out->temp_avg = simd_sum_f64(t, sensors) / (double)sensors;
+        out->hum_min = simd_min_f64(h, sensors);
+        out->hum_max = simd_max_f64(h, sensors);
+        out->hum_avg = simd_sum_f64(h, sensors) / (double)sensors;
+    }
+    out->eggs_total = simd_sum_f64(m->eggs + c->first[COOP_STATS_EGGS], c->count[COOP_STATS_EGGS]);
+    return 0;
+}
+
+/** @see coop_stats_kind_name() */
+const char *coop_stats_kind_name(enum CoopStatsKind kind) {
+    switch (kind) {
+    case COOP_STATS_SENSOR: return "sensors";
+    case COOP_STATS_EGGS: return "egg_counters";
+    case COOP_STATS_FEEDER: return "feeders";
+    case COOP_STATS_DRINKER: return "drinkers";
+    case COOP_STATS_FAN: return "fans";
+    case COOP_STATS_HEATER: return "heaters";
+    case COOP_STATS_SPRAYER: return "sprayers";
+    default: return "unknown";
+    }
+}
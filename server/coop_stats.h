@@ -0,0 +1,92 @@
+#ifndef SERVER_COOP_STATS_H
+#define SERVER_COOP_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "devices.h"
+
+/**
+ * @file coop_stats.h
+ * @brief Bản sao dạng cột (struct-of-arrays) các trường số hay đọc, gom theo chuồng và loại.
+ *
+ * Mỗi loại có mảng cột riêng (nhiệt độ/độ ẩm của cảm biến, số trứng, trạng thái
+ * bật/tắt của actuator); trong một loại các dòng xếp theo chuồng rồi theo `seq`,
+ * nên số liệu của một chuồng là một đoạn liên tục và được tính bằng kernel SIMD
+ * (`simd_kernels.h`) thay vì đi qua từng `struct Device`.
+ *
+ * Giá trị được cập nhật tại chỗ qua `coop_stats_update()` (hook thay đổi thiết
+ * bị); thêm/xoá thiết bị hay đổi chuồng gọi `coop_stats_invalidate()` và bản sao
+ * được dựng lại lười ở lần truy vấn sau, giống `ClimateIndex`.
+ */
+
+/** @brief Loại cột. */
+enum CoopStatsKind {
+    COOP_STATS_SENSOR = 0,
+    COOP_STATS_EGGS,
+    COOP_STATS_FEEDER,
+    COOP_STATS_DRINKER,
+    COOP_STATS_FAN,
+    COOP_STATS_HEATER,
+    COOP_STATS_SPRAYER,
+    COOP_STATS_KIND_COUNT
+};
+
+/** @brief Đoạn của một chuồng trong từng cột. */
+struct CoopStatsRange {
+    int coop_id;
+    size_t first[COOP_STATS_KIND_COUNT];
+    size_t count[COOP_STATS_KIND_COUNT];
+};
+
+/** @brief Bản sao dạng cột. */
+struct CoopStatsMirror {
+    struct CoopStatsRange *coops;                    /* sap xep theo coop_id */
+    size_t coop_count;
+    unsigned long long *seq[COOP_STATS_KIND_COUNT];  /* seq tung dong, theo chuong roi seq */
+    size_t rows[COOP_STATS_KIND_COUNT];
+    double *temperature;                             /* dong COOP_STATS_SENSOR */
+    double *humidity;
+    double *eggs;                                    /* dong COOP_STATS_EGGS */
+    uint8_t *on[COOP_STATS_KIND_COUNT];              /* chi dung cho actuator (1 = ON) */
+    int dirty;
+};
+
+/** @brief Số liệu tổng hợp của một chuồng. */
+struct CoopStats {
+    int coop_id;
+    size_t devices[COOP_STATS_KIND_COUNT];
+    size_t devices_on[COOP_STATS_KIND_COUNT];  /* chi co nghia voi actuator */
+    double temp_min, temp_max, temp_avg;       /* NAN neu chuong khong co cam bien */
+    double hum_min, hum_max, hum_avg;
+    double eggs_total;
+};
+
+/** @brief Khởi tạo bản sao rỗng (đánh dấu cần dựng). */
+void coop_stats_init(struct CoopStatsMirror *m);
+
+/** @brief Giải phóng bản sao. */
+void coop_stats_free(struct CoopStatsMirror *m);
+
+/** @brief Báo bản sao cần dựng lại (thiết bị mới/bị xoá hoặc đổi chuồng). */
+void coop_stats_invalidate(struct CoopStatsMirror *m);
+
+/**
+ * @brief Chép giá trị mới của thiết bị vào cột.
+ *
+ * Không làm gì nếu bản sao đang chờ dựng lại; nếu thiết bị chưa có dòng
+ * (vừa được thêm) thì đánh dấu cần dựng lại.
+ */
+void coop_stats_update(struct CoopStatsMirror *m, const struct Device *dev);
+
+/**
+ * @brief Tính số liệu một chuồng.
+ * @return 0 nếu thành công (chuồng không có thiết bị vẫn trả 0 với mọi bộ đếm = 0),
+ *         -1 nếu hết bộ nhớ khi dựng bản sao.
+ */
+int coop_stats_query(struct CoopStatsMirror *m, const struct DevicesContext *devices, int coop_id,
+                     struct CoopStats *out);
+
+/** @brief Tên loại cho payload (vd "heaters"). */
+const char *coop_stats_kind_name(enum CoopStatsKind kind);
+
+#endif /* SERVER_COOP_STATS_H */
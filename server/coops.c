@@ -1,5 +1,6 @@
 #include "coops.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 /**
@@ -12,6 +13,25 @@ void coops_init(struct CoopsContext *ctx) {
     ctx->next_id = 1;
 }
 
+void coops_free(struct CoopsContext *ctx) {
+    if (!ctx) return;
+    free(ctx->coops);
+    coops_init(ctx);
+}
+
+/** @brief Đảm bảo còn chỗ cho ít nhất một chuồng nữa (tăng gấp đôi). */
+static int coops_reserve_one(struct CoopsContext *ctx) {
+    if (ctx->count < ctx->capacity) return 0;
+    if (ctx->capacity >= MAX_FARM_COOPS) return -1;
+    size_t cap = ctx->capacity ? ctx->capacity * 2 : 16;
+    if (cap > MAX_FARM_COOPS) cap = MAX_FARM_COOPS;
+    struct CoopMeta *grown = (struct CoopMeta *)realloc(ctx->coops, cap * sizeof(*grown));
+    if (!grown) return -1;
+    ctx->coops = grown;
+    ctx->capacity = cap;
+    return 0;
+}
+
 const struct CoopMeta *coops_find(const struct CoopsContext *ctx, int id) {
     if (!ctx) return NULL;
     for (size_t i = 0; i < ctx->count; ++i) {
@@ -30,7 +50,7 @@ int coops_upsert(struct CoopsContext *ctx, int id, const char *name) {
             return 0;
         }
     }
-    if (ctx->count >= MAX_COOPS) return -2;
+    if (coops_reserve_one(ctx) != 0) return -2;
     struct CoopMeta *c = &ctx->coops[ctx->count++];
     memset(c, 0, sizeof(*c));
     c->id = id;
@@ -42,7 +62,7 @@ int coops_upsert(struct CoopsContext *ctx, int id, const char *name) {
 
 int coops_add(struct CoopsContext *ctx, const char *name, int *out_id) {
     if (!ctx || !name || name[0] == '\0') return -1;
-    if (ctx->count >= MAX_COOPS) return -2;
+    if (ctx->count >= MAX_FARM_COOPS) return -2;
     int id = ctx->next_id <= 0 ? 1 : ctx->next_id;
     if (coops_upsert(ctx, id, name) != 0) return -3;
     if (out_id) *out_id = id;
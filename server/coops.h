@@ -14,16 +14,25 @@ struct CoopMeta {
     char name[MAX_COOP_NAME];
 };
 
-/** @brief Context quản lý danh sách chuồng phía server. */
+/**
+ * @brief Context quản lý danh sách chuồng phía server.
+ *
+ * `coops` là mảng cấp phát động (tối đa `MAX_FARM_COOPS`); chuồng không bị xoá
+ * nên index của một chuồng ổn định và được dùng làm cursor COOPLIST.
+ */
 struct CoopsContext {
-    struct CoopMeta coops[MAX_COOPS];
+    struct CoopMeta *coops;
     size_t count;
+    size_t capacity;
     int next_id;
 };
 
-/** @brief Khởi tạo context chuồng (reset danh sách, set `next_id`). */
+/** @brief Khởi tạo context chuồng rỗng (set `next_id`, chưa cấp phát). */
 void coops_init(struct CoopsContext *ctx);
 
+/** @brief Giải phóng bộ nhớ của context và đưa về trạng thái rỗng. */
+void coops_free(struct CoopsContext *ctx);
+
 /**
  * @brief Tìm chuồng theo ID.
  * @return Con trỏ `CoopMeta` nếu tìm thấy, NULL nếu không có.
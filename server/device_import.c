@@ -0,0 +1,253 @@
+#include "device_import.h"
+#include "intern.h"
+#include "../shared/protocol.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jansson.h>
+
+/**
+ * @file device_import.c
+ * @brief Tách/parse bản ghi IMPORT theo từng dòng và chèn cả lô vào registry.
+ */
+
+enum {
+    IMPORT_MODE_UNKNOWN = 0,
+    IMPORT_MODE_NDJSON,
+    IMPORT_MODE_ARRAY,
+    IMPORT_MODE_CLOSED
+};
+
+/** @see device_import_init() */
+void device_import_init(struct DeviceImport *imp, int default_coop) {
+    memset(imp, 0, sizeof(*imp));
+    imp->default_coop = default_coop > 0 ? default_coop : 0;
+}
+
+/** @see device_import_free() */
+void device_import_free(struct DeviceImport *imp) {
+    free(imp->records);
+    free(imp->text);
+    memset(imp, 0, sizeof(*imp));
+}
+
+/**
+ * @brief Chép chuỗi JSON `value` vào `out` nếu là một "từ" của protocol.
+ *
+ * Lệnh được tách theo khoảng trắng (`CONNECT <id> <app> <password>`), nên ID và
+ * mật khẩu không được rỗng, chứa khoảng trắng/ký tự điều khiển hay bị cắt.
+ * @return 0 nếu hợp lệ, -1 nếu không (`out` giữ nguyên).
+ */
+static int copy_word(const json_t *value, char *out, size_t size) {
+    if (!json_is_string(value)) return -1;
+    const char *s = json_string_value(value);
+    size_t len = json_string_length(value);
+    if (len == 0 || len >= size) return -1;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (c <= ' ' || c == 0x7f) return -1;
+    }
+    memcpy(out, s, len + 1);
+    return 0;
+}
+
+/** @brief Thêm một bản ghi ở trạng thái lỗi, ID "#<thứ tự>"; NULL (và hỏng lô) nếu quá giới hạn/hết bộ nhớ. */
+static struct DeviceImportRecord *next_record(struct DeviceImport *imp) {
+    if (imp->count >= IMPORT_MAX_RECORDS) {
+        imp->broken = 1;
+        return NULL;
+    }
+    if (imp->count == imp->capacity) {
+        size_t cap = imp->capacity ? imp->capacity * 2 : 256;
+        struct DeviceImportRecord *grown =
+            (struct DeviceImportRecord *)realloc(imp->records, cap * sizeof(*grown));
+        if (!grown) {
+            imp->broken = 1;
+            return NULL;
+        }
+        imp->records = grown;
+        imp->capacity = cap;
+    }
+    struct DeviceImportRecord *rec = &imp->records[imp->count++];
+    memset(rec, 0, sizeof(*rec));
+    snprintf(rec->id, sizeof(rec->id), "#%zu", imp->count);
+    rec->status = RESP_BAD_REQUEST;
+    return rec;
+}
+
+/** @brief Parse văn bản bản ghi vừa tách xong thành một `DeviceImportRecord`. */
+static void parse_record(struct DeviceImport *imp) {
+    struct DeviceImportRecord *rec = next_record(imp);
+    if (!rec || imp->overflow) return;
+    json_error_t error;
+    json_t *root = json_loadb(imp->text, imp->text_len, 0, &error);
+    if (!json_is_object(root) || copy_word(json_object_get(root, "id"), rec->id, sizeof(rec->id)) != 0) {
+        json_decref(root);
+        return;
+    }
+    const json_t *type = json_object_get(root, "type");
+    const json_t *password = json_object_get(root, "password");
+    const json_t *coop = json_object_get(root, "coop_id");
+    rec->type = json_is_string(type) ? device_type_from_string(json_string_value(type)) : DEVICE_UNKNOWN;
+    int ok = rec->type != DEVICE_UNKNOWN;
+    /* Mat khau thieu/rong: mat khau mac dinh nhu ADD */
+    if (ok && password && !json_is_null(password) &&
+        !(json_is_string(password) && json_string_length(password) == 0)) {
+        ok = copy_word(password, rec->password, sizeof(rec->password)) == 0;
+    }
+    if (ok && coop && !json_is_null(coop)) {
+        ok = json_is_integer(coop) && json_integer_value(coop) >= 0 && json_integer_value(coop) <= INT_MAX;
+        if (ok) rec->coop_id = (int)json_integer_value(coop);
+    }
+    if (ok) rec->status = 0;
+    json_decref(root);
+}
+
+/** @brief Bắt đầu tách một bản ghi mới (dấu `{` đã đọc). */
+static void begin_record(struct DeviceImport *imp) {
+    if (!imp->text) {
+        imp->text = (char *)malloc(IMPORT_MAX_RECORD_LEN);
+        if (!imp->text) {
+            imp->broken = 1;
+            return;
+        }
+    }
+    imp->depth++;
+    imp->text[0] = '{';
+    imp->text_len = 1;
+    imp->overflow = 0;
+    imp->in_string = 0;
+    imp->escaped = 0;
+}
+
+static void append_char(struct DeviceImport *imp, char c) {
+    if (imp->text_len >= IMPORT_MAX_RECORD_LEN) {
+        imp->overflow = 1;
+        return;
+    }
+    imp->text[imp->text_len++] = c;
+}
+
+/** @see device_import_feed() */
+int device_import_feed(struct DeviceImport *imp, const char *line, size_t len) {
+    for (size_t i = 0; i < len && !imp->broken; ++i) {
+        char c = line[i];
+        int base = imp->mode == IMPORT_MODE_ARRAY ? 1 : 0;
+        if (imp->depth > base) {
+            /* Trong ban ghi: chi can biet ngoac nao nam ngoai chuoi de tim diem ket thuc */
+            append_char(imp, c);
+            if (imp->in_string) {
+                if (imp->escaped) imp->escaped = 0;
+                else if (c == '\\') imp->escaped = 1;
+                else if (c == '"') imp->in_string = 0;
+            } else if (c == '"') {
+                imp->in_string = 1;
+            } else if (c == '{' || c == '[') {
+                imp->depth++;
+            } else if ((c == '}' || c == ']') && --imp->depth == base) {
+                parse_record(imp);
+            }
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r') continue;
+        if (c == '{' && imp->mode != IMPORT_MODE_CLOSED) {
+            if (imp->mode == IMPORT_MODE_UNKNOWN) imp->mode = IMPORT_MODE_NDJSON;
+            begin_record(imp);
+        } else if (c == '[' && imp->mode == IMPORT_MODE_UNKNOWN) {
+            imp->mode = IMPORT_MODE_ARRAY;
+            imp->depth = 1;
+        } else if (c == ']' && imp->mode == IMPORT_MODE_ARRAY) {
+            imp->mode = IMPORT_MODE_CLOSED;
+            imp->depth = 0;
+        } else if (c != ',' || imp->mode != IMPORT_MODE_ARRAY) {
+            imp->broken = 1;
+        }
+    }
+    if (imp->broken) return -1;
+    if (imp->mode == IMPORT_MODE_NDJSON && imp->depth > 0) {
+        /* NDJSON: object chua dong o cuoi dong la ban ghi hong, dong sau bat dau lai */
+        imp->depth = 0;
+        (void)next_record(imp);
+    } else if (imp->mode == IMPORT_MODE_ARRAY && imp->depth > 1) {
+        append_char(imp, '\n');
+    }
+    return imp->broken ? -1 : 0;
+}
+
+/** @see device_import_finish() */
+int device_import_finish(struct DeviceImport *imp) {
+    if (imp->mode == IMPORT_MODE_ARRAY) {
+        imp->broken = 1;
+    }
+    return imp->broken ? -1 : 0;
+}
+
+/** @see device_import_apply() */
+size_t device_import_apply(struct DeviceImport *imp, const struct CoopsContext *coops,
+                           struct DevicesContext *devices,
+                           void (*added)(struct Device *dev, void *user_data), void *user_data) {
+    size_t valid = 0;
+    int last_coop = 0, last_found = 0;
+    for (size_t i = 0; i < imp->count; ++i) {
+        struct DeviceImportRecord *rec = &imp->records[i];
+        if (rec->status != 0) continue;
+        if (rec->coop_id == 0) rec->coop_id = imp->default_coop;
+        if (rec->coop_id <= 0) {
+            rec->status = RESP_BAD_REQUEST;
+            continue;
+        }
+        /* Danh sach thuong gom theo chuong: chi tim lai khi chuong doi */
+        if (rec->coop_id != last_coop) {
+            last_coop = rec->coop_id;
+            last_found = coops_find(coops, last_coop) != NULL;
+        }
+        if (!last_found) {
+            rec->status = RESP_NO_COOP;
+            continue;
+        }
+        valid++;
+    }
+    /* Cap cho ca lo mot lan; that bai thi devices_insert tu tang dan nhu ADD */
+    if (valid > 0) {
+        (void)devices_reserve(devices, devices->count + valid);
+    }
+
+    size_t inserted = 0;
+    for (size_t i = 0; i < imp->count; ++i) {
+        struct DeviceImportRecord *rec = &imp->records[i];
+        if (rec->status != 0) continue;
+        if (devices_find(devices, rec->id)) {
+            rec->status = RESP_BAD_REQUEST; /* da co (trong registry hoac ban ghi truoc cua lo) */
+            continue;
+        }
+        struct Device dev;
+        struct DeviceCold cold;
+        devices_init_default_device(&dev, &cold, rec->type, rec->id, rec->password);
+        dev.identity.coop_id = rec->coop_id;
+        struct Device *slot = devices_insert(devices, &dev);
+        if (!slot) {
+            rec->status = RESP_BAD_REQUEST;
+            continue;
+        }
+        inserted++;
+        if (added) added(slot, user_data);
+    }
+    return inserted;
+}
+
+/** @see device_import_format() */
+int device_import_format(const struct Device *dev, int with_password, char *out, size_t len) {
+    char password[MAX_PASSWORD_LEN * 6 + 16] = "";
+    if (with_password) {
+        memcpy(password, ",\"password\":", 12);
+        long pw_len = intern_escape_json(dev->cold->password, strlen(dev->cold->password), password + 12,
+                                         sizeof(password) - 12);
+        if (pw_len < 0) return -1;
+    }
+    int written = snprintf(out, len, "{\"id\":%s,\"type\":\"%s\"%s,\"coop_id\":%d}",
+                           intern_json(dev->id_handle), device_type_to_string(dev->identity.type), password,
+                           dev->identity.coop_id);
+    return written < 0 || (size_t)written >= len ? -1 : 0;
+}
@@ -0,0 +1,96 @@
+#ifndef SERVER_DEVICE_IMPORT_H
+#define SERVER_DEVICE_IMPORT_H
+
+#include <stddef.h>
+#include "coops.h"
+#include "devices.h"
+#include "../shared/config.h"
+#include "../shared/types.h"
+
+/**
+ * @file device_import.h
+ * @brief Nhập/xuất danh sách thiết bị hàng loạt (lệnh IMPORT/EXPORT và tool `farm_devices`).
+ *
+ * Mỗi bản ghi theo schema của `scan_devices.json`:
+ * `{"id": "...", "type": "sensor", "password": "...", "coop_id": 1}`
+ * (`password` tuỳ chọn; `coop_id` thiếu hoặc 0 thì dùng chuồng mặc định của lô).
+ * Input đưa vào theo từng dòng và có thể là NDJSON (mỗi dòng một object) hoặc
+ * một mảng JSON như `scan_devices.json` (object trải nhiều dòng được); dạng
+ * được nhận ra từ ký tự đầu tiên. Mỗi bản ghi được tách và parse ngay khi đủ,
+ * lô chỉ giữ các bản ghi đã parse gọn (không giữ văn bản).
+ *
+ * Lỗi của một bản ghi (JSON sai, thiếu trường, type lạ, ID có khoảng trắng)
+ * chỉ loại bản ghi đó; lỗi cú pháp ngoài bản ghi hoặc quá `IMPORT_MAX_RECORDS`
+ * bản ghi làm hỏng cả lô.
+ */
+
+/** @brief Một bản ghi của lô; `status` khác 0 là mã lỗi (`enum ResponseCode`). */
+struct DeviceImportRecord {
+    char id[MAX_ID_LEN];            // "#<thu tu>" neu ban ghi khong co ID hop le
+    char password[MAX_PASSWORD_LEN];
+    enum DeviceType type;
+    int coop_id;                    // 0: chuong mac dinh cua lo
+    int status;
+};
+
+/** @brief Một lô IMPORT đang nhận. */
+struct DeviceImport {
+    struct DeviceImportRecord *records;
+    size_t count;
+    size_t capacity;
+    int default_coop;
+    int broken;                     // loi cu phap ngoai ban ghi / qua nhieu ban ghi: ca lo bi tu choi
+    /* Bo tach ban ghi */
+    int mode;                       // 0 chua biet, 1 NDJSON, 2 mang JSON, 3 mang da dong
+    int depth;                      // do sau ngoac hien tai (tinh ca ngoac mang ngoai cung)
+    int in_string;
+    int escaped;
+    int overflow;                   // ban ghi dang doc vuot IMPORT_MAX_RECORD_LEN
+    char *text;                     // van ban cua ban ghi dang doc
+    size_t text_len;
+};
+
+/** @brief Khởi tạo lô rỗng; `default_coop` (>0) thay cho `coop_id` thiếu/0, 0 nếu không có. */
+void device_import_init(struct DeviceImport *imp, int default_coop);
+
+/** @brief Giải phóng bộ nhớ của lô. */
+void device_import_free(struct DeviceImport *imp);
+
+/**
+ * @brief Đưa một dòng input (không gồm `\n`) vào lô.
+ * @return 0 nếu lô còn dùng được, -1 nếu lô đã hỏng (xem `broken`).
+ */
+int device_import_feed(struct DeviceImport *imp, const char *line, size_t len);
+
+/**
+ * @brief Kết thúc input: bản ghi NDJSON dở dang bị loại, mảng JSON chưa đóng làm hỏng lô.
+ * @return 0 nếu lô dùng được, -1 nếu lô hỏng.
+ */
+int device_import_finish(struct DeviceImport *imp);
+
+/**
+ * @brief Kiểm tra cả lô và chèn các thiết bị hợp lệ vào `devices`.
+ *
+ * Chuồng phải có trong `coops`, ID chưa có trong registry (kể cả bản ghi
+ * trước trong lô). Registry được cấp chỗ một lần cho cả lô (một lần dựng bảng
+ * băm ID). `added` (có thể NULL) được gọi với từng thiết bị vừa chèn, trước
+ * lần chèn kế tiếp. Bản ghi bị loại có `status` = `RESP_BAD_REQUEST` hoặc
+ * `RESP_NO_COOP`. Không gọi hook thay đổi của devices.c.
+ * @return Số thiết bị đã chèn.
+ */
+size_t device_import_apply(struct DeviceImport *imp, const struct CoopsContext *coops,
+                           struct DevicesContext *devices,
+                           void (*added)(struct Device *dev, void *user_data), void *user_data);
+
+/**
+ * @brief Format thiết bị thành một bản ghi NDJSON (cùng schema với input, không có `\n`).
+ *
+ * `with_password` = 0 bỏ trường `password` (mật khẩu là credential CONNECT và
+ * khoá MAC telemetry): lệnh EXPORT của server không bao giờ gửi nó; chỉ tool
+ * offline `farm_devices` xuất đủ. Nhập lại bản ghi không có mật khẩu sẽ dùng
+ * mật khẩu mặc định.
+ * @return 0 nếu thành công, -1 nếu buffer không đủ.
+ */
+int device_import_format(const struct Device *dev, int with_password, char *out, size_t len);
+
+#endif /* SERVER_DEVICE_IMPORT_H */
@@ -1,6 +1,6 @@
 #include "devices.h"
 
-#include <jansson.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -28,98 +28,109 @@ enum {
     LIMIT_WATER_MAX_L = 20
 };
 
-/** @brief Khởi tạo thiết bị cảm biến mặc định. */
-static void init_sensor(struct Device *dev, const char *id) {
+/** @brief Phần chung của mọi thiết bị mặc định: xoá sạch, gắn `cold`, ID, type, mật khẩu mặc định. */
+static void init_common(struct Device *dev, struct DeviceCold *cold, const char *id, enum DeviceType type) {
     memset(dev, 0, sizeof(*dev));
+    memset(cold, 0, sizeof(*cold));
+    dev->cold = cold;
     strncpy(dev->identity.id, id, sizeof(dev->identity.id) - 1);
-    dev->identity.type = DEVICE_SENSOR;
-    strncpy(dev->password, "123456", sizeof(dev->password) - 1);
+    dev->identity.type = type;
+    strncpy(cold->password, "123456", sizeof(cold->password) - 1);
+}
+
+/** @brief Khởi tạo thiết bị cảm biến mặc định. */
+static void init_sensor(struct Device *dev, struct DeviceCold *cold, const char *id) {
+    init_common(dev, cold, id, DEVICE_SENSOR);
     dev->data.sensor.temperature = 32.5;
     dev->data.sensor.humidity = 58.2;
-    strncpy(dev->data.sensor.unit_temperature, "C", sizeof(dev->data.sensor.unit_temperature) - 1);
-    strncpy(dev->data.sensor.unit_humidity, "%", sizeof(dev->data.sensor.unit_humidity) - 1);
+    cold->data.sensor.unit_temperature = INTERN_UNIT_C;
+    cold->data.sensor.unit_humidity = INTERN_UNIT_PERCENT;
 }
 
 /** @brief Khởi tạo thiết bị đếm trứng mặc định. */
-static void init_egg_counter(struct Device *dev, const char *id) {
-    memset(dev, 0, sizeof(*dev));
-    strncpy(dev->identity.id, id, sizeof(dev->identity.id) - 1);
-    dev->identity.type = DEVICE_EGG_COUNTER;
-    strncpy(dev->password, "123456", sizeof(dev->password) - 1);
+static void init_egg_counter(struct Device *dev, struct DeviceCold *cold, const char *id) {
+    init_common(dev, cold, id, DEVICE_EGG_COUNTER);
     dev->data.egg_counter.egg_count = 35;
 }
 
 /** @brief Khởi tạo thiết bị quạt mặc định. */
-static void init_fan(struct Device *dev, const char *id) {
-    memset(dev, 0, sizeof(*dev));
-    strncpy(dev->identity.id, id, sizeof(dev->identity.id) - 1);
-    dev->identity.type = DEVICE_FAN;
-    strncpy(dev->password, "123456", sizeof(dev->password) - 1);
+static void init_fan(struct Device *dev, struct DeviceCold *cold, const char *id) {
+    init_common(dev, cold, id, DEVICE_FAN);
     dev->data.fan.state = DEVICE_ON;
     dev->data.fan.speed = 2;
 }
 
 /** @brief Khởi tạo thiết bị đèn sưởi mặc định. */
-static void init_heater(struct Device *dev, const char *id) {
-    memset(dev, 0, sizeof(*dev));
-    strncpy(dev->identity.id, id, sizeof(dev->identity.id) - 1);
-    dev->identity.type = DEVICE_HEATER;
-    strncpy(dev->password, "123456", sizeof(dev->password) - 1);
+static void init_heater(struct Device *dev, struct DeviceCold *cold, const char *id) {
+    init_common(dev, cold, id, DEVICE_HEATER);
     dev->data.heater.state = DEVICE_OFF;
     dev->data.heater.Tmin = 20.0;
     dev->data.heater.Tp2 = 24.0;
-    strncpy(dev->data.heater.mode, "AUTO", sizeof(dev->data.heater.mode) - 1);
-    strncpy(dev->data.heater.unit_temp, "C", sizeof(dev->data.heater.unit_temp) - 1);
+    dev->data.heater.mode = INTERN_AUTO;
+    cold->data.heater.unit_temp = INTERN_UNIT_C;
 }
 
 /** @brief Khởi tạo thiết bị phun sương mặc định. */
-static void init_sprayer(struct Device *dev, const char *id) {
-    memset(dev, 0, sizeof(*dev));
-    strncpy(dev->identity.id, id, sizeof(dev->identity.id) - 1);
-    dev->identity.type = DEVICE_SPRAYER;
-    strncpy(dev->password, "123456", sizeof(dev->password) - 1);
+static void init_sprayer(struct Device *dev, struct DeviceCold *cold, const char *id) {
+    init_common(dev, cold, id, DEVICE_SPRAYER);
     dev->data.sprayer.state = DEVICE_OFF;
     dev->data.sprayer.Hmin = 45.0;
     dev->data.sprayer.Hp = 60.0;
     dev->data.sprayer.Vh = 0.5;
-    strncpy(dev->data.sprayer.unit_humidity, "%", sizeof(dev->data.sprayer.unit_humidity) - 1);
-    strncpy(dev->data.sprayer.unit_flow, "L/h", sizeof(dev->data.sprayer.unit_flow) - 1);
+    cold->data.sprayer.unit_humidity = INTERN_UNIT_PERCENT;
+    cold->data.sprayer.unit_flow = INTERN_UNIT_LPH;
 }
 
 /** @brief Khởi tạo thiết bị cho ăn mặc định (kèm lịch mẫu). */
-static void init_feeder(struct Device *dev, const char *id) {
-    memset(dev, 0, sizeof(*dev));
-    strncpy(dev->identity.id, id, sizeof(dev->identity.id) - 1);
-    dev->identity.type = DEVICE_FEEDER;
-    strncpy(dev->password, "123456", sizeof(dev->password) - 1);
+static void init_feeder(struct Device *dev, struct DeviceCold *cold, const char *id) {
+    init_common(dev, cold, id, DEVICE_FEEDER);
     dev->data.feeder.state = DEVICE_ON;
     dev->data.feeder.W = 0.3;
     dev->data.feeder.Vw = 0.5;
-    strncpy(dev->data.feeder.unit_food, "kg", sizeof(dev->data.feeder.unit_food) - 1);
-    strncpy(dev->data.feeder.unit_water, "L", sizeof(dev->data.feeder.unit_water) - 1);
-    dev->data.feeder.schedule_count = 2;
-    snprintf(dev->data.feeder.schedule[0].time, sizeof(dev->data.feeder.schedule[0].time), "06:00");
-    dev->data.feeder.schedule[0].food = 0.3;
-    dev->data.feeder.schedule[0].water = 0.5;
-    snprintf(dev->data.feeder.schedule[1].time, sizeof(dev->data.feeder.schedule[1].time), "16:00");
-    dev->data.feeder.schedule[1].food = 0.4;
-    dev->data.feeder.schedule[1].water = 0.6;
+    struct FeederColdData *fc = &cold->data.feeder;
+    fc->unit_food = INTERN_UNIT_KG;
+    fc->unit_water = INTERN_UNIT_L;
+    fc->schedule_count = 2;
+    snprintf(fc->schedule[0].time, sizeof(fc->schedule[0].time), "06:00");
+    fc->schedule[0].food = 0.3;
+    fc->schedule[0].water = 0.5;
+    snprintf(fc->schedule[1].time, sizeof(fc->schedule[1].time), "16:00");
+    fc->schedule[1].food = 0.4;
+    fc->schedule[1].water = 0.6;
 }
 
 /** @brief Khởi tạo thiết bị cho uống mặc định (kèm lịch mẫu). */
-static void init_drinker(struct Device *dev, const char *id) {
-    memset(dev, 0, sizeof(*dev));
-    strncpy(dev->identity.id, id, sizeof(dev->identity.id) - 1);
-    dev->identity.type = DEVICE_DRINKER;
-    strncpy(dev->password, "123456", sizeof(dev->password) - 1);
+static void init_drinker(struct Device *dev, struct DeviceCold *cold, const char *id) {
+    init_common(dev, cold, id, DEVICE_DRINKER);
     dev->data.drinker.state = DEVICE_ON;
     dev->data.drinker.Vw = 0.4;
-    strncpy(dev->data.drinker.unit_water, "L", sizeof(dev->data.drinker.unit_water) - 1);
-    dev->data.drinker.schedule_count = 2;
-    snprintf(dev->data.drinker.schedule[0].time, sizeof(dev->data.drinker.schedule[0].time), "06:00");
-    dev->data.drinker.schedule[0].water = 0.3;
-    snprintf(dev->data.drinker.schedule[1].time, sizeof(dev->data.drinker.schedule[1].time), "16:00");
-    dev->data.drinker.schedule[1].water = 0.5;
+    struct DrinkerColdData *dc = &cold->data.drinker;
+    dc->unit_water = INTERN_UNIT_L;
+    dc->schedule_count = 2;
+    snprintf(dc->schedule[0].time, sizeof(dc->schedule[0].time), "06:00");
+    dc->schedule[0].water = 0.3;
+    snprintf(dc->schedule[1].time, sizeof(dc->schedule[1].time), "16:00");
+    dc->schedule[1].water = 0.5;
+}
+
+enum {
+    DEVICES_INITIAL_CAPACITY = 64
+};
+
+static void (*g_change_hook)(const struct Device *dev, enum DeviceChangeKind kind, void *user_data);
+static void *g_change_hook_user;
+
+void devices_set_change_hook(void (*hook)(const struct Device *dev, enum DeviceChangeKind kind, void *user_data),
+                             void *user_data) {
+    g_change_hook = hook;
+    g_change_hook_user = user_data;
+}
+
+/** @brief Báo thay đổi của `dev` cho hook đã đăng ký (nếu có). */
+static void notify_change(const struct Device *dev, enum DeviceChangeKind kind) {
+    if (g_change_hook && dev) {
+        g_change_hook(dev, kind, g_change_hook_user);
+    }
 }
 
 void devices_context_init(struct DevicesContext *ctx) {
@@ -127,6 +138,309 @@ void devices_context_init(struct DevicesContext *ctx) {
         return;
     }
     memset(ctx, 0, sizeof(*ctx));
+    ctx->next_seq = 1;
+}
+
+void devices_context_free(struct DevicesContext *ctx) {
+    if (!ctx) {
+        return;
+    }
+    for (size_t i = 0; i < ctx->count; ++i) {
+        free(ctx->devices[i].cold);
+        intern_release(ctx->devices[i].id_handle);
+    }
+    free(ctx->devices);
+    free(ctx->id_slots);
+    free(ctx->coop_lists);
+    devices_context_init(ctx);
+}
+
+/** @brief Vị trí đầu tiên trong `coop_lists` có `coop_id` >= `coop_id` (tìm nhị phân). */
+static size_t coop_list_lower_bound(const struct DevicesContext *ctx, int coop_id) {
+    size_t lo = 0, hi = ctx->coop_list_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ctx->coop_lists[mid].coop_id < coop_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Tìm danh sách của chuồng `coop_id`; `create` thì thêm danh sách rỗng nếu chưa có.
+ * @return NULL nếu không có (hoặc hết bộ nhớ khi `create`).
+ */
+static struct DeviceCoopList *coop_list_get(struct DevicesContext *ctx, int coop_id, int create) {
+    size_t lo = coop_list_lower_bound(ctx, coop_id);
+    if (lo < ctx->coop_list_count && ctx->coop_lists[lo].coop_id == coop_id) {
+        return &ctx->coop_lists[lo];
+    }
+    if (!create) {
+        return NULL;
+    }
+    if (ctx->coop_list_count == ctx->coop_list_capacity) {
+        size_t cap = ctx->coop_list_capacity ? ctx->coop_list_capacity * 2 : 16;
+        struct DeviceCoopList *grown = (struct DeviceCoopList *)realloc(ctx->coop_lists, cap * sizeof(*grown));
+        if (!grown) {
+            return NULL;
+        }
+        ctx->coop_lists = grown;
+        ctx->coop_list_capacity = cap;
+    }
+    /* Chuong moi hiem (chuong khong bi xoa) nen chen giu thu tu bang memmove */
+    struct DeviceCoopList *list = &ctx->coop_lists[lo];
+    memmove(list + 1, list, (ctx->coop_list_count - lo) * sizeof(*list));
+    ctx->coop_list_count++;
+    memset(list, 0, sizeof(*list));
+    list->coop_id = coop_id;
+    return list;
+}
+
+/**
+ * @brief Nối thiết bị ở `index` vào `list`, đúng vị trí theo `seq`.
+ *
+ * Thiết bị vừa insert có `seq` lớn nhất nên nằm ngay ở cuối (O(1)); thiết bị
+ * chuyển chuồng thì lùi từ cuối danh sách tới chỗ của nó.
+ */
+static void coop_link(struct DevicesContext *ctx, struct DeviceCoopList *list, size_t index) {
+    struct Device *dev = &ctx->devices[index];
+    uint32_t after = list->tail;
+    while (after != 0 && ctx->devices[after - 1].seq > dev->seq) {
+        after = ctx->devices[after - 1].coop_prev;
+    }
+    uint32_t self = (uint32_t)(index + 1);
+    dev->coop_prev = after;
+    dev->coop_next = after != 0 ? ctx->devices[after - 1].coop_next : list->head;
+    if (dev->coop_next != 0) {
+        ctx->devices[dev->coop_next - 1].coop_prev = self;
+    } else {
+        list->tail = self;
+    }
+    if (after != 0) {
+        ctx->devices[after - 1].coop_next = self;
+    } else {
+        list->head = self;
+    }
+    list->count++;
+}
+
+/** @brief Gỡ thiết bị ở `index` khỏi danh sách chuồng của nó (nếu có). */
+static void coop_unlink(struct DevicesContext *ctx, size_t index) {
+    struct Device *dev = &ctx->devices[index];
+    struct DeviceCoopList *list = dev->identity.coop_id > 0 ? coop_list_get(ctx, dev->identity.coop_id, 0) : NULL;
+    if (!list) {
+        return;
+    }
+    if (dev->coop_prev != 0) {
+        ctx->devices[dev->coop_prev - 1].coop_next = dev->coop_next;
+    } else {
+        list->head = dev->coop_next;
+    }
+    if (dev->coop_next != 0) {
+        ctx->devices[dev->coop_next - 1].coop_prev = dev->coop_prev;
+    } else {
+        list->tail = dev->coop_prev;
+    }
+    dev->coop_prev = 0;
+    dev->coop_next = 0;
+    list->count--;
+}
+
+/** @brief Sau khi xoá thiết bị ở `index` (mảng đã dịch), lùi mọi liên kết trỏ ra sau nó một bậc. */
+static void coop_shift_links(struct DevicesContext *ctx, size_t index) {
+    uint32_t removed = (uint32_t)(index + 1);
+    for (size_t i = 0; i < ctx->count; ++i) {
+        struct Device *dev = &ctx->devices[i];
+        if (dev->coop_prev > removed) dev->coop_prev--;
+        if (dev->coop_next > removed) dev->coop_next--;
+    }
+    for (size_t i = 0; i < ctx->coop_list_count; ++i) {
+        struct DeviceCoopList *list = &ctx->coop_lists[i];
+        if (list->head > removed) list->head--;
+        if (list->tail > removed) list->tail--;
+    }
+}
+
+/**
+ * @brief Ghi `index` vào slot trống đầu tiên theo dò tuyến tính.
+ *
+ * Bảng được băm theo chuỗi ID (cùng hàm băm với bảng intern) để
+ * `devices_find` đi thẳng vào đây mà không phải tra bảng intern trước.
+ */
+static void id_index_put(struct DevicesContext *ctx, size_t index) {
+    size_t slot = intern_handle_hash(ctx->devices[index].id_handle) & ctx->id_mask;
+    while (ctx->id_slots[slot] != 0) {
+        slot = (slot + 1) & ctx->id_mask;
+    }
+    ctx->id_slots[slot] = index + 1;
+}
+
+/**
+ * @brief Dựng lại bảng băm ID với ít nhất 2x `capacity` slot.
+ *
+ * Gọi khi mảng lớn lên hoặc sau khi xoá (index dịch chuyển). Hết bộ nhớ thì
+ * bỏ bảng và `devices_find` quay về tìm tuyến tính.
+ */
+static void id_index_rebuild(struct DevicesContext *ctx) {
+    size_t slots = 64;
+    while (slots < ctx->capacity * 2) {
+        slots *= 2;
+    }
+    if (!ctx->id_slots || ctx->id_mask + 1 != slots) {
+        free(ctx->id_slots);
+        ctx->id_slots = (size_t *)malloc(slots * sizeof(*ctx->id_slots));
+        if (!ctx->id_slots) {
+            ctx->id_mask = 0;
+            return;
+        }
+        ctx->id_mask = slots - 1;
+    }
+    memset(ctx->id_slots, 0, slots * sizeof(*ctx->id_slots));
+    for (size_t i = 0; i < ctx->count; ++i) {
+        id_index_put(ctx, i);
+    }
+}
+
+/** @brief Đảm bảo còn chỗ cho ít nhất một thiết bị nữa (tăng gấp đôi). */
+static int devices_reserve_one(struct DevicesContext *ctx) {
+    if (ctx->count < ctx->capacity) {
+        return 0;
+    }
+    if (ctx->capacity >= MAX_FARM_DEVICES) {
+        return -1;
+    }
+    size_t cap = ctx->capacity ? ctx->capacity * 2 : DEVICES_INITIAL_CAPACITY;
+    if (cap > MAX_FARM_DEVICES) {
+        cap = MAX_FARM_DEVICES;
+    }
+    struct Device *grown = (struct Device *)realloc(ctx->devices, cap * sizeof(*grown));
+    if (!grown) {
+        return -1;
+    }
+    ctx->devices = grown;
+    ctx->capacity = cap;
+    id_index_rebuild(ctx);
+    return 0;
+}
+
+int devices_reserve(struct DevicesContext *ctx, size_t count) {
+    if (!ctx) {
+        return -1;
+    }
+    if (count > MAX_FARM_DEVICES) {
+        count = MAX_FARM_DEVICES;
+    }
+    if (count <= ctx->capacity) {
+        return 0;
+    }
+    struct Device *grown = (struct Device *)realloc(ctx->devices, count * sizeof(*grown));
+    if (!grown) {
+        return -1;
+    }
+    ctx->devices = grown;
+    ctx->capacity = count;
+    id_index_rebuild(ctx);
+    return 0;
+}
+
+struct Device *devices_insert(struct DevicesContext *ctx, const struct Device *dev) {
+    if (!ctx || !dev || devices_reserve_one(ctx) != 0) {
+        return NULL;
+    }
+    /* Danh sach cua chuong co truoc khi them, de het bo nho khong de lai thiet bi mo coi */
+    int coop_id = dev->identity.coop_id;
+    if (coop_id > 0 && !coop_list_get(ctx, coop_id, 1)) {
+        return NULL;
+    }
+    struct DeviceCold *cold = (struct DeviceCold *)malloc(sizeof(*cold));
+    if (!cold) {
+        return NULL;
+    }
+    /* Tham chieu intern cua ID thuoc ve thiet bi, tra lai khi xoa */
+    uint32_t id_handle;
+    if (intern_string(dev->identity.id, &id_handle) != 0) {
+        free(cold);
+        return NULL;
+    }
+    if (dev->cold) {
+        *cold = *dev->cold;
+    } else {
+        memset(cold, 0, sizeof(*cold));
+    }
+    if (ctx->next_seq == 0) {
+        ctx->next_seq = 1;
+    }
+    struct Device *slot = &ctx->devices[ctx->count++];
+    *slot = *dev;
+    slot->cold = cold;
+    slot->id_handle = id_handle;
+    slot->seq = ctx->next_seq++;
+    slot->coop_prev = 0;
+    slot->coop_next = 0;
+    if (ctx->id_slots) {
+        id_index_put(ctx, ctx->count - 1);
+    }
+    if (coop_id > 0) {
+        coop_link(ctx, coop_list_get(ctx, coop_id, 0), ctx->count - 1);
+    }
+    return slot;
+}
+
+int devices_set_coop(struct DevicesContext *ctx, struct Device *dev, int coop_id) {
+    if (!ctx || !dev) {
+        return -1;
+    }
+    if (coop_id < 0) {
+        coop_id = 0;
+    }
+    if (dev->identity.coop_id == coop_id) {
+        return 0;
+    }
+    if (coop_id > 0 && !coop_list_get(ctx, coop_id, 1)) {
+        return -1;
+    }
+    size_t index = (size_t)(dev - ctx->devices);
+    coop_unlink(ctx, index);
+    dev->identity.coop_id = coop_id;
+    if (coop_id > 0) {
+        coop_link(ctx, coop_list_get(ctx, coop_id, 0), index);
+    }
+    return 0;
+}
+
+const struct DeviceCoopList *devices_coop_list(const struct DevicesContext *ctx, int coop_id) {
+    if (!ctx || coop_id <= 0) {
+        return NULL;
+    }
+    size_t pos = coop_list_lower_bound(ctx, coop_id);
+    return pos < ctx->coop_list_count && ctx->coop_lists[pos].coop_id == coop_id ? &ctx->coop_lists[pos] : NULL;
+}
+
+struct Device *devices_find_seq(struct DevicesContext *ctx, unsigned long long seq) {
+    if (!ctx || seq == 0) {
+        return NULL;
+    }
+    size_t i = devices_index_after_seq(ctx, seq - 1);
+    return (i < ctx->count && ctx->devices[i].seq == seq) ? &ctx->devices[i] : NULL;
+}
+
+size_t devices_index_after_seq(const struct DevicesContext *ctx, unsigned long long after_seq) {
+    if (!ctx) {
+        return 0;
+    }
+    size_t lo = 0, hi = ctx->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ctx->devices[mid].seq <= after_seq) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
 }
 
 size_t devices_scan(const struct DevicesContext *ctx, struct DeviceIdentity *out, size_t max_out) {
@@ -144,8 +458,36 @@ struct Device *devices_find(struct DevicesContext *ctx, const char *id) {
     if (!ctx || !id) {
         return NULL;
     }
+    if (ctx->id_slots) {
+        size_t len = strlen(id);
+        for (size_t slot = intern_hash(id, len) & ctx->id_mask; ctx->id_slots[slot] != 0; slot = (slot + 1) & ctx->id_mask) {
+            struct Device *dev = &ctx->devices[ctx->id_slots[slot] - 1];
+            if (strcmp(dev->identity.id, id) == 0) {
+                return dev;
+            }
+        }
+        return NULL;
+    }
+    uint32_t id_handle;
+    return intern_lookup(id, &id_handle) == 0 ? devices_find_handle(ctx, id_handle) : NULL;
+}
+
+struct Device *devices_find_handle(struct DevicesContext *ctx, uint32_t id_handle) {
+    if (!ctx) {
+        return NULL;
+    }
+    if (ctx->id_slots) {
+        /* Slot trung ID dau tien theo thu tu do = thiet bi them som nhat, giong tim tuyen tinh */
+        for (size_t slot = intern_handle_hash(id_handle) & ctx->id_mask; ctx->id_slots[slot] != 0; slot = (slot + 1) & ctx->id_mask) {
+            struct Device *dev = &ctx->devices[ctx->id_slots[slot] - 1];
+            if (dev->id_handle == id_handle) {
+                return dev;
+            }
+        }
+        return NULL;
+    }
     for (size_t i = 0; i < ctx->count; ++i) {
-        if (strncmp(ctx->devices[i].identity.id, id, sizeof(ctx->devices[i].identity.id)) == 0) {
+        if (ctx->devices[i].id_handle == id_handle) {
             return &ctx->devices[i];
         }
     }
@@ -156,11 +498,12 @@ int devices_change_password(struct Device *dev, const char *old_pw, const char *
     if (!dev || !old_pw || !new_pw) {
         return -1;
     }
-    if (strncmp(dev->password, old_pw, sizeof(dev->password)) != 0) {
+    char *password = dev->cold->password;
+    if (strncmp(password, old_pw, MAX_PASSWORD_LEN) != 0) {
         return -2;
     }
-    strncpy(dev->password, new_pw, sizeof(dev->password) - 1);
-    dev->password[sizeof(dev->password) - 1] = '\0';
+    strncpy(password, new_pw, MAX_PASSWORD_LEN - 1);
+    password[MAX_PASSWORD_LEN - 1] = '\0';
     return 0;
 }
 
@@ -174,22 +517,24 @@ int devices_set_state(struct Device *dev, enum DevicePowerState state) {
     switch (dev->identity.type) {
     case DEVICE_FAN:
         dev->data.fan.state = state;
-        return 0;
+        break;
     case DEVICE_HEATER:
         dev->data.heater.state = state;
-        return 0;
+        break;
     case DEVICE_SPRAYER:
         dev->data.sprayer.state = state;
-        return 0;
+        break;
     case DEVICE_FEEDER:
         dev->data.feeder.state = state;
-        return 0;
+        break;
     case DEVICE_DRINKER:
         dev->data.drinker.state = state;
-        return 0;
+        break;
     default:
         return -2;
     }
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
+    return 0;
 }
 
 int devices_feed_now(struct Device *dev, double food, double water) {
@@ -201,6 +546,7 @@ int devices_feed_now(struct Device *dev, double food, double water) {
     }
     dev->data.feeder.W = food;
     dev->data.feeder.Vw = water;
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
     return 0;
 }
 
@@ -212,9 +558,49 @@ int devices_drink_now(struct Device *dev, double water) {
         return -2;
     }
     dev->data.drinker.Vw = water;
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
     return 0;
 }
 
+int devices_report_sensor(struct Device *dev, double temperature, double humidity) {
+    if (!dev || dev->identity.type != DEVICE_SENSOR) {
+        return -1;
+    }
+    if ((!isnan(temperature) && !in_range(temperature, (double)LIMIT_TEMP_MIN_C, (double)LIMIT_TEMP_MAX_C)) ||
+        (!isnan(humidity) && !in_range(humidity, (double)LIMIT_HUM_MIN_PCT, (double)LIMIT_HUM_MAX_PCT))) {
+        return -2;
+    }
+    struct SensorData *sensor = &dev->data.sensor;
+    int changed = 0;
+    if (!isnan(temperature) && sensor->temperature != temperature) {
+        sensor->temperature = temperature;
+        changed = 1;
+    }
+    if (!isnan(humidity) && sensor->humidity != humidity) {
+        sensor->humidity = humidity;
+        changed = 1;
+    }
+    if (changed) {
+        notify_change(dev, DEVICE_CHANGE_UPDATED);
+    }
+    return changed;
+}
+
+int devices_report_eggs(struct Device *dev, int egg_count) {
+    if (!dev || dev->identity.type != DEVICE_EGG_COUNTER) {
+        return -1;
+    }
+    if (egg_count < 0) {
+        return -2;
+    }
+    if (dev->data.egg_counter.egg_count == egg_count) {
+        return 0;
+    }
+    dev->data.egg_counter.egg_count = egg_count;
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
+    return 1;
+}
+
 int devices_spray_now(struct Device *dev, double Vh) {
     if (!dev || dev->identity.type != DEVICE_SPRAYER) {
         return -1;
@@ -224,6 +610,7 @@ int devices_spray_now(struct Device *dev, double Vh) {
     }
     dev->data.sprayer.Vh = Vh;
     dev->data.sprayer.state = DEVICE_ON;
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
     return 0;
 }
 
@@ -235,10 +622,11 @@ int devices_set_config_fan(struct Device *dev, int speed) {
         return -2;
     }
     dev->data.fan.speed = speed;
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
     return 0;
 }
 
-int devices_set_config_heater(struct Device *dev, double Tmin, double Tp2, const char *mode) {
+int devices_set_config_heater(struct Device *dev, double Tmin, double Tp2, uint32_t mode) {
     if (!dev || dev->identity.type != DEVICE_HEATER) {
         return -1;
     }
@@ -249,10 +637,10 @@ int devices_set_config_heater(struct Device *dev, double Tmin, double Tp2, const
     }
     dev->data.heater.Tmin = Tmin;
     dev->data.heater.Tp2 = Tp2;
-    if (mode && mode[0] != '\0') {
-        strncpy(dev->data.heater.mode, mode, sizeof(dev->data.heater.mode) - 1);
-        dev->data.heater.mode[sizeof(dev->data.heater.mode) - 1] = '\0';
+    if (mode != INTERN_EMPTY) {
+        dev->data.heater.mode = mode;
     }
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
     return 0;
 }
 
@@ -269,6 +657,7 @@ int devices_set_config_sprayer(struct Device *dev, double Hmin, double Hp, doubl
     dev->data.sprayer.Hmin = Hmin;
     dev->data.sprayer.Hp = Hp;
     dev->data.sprayer.Vh = Vh;
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
     return 0;
 }
 
@@ -277,36 +666,87 @@ static size_t clamp_schedule_count(size_t count) {
     return count > MAX_SCHEDULE_ENTRIES ? MAX_SCHEDULE_ENTRIES : count;
 }
 
-static const char *power_state_string(enum DevicePowerState state) {
-    return state == DEVICE_ON ? "ON" : "OFF";
+/** @brief Buffer ghi JSON trực tiếp (không dựng cây jansson). */
+struct JsonWriter {
+    char *out;
+    size_t len;
+    size_t pos;
+    int failed;
+};
+
+static void jw_raw(struct JsonWriter *w, const char *s, size_t n) {
+    if (w->failed || n >= w->len - w->pos) {
+        w->failed = 1;
+        return;
+    }
+    memcpy(w->out + w->pos, s, n);
+    w->pos += n;
+    w->out[w->pos] = '\0';
 }
 
-static json_t *build_schedule_array(const struct ScheduleEntry *schedule, size_t schedule_count, int include_food) {
-    json_t *arr = json_array();
-    if (!arr) {
-        return NULL;
+/* Chuoi hang: key kem dau nhay/dau hai cham, do dai tinh luc bien dich */
+#define JW_LIT(w, s) jw_raw((w), (s), sizeof(s) - 1)
+
+/** @brief Chuỗi đã intern: chép dạng JSON tính sẵn. */
+static void jw_interned(struct JsonWriter *w, uint32_t handle) {
+    jw_raw(w, intern_json(handle), intern_json_length(handle));
+}
+
+/** @brief Số thực, cùng định dạng với jansson `JSON_REAL_PRECISION(4)`: "%.4g", thêm ".0" nếu trông như số nguyên. */
+static void jw_real(struct JsonWriter *w, double v) {
+    char buf[40];
+    int n = isfinite(v) ? snprintf(buf, sizeof(buf), "%.4g", v) : -1;
+    if (n < 0 || (size_t)n >= sizeof(buf) - 2) {
+        w->failed = 1;
+        return;
     }
+    if (!strchr(buf, '.') && !strchr(buf, 'e')) {
+        memcpy(buf + n, ".0", 3);
+        n += 2;
+    }
+    jw_raw(w, buf, (size_t)n);
+}
 
+static void jw_int(struct JsonWriter *w, long long v) {
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%lld", v);
+    jw_raw(w, buf, (size_t)n);
+}
+
+static void jw_state(struct JsonWriter *w, enum DevicePowerState state) {
+    if (state == DEVICE_ON) {
+        JW_LIT(w, "\"ON\"");
+    } else {
+        JW_LIT(w, "\"OFF\"");
+    }
+}
+
+static void jw_schedule(struct JsonWriter *w, const struct ScheduleEntry *schedule, size_t schedule_count,
+                        int include_food) {
+    char time_json[sizeof(schedule[0].time) * 6 + 3];
     size_t count = clamp_schedule_count(schedule_count);
+    JW_LIT(w, "[");
     for (size_t i = 0; i < count; ++i) {
         const struct ScheduleEntry *s = &schedule[i];
-        json_t *entry = json_object();
-        if (!entry) {
-            json_decref(arr);
-            return NULL;
+        const char *nul = (const char *)memchr(s->time, '\0', sizeof(s->time));
+        size_t time_len = nul ? (size_t)(nul - s->time) : sizeof(s->time);
+        long n = intern_escape_json(s->time, time_len, time_json, sizeof(time_json));
+        if (n < 0) {
+            w->failed = 1;
+            return;
         }
-
-        if (json_object_set_new(entry, "time", json_string(s->time)) != 0 ||
-            (include_food && json_object_set_new(entry, "food", json_real(s->food)) != 0) ||
-            json_object_set_new(entry, "water", json_real(s->water)) != 0 ||
-            json_array_append_new(arr, entry) != 0) {
-            json_decref(entry);
-            json_decref(arr);
-            return NULL;
+        if (i > 0) JW_LIT(w, ",");
+        JW_LIT(w, "{\"time\":");
+        jw_raw(w, time_json, (size_t)n);
+        if (include_food) {
+            JW_LIT(w, ",\"food\":");
+            jw_real(w, s->food);
         }
+        JW_LIT(w, ",\"water\":");
+        jw_real(w, s->water);
+        JW_LIT(w, "}");
     }
-
-    return arr;
+    JW_LIT(w, "]");
 }
 
 int devices_set_config_feeder(struct Device *dev, double W, double Vw, const struct ScheduleEntry *schedule, size_t schedule_count) {
@@ -318,11 +758,12 @@ int devices_set_config_feeder(struct Device *dev, double W, double Vw, const str
     }
     dev->data.feeder.W = W;
     dev->data.feeder.Vw = Vw;
+    struct FeederColdData *fc = &dev->cold->data.feeder;
     size_t copy = clamp_schedule_count(schedule_count);
-    dev->data.feeder.schedule_count = copy;
-    for (size_t i = 0; i < copy; ++i) {
-        dev->data.feeder.schedule[i] = schedule[i];
-    }
+    /* memmove: caller co the truyen lai chinh lich hien tai (SETCFG khong kem schedule) */
+    memmove(fc->schedule, schedule, copy * sizeof(*schedule));
+    fc->schedule_count = copy;
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
     return 0;
 }
 
@@ -334,12 +775,14 @@ int devices_set_config_drinker(struct Device *dev, double Vw, const struct Sched
         return -2;
     }
     dev->data.drinker.Vw = Vw;
+    struct DrinkerColdData *dc = &dev->cold->data.drinker;
     size_t copy = clamp_schedule_count(schedule_count);
-    dev->data.drinker.schedule_count = copy;
+    memmove(dc->schedule, schedule, copy * sizeof(*schedule));
+    dc->schedule_count = copy;
     for (size_t i = 0; i < copy; ++i) {
-        dev->data.drinker.schedule[i] = schedule[i];
-        dev->data.drinker.schedule[i].food = 0.0; /* not used */
+        dc->schedule[i].food = 0.0; /* not used */
     }
+    notify_change(dev, DEVICE_CHANGE_UPDATED);
     return 0;
 }
 
@@ -349,151 +792,126 @@ int devices_info_json(const struct Device *dev, char *out_json, size_t out_len)
     }
 
     out_json[0] = '\0';
+    struct JsonWriter w = { out_json, out_len, 0, 0 };
+    const union DeviceColdData *cold = &dev->cold->data;
 
-    int rc = -1;
-    char *dumped = NULL;
-    json_t *root = json_object();
-    if (!root) {
-        return -1;
-    }
-
-    if (json_object_set_new(root, "device_id", json_string(dev->identity.id)) != 0) {
-        goto out;
-    }
-
+    JW_LIT(&w, "{\"device_id\":");
+    jw_interned(&w, dev->id_handle);
     switch (dev->identity.type) {
     case DEVICE_SENSOR:
-        if (json_object_set_new(root, "type", json_string("sensor")) != 0 ||
-            json_object_set_new(root, "temperature", json_real(dev->data.sensor.temperature)) != 0 ||
-            json_object_set_new(root, "humidity", json_real(dev->data.sensor.humidity)) != 0 ||
-            json_object_set_new(root, "unit_temperature", json_string(dev->data.sensor.unit_temperature)) != 0 ||
-            json_object_set_new(root, "unit_humidity", json_string(dev->data.sensor.unit_humidity)) != 0) {
-            goto out;
-        }
+        JW_LIT(&w, ",\"type\":\"sensor\",\"temperature\":");
+        jw_real(&w, dev->data.sensor.temperature);
+        JW_LIT(&w, ",\"humidity\":");
+        jw_real(&w, dev->data.sensor.humidity);
+        JW_LIT(&w, ",\"unit_temperature\":");
+        jw_interned(&w, cold->sensor.unit_temperature);
+        JW_LIT(&w, ",\"unit_humidity\":");
+        jw_interned(&w, cold->sensor.unit_humidity);
         break;
     case DEVICE_EGG_COUNTER:
-        if (json_object_set_new(root, "type", json_string("egg_counter")) != 0 ||
-            json_object_set_new(root, "egg_count", json_integer(dev->data.egg_counter.egg_count)) != 0) {
-            goto out;
-        }
+        JW_LIT(&w, ",\"type\":\"egg_counter\",\"egg_count\":");
+        jw_int(&w, dev->data.egg_counter.egg_count);
         break;
     case DEVICE_FAN:
-        if (json_object_set_new(root, "type", json_string("fan")) != 0 ||
-            json_object_set_new(root, "state", json_string(power_state_string(dev->data.fan.state))) != 0 ||
-            json_object_set_new(root, "toc_do", json_integer(dev->data.fan.speed)) != 0) {
-            goto out;
-        }
+        JW_LIT(&w, ",\"type\":\"fan\",\"state\":");
+        jw_state(&w, dev->data.fan.state);
+        JW_LIT(&w, ",\"toc_do\":");
+        jw_int(&w, dev->data.fan.speed);
         break;
     case DEVICE_HEATER:
-        if (json_object_set_new(root, "type", json_string("heater")) != 0 ||
-            json_object_set_new(root, "state", json_string(power_state_string(dev->data.heater.state))) != 0 ||
-            json_object_set_new(root, "nhiet_do_bat_c", json_real(dev->data.heater.Tmin)) != 0 ||
-            json_object_set_new(root, "nhiet_do_tat_c", json_real(dev->data.heater.Tp2)) != 0 ||
-            json_object_set_new(root, "mode", json_string(dev->data.heater.mode)) != 0 ||
-            json_object_set_new(root, "unit_temp", json_string(dev->data.heater.unit_temp)) != 0) {
-            goto out;
-        }
+        JW_LIT(&w, ",\"type\":\"heater\",\"state\":");
+        jw_state(&w, dev->data.heater.state);
+        JW_LIT(&w, ",\"nhiet_do_bat_c\":");
+        jw_real(&w, dev->data.heater.Tmin);
+        JW_LIT(&w, ",\"nhiet_do_tat_c\":");
+        jw_real(&w, dev->data.heater.Tp2);
+        JW_LIT(&w, ",\"mode\":");
+        jw_interned(&w, dev->data.heater.mode);
+        JW_LIT(&w, ",\"unit_temp\":");
+        jw_interned(&w, cold->heater.unit_temp);
         break;
     case DEVICE_SPRAYER:
-        if (json_object_set_new(root, "type", json_string("sprayer")) != 0 ||
-            json_object_set_new(root, "state", json_string(power_state_string(dev->data.sprayer.state))) != 0 ||
-            json_object_set_new(root, "do_am_bat_pct", json_real(dev->data.sprayer.Hmin)) != 0 ||
-            json_object_set_new(root, "do_am_muc_tieu_pct", json_real(dev->data.sprayer.Hp)) != 0 ||
-            json_object_set_new(root, "luu_luong_lph", json_real(dev->data.sprayer.Vh)) != 0 ||
-            json_object_set_new(root, "unit_humidity", json_string(dev->data.sprayer.unit_humidity)) != 0 ||
-            json_object_set_new(root, "unit_flow", json_string(dev->data.sprayer.unit_flow)) != 0) {
-            goto out;
-        }
+        JW_LIT(&w, ",\"type\":\"sprayer\",\"state\":");
+        jw_state(&w, dev->data.sprayer.state);
+        JW_LIT(&w, ",\"do_am_bat_pct\":");
+        jw_real(&w, dev->data.sprayer.Hmin);
+        JW_LIT(&w, ",\"do_am_muc_tieu_pct\":");
+        jw_real(&w, dev->data.sprayer.Hp);
+        JW_LIT(&w, ",\"luu_luong_lph\":");
+        jw_real(&w, dev->data.sprayer.Vh);
+        JW_LIT(&w, ",\"unit_humidity\":");
+        jw_interned(&w, cold->sprayer.unit_humidity);
+        JW_LIT(&w, ",\"unit_flow\":");
+        jw_interned(&w, cold->sprayer.unit_flow);
         break;
-    case DEVICE_FEEDER: {
-        json_t *schedule = build_schedule_array(dev->data.feeder.schedule, dev->data.feeder.schedule_count, 1);
-        if (!schedule) {
-            goto out;
-        }
-        if (json_object_set_new(root, "type", json_string("feeder")) != 0 ||
-            json_object_set_new(root, "state", json_string(power_state_string(dev->data.feeder.state))) != 0 ||
-            json_object_set_new(root, "thuc_an_kg", json_real(dev->data.feeder.W)) != 0 ||
-            json_object_set_new(root, "nuoc_l", json_real(dev->data.feeder.Vw)) != 0 ||
-            json_object_set_new(root, "unit_food", json_string(dev->data.feeder.unit_food)) != 0 ||
-            json_object_set_new(root, "unit_water", json_string(dev->data.feeder.unit_water)) != 0 ||
-            json_object_set_new(root, "schedule", schedule) != 0) {
-            json_decref(schedule);
-            goto out;
-        }
+    case DEVICE_FEEDER:
+        JW_LIT(&w, ",\"type\":\"feeder\",\"state\":");
+        jw_state(&w, dev->data.feeder.state);
+        JW_LIT(&w, ",\"thuc_an_kg\":");
+        jw_real(&w, dev->data.feeder.W);
+        JW_LIT(&w, ",\"nuoc_l\":");
+        jw_real(&w, dev->data.feeder.Vw);
+        JW_LIT(&w, ",\"unit_food\":");
+        jw_interned(&w, cold->feeder.unit_food);
+        JW_LIT(&w, ",\"unit_water\":");
+        jw_interned(&w, cold->feeder.unit_water);
+        JW_LIT(&w, ",\"schedule\":");
+        jw_schedule(&w, cold->feeder.schedule, cold->feeder.schedule_count, 1);
         break;
-    }
-    case DEVICE_DRINKER: {
-        json_t *schedule = build_schedule_array(dev->data.drinker.schedule, dev->data.drinker.schedule_count, 0);
-        if (!schedule) {
-            goto out;
-        }
-        if (json_object_set_new(root, "type", json_string("drinker")) != 0 ||
-            json_object_set_new(root, "state", json_string(power_state_string(dev->data.drinker.state))) != 0 ||
-            json_object_set_new(root, "nuoc_l", json_real(dev->data.drinker.Vw)) != 0 ||
-            json_object_set_new(root, "unit_water", json_string(dev->data.drinker.unit_water)) != 0 ||
-            json_object_set_new(root, "schedule", schedule) != 0) {
-            json_decref(schedule);
-            goto out;
-        }
+    case DEVICE_DRINKER:
+        JW_LIT(&w, ",\"type\":\"drinker\",\"state\":");
+        jw_state(&w, dev->data.drinker.state);
+        JW_LIT(&w, ",\"nuoc_l\":");
+        jw_real(&w, dev->data.drinker.Vw);
+        JW_LIT(&w, ",\"unit_water\":");
+        jw_interned(&w, cold->drinker.unit_water);
+        JW_LIT(&w, ",\"schedule\":");
+        jw_schedule(&w, cold->drinker.schedule, cold->drinker.schedule_count, 0);
         break;
-    }
     default:
-        if (json_object_set_new(root, "type", json_string("unknown")) != 0) {
-            goto out;
-        }
+        JW_LIT(&w, ",\"type\":\"unknown\"");
         break;
     }
+    JW_LIT(&w, "}");
 
-    dumped = json_dumps(root, JSON_COMPACT | JSON_REAL_PRECISION(4));
-    if (!dumped) {
-        goto out;
-    }
-    size_t dumped_len = strlen(dumped);
-    if (dumped_len + 1 > out_len) {
-        goto out;
+    if (w.failed) {
+        out_json[0] = '\0';
+        return -1;
     }
-    memcpy(out_json, dumped, dumped_len + 1);
-    rc = 0;
-
-out:
-    free(dumped);
-    json_decref(root);
-    return rc;
+    return 0;
 }
 
-void devices_init_default_device(struct Device *dev, enum DeviceType type, const char *id, const char *password) {
+void devices_init_default_device(struct Device *dev, struct DeviceCold *cold, enum DeviceType type, const char *id,
+                                 const char *password) {
     switch (type) {
     case DEVICE_SENSOR:
-        init_sensor(dev, id);
+        init_sensor(dev, cold, id);
         break;
     case DEVICE_EGG_COUNTER:
-        init_egg_counter(dev, id);
+        init_egg_counter(dev, cold, id);
         break;
     case DEVICE_FAN:
-        init_fan(dev, id);
+        init_fan(dev, cold, id);
         break;
     case DEVICE_HEATER:
-        init_heater(dev, id);
+        init_heater(dev, cold, id);
         break;
     case DEVICE_SPRAYER:
-        init_sprayer(dev, id);
+        init_sprayer(dev, cold, id);
         break;
     case DEVICE_FEEDER:
-        init_feeder(dev, id);
+        init_feeder(dev, cold, id);
         break;
     case DEVICE_DRINKER:
-        init_drinker(dev, id);
+        init_drinker(dev, cold, id);
         break;
     default:
-        memset(dev, 0, sizeof(*dev));
-        strncpy(dev->identity.id, id, sizeof(dev->identity.id) - 1);
-        dev->identity.type = DEVICE_UNKNOWN;
-        strncpy(dev->password, "123456", sizeof(dev->password) - 1);
+        init_common(dev, cold, id, DEVICE_UNKNOWN);
         return;
     }
     if (password && password[0] != '\0') {
-        strncpy(dev->password, password, sizeof(dev->password) - 1);
-        dev->password[sizeof(dev->password) - 1] = '\0';
+        strncpy(cold->password, password, sizeof(cold->password) - 1);
+        cold->password[sizeof(cold->password) - 1] = '\0';
     }
 }
 
@@ -504,16 +922,34 @@ int devices_add(struct DevicesContext *ctx, const char *id, enum DeviceType type
     if (coop_id <= 0) {
         return -1;
     }
-    if (ctx->count >= MAX_DEVICES) {
-        return -2;
-    }
     if (devices_find(ctx, id) != NULL) {
         return -3; /* da ton tai */
     }
-    struct Device *dev = &ctx->devices[ctx->count];
-    memset(dev, 0, sizeof(*dev));
-    devices_init_default_device(dev, type, id, password ? password : "123456");
-    dev->identity.coop_id = coop_id;
-    ctx->count++;
+    struct Device dev;
+    struct DeviceCold cold;
+    devices_init_default_device(&dev, &cold, type, id, password ? password : "123456");
+    dev.identity.coop_id = coop_id;
+    const struct Device *added = devices_insert(ctx, &dev);
+    if (!added) {
+        return -2;
+    }
+    notify_change(added, DEVICE_CHANGE_UPDATED);
+    return 0;
+}
+
+int devices_remove(struct DevicesContext *ctx, const char *id) {
+    struct Device *dev = devices_find(ctx, id);
+    if (!dev) {
+        return -1;
+    }
+    notify_change(dev, DEVICE_CHANGE_REMOVED);
+    free(dev->cold);
+    intern_release(dev->id_handle);
+    size_t index = (size_t)(dev - ctx->devices);
+    coop_unlink(ctx, index);
+    memmove(dev, dev + 1, (ctx->count - index - 1) * sizeof(*dev));
+    ctx->count--;
+    id_index_rebuild(ctx);
+    coop_shift_links(ctx, index);
     return 0;
 }
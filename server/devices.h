@@ -2,6 +2,8 @@
 #define SERVER_DEVICES_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "intern.h"
 #include "../shared/config.h"
 #include "../shared/types.h"
 
@@ -18,12 +20,21 @@ struct ScheduleEntry {
     double water;   /* L */
 };
 
+/*
+ * Thiet bi duoc tach lam hai phan:
+ *  - Phan nong (`struct Device`, nam lien tiep trong `DevicesContext.devices`):
+ *    dinh danh, coop, trang thai va cac so do/nguong ma moi lan tim/quet/dieu
+ *    khien deu doc.
+ *  - Phan lanh (`struct DeviceCold`, moi thiet bi mot ban ghi rieng, tro toi qua
+ *    `Device.cold`): mat khau, lich va don vi, chi doc khi CONNECT/INFO/
+ *    SETCFG/ghi file.
+ * ID, don vi va mode heater la handle cua bang intern (`intern.h`).
+ */
+
 /** @brief Dữ liệu cho cảm biến nhiệt độ/độ ẩm. */
 struct SensorData {
     double temperature;
     double humidity;
-    char unit_temperature[4];
-    char unit_humidity[4];
 };
 
 /** @brief Dữ liệu cho bộ đếm trứng. */
@@ -36,19 +47,12 @@ struct FeederData {
     enum DevicePowerState state;
     double W;   /* kg per meal */
     double Vw;  /* L per meal */
-    char unit_food[8];
-    char unit_water[8];
-    struct ScheduleEntry schedule[MAX_SCHEDULE_ENTRIES];
-    size_t schedule_count;
 };
 
 /** @brief Dữ liệu/cấu hình cho máy cho uống. */
 struct DrinkerData {
     enum DevicePowerState state;
     double Vw;  /* L per meal */
-    char unit_water[8];
-    struct ScheduleEntry schedule[MAX_SCHEDULE_ENTRIES];
-    size_t schedule_count;
 };
 
 /** @brief Dữ liệu/cấu hình cho quạt. */
@@ -62,8 +66,7 @@ struct HeaterData {
     enum DevicePowerState state;
     double Tmin;
     double Tp2;
-    char mode[8];       /* e.g., AUTO/MANUAL */
-    char unit_temp[4];
+    uint32_t mode;      /* handle intern, vd INTERN_AUTO/INTERN_MANUAL */
 };
 
 /** @brief Dữ liệu/cấu hình cho máy phun sương. */
@@ -72,11 +75,9 @@ struct SprayerData {
     double Hmin;
     double Hp;
     double Vh;
-    char unit_humidity[4];
-    char unit_flow[8];  /* L/h */
 };
 
-/** @brief Union dữ liệu theo từng loại thiết bị. */
+/** @brief Union dữ liệu nóng theo từng loại thiết bị. */
 union DeviceData {
     struct SensorData sensor;
     struct EggCounterData egg_counter;
@@ -87,24 +88,175 @@ union DeviceData {
     struct SprayerData sprayer;
 };
 
-/** @brief Thiết bị trong hệ thống (định danh + mật khẩu + dữ liệu theo type). */
+/** @brief Phần lạnh của cảm biến. */
+struct SensorColdData {
+    uint32_t unit_temperature;  /* handle intern */
+    uint32_t unit_humidity;
+};
+
+/** @brief Phần lạnh của máy cho ăn. */
+struct FeederColdData {
+    uint32_t unit_food;     /* handle intern */
+    uint32_t unit_water;
+    struct ScheduleEntry schedule[MAX_SCHEDULE_ENTRIES];
+    size_t schedule_count;
+};
+
+/** @brief Phần lạnh của máy cho uống. */
+struct DrinkerColdData {
+    uint32_t unit_water;    /* handle intern */
+    struct ScheduleEntry schedule[MAX_SCHEDULE_ENTRIES];
+    size_t schedule_count;
+};
+
+/** @brief Phần lạnh của đèn sưởi. */
+struct HeaterColdData {
+    uint32_t unit_temp;     /* handle intern */
+};
+
+/** @brief Phần lạnh của máy phun sương. */
+struct SprayerColdData {
+    uint32_t unit_humidity; /* handle intern */
+    uint32_t unit_flow;     /* L/h */
+};
+
+/** @brief Union dữ liệu lạnh theo từng loại thiết bị. */
+union DeviceColdData {
+    struct SensorColdData sensor;
+    struct FeederColdData feeder;
+    struct DrinkerColdData drinker;
+    struct HeaterColdData heater;
+    struct SprayerColdData sprayer;
+};
+
+/** @brief Phần ít dùng của thiết bị: mật khẩu, lịch, đơn vị. */
+struct DeviceCold {
+    char password[MAX_PASSWORD_LEN];
+    union DeviceColdData data;
+};
+
+/**
+ * @brief Thiết bị trong hệ thống (phần nóng: định danh + trạng thái + số đo).
+ *
+ * `cold` luôn khác NULL với thiết bị trong context; bản ghi lạnh thuộc về
+ * context và bị giải phóng cùng thiết bị.
+ */
 struct Device {
     struct DeviceIdentity identity;
-    char password[MAX_PASSWORD_LEN];
     union DeviceData data;
+    unsigned long long version;  /* state version lan thay doi cuoi (khong luu ra file) */
+    unsigned long long seq;      /* thu tu them vao context, dung lam cursor SCAN */
+    unsigned long long telemetry_counter;  /* counter datagram UDP cuoi da nhan (luu ra file, chong phat lai sau restart) */
+    unsigned sched_gen;          /* the he lich trong scheduler (khong luu ra file) */
+    uint32_t id_handle;          /* handle intern cua identity.id (gan khi insert, giu mot tham chieu) */
+    uint32_t coop_prev;          /* danh sach thiet bi cung chuong: index + 1 (0 = het) */
+    uint32_t coop_next;
+    struct DeviceCold *cold;     /* mat khau, lich, don vi */
 };
 
-/** @brief Context quản lý danh sách thiết bị trên server. */
+/**
+ * @brief Đầu/cuối danh sách liên kết (intrusive, qua `Device.coop_prev/coop_next`)
+ *        các thiết bị của một chuồng, theo `seq` tăng dần.
+ */
+struct DeviceCoopList {
+    int coop_id;
+    uint32_t head;      /* index + 1 (0 = rong) */
+    uint32_t tail;
+    size_t count;
+};
+
+/**
+ * @brief Context quản lý danh sách thiết bị trên server.
+ *
+ * `devices` là mảng cấp phát động (tối đa `MAX_FARM_DEVICES`), luôn sắp xếp
+ * theo `seq` tăng dần: thêm mới ở cuối, xoá giữ nguyên thứ tự. Con trỏ tới
+ * phần tử có thể thay đổi sau mỗi lần thêm thiết bị.
+ */
 struct DevicesContext {
-    struct Device devices[MAX_DEVICES];
+    struct Device *devices;
     size_t count;
+    size_t capacity;
+    unsigned long long next_seq;
+    size_t *id_slots;   /* bang bam handle ID -> index + 1 (0 = trong), dung cho devices_find */
+    size_t id_mask;     /* so slot - 1 (luy thua 2) */
+    struct DeviceCoopList *coop_lists;  /* moi chuong (coop_id > 0) mot danh sach, sap theo coop_id */
+    size_t coop_list_count;
+    size_t coop_list_capacity;
+};
+
+/** @brief Loại thay đổi báo qua hook của `devices_set_change_hook()`. */
+enum DeviceChangeKind {
+    DEVICE_CHANGE_UPDATED = 0,  /* state/config thay doi hoac vua duoc them */
+    DEVICE_CHANGE_REMOVED       /* sap bi xoa khoi context */
 };
 
 /**
- * @brief Khởi tạo context thiết bị với dữ liệu mặc định.
+ * @brief Đăng ký hook được gọi sau mỗi mutator thành công (set_state, feed/drink/spray,
+ *        set_config_*, add, remove). NULL để tắt.
+ *
+ * Hook chạy đồng bộ trong mutator nên chỉ nên ghi nhận thay đổi (vd đánh dấu
+ * thiết bị cần push), không được thêm/xoá thiết bị.
+ */
+void devices_set_change_hook(void (*hook)(const struct Device *dev, enum DeviceChangeKind kind, void *user_data),
+                             void *user_data);
+
+/**
+ * @brief Khởi tạo context thiết bị rỗng (chưa cấp phát).
  */
 void devices_context_init(struct DevicesContext *ctx);
 
+/**
+ * @brief Giải phóng bộ nhớ của context và đưa về trạng thái rỗng.
+ */
+void devices_context_free(struct DevicesContext *ctx);
+
+/**
+ * @brief Thêm bản sao của `dev` vào cuối context và gán `seq` mới.
+ *
+ * Phần lạnh `*dev->cold` được chép sang bản ghi mới của context (NULL = rỗng);
+ * `identity.id` được intern vào `id_handle`; thiết bị được nối vào cuối danh
+ * sách của chuồng `identity.coop_id`.
+ * Không kiểm tra trùng ID (caller dùng `devices_find` trước nếu cần).
+ * @return Con trỏ tới bản sao trong context, NULL nếu đầy/hết bộ nhớ.
+ */
+struct Device *devices_insert(struct DevicesContext *ctx, const struct Device *dev);
+
+/**
+ * @brief Chuyển thiết bị sang chuồng `coop_id` (<= 0: không thuộc chuồng nào), cập nhật danh sách theo chuồng.
+ * @return 0 nếu thành công, -1 nếu hết bộ nhớ (thiết bị giữ chuồng cũ).
+ */
+int devices_set_coop(struct DevicesContext *ctx, struct Device *dev, int coop_id);
+
+/**
+ * @brief Danh sách thiết bị của chuồng `coop_id`; NULL nếu chuồng chưa từng có thiết bị.
+ *
+ * Duyệt theo `seq` tăng dần, O(số thiết bị của chuồng):
+ * `for (uint32_t k = list->head; k != 0; k = ctx->devices[k - 1].coop_next)`.
+ * Danh sách được giữ đúng qua insert/xoá/`devices_set_coop()`; không sửa
+ * `identity.coop_id` trực tiếp trên thiết bị trong context.
+ */
+const struct DeviceCoopList *devices_coop_list(const struct DevicesContext *ctx, int coop_id);
+
+/**
+ * @brief Cấp trước chỗ cho tổng cộng `count` thiết bị (tối đa `MAX_FARM_DEVICES`).
+ *
+ * Một lần realloc và một lần dựng bảng băm ID thay vì dựng lại ở mỗi lần mảng
+ * tăng gấp đôi; dùng trước khi chèn hàng loạt (IMPORT).
+ * @return 0 nếu thành công, -1 nếu hết bộ nhớ (context giữ nguyên).
+ */
+int devices_reserve(struct DevicesContext *ctx, size_t count);
+
+/**
+ * @brief Tìm thiết bị theo `seq` (tìm nhị phân). NULL nếu không còn.
+ */
+struct Device *devices_find_seq(struct DevicesContext *ctx, unsigned long long seq);
+
+/**
+ * @brief Vị trí thiết bị đầu tiên có `seq > after_seq` (tìm nhị phân).
+ * @return Index trong `ctx->devices`, bằng `ctx->count` nếu không còn thiết bị nào.
+ */
+size_t devices_index_after_seq(const struct DevicesContext *ctx, unsigned long long after_seq);
+
 /**
  * @brief Quét danh sách thiết bị hiện có và copy ra mảng `DeviceIdentity`.
  * @return Số phần tử đã ghi vào `out`.
@@ -112,11 +264,16 @@ void devices_context_init(struct DevicesContext *ctx);
 size_t devices_scan(const struct DevicesContext *ctx, struct DeviceIdentity *out, size_t max_out);
 
 /**
- * @brief Tìm thiết bị theo ID (bản mutable).
+ * @brief Tìm thiết bị theo ID (bản mutable), O(1) trung bình qua bảng băm ID.
+ *
+ * ID chưa từng được intern bị loại ngay mà không chạm vào mảng thiết bị.
  * @return Con trỏ tới thiết bị nếu tìm thấy, NULL nếu không có.
  */
 struct Device *devices_find(struct DevicesContext *ctx, const char *id);
 
+/** @brief Như `devices_find()` nhưng theo handle intern của ID (so sánh số nguyên). */
+struct Device *devices_find_handle(struct DevicesContext *ctx, uint32_t id_handle);
+
 /**
  * @brief Đổi mật khẩu thiết bị.
  * @return 0 nếu thành công, -2 nếu sai mật khẩu cũ, giá trị âm khác nếu lỗi.
@@ -135,14 +292,26 @@ int devices_feed_now(struct Device *dev, double food, double water);
 /** @brief Cho uống ngay (chỉ áp dụng cho `DEVICE_DRINKER`). */
 int devices_drink_now(struct Device *dev, double water);
 
+/**
+ * @brief Ghi số đo mới của cảm biến (`DEVICE_SENSOR`); NAN giữ nguyên giá trị cũ.
+ * @return 1 nếu giá trị thay đổi, 0 nếu giống cũ, -1 nếu sai loại, -2 nếu ngoài giới hạn.
+ */
+int devices_report_sensor(struct Device *dev, double temperature, double humidity);
+
+/**
+ * @brief Ghi số trứng mới của bộ đếm trứng (`DEVICE_EGG_COUNTER`).
+ * @return 1 nếu giá trị thay đổi, 0 nếu giống cũ, -1 nếu sai loại, -2 nếu ngoài giới hạn.
+ */
+int devices_report_eggs(struct Device *dev, int egg_count);
+
 /** @brief Phun ngay (chỉ áp dụng cho `DEVICE_SPRAYER`). */
 int devices_spray_now(struct Device *dev, double Vh);
 
 /** @brief Cập nhật cấu hình quạt (tốc độ 1..3). */
 int devices_set_config_fan(struct Device *dev, int speed);
 
-/** @brief Cập nhật cấu hình đèn sưởi (ngưỡng bật/tắt + mode). */
-int devices_set_config_heater(struct Device *dev, double Tmin, double Tp2, const char *mode);
+/** @brief Cập nhật cấu hình đèn sưởi (ngưỡng bật/tắt + mode; `INTERN_EMPTY` giữ mode cũ). */
+int devices_set_config_heater(struct Device *dev, double Tmin, double Tp2, uint32_t mode);
 
 /** @brief Cập nhật cấu hình phun sương (ngưỡng độ ẩm + lưu lượng). */
 int devices_set_config_sprayer(struct Device *dev, double Hmin, double Hp, double Vh);
@@ -166,10 +335,22 @@ int devices_info_json(const struct Device *dev, char *out_json, size_t out_len);
  */
 int devices_add(struct DevicesContext *ctx, const char *id, enum DeviceType type, const char *password, int coop_id);
 
+/**
+ * @brief Xoá thiết bị khỏi context, giữ nguyên thứ tự các thiết bị còn lại.
+ *
+ * Tham chiếu intern của ID được trả sau khi báo `DEVICE_CHANGE_REMOVED`.
+ * @return 0 nếu đã xoá, -1 nếu không tìm thấy/tham số sai.
+ */
+int devices_remove(struct DevicesContext *ctx, const char *id);
+
 /* Tao thiet bi voi thong so mac dinh theo type (phuc vu load file scan/devices). */
 /**
  * @brief Khởi tạo struct `Device` với thông số mặc định theo `type`.
+ *
+ * `cold` (do caller cấp, thường trên stack) được gắn vào `dev->cold` và điền
+ * mật khẩu/lịch/đơn vị mặc định; `devices_insert()` sẽ chép nó vào context.
  */
-void devices_init_default_device(struct Device *dev, enum DeviceType type, const char *id, const char *password);
+void devices_init_default_device(struct Device *dev, struct DeviceCold *cold, enum DeviceType type, const char *id,
+                                 const char *password);
 
 #endif /* SERVER_DEVICES_H */
@@ -0,0 +1,478 @@
+#include "farm_snapshot.h"
+#include "cmd_args.h"
+#include "intern.h"
+#include "../shared/config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file farm_snapshot.c
+ * @brief Dựng/công bố snapshot (writer) và thu hồi bộ nhớ theo epoch; đọc snapshot (reader).
+ */
+
+/** @brief Ô công bố epoch của một reader, mỗi ô một cache line. */
+struct SnapReader {
+    unsigned long long epoch;   // 0 = khong doc
+    char pad[64 - sizeof(unsigned long long)];
+};
+
+/** @brief Khối đã bị thay thế, chờ hết grace period để free. */
+struct SnapRetired {
+    void *ptr;
+    unsigned long long epoch;
+};
+
+static struct SnapReader g_readers[FARM_SNAPSHOT_MAX_READERS] __attribute__((aligned(64)));
+static unsigned g_reader_count;
+static unsigned long long g_epoch = 1;
+static const struct FarmSnapshot *g_current;
+static struct FarmSnapshot *g_prepared;       /* da dung, cho farm_snapshot_commit() */
+static unsigned long long g_valid_batch;
+
+/* Chi writer dung */
+static struct SnapRetired *g_limbo;
+static size_t g_limbo_count;
+static size_t g_limbo_cap;
+static struct FarmSnapshotStats g_stats;
+
+/** @brief Render một thiết bị thành bản ghi snapshot (JSON INFO đã sẵn). */
+static struct SnapDevice *snap_device_render(const struct Device *dev) {
+    char json[MAX_JSON_LEN];
+    int ok = devices_info_json(dev, json, sizeof(json)) == 0;
+    size_t len = ok ? strlen(json) : 0;
+    struct SnapDevice *rec = (struct SnapDevice *)malloc(sizeof(*rec) + len + 1);
+    if (!rec) {
+        return NULL;
+    }
+    rec->seq = dev->seq;
+    rec->version = dev->version;
+    rec->identity = dev->identity;
+    rec->hash = intern_handle_hash(dev->id_handle);
+    rec->json_ok = ok;
+    memcpy(rec->json, ok ? json : "", len + 1);
+    g_stats.rendered++;
+    return rec;
+}
+
+/** @brief Dựng bảng băm ID cho `snap` (kích thước >= 2 lần số thiết bị). */
+static struct SnapIndex *snap_index_build(const struct FarmSnapshot *snap) {
+    size_t cap = 16;
+    while (cap < snap->count * 2) cap *= 2;
+    struct SnapIndex *index = (struct SnapIndex *)calloc(1, sizeof(*index) + cap * sizeof(index->slots[0]));
+    if (!index) {
+        return NULL;
+    }
+    index->mask = cap - 1;
+    for (size_t i = 0; i < snap->count; ++i) {
+        size_t at = snap->devices[i]->hash & index->mask;
+        while (index->slots[at] != 0) at = (at + 1) & index->mask;
+        index->slots[at] = (uint32_t)(i + 1);
+    }
+    return index;
+}
+
+/** @brief Chép danh sách chuồng hiện tại. */
+static struct SnapCoops *snap_coops_copy(const struct CoopsContext *coops) {
+    size_t n = coops ? coops->count : 0;
+    struct SnapCoops *copy = (struct SnapCoops *)malloc(sizeof(*copy) + n * sizeof(copy->coops[0]));
+    if (!copy) {
+        return NULL;
+    }
+    copy->count = n;
+    if (n > 0) {
+        memcpy(copy->coops, coops->coops, n * sizeof(copy->coops[0]));
+    }
+    return copy;
+}
+
+/** @brief Bản ghi `rec` có nằm ở vị trí tương ứng (theo seq) trong `snap` không. */
+static int snap_holds(const struct FarmSnapshot *snap, const struct SnapDevice *rec) {
+    size_t lo = 0, hi = snap->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (snap->devices[mid]->seq < rec->seq) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < snap->count && snap->devices[lo] == rec;
+}
+
+/** @brief Đảm bảo limbo còn chỗ cho `extra` khối nữa. */
+static int limbo_reserve(size_t extra) {
+    if (g_limbo_count + extra <= g_limbo_cap) {
+        return 0;
+    }
+    size_t cap = g_limbo_cap ? g_limbo_cap : 64;
+    while (cap < g_limbo_count + extra) cap *= 2;
+    struct SnapRetired *grown = (struct SnapRetired *)realloc(g_limbo, cap * sizeof(*grown));
+    if (!grown) {
+        return -1;
+    }
+    g_limbo = grown;
+    g_limbo_cap = cap;
+    return 0;
+}
+
+static void retire(const void *ptr, unsigned long long epoch) {
+    g_limbo[g_limbo_count].ptr = (void *)ptr;
+    g_limbo[g_limbo_count].epoch = epoch;
+    g_limbo_count++;
+}
+
+/** @brief Free mọi khối bị thay thế trước epoch nhỏ nhất mà reader đang đọc còn giữ. */
+static void reclaim(void) {
+    unsigned long long oldest = ~0ULL;
+    unsigned n = __atomic_load_n(&g_reader_count, __ATOMIC_ACQUIRE);
+    if (n > FARM_SNAPSHOT_MAX_READERS) n = FARM_SNAPSHOT_MAX_READERS;
+    for (unsigned i = 0; i < n; ++i) {
+        unsigned long long e = __atomic_load_n(&g_readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (e != 0 && e < oldest) oldest = e;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < g_limbo_count; ++i) {
+        if (g_limbo[i].epoch < oldest) {
+            free(g_limbo[i].ptr);
+        } else {
+            g_limbo[kept++] = g_limbo[i];
+        }
+    }
+    g_limbo_count = kept;
+}
+
+/** @brief Free các bản ghi mới dựng của `snap` (publish thất bại giữa chừng). */
+static void discard_fresh(struct FarmSnapshot *snap, size_t built, const struct FarmSnapshot *old) {
+    for (size_t i = 0; i < built; ++i) {
+        if (!old || !snap_holds(old, snap->devices[i])) {
+            free((void *)snap->devices[i]);
+        }
+    }
+    free(snap);
+}
+
+/** @see farm_snapshot_prepare() */
+int farm_snapshot_prepare(const struct FarmSnapshotSource *src) {
+    if (!src || !src->devices || g_prepared) {
+        return -1;
+    }
+    const struct FarmSnapshot *old = g_current; /* chi writer ghi g_current */
+    const struct DevicesContext *devs = src->devices;
+    size_t n = devs->count;
+    struct FarmSnapshot *snap = (struct FarmSnapshot *)malloc(sizeof(*snap) + n * sizeof(snap->devices[0]));
+    if (!snap) {
+        return -1;
+    }
+    snap->state_version = src->state_version;
+    snap->count = n;
+
+    /* Duyet song song hai day (deu sap theo seq): dung lai ban ghi cu neu version khong doi */
+    int members_changed = old == NULL;
+    size_t oi = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const struct Device *dev = &devs->devices[i];
+        while (old && oi < old->count && old->devices[oi]->seq < dev->seq) {
+            oi++;
+            members_changed = 1;
+        }
+        const struct SnapDevice *prev = NULL;
+        if (old && oi < old->count && old->devices[oi]->seq == dev->seq) {
+            prev = old->devices[oi++];
+        } else {
+            members_changed = 1;
+        }
+        if (prev && prev->version == dev->version) {
+            snap->devices[i] = prev;
+            continue;
+        }
+        struct SnapDevice *rec = snap_device_render(dev);
+        if (!rec) {
+            discard_fresh(snap, i, old);
+            return -1;
+        }
+        snap->devices[i] = rec;
+    }
+    if (old && oi < old->count) {
+        members_changed = 1;
+    }
+
+    struct SnapIndex *index = NULL;
+    struct SnapCoops *coops = NULL;
+    if (members_changed && (index = snap_index_build(snap)) == NULL) {
+        discard_fresh(snap, n, old);
+        return -1;
+    }
+    if ((src->coops || !old) && (coops = snap_coops_copy(src->coops)) == NULL) {
+        free(index);
+        discard_fresh(snap, n, old);
+        return -1;
+    }
+    /* Snapshot cu + index + coops + moi ban ghi cu: du cho so khoi se retire */
+    if (old && limbo_reserve(3 + old->count) != 0) {
+        free(coops);
+        free(index);
+        discard_fresh(snap, n, old);
+        return -1;
+    }
+    snap->index = index ? index : old->index;
+    snap->coops = coops ? coops : old->coops;
+    if (src->sessions || !old) {
+        snap->session_count = src->sessions ? src->session_count : 0;
+        if (snap->session_count > MAX_DEVICES) snap->session_count = MAX_DEVICES;
+        if (snap->session_count > 0) {
+            memcpy(snap->sessions, src->sessions, snap->session_count * sizeof(snap->sessions[0]));
+        }
+    } else {
+        snap->session_count = old->session_count;
+        memcpy(snap->sessions, old->sessions, sizeof(snap->sessions));
+    }
+
+    g_prepared = snap;
+    return 0;
+}
+
+/** @see farm_snapshot_commit() */
+void farm_snapshot_commit(void) {
+    struct FarmSnapshot *snap = g_prepared;
+    if (!snap) {
+        return;
+    }
+    g_prepared = NULL;
+    const struct FarmSnapshot *old = g_current;
+    size_t n = snap->count;
+    __atomic_store_n(&g_current, snap, __ATOMIC_SEQ_CST);
+    g_stats.publishes++;
+    if (old) {
+        /* Reader vao o epoch <= e co the con giu phan cu; reader vao sau khi epoch tang thi khong */
+        unsigned long long e = __atomic_load_n(&g_epoch, __ATOMIC_RELAXED);
+        size_t ni = 0;
+        for (size_t k = 0; k < old->count; ++k) {
+            const struct SnapDevice *rec = old->devices[k];
+            while (ni < n && snap->devices[ni]->seq < rec->seq) ni++;
+            if (ni < n && snap->devices[ni] == rec) continue;
+            retire(rec, e);
+        }
+        if (snap->index != old->index) retire(old->index, e);
+        if (snap->coops != old->coops) retire(old->coops, e);
+        retire(old, e);
+        __atomic_store_n(&g_epoch, e + 1, __ATOMIC_SEQ_CST);
+    }
+    reclaim();
+}
+
+/** @see farm_snapshot_publish() */
+int farm_snapshot_publish(const struct FarmSnapshotSource *src) {
+    if (farm_snapshot_prepare(src) != 0) {
+        return -1;
+    }
+    farm_snapshot_commit();
+    return 0;
+}
+
+/** @see farm_snapshot_mark_valid() */
+void farm_snapshot_mark_valid(unsigned long long batch) {
+    __atomic_store_n(&g_valid_batch, batch, __ATOMIC_RELEASE);
+}
+
+/** @see farm_snapshot_valid_batch() */
+unsigned long long farm_snapshot_valid_batch(void) {
+    return __atomic_load_n(&g_valid_batch, __ATOMIC_ACQUIRE);
+}
+
+/** @see farm_snapshot_reader_register() */
+int farm_snapshot_reader_register(void) {
+    unsigned idx = __atomic_fetch_add(&g_reader_count, 1, __ATOMIC_ACQ_REL);
+    return idx < FARM_SNAPSHOT_MAX_READERS ? (int)idx : -1;
+}
+
+/** @see farm_snapshot_enter() */
+const struct FarmSnapshot *farm_snapshot_enter(int reader) {
+    struct SnapReader *r = &g_readers[reader];
+    /* Cong bo epoch truoc khi nap con tro (seq_cst ca hai phia) */
+    __atomic_store_n(&r->epoch, __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&g_current, __ATOMIC_SEQ_CST);
+}
+
+/** @see farm_snapshot_exit() */
+void farm_snapshot_exit(int reader) {
+    __atomic_store_n(&g_readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/** @see farm_snapshot_find() */
+const struct SnapDevice *farm_snapshot_find(const struct FarmSnapshot *snap, const char *id) {
+    if (!snap || !id || snap->count == 0) {
+        return NULL;
+    }
+    const struct SnapIndex *index = snap->index;
+    size_t at = intern_hash(id, strlen(id)) & index->mask;
+    uint32_t pos;
+    while ((pos = index->slots[at]) != 0) {
+        const struct SnapDevice *rec = snap->devices[pos - 1];
+        if (strcmp(rec->identity.id, id) == 0) {
+            return rec;
+        }
+        at = (at + 1) & index->mask;
+    }
+    return NULL;
+}
+
+/** @brief Vị trí đầu tiên có seq > `after_seq` (tìm nhị phân). */
+static size_t snap_index_after_seq(const struct FarmSnapshot *snap, unsigned long long after_seq) {
+    size_t lo = 0, hi = snap->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (snap->devices[mid]->seq <= after_seq) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static const struct CoopMeta *snap_find_coop(const struct FarmSnapshot *snap, int id) {
+    for (size_t i = 0; i < snap->coops->count; ++i) {
+        if (snap->coops->coops[i].id == id) return &snap->coops->coops[i];
+    }
+    return NULL;
+}
+
+/** @brief INFO: kiểm tra session rồi trả JSON đã render sẵn. */
+static void serve_info(const struct FarmSnapshot *snap, const char *args, char *line, size_t len) {
+    char dev_id[MAX_ID_LEN], token[MAX_TOKEN_LEN];
+    if (!args || sscanf(args, "%31s %63s", dev_id, token) != 2) {
+        protocol_format_bad_request(line, len);
+        return;
+    }
+    const struct Session *session = NULL;
+    for (size_t i = 0; i < snap->session_count; ++i) {
+        if (strcmp(snap->sessions[i].token, token) == 0) {
+            session = &snap->sessions[i];
+            break;
+        }
+    }
+    if (!session || strncmp(session->device_id, dev_id, sizeof(session->device_id)) != 0) {
+        protocol_format_not_connected(line, len);
+        return;
+    }
+    const struct SnapDevice *rec = farm_snapshot_find(snap, dev_id);
+    if (!rec) {
+        protocol_format_no_device_err(line, len);
+        return;
+    }
+    if (!rec->json_ok) {
+        protocol_format_bad_request(line, len);
+        return;
+    }
+    protocol_format_info_ok(line, len, rec->json);
+}
+
+/** @brief COOPLIST (mọi dạng), giống `handle_coop_list()` của actor. */
+static void serve_coop_list(const struct FarmSnapshot *snap, char *args,
+                            void (*emit)(const char *line, void *user_data), void *user_data) {
+    char line[MAX_LINE_LEN];
+    struct ScanQuery q;
+    if (parse_scan_query(args, &q) != 0 || q.since_set || q.coop_id > 0) {
+        protocol_format_bad_request(line, sizeof(line));
+        emit(line, user_data);
+        return;
+    }
+    const struct SnapCoops *coops = snap->coops;
+    int paged = args && *args != '\0';
+    if (!paged && coops->count == 0) {
+        protocol_format_no_coop(line, sizeof(line));
+        emit(line, user_data);
+        return;
+    }
+    size_t start = q.after_seq < coops->count ? (size_t)q.after_seq : coops->count;
+    size_t end = coops->count;
+    if (q.limit > 0 && end - start > q.limit) {
+        end = start + q.limit;
+    }
+    for (size_t i = start; i < end; ++i) {
+        protocol_format_coop(line, sizeof(line), coops->coops[i].id, coops->coops[i].name);
+        emit(line, user_data);
+    }
+    if (!paged) return;
+    if (end < coops->count) {
+        protocol_format_coop_more(line, sizeof(line), end);
+    } else {
+        protocol_format_coop_end(line, sizeof(line));
+    }
+    emit(line, user_data);
+}
+
+/** @brief Trang SCAN có cursor, giống nhánh `has_cursor` của `handle_scan_paged()`. */
+static void serve_scan_page(const struct FarmSnapshot *snap, struct ScanQuery *q,
+                            void (*emit)(const char *line, void *user_data), void *user_data) {
+    char line[MAX_LINE_LEN];
+    if (q->coop_id > 0 && !snap_find_coop(snap, q->coop_id)) {
+        protocol_format_no_coop(line, sizeof(line));
+        emit(line, user_data);
+        return;
+    }
+    if (q->snapshot == 0) {
+        q->snapshot = snap->state_version;
+    }
+    size_t sent = 0;
+    for (size_t i = snap_index_after_seq(snap, q->after_seq); i < snap->count; ++i) {
+        const struct SnapDevice *rec = snap->devices[i];
+        if (q->coop_id > 0 && rec->identity.coop_id != q->coop_id) continue;
+        if (rec->version <= q->since) continue;
+        if (q->limit > 0 && sent == q->limit) {
+            protocol_format_scan_more(line, sizeof(line), snap->devices[i - 1]->seq, q->snapshot);
+            emit(line, user_data);
+            return;
+        }
+        if (q->since_set) {
+            protocol_format_device_delta(line, sizeof(line), rec->identity.id, rec->identity.type,
+                                         rec->identity.coop_id, rec->version);
+        } else {
+            protocol_format_device_ex(line, sizeof(line), rec->identity.id, rec->identity.type,
+                                      rec->identity.coop_id);
+        }
+        emit(line, user_data);
+        sent++;
+    }
+    protocol_format_scan_end(line, sizeof(line), q->snapshot);
+    emit(line, user_data);
+}
+
+/** @see farm_snapshot_serve() */
+int farm_snapshot_serve(const struct FarmSnapshot *snap, enum CommandType cmd, char *args,
+                        void (*emit)(const char *line, void *user_data), void *user_data) {
+    if (!snap) {
+        return 0;
+    }
+    char line[MAX_LINE_LEN];
+    switch (cmd) {
+    case CMD_INFO:
+        serve_info(snap, args, line, sizeof(line));
+        emit(line, user_data);
+        return 1;
+    case CMD_COOP_LIST:
+        serve_coop_list(snap, args, emit, user_data);
+        return 1;
+    case CMD_SCAN: {
+        /* Trang dau (merge file farm, SCAN_RESET, tombstone) va lenh sai format de actor tra loi */
+        struct ScanQuery q;
+        char copy[MAX_LINE_LEN];
+        if (!args) return 0;
+        snprintf(copy, sizeof(copy), "%s", args);
+        if (parse_scan_query(copy, &q) != 0 || !q.has_cursor) return 0;
+        serve_scan_page(snap, &q, emit, user_data);
+        return 1;
+    }
+    default:
+        return 0;
+    }
+}
+
+/** @see farm_snapshot_get_stats() */
+void farm_snapshot_get_stats(struct FarmSnapshotStats *out) {
+    if (!out) return;
+    *out = g_stats;
+    out->limbo = g_limbo_count;
+}
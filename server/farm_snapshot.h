@@ -0,0 +1,137 @@
+#ifndef SERVER_FARM_SNAPSHOT_H
+#define SERVER_FARM_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "coops.h"
+#include "devices.h"
+#include "session_auth.h"
+#include "../shared/protocol.h"
+#include "../shared/types.h"
+
+/**
+ * @file farm_snapshot.h
+ * @brief Snapshot bất biến của registry thiết bị/chuồng cho các lệnh chỉ đọc (RCU theo epoch).
+ *
+ * State actor (writer duy nhất) công bố phiên bản mới ở cuối lô bằng một phép
+ * gán con trỏ; reader (thread mạng, benchmark) đọc snapshot hiện tại không
+ * khoá, không atomic trên đường duyệt. Bản ghi thiết bị không đổi được dùng
+ * chung giữa các phiên bản, chỉ thiết bị có version mới được render lại.
+ *
+ * Thu hồi theo epoch: reader công bố epoch toàn cục khi vào (`farm_snapshot_enter()`)
+ * và xoá khi ra; phần bị thay thế ở epoch E chỉ được free khi mọi reader đang
+ * đọc đều đã vào sau E (grace period), nên reader không bao giờ thấy bộ nhớ đã free.
+ */
+
+/** @brief Một thiết bị trong snapshot: định danh + JSON INFO đã render sẵn. */
+struct SnapDevice {
+    unsigned long long seq;
+    unsigned long long version;
+    struct DeviceIdentity identity;
+    uint32_t hash;               // intern_hash() của ID
+    int json_ok;                 // 0 nếu devices_info_json() lỗi (INFO trả BAD_REQUEST)
+    char json[];
+};
+
+/** @brief Bảng băm ID -> vị trí trong `FarmSnapshot.devices` (dùng chung khi tập thiết bị không đổi). */
+struct SnapIndex {
+    size_t mask;
+    uint32_t slots[];            // vi tri + 1, 0 = o trong
+};
+
+/** @brief Bản chép danh sách chuồng (dùng chung khi chuồng không đổi). */
+struct SnapCoops {
+    size_t count;
+    struct CoopMeta coops[];
+};
+
+/** @brief Một phiên bản farm; mọi thứ reader thấy qua con trỏ này đều bất biến. */
+struct FarmSnapshot {
+    unsigned long long state_version;
+    const struct SnapIndex *index;
+    const struct SnapCoops *coops;
+    size_t session_count;
+    struct Session sessions[MAX_DEVICES];
+    size_t count;
+    const struct SnapDevice *devices[];  // Sắp theo seq như DevicesContext
+};
+
+/** @brief Nguồn để dựng snapshot mới (chỉ actor gọi). */
+struct FarmSnapshotSource {
+    const struct DevicesContext *devices;
+    const struct CoopsContext *coops;   // NULL: giữ danh sách chuồng của snapshot trước
+    const struct Session *sessions;     // NULL: giữ session của snapshot trước
+    size_t session_count;
+    unsigned long long state_version;
+};
+
+/** @brief Số liệu của cơ chế snapshot. */
+struct FarmSnapshotStats {
+    unsigned long publishes;     /* so phien ban da cong bo */
+    unsigned long rendered;      /* so ban ghi thiet bi da render lai */
+    size_t limbo;                /* so khoi cho het grace period */
+};
+
+/**
+ * @brief Dựng snapshot mới từ `src`, công bố và thu hồi phần cũ đã hết grace period.
+ *
+ * Chỉ gọi từ một thread (writer). Hết bộ nhớ thì snapshot cũ vẫn giữ nguyên.
+ * @return 0 nếu thành công, -1 nếu lỗi.
+ */
+int farm_snapshot_publish(const struct FarmSnapshotSource *src);
+
+/**
+ * @brief Dựng snapshot mới từ `src` nhưng chưa công bố (xem `farm_snapshot_commit()`).
+ *
+ * Dùng khi state chỉ được phép lộ ra sau một sự kiện khác (farm đã ghi xong).
+ * Chỉ có tối đa một snapshot chờ, và không được công bố snapshot nào khác trong lúc chờ.
+ * @return 0 nếu thành công, -1 nếu lỗi hoặc đã có snapshot chờ.
+ */
+int farm_snapshot_prepare(const struct FarmSnapshotSource *src);
+
+/** @brief Công bố snapshot đã dựng bằng `farm_snapshot_prepare()` (không có thì bỏ qua). */
+void farm_snapshot_commit(void);
+
+/**
+ * @brief Ghi nhận snapshot hiện tại phản ánh state tới hết lô `batch` (writer gọi).
+ *
+ * Thread mạng chỉ trả lời từ snapshot cho kết nối đã thấy response của lô <= giá trị này.
+ */
+void farm_snapshot_mark_valid(unsigned long long batch);
+
+/** @brief Lô mới nhất mà snapshot hiện tại phản ánh (đọc từ thread bất kỳ). */
+unsigned long long farm_snapshot_valid_batch(void);
+
+/**
+ * @brief Đăng ký thread đọc; mỗi thread gọi một lần.
+ * @return Mã reader (>=0) cho `farm_snapshot_enter()`, -1 nếu đã đủ `FARM_SNAPSHOT_MAX_READERS`.
+ */
+int farm_snapshot_reader_register(void);
+
+/**
+ * @brief Bắt đầu một lượt đọc; snapshot trả về sống tới `farm_snapshot_exit()`.
+ * @return Snapshot hiện tại, NULL nếu chưa công bố lần nào (vẫn phải gọi exit).
+ */
+const struct FarmSnapshot *farm_snapshot_enter(int reader);
+
+/** @brief Kết thúc lượt đọc (không giữ con trỏ nào từ snapshot sau lời gọi này). */
+void farm_snapshot_exit(int reader);
+
+/** @brief Tìm thiết bị theo ID trong snapshot (NULL nếu không có). */
+const struct SnapDevice *farm_snapshot_find(const struct FarmSnapshot *snap, const char *id);
+
+/**
+ * @brief Trả lời lệnh chỉ đọc từ snapshot, cùng format với actor.
+ *
+ * Hỗ trợ INFO, COOPLIST và các trang SCAN có `cursor=`; SCAN trang đầu cần
+ * merge file farm và tombstone nên vẫn do actor xử lý. `args` chỉ bị sửa khi
+ * hàm trả 1, nên dòng bị từ chối vẫn chuyển nguyên cho actor được.
+ * @return 1 nếu đã trả lời (đã gọi `emit` cho từng dòng), 0 nếu phải chuyển cho actor.
+ */
+int farm_snapshot_serve(const struct FarmSnapshot *snap, enum CommandType cmd, char *args,
+                        void (*emit)(const char *line, void *user_data), void *user_data);
+
+/** @brief Lấy số liệu snapshot (gọi từ writer). */
+void farm_snapshot_get_stats(struct FarmSnapshotStats *out);
+
+#endif /* SERVER_FARM_SNAPSHOT_H */
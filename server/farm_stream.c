@@ -0,0 +1,580 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "farm_stream.h"
+#include "../shared/config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file farm_stream.c
+ * @brief Lexer JSON đọc qua buffer cố định và bộ duyệt theo schema farm.
+ */
+
+enum {
+    STREAM_MAX_DEPTH = 2048,    /* do sau toi da nhu jansson */
+    STREAM_NUMBER_MAX = 512,    /* ky tu toi da cua mot so */
+    STREAM_KEY_MATCH = 16       /* khoa o muc schema dai hon thi khong khop truong nao */
+};
+
+struct StreamReader {
+    FILE *f;
+    char *buf;                  /* FARM_STREAM_BUFFER byte */
+    size_t pos;
+    size_t len;
+    int eof;
+    int limited;                /* dang dung cay cho mot muc: moi byte tru vao budget */
+    size_t budget;
+    char *tok;                  /* chuoi vua doc (neu giu), ket thuc bang NUL */
+    size_t tok_len;
+    size_t tok_cap;
+    int tok_truncated;          /* chuoi dai hon gioi han giu */
+    uint32_t crc;               /* CRC cua moi byte truoc buf + crc_pos */
+    size_t crc_pos;
+    const struct FarmStreamHandler *h;
+};
+
+/** @brief Byte kế tiếp (chưa đọc qua), -1 nếu hết file/lỗi đọc. */
+static int rd_peek(struct StreamReader *r) {
+    if (r->pos == r->len) {
+        if (r->eof) return -1;
+        r->crc = farm_stream_crc32(r->crc, r->buf + r->crc_pos, r->len - r->crc_pos);
+        r->crc_pos = 0;
+        r->len = fread(r->buf, 1, FARM_STREAM_BUFFER, r->f);
+        r->pos = 0;
+        if (r->len == 0) {
+            r->eof = 1;
+            return -1;
+        }
+    }
+    return (unsigned char)r->buf[r->pos];
+}
+
+/** @brief Đọc qua một byte; -1 nếu hết file hoặc mục đang dựng vượt giới hạn. */
+static int rd_get(struct StreamReader *r) {
+    int c = rd_peek(r);
+    if (c < 0) return -1;
+    if (r->limited) {
+        if (r->budget == 0) return -1;
+        r->budget--;
+    }
+    r->pos++;
+    return c;
+}
+
+/** @brief CRC của mọi byte trước vị trí đọc hiện tại. */
+static uint32_t rd_crc(struct StreamReader *r) {
+    r->crc = farm_stream_crc32(r->crc, r->buf + r->crc_pos, r->pos - r->crc_pos);
+    r->crc_pos = r->pos;
+    return r->crc;
+}
+
+/** @brief Bỏ khoảng trắng; trả ký tự kế tiếp (chưa đọc qua). */
+static int rd_peek_token(struct StreamReader *r) {
+    for (;;) {
+        int c = rd_peek(r);
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return c;
+        if (rd_get(r) < 0) return -1;
+    }
+}
+
+/** @brief Bỏ khoảng trắng rồi đọc qua ký tự kế tiếp. */
+static int rd_next_token(struct StreamReader *r) {
+    return rd_peek_token(r) < 0 ? -1 : rd_get(r);
+}
+
+static int tok_push(struct StreamReader *r, const char *bytes, size_t n, size_t keep_max) {
+    if (r->tok_len + n > keep_max) {
+        r->tok_truncated = 1;
+        return 0;
+    }
+    if (r->tok_len + n + 1 > r->tok_cap) {
+        size_t cap = r->tok_cap ? r->tok_cap * 2 : 256;
+        while (cap < r->tok_len + n + 1) cap *= 2;
+        char *grown = (char *)realloc(r->tok, cap);
+        if (!grown) return -1;
+        r->tok = grown;
+        r->tok_cap = cap;
+    }
+    memcpy(r->tok + r->tok_len, bytes, n);
+    r->tok_len += n;
+    r->tok[r->tok_len] = '\0';
+    return 0;
+}
+
+static long read_hex4(struct StreamReader *r) {
+    long v = 0;
+    for (int i = 0; i < 4; ++i) {
+        int c = rd_get(r);
+        if (c >= '0' && c <= '9') v = v * 16 + (c - '0');
+        else if (c >= 'a' && c <= 'f') v = v * 16 + (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v = v * 16 + (c - 'A' + 10);
+        else return -1;
+    }
+    return v;
+}
+
+static size_t utf8_encode(long cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/** @brief Đọc phần còn lại của một ký tự UTF-8 bắt đầu bằng `lead`; 0 nếu không hợp lệ. */
+static size_t read_utf8(struct StreamReader *r, int lead, char *out) {
+    size_t n;
+    long cp;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        n = 2;
+        cp = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        n = 3;
+        cp = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        n = 4;
+        cp = lead & 0x07;
+    } else {
+        return 0;
+    }
+    out[0] = (char)lead;
+    for (size_t i = 1; i < n; ++i) {
+        int c = rd_get(r);
+        if (c < 0 || (c & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (c & 0x3F);
+        out[i] = (char)c;
+    }
+    /* Ma hoa thua byte, surrogate va ngoai U+10FFFF deu khong hop le */
+    if ((n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000) || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+        return 0;
+    }
+    return n;
+}
+
+/**
+ * @brief Đọc một chuỗi (dấu `"` mở đã đọc) và giải escape.
+ *
+ * Giữ tối đa `keep_max` byte trong `r->tok` (0: chỉ kiểm tra cú pháp).
+ */
+static int read_string(struct StreamReader *r, size_t keep_max) {
+    r->tok_len = 0;
+    r->tok_truncated = 0;
+    if (keep_max > 0 && tok_push(r, "", 0, keep_max) != 0) return -1;
+    for (;;) {
+        int c = rd_get(r);
+        if (c < 0x20) return -1;    /* het file hoac ky tu dieu khien */
+        if (c == '"') return 0;
+
+        char out[4];
+        size_t n = 1;
+        if (c == '\\') {
+            int e = rd_get(r);
+            switch (e) {
+            case '"': case '\\': case '/': out[0] = (char)e; break;
+            case 'b': out[0] = '\b'; break;
+            case 'f': out[0] = '\f'; break;
+            case 'n': out[0] = '\n'; break;
+            case 'r': out[0] = '\r'; break;
+            case 't': out[0] = '\t'; break;
+            case 'u': {
+                long cp = read_hex4(r);
+                if (cp < 0 || (cp >= 0xDC00 && cp <= 0xDFFF)) return -1;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    if (rd_get(r) != '\\' || rd_get(r) != 'u') return -1;
+                    long lo = read_hex4(r);
+                    if (lo < 0xDC00 || lo > 0xDFFF) return -1;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                /* Nhu jansson mac dinh: khong cho NUL trong chuoi */
+                if (cp == 0) return -1;
+                n = utf8_encode(cp, out);
+                break;
+            }
+            default:
+                return -1;
+            }
+        } else if (c < 0x80) {
+            out[0] = (char)c;
+        } else if ((n = read_utf8(r, c, out)) == 0) {
+            return -1;
+        }
+        if (keep_max > 0 && tok_push(r, out, n, keep_max) != 0) return -1;
+    }
+}
+
+static int is_digit(int c) {
+    return c >= '0' && c <= '9';
+}
+
+static int num_take(struct StreamReader *r, char *text, size_t *n) {
+    if (*n == STREAM_NUMBER_MAX) return -1;
+    int c = rd_get(r);
+    if (c < 0) return -1;
+    text[(*n)++] = (char)c;
+    return 0;
+}
+
+static int num_digits(struct StreamReader *r, char *text, size_t *n) {
+    if (!is_digit(rd_peek(r))) return -1;
+    while (is_digit(rd_peek(r))) {
+        if (num_take(r, text, n) != 0) return -1;
+    }
+    return 0;
+}
+
+/** @brief Đọc một số theo ngữ pháp JSON; `out` NULL thì chỉ kiểm tra. */
+static int read_number(struct StreamReader *r, json_t **out) {
+    char text[STREAM_NUMBER_MAX + 1];
+    size_t n = 0;
+    int real = 0;
+    if (rd_peek(r) == '-' && num_take(r, text, &n) != 0) return -1;
+    if (rd_peek(r) == '0') {
+        if (num_take(r, text, &n) != 0 || is_digit(rd_peek(r))) return -1;
+    } else if (num_digits(r, text, &n) != 0) {
+        return -1;
+    }
+    if (rd_peek(r) == '.') {
+        real = 1;
+        if (num_take(r, text, &n) != 0 || num_digits(r, text, &n) != 0) return -1;
+    }
+    if (rd_peek(r) == 'e' || rd_peek(r) == 'E') {
+        real = 1;
+        if (num_take(r, text, &n) != 0) return -1;
+        if ((rd_peek(r) == '+' || rd_peek(r) == '-') && num_take(r, text, &n) != 0) return -1;
+        if (num_digits(r, text, &n) != 0) return -1;
+    }
+    text[n] = '\0';
+
+    /* Tran so la loi nhu jansson, ca khi gia tri bi bo qua (so thuc qua nho thi ve 0) */
+    errno = 0;
+    if (!real) {
+        long long v = strtoll(text, NULL, 10);
+        if (errno == ERANGE) return -1;
+        if (out) *out = json_integer(v);
+    } else {
+        double v = strtod(text, NULL);
+        if (errno == ERANGE && (v == HUGE_VAL || v == -HUGE_VAL)) return -1;
+        if (out) *out = json_real(v);
+    }
+    return !out || *out ? 0 : -1;
+}
+
+static int read_literal(struct StreamReader *r, const char *word) {
+    for (; *word; ++word) {
+        if (rd_get(r) != (unsigned char)*word) return -1;
+    }
+    return 0;
+}
+
+static int parse_value(struct StreamReader *r, int depth, json_t **out);
+
+/** @brief Object (dấu `{` đã đọc); `out` NULL thì chỉ kiểm tra cú pháp, không cấp phát. */
+static int parse_object(struct StreamReader *r, int depth, json_t **out) {
+    json_t *obj = out ? json_object() : NULL;
+    if (out && !obj) return -1;
+    int rc = 0;
+    if (rd_peek_token(r) == '}') {
+        rc = rd_get(r) < 0 ? -1 : 0;
+    } else {
+        for (;;) {
+            if (rd_next_token(r) != '"' || read_string(r, out ? SIZE_MAX : 0) != 0) {
+                rc = -1;
+                break;
+            }
+            /* Khoa phai chep ra: r->tok bi ghi de khi doc gia tri */
+            char *key = out ? strdup(r->tok) : NULL;
+            json_t *value = NULL;
+            if ((out && !key) || rd_next_token(r) != ':' || parse_value(r, depth, out ? &value : NULL) != 0 ||
+                (out && json_object_set_new(obj, key, value) != 0)) {
+                free(key);
+                rc = -1;
+                break;
+            }
+            free(key);
+            int c = rd_next_token(r);
+            if (c == '}') break;
+            if (c != ',') {
+                rc = -1;
+                break;
+            }
+        }
+    }
+    if (rc != 0) {
+        json_decref(obj);
+    } else if (out) {
+        *out = obj;
+    }
+    return rc;
+}
+
+/** @brief Mảng (dấu `[` đã đọc); `out` NULL thì chỉ kiểm tra cú pháp. */
+static int parse_array(struct StreamReader *r, int depth, json_t **out) {
+    json_t *arr = out ? json_array() : NULL;
+    if (out && !arr) return -1;
+    int rc = 0;
+    if (rd_peek_token(r) == ']') {
+        rc = rd_get(r) < 0 ? -1 : 0;
+    } else {
+        for (;;) {
+            json_t *value = NULL;
+            if (parse_value(r, depth, out ? &value : NULL) != 0 || (out && json_array_append_new(arr, value) != 0)) {
+                rc = -1;
+                break;
+            }
+            int c = rd_next_token(r);
+            if (c == ']') break;
+            if (c != ',') {
+                rc = -1;
+                break;
+            }
+        }
+    }
+    if (rc != 0) {
+        json_decref(arr);
+    } else if (out) {
+        *out = arr;
+    }
+    return rc;
+}
+
+static int parse_value(struct StreamReader *r, int depth, json_t **out) {
+    int c = rd_peek_token(r);
+    if (c == '{' || c == '[') {
+        if (depth >= STREAM_MAX_DEPTH || rd_get(r) < 0) return -1;
+        return c == '{' ? parse_object(r, depth + 1, out) : parse_array(r, depth + 1, out);
+    }
+    if (c == '"') {
+        if (rd_get(r) < 0 || read_string(r, out ? SIZE_MAX : 0) != 0) return -1;
+        if (out && !(*out = json_stringn(r->tok, r->tok_len))) return -1;
+        return 0;
+    }
+    if (c == '-' || is_digit(c)) return read_number(r, out);
+
+    const char *word = c == 't' ? "true" : c == 'f' ? "false" : c == 'n' ? "null" : NULL;
+    if (!word || read_literal(r, word) != 0) return -1;
+    if (out) *out = c == 't' ? json_true() : c == 'f' ? json_false() : json_null();
+    return 0;
+}
+
+/** @brief Dựng cây cho một giá trị của schema, tối đa `FARM_STREAM_MAX_ENTRY` byte văn bản. */
+static int parse_entry(struct StreamReader *r, int depth, json_t **out) {
+    *out = NULL;
+    r->limited = 1;
+    r->budget = FARM_STREAM_MAX_ENTRY;
+    int rc = parse_value(r, depth, out);
+    r->limited = 0;
+    return rc;
+}
+
+/** @brief Đọc khoá ở mức schema (dấu `"` đã đọc) và dấu `:`; khoá quá dài không khớp trường nào. */
+static int read_key(struct StreamReader *r, const char **key) {
+    if (read_string(r, STREAM_KEY_MATCH) != 0 || rd_next_token(r) != ':') return -1;
+    *key = r->tok_truncated ? "" : r->tok;
+    return 0;
+}
+
+/** @brief Mảng "devices" (dấu `[` đã đọc): mỗi phần tử một sự kiện `device`. */
+static int parse_devices(struct StreamReader *r, int depth) {
+    if (rd_peek_token(r) == ']') return rd_get(r) < 0 ? -1 : 0;
+    for (;;) {
+        json_t *entry;
+        if (parse_entry(r, depth, &entry) != 0) return -1;
+        int rc = r->h->device ? r->h->device(r->h->user, entry) : 0;
+        json_decref(entry);
+        if (rc != 0) return -1;
+        int c = rd_next_token(r);
+        if (c == ']') return 0;
+        if (c != ',') return -1;
+    }
+}
+
+/**
+ * @brief Đọc qua dấu phân cách sau một thành viên của object gốc.
+ *
+ * Trước dấu phẩy, ghi CRC của mọi byte trước nó vào `*mark` (cho trailer CRC).
+ * @return Ký tự đã đọc (`,` hoặc `}`), -1 nếu lỗi.
+ */
+static int next_root_member(struct StreamReader *r, uint32_t *mark) {
+    int c = rd_peek_token(r);
+    if (c == ',') *mark = rd_crc(r);
+    if (rd_get(r) < 0 || (c != ',' && c != '}')) return -1;
+    return c;
+}
+
+/**
+ * @brief Trailer `"crc32": "<8 hex>"` (khoá và `:` đã đọc): phải là thành viên cuối và khớp `mark`.
+ * @param comma 0 nếu trailer là thành viên đầu tiên (không có dấu phẩy trước nó: lỗi).
+ */
+static int check_crc(struct StreamReader *r, uint32_t mark, int comma) {
+    if (!comma || rd_next_token(r) != '"' || read_string(r, 8) != 0 || r->tok_len != 8 || r->tok_truncated) {
+        return -1;
+    }
+    uint32_t crc = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        char c = r->tok[i];
+        int v = c >= '0' && c <= '9' ? c - '0'
+                : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (v < 0) return -1;
+        crc = (crc << 4) | (uint32_t)v;
+    }
+    return crc == mark && rd_peek_token(r) == '}' ? 0 : -1;
+}
+
+/** @brief Object chuồng (dấu `{` đã đọc); `root`: chuồng là giá trị gốc của file (shard). */
+static int parse_coop(struct StreamReader *r, int depth, int root) {
+    const struct FarmStreamHandler *h = r->h;
+    if (h->coop_begin && h->coop_begin(h->user) != 0) return -1;
+    if (rd_peek_token(r) == '}') {
+        if (rd_get(r) < 0) return -1;
+        return h->coop_end && h->coop_end(h->user) != 0 ? -1 : 0;
+    }
+    uint32_t mark = 0;
+    int members = 0;
+    for (;;) {
+        const char *key;
+        if (rd_next_token(r) != '"' || read_key(r, &key) != 0) return -1;
+        if (strcmp(key, "id") == 0 || strcmp(key, "name") == 0) {
+            char field[STREAM_KEY_MATCH + 1];
+            json_t *value;
+            memcpy(field, key, strlen(key) + 1);
+            if (parse_entry(r, depth, &value) != 0) return -1;
+            int rc = h->coop_field ? h->coop_field(h->user, field, value) : 0;
+            json_decref(value);
+            if (rc != 0) return -1;
+        } else if (strcmp(key, "devices") == 0 && rd_peek_token(r) == '[') {
+            if (depth >= STREAM_MAX_DEPTH || rd_get(r) < 0 || parse_devices(r, depth + 1) != 0) return -1;
+        } else if (root && strcmp(key, FARM_STREAM_CRC_KEY) == 0) {
+            if (check_crc(r, mark, members > 0) != 0) return -1;
+        } else if (parse_value(r, depth, NULL) != 0) {
+            return -1;
+        }
+        members++;
+        int c = root ? next_root_member(r, &mark) : rd_next_token(r);
+        if (c == '}') break;
+        if (c != ',') return -1;
+    }
+    return h->coop_end && h->coop_end(h->user) != 0 ? -1 : 0;
+}
+
+/** @brief Mảng "coops" (dấu `[` đã đọc); phần tử không phải object bị bỏ qua. */
+static int parse_coops(struct StreamReader *r, int depth) {
+    if (rd_peek_token(r) == ']') return rd_get(r) < 0 ? -1 : 0;
+    for (;;) {
+        int rc;
+        if (rd_peek_token(r) == '{') {
+            rc = depth >= STREAM_MAX_DEPTH || rd_get(r) < 0 ? -1 : parse_coop(r, depth + 1, 0);
+        } else {
+            rc = parse_value(r, depth, NULL);
+        }
+        if (rc != 0) return -1;
+        int c = rd_next_token(r);
+        if (c == ']') return 0;
+        if (c != ',') return -1;
+    }
+}
+
+/** @brief Object gốc của file farm (dấu `{` đã đọc); phải có mảng "coops". */
+static int parse_farm(struct StreamReader *r) {
+    int found = 0;
+    uint32_t mark = 0;
+    int members = 0;
+    if (rd_peek_token(r) == '}') return -1;
+    for (;;) {
+        const char *key;
+        if (rd_next_token(r) != '"' || read_key(r, &key) != 0) return -1;
+        if (strcmp(key, "coops") == 0) {
+            if (rd_next_token(r) != '[' || parse_coops(r, 2) != 0) return -1;
+            found = 1;
+        } else if (strcmp(key, FARM_STREAM_CRC_KEY) == 0) {
+            if (check_crc(r, mark, members > 0) != 0) return -1;
+        } else if (parse_value(r, 1, NULL) != 0) {
+            return -1;
+        }
+        members++;
+        int c = next_root_member(r, &mark);
+        if (c == '}') break;
+        if (c != ',') return -1;
+    }
+    return found ? 0 : -1;
+}
+
+/** @see farm_stream_file() */
+int farm_stream_file(const char *path, enum FarmStreamRoot root, const struct FarmStreamHandler *handler) {
+    if (!path || !handler) return -1;
+    struct StreamReader r;
+    memset(&r, 0, sizeof(r));
+    r.h = handler;
+    r.f = fopen(path, "rb");
+    r.buf = (char *)malloc(FARM_STREAM_BUFFER);
+
+    int rc = -1;
+    if (r.f && r.buf && rd_next_token(&r) == '{') {
+        rc = root == FARM_STREAM_FARM ? parse_farm(&r) : parse_coop(&r, 1, 1);
+        /* Sau gia tri goc chi duoc con khoang trang */
+        if (rc == 0 && (rd_peek_token(&r) != -1 || ferror(r.f))) rc = -1;
+    }
+    if (r.f) fclose(r.f);
+    free(r.buf);
+    free(r.tok);
+    return rc;
+}
+
+static uint32_t g_crc_table[8][256];
+static pthread_once_t g_crc_once = PTHREAD_ONCE_INIT;
+
+/** @brief Bảng slicing-by-8 cho đa thức 0xEDB88320 (dựng một lần, sau đó chỉ đọc). */
+static void crc_table_build(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+        g_crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int t = 1; t < 8; ++t) {
+            uint32_t prev = g_crc_table[t - 1][i];
+            g_crc_table[t][i] = (prev >> 8) ^ g_crc_table[0][prev & 0xFF];
+        }
+    }
+}
+
+/** @see farm_stream_crc32() */
+uint32_t farm_stream_crc32(uint32_t crc, const void *data, size_t len) {
+    (void)pthread_once(&g_crc_once, crc_table_build);
+    const unsigned char *p = (const unsigned char *)data;
+    crc = ~crc;
+    /* Moi vong 8 byte: 8 lan tra bang doc lap thay vi 8 lan phu thuoc noi tiep */
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = g_crc_table[7][lo & 0xFF] ^ g_crc_table[6][(lo >> 8) & 0xFF] ^ g_crc_table[5][(lo >> 16) & 0xFF] ^
+              g_crc_table[4][lo >> 24] ^ g_crc_table[3][p[4]] ^ g_crc_table[2][p[5]] ^ g_crc_table[1][p[6]] ^
+              g_crc_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = g_crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
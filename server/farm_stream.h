@@ -0,0 +1,63 @@
+#ifndef SERVER_FARM_STREAM_H
+#define SERVER_FARM_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <jansson.h>
+
+/**
+ * @file farm_stream.h
+ * @brief Đọc file farm JSON theo luồng (kiểu SAX), bộ nhớ không phụ thuộc kích thước file.
+ *
+ * File được đọc qua buffer cố định `FARM_STREAM_BUFFER` byte; parser đi theo
+ * schema farm và báo sự kiện cho handler: bắt đầu chuồng, trường "id"/"name"
+ * của chuồng, từng mục trong "devices", kết thúc chuồng. Chỉ mỗi mục thiết bị
+ * (và giá trị id/name) được dựng thành cây jansson nhỏ, tối đa
+ * `FARM_STREAM_MAX_ENTRY` byte văn bản; mọi phần khác được kiểm tra cú pháp
+ * rồi bỏ qua mà không cấp phát. Cú pháp JSON kiểm tra chặt như `json_load_file()`
+ * (UTF-8, escape, số tràn, rác sau giá trị gốc).
+ *
+ * Object gốc có thể kết thúc bằng trailer `"crc32": "<8 hex>"`: CRC-32 của mọi
+ * byte trước dấu phẩy đứng ngay trước nó (file vẫn là JSON hợp lệ). Có trailer
+ * thì CRC phải khớp; file không có trailer (viết tay, bản cũ) vẫn đọc được.
+ *
+ * Không dùng trạng thái toàn cục: gọi được song song trên nhiều thread (mỗi
+ * lần gọi một file, một handler).
+ */
+
+#define FARM_STREAM_CRC_KEY "crc32"     /* khoa trailer CRC, thanh vien cuoi cua object goc */
+
+/** @brief Giá trị gốc của file. */
+enum FarmStreamRoot {
+    FARM_STREAM_FARM,   /* { "coops": [ {id, name, devices:[...]}, ...] } */
+    FARM_STREAM_COOP    /* mot object chuong (shard) */
+};
+
+/**
+ * @brief Callback của parser; trả khác 0 để dừng (parse trả -1). Callback NULL bị bỏ qua.
+ *
+ * Giá trị jansson chỉ sống trong lần gọi (handler `json_incref()` nếu muốn giữ).
+ */
+struct FarmStreamHandler {
+    int (*coop_begin)(void *user);
+    int (*coop_field)(void *user, const char *key, json_t *value);  // "id" hoac "name"
+    int (*device)(void *user, json_t *entry);                       // Mot phan tu cua "devices"
+    int (*coop_end)(void *user);
+    void *user;
+};
+
+/**
+ * @brief Parse file `path` và gọi `handler` theo thứ tự trong file.
+ *
+ * Với `FARM_STREAM_FARM`, gốc không phải object hoặc thiếu mảng "coops" là lỗi.
+ * Phần tử không phải object trong "coops" bị bỏ qua. Sự kiện đã gửi trước khi
+ * gặp lỗi không bị thu hồi: handler tự bỏ kết quả khi hàm trả -1.
+ * @return 0 nếu thành công, -1 nếu không mở được file, JSON sai, CRC không khớp,
+ *         một mục vượt `FARM_STREAM_MAX_ENTRY`, hết bộ nhớ hoặc handler dừng.
+ */
+int farm_stream_file(const char *path, enum FarmStreamRoot root, const struct FarmStreamHandler *handler);
+
+/** @brief CRC-32 (IEEE, như `crc32()` của zlib) của `len` byte, nối tiếp `crc` (0 khi bắt đầu). */
+uint32_t farm_stream_crc32(uint32_t crc, const void *data, size_t len);
+
+#endif /* SERVER_FARM_STREAM_H */
@@ -0,0 +1,349 @@
+#include "intern.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file intern.c
+ * @brief Arena + bảng băm dò tuyến tính cho chuỗi intern.
+ */
+
+enum {
+    INTERN_CHUNK_SIZE = 16384,
+    INTERN_INITIAL_SLOTS = 256,
+    INTERN_CLASS_BYTES = 8,
+    /* Chuoi + NUL + JSON (moi byte toi da 6 ky tu, 2 dau nhay) + NUL, lam tron theo lop */
+    INTERN_CLASS_COUNT = (INTERN_MAX_LEN * 7 + 4) / INTERN_CLASS_BYTES + 2
+};
+
+/**
+ * @brief Một chuỗi đã intern; `str` và `json` trỏ vào ô arena `cap` byte của handle.
+ *
+ * `refs` = 0 với handle ngoài bảng có sẵn nghĩa là handle đã được trả hết và
+ * đang nằm trong danh sách chờ dùng lại của lớp cỡ `cap` (nối qua `next_free`).
+ */
+struct InternEntry {
+    char *str;
+    const char *json;
+    uint32_t len;
+    uint32_t json_len;
+    uint32_t hash;
+    uint32_t refs;
+    uint32_t cap;
+    uint32_t next_free;     /* handle + 1 ke tiep trong danh sach cho, 0 = het */
+};
+
+/** @brief Một khối arena (chuỗi nối tiếp nhau ngay sau header). */
+struct InternChunk {
+    struct InternChunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+static struct InternEntry *g_entries;
+static size_t g_count;
+static size_t g_capacity;
+static uint32_t *g_slots;       /* handle + 1, 0 = trong */
+static size_t g_slot_mask;
+static struct InternChunk *g_chunks;
+static size_t g_arena_bytes;
+static uint32_t g_free[INTERN_CLASS_COUNT];    /* handle + 1 dau danh sach cho theo lop cap */
+static size_t g_free_count;
+
+static const char *const WELL_KNOWN[INTERN_WELL_KNOWN_COUNT] = {
+    "", "AUTO", "MANUAL", "C", "%", "kg", "L", "L/h"
+};
+
+/** @brief FNV-1a 32 bit. */
+static uint32_t hash_bytes(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/** @brief Cấp `n` byte từ arena (không căn lề: chỉ chứa chuỗi). */
+static char *arena_alloc(size_t n) {
+    if (!g_chunks || g_chunks->size - g_chunks->used < n) {
+        size_t size = n > INTERN_CHUNK_SIZE ? n : INTERN_CHUNK_SIZE;
+        struct InternChunk *chunk = (struct InternChunk *)malloc(sizeof(*chunk) + size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = g_chunks;
+        chunk->used = 0;
+        chunk->size = size;
+        g_chunks = chunk;
+        g_arena_bytes += size;
+    }
+    char *p = g_chunks->data + g_chunks->used;
+    g_chunks->used += n;
+    return p;
+}
+
+/** @see intern_escape_json() */
+long intern_escape_json(const char *s, size_t len, char *out, size_t out_len) {
+    static const char HEX[] = "0123456789abcdef";
+    size_t pos = 0;
+    /* Het cho thi tra -1 ngay; luon chua 1 byte cho NUL */
+#define PUT(c) do { if (pos + 1 >= out_len) return -1; out[pos++] = (c); } while (0)
+    PUT('"');
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        switch (c) {
+        case '"': PUT('\\'); PUT('"'); break;
+        case '\\': PUT('\\'); PUT('\\'); break;
+        case '\b': PUT('\\'); PUT('b'); break;
+        case '\f': PUT('\\'); PUT('f'); break;
+        case '\n': PUT('\\'); PUT('n'); break;
+        case '\r': PUT('\\'); PUT('r'); break;
+        case '\t': PUT('\\'); PUT('t'); break;
+        default:
+            if (c < 0x20) {
+                PUT('\\'); PUT('u'); PUT('0'); PUT('0'); PUT(HEX[c >> 4]); PUT(HEX[c & 0xF]);
+            } else {
+                PUT((char)c);
+            }
+            break;
+        }
+    }
+    PUT('"');
+#undef PUT
+    out[pos] = '\0';
+    return (long)pos;
+}
+
+/** @brief Ghi handle vào slot trống đầu tiên theo dò tuyến tính. */
+static void slot_put(uint32_t handle) {
+    size_t slot = g_entries[handle].hash & g_slot_mask;
+    while (g_slots[slot] != 0) {
+        slot = (slot + 1) & g_slot_mask;
+    }
+    g_slots[slot] = handle + 1;
+}
+
+/** @brief Handle đã trả hết tham chiếu (chuỗi có sẵn không bao giờ ở trạng thái này). */
+static int is_free(uint32_t handle) {
+    return handle >= INTERN_WELL_KNOWN_COUNT && g_entries[handle].refs == 0;
+}
+
+/** @brief Gỡ handle khỏi bảng băm, dịch lùi các slot phía sau để chuỗi dò không bị đứt. */
+static void slot_remove(uint32_t handle) {
+    size_t hole = g_entries[handle].hash & g_slot_mask;
+    while (g_slots[hole] != handle + 1) {
+        hole = (hole + 1) & g_slot_mask;
+    }
+    for (size_t next = (hole + 1) & g_slot_mask; g_slots[next] != 0; next = (next + 1) & g_slot_mask) {
+        size_t home = g_entries[g_slots[next] - 1].hash & g_slot_mask;
+        /* Chi dich neu hole nam giua vi tri goc va vi tri hien tai cua phan tu */
+        if (((next - home) & g_slot_mask) >= ((next - hole) & g_slot_mask)) {
+            g_slots[hole] = g_slots[next];
+            hole = next;
+        }
+    }
+    g_slots[hole] = 0;
+}
+
+/** @brief Đảm bảo còn chỗ cho một chuỗi nữa (mảng entry + bảng băm tải <= 1/2). */
+static int reserve_one(void) {
+    if (g_count == g_capacity) {
+        size_t cap = g_capacity ? g_capacity * 2 : INTERN_INITIAL_SLOTS / 2;
+        struct InternEntry *grown = (struct InternEntry *)realloc(g_entries, cap * sizeof(*grown));
+        if (!grown) {
+            return -1;
+        }
+        g_entries = grown;
+        g_capacity = cap;
+    }
+    if (!g_slots || (g_count + 1) * 2 > g_slot_mask + 1) {
+        size_t slots = g_slots ? (g_slot_mask + 1) * 2 : INTERN_INITIAL_SLOTS;
+        uint32_t *table = (uint32_t *)calloc(slots, sizeof(*table));
+        if (!table) {
+            return -1;
+        }
+        free(g_slots);
+        g_slots = table;
+        g_slot_mask = slots - 1;
+        for (size_t i = 0; i < g_count; ++i) {
+            if (!is_free((uint32_t)i)) slot_put((uint32_t)i);
+        }
+    }
+    return 0;
+}
+
+static int find(const char *s, size_t len, uint32_t hash, uint32_t *out) {
+    if (!g_slots) {
+        return -1;
+    }
+    for (size_t slot = hash & g_slot_mask; g_slots[slot] != 0; slot = (slot + 1) & g_slot_mask) {
+        const struct InternEntry *e = &g_entries[g_slots[slot] - 1];
+        if (e->hash == hash && e->len == len && memcmp(e->str, s, len) == 0) {
+            *out = g_slots[slot] - 1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int insert(const char *s, size_t len, uint32_t hash, uint32_t *out) {
+    char json[INTERN_MAX_LEN * 6 + 3];  /* moi byte toi da 6 ky tu (\u00XX) + 2 dau nhay + NUL */
+    long json_len = intern_escape_json(s, len, json, sizeof(json));
+    if (json_len < 0) {
+        return -1;
+    }
+    size_t need = len + 1 + (size_t)json_len + 1;
+    size_t cls = (need + INTERN_CLASS_BYTES - 1) / INTERN_CLASS_BYTES;
+    uint32_t handle;
+    if (g_free[cls] != 0) {
+        /* Dung lai handle va o arena cung lop cua chuoi da tra het tham chieu */
+        handle = g_free[cls] - 1;
+        g_free[cls] = g_entries[handle].next_free;
+        g_free_count--;
+    } else {
+        if (reserve_one() != 0) {
+            return -1;
+        }
+        char *mem = arena_alloc(cls * INTERN_CLASS_BYTES);
+        if (!mem) {
+            return -1;
+        }
+        handle = (uint32_t)g_count++;
+        g_entries[handle].str = mem;
+        g_entries[handle].cap = (uint32_t)(cls * INTERN_CLASS_BYTES);
+    }
+    struct InternEntry *e = &g_entries[handle];
+    char *mem = e->str;
+    memcpy(mem, s, len);
+    mem[len] = '\0';
+    memcpy(mem + len + 1, json, (size_t)json_len + 1);
+    e->json = mem + len + 1;
+    e->len = (uint32_t)len;
+    e->json_len = (uint32_t)json_len;
+    e->hash = hash;
+    e->refs = 1;
+    e->next_free = 0;
+    slot_put(handle);
+    *out = handle;
+    return 0;
+}
+
+/** @brief Nạp các chuỗi cố định ở lần dùng đầu; handle của chúng bằng vị trí trong `WELL_KNOWN`. */
+static void ensure_init(void) {
+    if (g_count > 0) {
+        return;
+    }
+    for (size_t i = 0; i < INTERN_WELL_KNOWN_COUNT; ++i) {
+        size_t len = strlen(WELL_KNOWN[i]);
+        uint32_t handle;
+        if (insert(WELL_KNOWN[i], len, hash_bytes(WELL_KNOWN[i], len), &handle) != 0 || handle != i) {
+            fprintf(stderr, "intern: khong khoi tao duoc bang chuoi\n");
+            abort();
+        }
+    }
+}
+
+/** @see intern_string() */
+int intern_string(const char *s, uint32_t *out) {
+    size_t len = s ? strlen(s) : 0;
+    if (!s || !out || len > INTERN_MAX_LEN) {
+        return -1;
+    }
+    ensure_init();
+    uint32_t hash = hash_bytes(s, len);
+    if (find(s, len, hash, out) == 0) {
+        intern_retain(*out);
+        return 0;
+    }
+    return insert(s, len, hash, out);
+}
+
+/** @see intern_retain() */
+void intern_retain(uint32_t handle) {
+    ensure_init();
+    /* Dem bao hoa: chuoi bi giu qua nhieu lan thi coi nhu song mai */
+    if (handle < g_count && !is_free(handle) && g_entries[handle].refs != UINT32_MAX) {
+        g_entries[handle].refs++;
+    }
+}
+
+/** @see intern_release() */
+void intern_release(uint32_t handle) {
+    ensure_init();
+    if (handle < INTERN_WELL_KNOWN_COUNT || handle >= g_count || is_free(handle)) {
+        return;
+    }
+    struct InternEntry *e = &g_entries[handle];
+    if (e->refs == UINT32_MAX || --e->refs > 0) {
+        return;
+    }
+    slot_remove(handle);
+    size_t cls = e->cap / INTERN_CLASS_BYTES;
+    e->next_free = g_free[cls];
+    g_free[cls] = handle + 1;
+    g_free_count++;
+}
+
+/** @see intern_lookup() */
+int intern_lookup(const char *s, uint32_t *out) {
+    size_t len = s ? strlen(s) : 0;
+    if (!s || !out || len > INTERN_MAX_LEN) {
+        return -1;
+    }
+    ensure_init();
+    return find(s, len, hash_bytes(s, len), out);
+}
+
+/** @see intern_well_known() */
+int intern_well_known(const char *s, uint32_t *out) {
+    if (!s || !out) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < INTERN_WELL_KNOWN_COUNT; ++i) {
+        if (strcmp(WELL_KNOWN[i], s) == 0) {
+            *out = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/** @see intern_hash() */
+uint32_t intern_hash(const char *s, size_t len) {
+    return hash_bytes(s, len);
+}
+
+/** @see intern_handle_hash() */
+uint32_t intern_handle_hash(uint32_t handle) {
+    ensure_init();
+    return handle < g_count && !is_free(handle) ? g_entries[handle].hash : 0;
+}
+
+/** @see intern_cstr() */
+const char *intern_cstr(uint32_t handle) {
+    ensure_init();
+    return handle < g_count && !is_free(handle) ? g_entries[handle].str : "";
+}
+
+/** @see intern_json() */
+const char *intern_json(uint32_t handle) {
+    ensure_init();
+    return handle < g_count && !is_free(handle) ? g_entries[handle].json : "\"\"";
+}
+
+/** @see intern_json_length() */
+size_t intern_json_length(uint32_t handle) {
+    ensure_init();
+    return handle < g_count && !is_free(handle) ? g_entries[handle].json_len : 2;
+}
+
+/** @see intern_get_stats() */
+void intern_get_stats(struct InternStats *out) {
+    ensure_init();
+    out->strings = g_count - g_free_count;
+    out->free_handles = g_free_count;
+    out->arena_bytes = g_arena_bytes;
+}
@@ -0,0 +1,103 @@
+#ifndef SERVER_INTERN_H
+#define SERVER_INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file intern.h
+ * @brief Bảng chuỗi intern toàn cục: mỗi chuỗi khác nhau lưu một lần, tham chiếu bằng handle số.
+ *
+ * Dùng cho ID thiết bị, đơn vị ("kg", "L", "%", "L/h", "C") và mode heater
+ * ("AUTO"/"MANUAL"): thiết bị lưu handle 4 byte thay vì mảng char, so sánh là
+ * so sánh số nguyên, và writer JSON chép thẳng dạng đã escape (kèm dấu nháy)
+ * được tính sẵn lúc intern.
+ *
+ * Chuỗi nằm trong arena cấp theo khối. Mỗi lần `intern_string()` giữ một tham
+ * chiếu; nơi giữ handle lâu dài (thiết bị, subscription, event chờ gửi) trả lại
+ * bằng `intern_release()`. Hết tham chiếu thì handle và ô arena của nó được
+ * dùng lại cho chuỗi mới cùng cỡ, nên thêm/xoá thiết bị liên tục không làm
+ * arena lớn mãi. Chuỗi không ai trả (chuỗi có sẵn, đơn vị, mode) sống suốt đời
+ * tiến trình. Con trỏ từ `intern_cstr()`/`intern_json()` chỉ hợp lệ khi còn
+ * tham chiếu. Không thread-safe: chỉ gọi từ state actor (xem `state_actor.h`).
+ */
+
+/** @brief Handle cố định, có sẵn mà không cần intern (0 luôn là chuỗi rỗng). */
+enum InternWellKnown {
+    INTERN_EMPTY = 0,
+    INTERN_AUTO,
+    INTERN_MANUAL,
+    INTERN_UNIT_C,
+    INTERN_UNIT_PERCENT,
+    INTERN_UNIT_KG,
+    INTERN_UNIT_L,
+    INTERN_UNIT_LPH,
+    INTERN_WELL_KNOWN_COUNT
+};
+
+/** @brief Độ dài tối đa của chuỗi được intern (byte, không tính NUL). */
+#define INTERN_MAX_LEN 255
+
+/** @brief Số liệu của bảng intern. */
+struct InternStats {
+    size_t strings;      /* so chuoi dang song (ke ca chuoi co dinh) */
+    size_t free_handles; /* handle da tra het tham chieu, cho dung lai */
+    size_t arena_bytes;  /* tong dung luong cac khoi arena da cap */
+};
+
+/**
+ * @brief Intern `s` (thêm nếu chưa có) và giữ một tham chiếu tới nó.
+ * @return 0 và ghi handle vào `out`, -1 nếu chuỗi quá dài/NULL hoặc hết bộ nhớ.
+ */
+int intern_string(const char *s, uint32_t *out);
+
+/**
+ * @brief Tìm handle của `s` mà không thêm mới (không giữ tham chiếu).
+ * @return 0 nếu đã được intern, -1 nếu chưa (không thiết bị nào có thể mang chuỗi này).
+ */
+int intern_lookup(const char *s, uint32_t *out);
+
+/** @brief Giữ thêm một tham chiếu tới handle đang sống (handle không hợp lệ thì bỏ qua). */
+void intern_retain(uint32_t handle);
+
+/**
+ * @brief Trả một tham chiếu; hết tham chiếu thì chuỗi bị gỡ khỏi bảng và handle chờ dùng lại.
+ *
+ * Chuỗi có sẵn (`InternWellKnown`) và handle không hợp lệ thì bỏ qua.
+ */
+void intern_release(uint32_t handle);
+
+/**
+ * @brief Handle cố định của `s` nếu là một chuỗi có sẵn (`InternWellKnown`).
+ *
+ * Chỉ so với bảng hằng, không đọc bảng intern, nên gọi được từ thread bất kỳ
+ * (vd parse farm trên work pool).
+ * @return 0 và ghi handle vào `out`, -1 nếu không phải chuỗi có sẵn.
+ */
+int intern_well_known(const char *s, uint32_t *out);
+
+/** @brief Hàm băm dùng cho bảng intern (FNV-1a 32 bit); bảng khác có thể dùng lại để khỏi băm hai lần. */
+uint32_t intern_hash(const char *s, size_t len);
+
+/** @brief Giá trị `intern_hash()` đã lưu của handle (0 nếu handle không hợp lệ). */
+uint32_t intern_handle_hash(uint32_t handle);
+
+/** @brief Chuỗi gốc của handle ("" nếu handle không hợp lệ hoặc đã được trả hết). */
+const char *intern_cstr(uint32_t handle);
+
+/** @brief Dạng JSON đã escape, kèm dấu nháy (vd `"L/h"`); `""` nếu handle không hợp lệ. */
+const char *intern_json(uint32_t handle);
+
+/** @brief Độ dài của `intern_json(handle)`. */
+size_t intern_json_length(uint32_t handle);
+
+/**
+ * @brief Escape `s` thành chuỗi JSON (kèm dấu nháy) vào `out`.
+ * @return Số byte đã ghi (không tính NUL), hoặc -1 nếu `out` không đủ chỗ.
+ */
+long intern_escape_json(const char *s, size_t len, char *out, size_t out_len);
+
+/** @brief Lấy số liệu bảng intern. */
+void intern_get_stats(struct InternStats *out);
+
+#endif /* SERVER_INTERN_H */
@@ -1,10 +1,24 @@
 #include <stdio.h>
 #include "net_server.h"
 #include "coop_logic.h"
+#include "metrics.h"
+#include "metrics_http.h"
+#include "req_arena.h"
+#include "telemetry_udp.h"
+#include "work_pool.h"
 #include "../shared/config.h"
 
 /** @brief Entry point của server: init dữ liệu và chạy vòng lặp network. */
 int main(void) {
+    metrics_init();
+    if (req_arena_init() != 0) {
+        fprintf(stderr, "Khong cap duoc arena xu ly lenh\n");
+        return 1;
+    }
+    /* Pool chay truoc de nap cac shard farm song song */
+    if (WORK_POOL_THREADS > 0 && work_pool_start(WORK_POOL_THREADS) != 0) {
+        fprintf(stderr, "Khong chay duoc work pool, doc/ghi farm tai cho\n");
+    }
     coop_logic_init();
 
     int server_fd = server_init(DEFAULT_PORT, DEFAULT_BACKLOG);
@@ -14,6 +28,12 @@ int main(void) {
     }
 
     printf("Server dang lang nghe tai cong %d\n", DEFAULT_PORT);
+    if (METRICS_HTTP_PORT > 0 && metrics_http_start(METRICS_HTTP_PORT) == 0) {
+        printf("Metrics: http://127.0.0.1:%d/metrics\n", METRICS_HTTP_PORT);
+    }
+    if (TELEMETRY_UDP_PORT > 0 && telemetry_udp_start(TELEMETRY_UDP_PORT) == 0) {
+        printf("Telemetry UDP tai cong %d\n", TELEMETRY_UDP_PORT);
+    }
     server_run(server_fd);
     return 0;
 }
@@ -0,0 +1,289 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @file metrics.c
+ * @brief Counter/histogram theo shard từng thread, cộng lại khi đọc.
+ *
+ * Shard chỉ được ghi bởi thread sở hữu nên hot path chỉ là vài phép cộng;
+ * thread đọc có thể thấy giá trị trễ một chút, chấp nhận được cho thống kê.
+ * Khi có nhiều hơn `METRICS_MAX_SHARDS` thread, các thread dư dùng chung
+ * shard cuối (số liệu của chúng có thể lệch nhẹ).
+ */
+
+struct MetricsShard {
+    uint64_t cmd_hist[METRICS_CMD_SLOTS][METRICS_HIST_BUCKETS];
+    uint64_t cmd_sum_ns[METRICS_CMD_SLOTS];
+    uint64_t cmd_max_ns[METRICS_CMD_SLOTS];
+    uint64_t flush_hist[METRICS_HIST_BUCKETS];
+    uint64_t flush_sum_ns;
+    uint64_t flush_max_ns;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+};
+
+static struct MetricsShard g_shards[METRICS_MAX_SHARDS];
+static unsigned g_shard_count;
+static __thread struct MetricsShard *t_shard;
+static long g_connections;
+static uint64_t g_start_ns;
+
+/** @brief Shard của thread hiện tại (đăng ký ở lần dùng đầu tiên). */
+static struct MetricsShard *local_shard(void) {
+    if (!t_shard) {
+        unsigned idx = __atomic_fetch_add(&g_shard_count, 1, __ATOMIC_RELAXED);
+        t_shard = &g_shards[idx < METRICS_MAX_SHARDS ? idx : METRICS_MAX_SHARDS - 1];
+    }
+    return t_shard;
+}
+
+/** @brief Số shard đã có thread dùng. */
+static unsigned used_shards(void) {
+    unsigned n = __atomic_load_n(&g_shard_count, __ATOMIC_RELAXED);
+    return n < METRICS_MAX_SHARDS ? n : METRICS_MAX_SHARDS;
+}
+
+/** @brief Vị trí bucket của `v`: hàng = bit cao nhất, cột = `METRICS_HIST_SUB_BITS` bit kế tiếp. */
+static unsigned hist_index(uint64_t v) {
+    if (v < METRICS_HIST_SUB) return (unsigned)v;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(v);
+    if (msb > METRICS_HIST_MAX_BIT) return METRICS_HIST_BUCKETS - 1;
+    unsigned shift = msb - METRICS_HIST_SUB_BITS;
+    unsigned sub = (unsigned)(v >> shift) & (METRICS_HIST_SUB - 1);
+    return (shift + 1) * METRICS_HIST_SUB + sub;
+}
+
+/** @see metrics_hist_bucket_upper_ns() */
+uint64_t metrics_hist_bucket_upper_ns(unsigned i) {
+    unsigned row = i / METRICS_HIST_SUB;
+    unsigned sub = i % METRICS_HIST_SUB;
+    if (row == 0) return sub;
+    unsigned shift = row - 1;
+    return (((uint64_t)(METRICS_HIST_SUB + sub)) << shift) + (((uint64_t)1 << shift) - 1);
+}
+
+/** @brief Ghi một mẫu vào histogram + tổng + max. */
+static void hist_record(uint64_t *hist, uint64_t *sum, uint64_t *max, uint64_t v) {
+    hist[hist_index(v)]++;
+    *sum += v;
+    if (v > *max) *max = v;
+}
+
+/** @brief Percentile `q` (0..1) từ histogram đã cộng. */
+static uint64_t hist_quantile(const uint64_t *hist, uint64_t count, double q, uint64_t max) {
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)count);
+    if (rank >= count) rank = count - 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < METRICS_HIST_BUCKETS; ++i) {
+        seen += hist[i];
+        if (seen > rank) {
+            uint64_t v = metrics_hist_bucket_upper_ns(i);
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
+
+/** @brief Tính tóm tắt từ histogram đã cộng. */
+static void summarize(const uint64_t *hist, uint64_t sum, uint64_t max, struct MetricsSummary *out) {
+    memset(out, 0, sizeof(*out));
+    for (unsigned i = 0; i < METRICS_HIST_BUCKETS; ++i) {
+        out->count += hist[i];
+    }
+    out->sum_ns = sum;
+    out->max_ns = max;
+    out->p50_ns = hist_quantile(hist, out->count, 0.50, max);
+    out->p90_ns = hist_quantile(hist, out->count, 0.90, max);
+    out->p99_ns = hist_quantile(hist, out->count, 0.99, max);
+}
+
+/** @see metrics_init() */
+void metrics_init(void) {
+    g_start_ns = metrics_now_ns();
+}
+
+/** @see metrics_now_ns() */
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/** @see metrics_record_command() */
+void metrics_record_command(enum CommandType cmd, uint64_t elapsed_ns) {
+    unsigned slot = (unsigned)cmd < METRICS_CMD_SLOTS ? (unsigned)cmd : CMD_UNKNOWN;
+    struct MetricsShard *s = local_shard();
+    hist_record(s->cmd_hist[slot], &s->cmd_sum_ns[slot], &s->cmd_max_ns[slot], elapsed_ns);
+}
+
+/** @see metrics_record_flush() */
+void metrics_record_flush(uint64_t elapsed_ns) {
+    struct MetricsShard *s = local_shard();
+    hist_record(s->flush_hist, &s->flush_sum_ns, &s->flush_max_ns, elapsed_ns);
+}
+
+/** @see metrics_add_bytes_in() */
+void metrics_add_bytes_in(size_t n) {
+    local_shard()->bytes_in += n;
+}
+
+/** @see metrics_add_bytes_out() */
+void metrics_add_bytes_out(size_t n) {
+    local_shard()->bytes_out += n;
+}
+
+/** @see metrics_connection_delta() */
+void metrics_connection_delta(int delta) {
+    __atomic_add_fetch(&g_connections, delta, __ATOMIC_RELAXED);
+}
+
+/** @see metrics_active_connections() */
+size_t metrics_active_connections(void) {
+    long n = __atomic_load_n(&g_connections, __ATOMIC_RELAXED);
+    return n > 0 ? (size_t)n : 0;
+}
+
+/** @see metrics_bytes() */
+void metrics_bytes(uint64_t *in, uint64_t *out) {
+    uint64_t total_in = 0, total_out = 0;
+    for (unsigned i = 0; i < used_shards(); ++i) {
+        total_in += g_shards[i].bytes_in;
+        total_out += g_shards[i].bytes_out;
+    }
+    if (in) *in = total_in;
+    if (out) *out = total_out;
+}
+
+/** @see metrics_command_histogram() */
+void metrics_command_histogram(enum CommandType cmd, uint64_t *hist, uint64_t *sum_ns, uint64_t *max_ns) {
+    unsigned slot = (unsigned)cmd < METRICS_CMD_SLOTS ? (unsigned)cmd : CMD_UNKNOWN;
+    uint64_t sum = 0, max = 0;
+    memset(hist, 0, METRICS_HIST_BUCKETS * sizeof(*hist));
+    for (unsigned i = 0; i < used_shards(); ++i) {
+        const struct MetricsShard *s = &g_shards[i];
+        for (unsigned b = 0; b < METRICS_HIST_BUCKETS; ++b) {
+            hist[b] += s->cmd_hist[slot][b];
+        }
+        sum += s->cmd_sum_ns[slot];
+        if (s->cmd_max_ns[slot] > max) max = s->cmd_max_ns[slot];
+    }
+    if (sum_ns) *sum_ns = sum;
+    if (max_ns) *max_ns = max;
+}
+
+/** @see metrics_flush_histogram() */
+void metrics_flush_histogram(uint64_t *hist, uint64_t *sum_ns, uint64_t *max_ns) {
+    uint64_t sum = 0, max = 0;
+    memset(hist, 0, METRICS_HIST_BUCKETS * sizeof(*hist));
+    for (unsigned i = 0; i < used_shards(); ++i) {
+        const struct MetricsShard *s = &g_shards[i];
+        for (unsigned b = 0; b < METRICS_HIST_BUCKETS; ++b) {
+            hist[b] += s->flush_hist[b];
+        }
+        sum += s->flush_sum_ns;
+        if (s->flush_max_ns > max) max = s->flush_max_ns;
+    }
+    if (sum_ns) *sum_ns = sum;
+    if (max_ns) *max_ns = max;
+}
+
+/** @see metrics_command_summary() */
+void metrics_command_summary(enum CommandType cmd, struct MetricsSummary *out) {
+    uint64_t hist[METRICS_HIST_BUCKETS];
+    uint64_t sum = 0, max = 0;
+    metrics_command_histogram(cmd, hist, &sum, &max);
+    summarize(hist, sum, max, out);
+}
+
+/** @see metrics_flush_summary() */
+void metrics_flush_summary(struct MetricsSummary *out) {
+    uint64_t hist[METRICS_HIST_BUCKETS];
+    uint64_t sum = 0, max = 0;
+    metrics_flush_histogram(hist, &sum, &max);
+    summarize(hist, sum, max, out);
+}
+
+/** @see metrics_uptime_seconds() */
+uint64_t metrics_uptime_seconds(void) {
+    return (metrics_now_ns() - g_start_ns) / 1000000000ull;
+}
+
+/** @brief Format "<name> count=.. avg_us=.. p50_us=.. p90_us=.. p99_us=.. max_us=..". */
+static void format_summary(char *out, size_t len, const char *name, const struct MetricsSummary *s) {
+    uint64_t avg = s->count ? s->sum_ns / s->count : 0;
+    snprintf(out, len,
+             "%s count=%" PRIu64 " avg_us=%" PRIu64 " p50_us=%" PRIu64 " p90_us=%" PRIu64
+             " p99_us=%" PRIu64 " max_us=%" PRIu64,
+             name, s->count, avg / 1000, s->p50_ns / 1000, s->p90_ns / 1000, s->p99_ns / 1000, s->max_ns / 1000);
+}
+
+/** @see metrics_render() */
+size_t metrics_render(const struct MetricsGauges *gauges, void (*emit)(const char *line, void *user_data), void *user_data) {
+    char line[256];
+    size_t lines = 0;
+    uint64_t in = 0, out = 0;
+    metrics_bytes(&in, &out);
+
+    snprintf(line, sizeof(line), "uptime_s %" PRIu64, metrics_uptime_seconds());
+    emit(line, user_data); lines++;
+    snprintf(line, sizeof(line), "connections %zu", metrics_active_connections());
+    emit(line, user_data); lines++;
+    snprintf(line, sizeof(line), "bytes_in %" PRIu64, in);
+    emit(line, user_data); lines++;
+    snprintf(line, sizeof(line), "bytes_out %" PRIu64, out);
+    emit(line, user_data); lines++;
+    if (gauges) {
+        snprintf(line, sizeof(line), "sessions %zu", gauges->sessions);
+        emit(line, user_data); lines++;
+        snprintf(line, sizeof(line), "devices %zu", gauges->devices);
+        emit(line, user_data); lines++;
+        snprintf(line, sizeof(line), "coops %zu", gauges->coops);
+        emit(line, user_data); lines++;
+        snprintf(line, sizeof(line), "log_queue %zu", gauges->log_queue);
+        emit(line, user_data); lines++;
+        snprintf(line, sizeof(line), "events_dropped %lu", gauges->events_dropped);
+        emit(line, user_data); lines++;
+        const struct TelemetryUdpStats *u = &gauges->udp;
+        snprintf(line, sizeof(line),
+                 "udp datagrams=%llu applied=%llu parse_errors=%llu auth_failures=%llu replays=%llu "
+                 "unknown_devices=%llu rejected=%llu kernel_drops=%llu",
+                 u->datagrams, u->applied, u->parse_errors, u->auth_failures, u->replays,
+                 u->unknown_devices, u->rejected, u->kernel_drops);
+        emit(line, user_data); lines++;
+        snprintf(line, sizeof(line), "history series=%zu chunks=%zu samples=%llu skipped=%llu",
+                 gauges->history.series, gauges->history.chunks, gauges->history.samples, gauges->history.skipped);
+        emit(line, user_data); lines++;
+        snprintf(line, sizeof(line), "arena peak_bytes=%zu overflows=%lu",
+                 gauges->arena.peak_bytes, gauges->arena.overflows);
+        emit(line, user_data); lines++;
+        snprintf(line, sizeof(line), "snapshot publishes=%lu rendered=%lu limbo=%zu",
+                 gauges->snapshot.publishes, gauges->snapshot.rendered, gauges->snapshot.limbo);
+        emit(line, user_data); lines++;
+        snprintf(line, sizeof(line), "pool workers=%u submitted=%lu executed=%lu stolen=%lu",
+                 gauges->pool.workers, gauges->pool.submitted, gauges->pool.executed, gauges->pool.stolen);
+        emit(line, user_data); lines++;
+    }
+
+    struct MetricsSummary s;
+    metrics_flush_summary(&s);
+    format_summary(line, sizeof(line), "flush", &s);
+    emit(line, user_data); lines++;
+
+    /* Chi in command da tung duoc goi */
+    for (int cmd = 0; cmd < METRICS_CMD_SLOTS; ++cmd) {
+        metrics_command_summary((enum CommandType)cmd, &s);
+        if (s.count == 0) continue;
+        char name[48];
+        snprintf(name, sizeof(name), "cmd.%s", protocol_command_name((enum CommandType)cmd));
+        format_summary(line, sizeof(line), name, &s);
+        emit(line, user_data); lines++;
+    }
+    return lines;
+}
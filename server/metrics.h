@@ -0,0 +1,107 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../shared/protocol.h"
+#include "farm_snapshot.h"
+#include "req_arena.h"
+#include "work_pool.h"
+#include "telemetry_udp.h"
+#include "tsdb.h"
+
+/**
+ * @file metrics.h
+ * @brief Đo đạc nội bộ của server: histogram độ trễ theo command, byte vào/ra, kết nối, flush.
+ *
+ * Mỗi thread ghi vào shard riêng (không khoá, không atomic); khi đọc (STATS,
+ * dump định kỳ) các shard được cộng lại. Histogram kiểu HDR: chia theo luỹ
+ * thừa 2, mỗi khoảng có `METRICS_HIST_SUB` bucket tuyến tính (sai số tương
+ * đối ~12.5%), giá trị tính bằng nano giây.
+ */
+
+#define METRICS_HIST_SUB_BITS 3
+#define METRICS_HIST_SUB (1 << METRICS_HIST_SUB_BITS)
+#define METRICS_HIST_MAX_BIT 39  /* ~9 phut; gia tri lon hon bi don vao bucket cuoi */
+#define METRICS_HIST_BUCKETS ((METRICS_HIST_MAX_BIT - METRICS_HIST_SUB_BITS + 2) * METRICS_HIST_SUB)
+#define METRICS_MAX_SHARDS 8
+#define METRICS_CMD_SLOTS (CMD_UNKNOWN + 1)
+
+/** @brief Tóm tắt một histogram (đơn vị nano giây). */
+struct MetricsSummary {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+};
+
+/** @brief Các giá trị do module khác sở hữu, caller điền khi render. */
+struct MetricsGauges {
+    size_t sessions;
+    size_t devices;
+    size_t coops;
+    size_t log_queue;
+    unsigned long events_dropped;
+    struct TelemetryUdpStats udp;
+    struct TsdbStats history;
+    struct ReqArenaStats arena;
+    struct FarmSnapshotStats snapshot;
+    struct WorkPoolStats pool;
+};
+
+/** @brief Ghi mốc khởi động server (dùng cho uptime). Gọi một lần trong `main()`. */
+void metrics_init(void);
+
+/** @brief Thời gian monotonic hiện tại (nano giây). */
+uint64_t metrics_now_ns(void);
+
+/** @brief Ghi nhận một lần xử lý command `cmd` mất `elapsed_ns`. */
+void metrics_record_command(enum CommandType cmd, uint64_t elapsed_ns);
+
+/** @brief Ghi nhận một lần lưu farm ra đĩa mất `elapsed_ns`. */
+void metrics_record_flush(uint64_t elapsed_ns);
+
+/** @brief Cộng số byte nhận từ client. */
+void metrics_add_bytes_in(size_t n);
+
+/** @brief Cộng số byte đã gửi cho client. */
+void metrics_add_bytes_out(size_t n);
+
+/** @brief Cập nhật số kết nối đang mở (+1/-1). */
+void metrics_connection_delta(int delta);
+
+/** @brief Số kết nối đang mở. */
+size_t metrics_active_connections(void);
+
+/** @brief Tổng byte vào/ra (cộng mọi shard). */
+void metrics_bytes(uint64_t *in, uint64_t *out);
+
+/** @brief Tóm tắt histogram của command `cmd` (cộng mọi shard). */
+void metrics_command_summary(enum CommandType cmd, struct MetricsSummary *out);
+
+/** @brief Tóm tắt histogram thời gian lưu farm (cộng mọi shard). */
+void metrics_flush_summary(struct MetricsSummary *out);
+
+/**
+ * @brief Histogram đã cộng của command `cmd` (`hist` có `METRICS_HIST_BUCKETS` phần tử).
+ */
+void metrics_command_histogram(enum CommandType cmd, uint64_t *hist, uint64_t *sum_ns, uint64_t *max_ns);
+
+/** @brief Histogram đã cộng của thời gian lưu farm. */
+void metrics_flush_histogram(uint64_t *hist, uint64_t *sum_ns, uint64_t *max_ns);
+
+/** @brief Giá trị lớn nhất (ns) thuộc bucket `i` của histogram. */
+uint64_t metrics_hist_bucket_upper_ns(unsigned i);
+
+/** @brief Số giây từ khi server khởi động. */
+uint64_t metrics_uptime_seconds(void);
+
+/**
+ * @brief Render toàn bộ số liệu thành các dòng "<tên> <giá trị...>" và gọi `emit` cho từng dòng.
+ * @return Số dòng đã emit.
+ */
+size_t metrics_render(const struct MetricsGauges *gauges, void (*emit)(const char *line, void *user_data), void *user_data);
+
+#endif  /* SERVER_METRICS_H */
@@ -0,0 +1,365 @@
+#include "metrics_http.h"
+#include "coop_logic.h"
+#include "metrics.h"
+#include "../shared/config.h"
+#include "../shared/types.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * @file metrics_http.c
+ * @brief Listener `/metrics` chạy trong vòng poll của server.
+ *
+ * Nội dung được render vào buffer dùng lại giữa các lần scrape. Phần đếm
+ * thiết bị theo chuồng/loại (phải duyệt toàn bộ farm) chỉ render lại khi
+ * state version của farm thay đổi; phần counter/histogram nhỏ được render
+ * lại mỗi lần scrape nhưng không quá một lần mỗi `METRICS_HTTP_CACHE_MS`.
+ */
+
+#define METRICS_HTTP_CACHE_MS 1000
+#define METRICS_HTTP_REQ_MAX 2048
+
+/** @brief Buffer text tăng dần, không giải phóng giữa các lần render. */
+struct TextBuf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+/** @brief Một kết nối HTTP: đọc request rồi gửi một response và đóng. */
+struct HttpConn {
+    int fd;
+    char req[METRICS_HTTP_REQ_MAX];
+    size_t req_len;
+    char head[256];         /* status line + header */
+    size_t head_len;
+    const char *body;       /* tro vao g_page (hoac chuoi hang) */
+    size_t body_len;
+    size_t sent;            /* tong byte da gui (head + body) */
+    int responding;
+};
+
+static int g_listen_fd = -1;
+static struct HttpConn g_conns[METRICS_HTTP_MAX_CLIENTS];
+static struct TextBuf g_page;       /* runtime + farm, body tra ve */
+static struct TextBuf g_farm;       /* phan dem thiet bi, cache theo state version */
+static unsigned long long g_farm_version;
+static int g_farm_valid;
+static uint64_t g_page_rendered_ns;
+static int g_page_valid;
+
+/** @brief Giới hạn `le` (giây) cho histogram Prometheus, gộp từ bucket nội bộ. */
+static const double LATENCY_BOUNDS_S[] = {
+    0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5
+};
+
+static int buf_reserve(struct TextBuf *b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 8192;
+    while (cap < b->len + extra + 1) cap *= 2;
+    char *grown = (char *)realloc(b->data, cap);
+    if (!grown) return -1;
+    b->data = grown;
+    b->cap = cap;
+    return 0;
+}
+
+static void buf_printf(struct TextBuf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char tmp[512];
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    size_t len = (size_t)n < sizeof(tmp) ? (size_t)n : sizeof(tmp) - 1;
+    if (buf_reserve(b, len) != 0) return;
+    memcpy(b->data + b->len, tmp, len + 1);
+    b->len += len;
+}
+
+static void buf_append(struct TextBuf *b, const char *data, size_t len) {
+    if (len == 0 || buf_reserve(b, len) != 0) return;
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+/** @brief Ghi một histogram nội bộ thành series `_bucket`/`_sum`/`_count` của Prometheus. */
+static void render_histogram(struct TextBuf *b, const char *name, const char *labels,
+                             const uint64_t *hist, uint64_t sum_ns) {
+    uint64_t cumulative = 0;
+    unsigned bucket = 0;
+    const char *sep = labels[0] ? "," : "";
+    for (size_t k = 0; k < sizeof(LATENCY_BOUNDS_S) / sizeof(LATENCY_BOUNDS_S[0]); ++k) {
+        uint64_t bound_ns = (uint64_t)(LATENCY_BOUNDS_S[k] * 1e9);
+        while (bucket < METRICS_HIST_BUCKETS && metrics_hist_bucket_upper_ns(bucket) <= bound_ns) {
+            cumulative += hist[bucket++];
+        }
+        buf_printf(b, "%s_bucket{%s%sle=\"%g\"} %" PRIu64 "\n", name, labels, sep, LATENCY_BOUNDS_S[k], cumulative);
+    }
+    while (bucket < METRICS_HIST_BUCKETS) {
+        cumulative += hist[bucket++];
+    }
+    buf_printf(b, "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n", name, labels, sep, cumulative);
+    if (labels[0]) {
+        buf_printf(b, "%s_sum{%s} %.9f\n", name, labels, (double)sum_ns / 1e9);
+        buf_printf(b, "%s_count{%s} %" PRIu64 "\n", name, labels, cumulative);
+    } else {
+        buf_printf(b, "%s_sum %.9f\n", name, (double)sum_ns / 1e9);
+        buf_printf(b, "%s_count %" PRIu64 "\n", name, cumulative);
+    }
+}
+
+static void visit_device_count(int coop_id, enum DeviceType type, size_t count, void *user_data) {
+    buf_printf((struct TextBuf *)user_data, "coopfarm_devices{coop=\"%d\",type=\"%s\"} %zu\n",
+               coop_id, device_type_to_string(type), count);
+}
+
+/** @brief Render phần đếm thiết bị nếu farm đã đổi từ lần trước. */
+static void refresh_farm_section(void) {
+    unsigned long long version = coop_logic_state_version();
+    if (g_farm_valid && version == g_farm_version) return;
+    g_farm.len = 0;
+    buf_printf(&g_farm, "# HELP coopfarm_devices Devices per coop and type (coop=\"0\": unassigned).\n");
+    buf_printf(&g_farm, "# TYPE coopfarm_devices gauge\n");
+    if (coop_logic_visit_device_counts(visit_device_count, &g_farm) != 0) return;
+    g_farm_version = version;
+    g_farm_valid = 1;
+}
+
+/** @brief Render lại body `/metrics` (dùng cache nếu còn mới). */
+static void render_page(void) {
+    uint64_t now = metrics_now_ns();
+    if (g_page_valid && now - g_page_rendered_ns < (uint64_t)METRICS_HTTP_CACHE_MS * 1000000ull &&
+        g_farm_valid && g_farm_version == coop_logic_state_version()) {
+        return;
+    }
+    refresh_farm_section();
+
+    struct MetricsGauges gauges;
+    coop_logic_collect_gauges(&gauges);
+    uint64_t in = 0, out = 0;
+    metrics_bytes(&in, &out);
+
+    struct TextBuf *b = &g_page;
+    b->len = 0;
+    buf_printf(b, "# TYPE coopfarm_uptime_seconds gauge\ncoopfarm_uptime_seconds %" PRIu64 "\n", metrics_uptime_seconds());
+    buf_printf(b, "# TYPE coopfarm_connections gauge\ncoopfarm_connections %zu\n", metrics_active_connections());
+    buf_printf(b, "# TYPE coopfarm_sessions gauge\ncoopfarm_sessions %zu\n", gauges.sessions);
+    buf_printf(b, "# TYPE coopfarm_coops gauge\ncoopfarm_coops %zu\n", gauges.coops);
+    buf_printf(b, "# TYPE coopfarm_log_queue gauge\ncoopfarm_log_queue %zu\n", gauges.log_queue);
+    buf_printf(b, "# TYPE coopfarm_bytes_in_total counter\ncoopfarm_bytes_in_total %" PRIu64 "\n", in);
+    buf_printf(b, "# TYPE coopfarm_bytes_out_total counter\ncoopfarm_bytes_out_total %" PRIu64 "\n", out);
+    buf_printf(b, "# TYPE coopfarm_events_dropped_total counter\ncoopfarm_events_dropped_total %lu\n", gauges.events_dropped);
+    const struct TelemetryUdpStats *u = &gauges.udp;
+    buf_printf(b, "# HELP coopfarm_udp_datagrams_total Telemetry datagrams, by outcome.\n"
+                  "# TYPE coopfarm_udp_datagrams_total counter\n");
+    buf_printf(b, "coopfarm_udp_datagrams_total{result=\"applied\"} %llu\n", u->applied);
+    buf_printf(b, "coopfarm_udp_datagrams_total{result=\"parse_error\"} %llu\n", u->parse_errors);
+    buf_printf(b, "coopfarm_udp_datagrams_total{result=\"auth_failed\"} %llu\n", u->auth_failures);
+    buf_printf(b, "coopfarm_udp_datagrams_total{result=\"replay\"} %llu\n", u->replays);
+    buf_printf(b, "coopfarm_udp_datagrams_total{result=\"unknown_device\"} %llu\n", u->unknown_devices);
+    buf_printf(b, "coopfarm_udp_datagrams_total{result=\"rejected\"} %llu\n", u->rejected);
+    buf_printf(b, "# TYPE coopfarm_udp_kernel_drops_total counter\ncoopfarm_udp_kernel_drops_total %llu\n",
+               u->kernel_drops);
+    buf_printf(b, "# TYPE coopfarm_history_series gauge\ncoopfarm_history_series %zu\n", gauges.history.series);
+    buf_printf(b, "# TYPE coopfarm_history_chunks gauge\ncoopfarm_history_chunks %zu\n", gauges.history.chunks);
+    buf_printf(b, "# TYPE coopfarm_history_samples_total counter\ncoopfarm_history_samples_total %llu\n",
+               gauges.history.samples);
+    buf_printf(b, "# TYPE coopfarm_req_arena_peak_bytes gauge\ncoopfarm_req_arena_peak_bytes %zu\n",
+               gauges.arena.peak_bytes);
+    buf_printf(b, "# TYPE coopfarm_req_arena_overflows_total counter\ncoopfarm_req_arena_overflows_total %lu\n",
+               gauges.arena.overflows);
+    buf_printf(b, "# TYPE coopfarm_snapshot_publishes_total counter\ncoopfarm_snapshot_publishes_total %lu\n",
+               gauges.snapshot.publishes);
+    buf_printf(b, "# TYPE coopfarm_snapshot_rendered_total counter\ncoopfarm_snapshot_rendered_total %lu\n",
+               gauges.snapshot.rendered);
+    buf_printf(b, "# TYPE coopfarm_snapshot_limbo gauge\ncoopfarm_snapshot_limbo %zu\n", gauges.snapshot.limbo);
+    buf_printf(b, "# TYPE coopfarm_pool_workers gauge\ncoopfarm_pool_workers %u\n", gauges.pool.workers);
+    buf_printf(b, "# TYPE coopfarm_pool_submitted_total counter\ncoopfarm_pool_submitted_total %lu\n",
+               gauges.pool.submitted);
+    buf_printf(b, "# TYPE coopfarm_pool_executed_total counter\ncoopfarm_pool_executed_total %lu\n",
+               gauges.pool.executed);
+    buf_printf(b, "# TYPE coopfarm_pool_stolen_total counter\ncoopfarm_pool_stolen_total %lu\n",
+               gauges.pool.stolen);
+
+    uint64_t hist[METRICS_HIST_BUCKETS];
+    uint64_t sum = 0;
+    buf_printf(b, "# HELP coopfarm_commands_total Commands handled, by command.\n# TYPE coopfarm_commands_total counter\n");
+    for (int cmd = 0; cmd < METRICS_CMD_SLOTS; ++cmd) {
+        struct MetricsSummary s;
+        metrics_command_summary((enum CommandType)cmd, &s);
+        buf_printf(b, "coopfarm_commands_total{command=\"%s\"} %" PRIu64 "\n",
+                   protocol_command_name((enum CommandType)cmd), s.count);
+    }
+    buf_printf(b, "# HELP coopfarm_command_duration_seconds Time spent in handle_command.\n"
+                  "# TYPE coopfarm_command_duration_seconds histogram\n");
+    for (int cmd = 0; cmd < METRICS_CMD_SLOTS; ++cmd) {
+        metrics_command_histogram((enum CommandType)cmd, hist, &sum, NULL);
+        char labels[64];
+        snprintf(labels, sizeof(labels), "command=\"%s\"", protocol_command_name((enum CommandType)cmd));
+        render_histogram(b, "coopfarm_command_duration_seconds", labels, hist, sum);
+    }
+    buf_printf(b, "# HELP coopfarm_flush_duration_seconds Time spent saving the farm to disk.\n"
+                  "# TYPE coopfarm_flush_duration_seconds histogram\n");
+    metrics_flush_histogram(hist, &sum, NULL);
+    render_histogram(b, "coopfarm_flush_duration_seconds", "", hist, sum);
+
+    buf_append(b, g_farm.data, g_farm.len);
+    g_page_rendered_ns = now;
+    g_page_valid = 1;
+}
+
+/** @see metrics_http_start() */
+int metrics_http_start(int port) {
+    for (int i = 0; i < METRICS_HTTP_MAX_CLIENTS; ++i) {
+        g_conns[i].fd = -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket(metrics)");
+        return -1;
+    }
+    int yes = 1;
+    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, METRICS_HTTP_MAX_CLIENTS) < 0) {
+        perror("metrics listener");
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    g_listen_fd = fd;
+    return 0;
+}
+
+/** @see metrics_http_fill_pollfds() */
+size_t metrics_http_fill_pollfds(struct pollfd *fds, size_t max) {
+    if (g_listen_fd < 0 || max < METRICS_HTTP_POLLFDS) return 0;
+    fds[0].fd = g_listen_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    for (int i = 0; i < METRICS_HTTP_MAX_CLIENTS; ++i) {
+        fds[i + 1].fd = g_conns[i].fd;
+        fds[i + 1].events = g_conns[i].responding ? POLLOUT : POLLIN;
+        fds[i + 1].revents = 0;
+    }
+    return METRICS_HTTP_POLLFDS;
+}
+
+static void close_http(struct HttpConn *c) {
+    close(c->fd);
+    c->fd = -1;
+    c->responding = 0;
+}
+
+/** @brief Có kết nối nào đang gửi dở body trỏ vào `g_page` không (khi đó không render lại). */
+static int page_in_flight(void) {
+    for (int i = 0; i < METRICS_HTTP_MAX_CLIENTS; ++i) {
+        if (g_conns[i].fd >= 0 && g_conns[i].responding && g_conns[i].body == g_page.data) return 1;
+    }
+    return 0;
+}
+
+/** @brief Request đã đủ header: chọn response (chỉ hỗ trợ GET /metrics). */
+static void start_response(struct HttpConn *c) {
+    const char *status = "200 OK";
+    if (strncmp(c->req, "GET /metrics ", 13) == 0 || strncmp(c->req, "GET /metrics?", 13) == 0) {
+        /* Dang co scrape khac gui body: dung lai ban do thay vi render de len */
+        if (!page_in_flight()) {
+            render_page();
+        }
+        c->body = g_page.data ? g_page.data : "";
+        c->body_len = g_page.len;
+    } else {
+        status = "404 Not Found";
+        c->body = "not found\n";
+        c->body_len = strlen(c->body);
+    }
+    int n = snprintf(c->head, sizeof(c->head),
+                     "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, c->body_len);
+    c->head_len = n > 0 && (size_t)n < sizeof(c->head) ? (size_t)n : 0;
+    c->sent = 0;
+    c->responding = 1;
+}
+
+/** @brief Gửi tiếp response; đóng kết nối khi xong hoặc lỗi. */
+static void continue_response(struct HttpConn *c) {
+    while (c->sent < c->head_len + c->body_len) {
+        const char *src;
+        size_t left;
+        if (c->sent < c->head_len) {
+            src = c->head + c->sent;
+            left = c->head_len - c->sent;
+        } else {
+            src = c->body + (c->sent - c->head_len);
+            left = c->body_len - (c->sent - c->head_len);
+        }
+        ssize_t n = send(c->fd, src, left, MSG_NOSIGNAL);
+        if (n > 0) {
+            c->sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+        break;
+    }
+    close_http(c);
+}
+
+/** @see metrics_http_process() */
+void metrics_http_process(const struct pollfd *fds, size_t count) {
+    if (count < METRICS_HTTP_POLLFDS) return;
+
+    for (int i = 0; i < METRICS_HTTP_MAX_CLIENTS; ++i) {
+        struct HttpConn *c = &g_conns[i];
+        short rev = fds[i + 1].revents;
+        if (c->fd < 0 || fds[i + 1].fd != c->fd || rev == 0) continue;
+        if (c->responding) {
+            continue_response(c);
+            continue;
+        }
+        ssize_t n = read(c->fd, c->req + c->req_len, sizeof(c->req) - c->req_len - 1);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+        if (n <= 0) {
+            close_http(c);
+            continue;
+        }
+        c->req_len += (size_t)n;
+        c->req[c->req_len] = '\0';
+        if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n")) {
+            start_response(c);
+            continue_response(c);
+        } else if (c->req_len >= sizeof(c->req) - 1) {
+            close_http(c); /* request qua dai */
+        }
+    }
+
+    if (fds[0].revents & POLLIN) {
+        int fd = accept(g_listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        for (int i = 0; i < METRICS_HTTP_MAX_CLIENTS; ++i) {
+            if (g_conns[i].fd < 0) {
+                memset(&g_conns[i], 0, sizeof(g_conns[i]));
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                g_conns[i].fd = fd;
+                return;
+            }
+        }
+        close(fd); /* het slot */
+    }
+}
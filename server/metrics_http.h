@@ -0,0 +1,36 @@
+#ifndef SERVER_METRICS_HTTP_H
+#define SERVER_METRICS_HTTP_H
+
+#include <poll.h>
+#include <stddef.h>
+
+/**
+ * @file metrics_http.h
+ * @brief HTTP/1.1 tối giản trên cổng riêng (chỉ 127.0.0.1) trả `/metrics` dạng Prometheus.
+ *
+ * Không có thread riêng: `server_run()` thêm các pollfd của module này vào
+ * vòng poll chung qua `metrics_http_fill_pollfds()`/`metrics_http_process()`.
+ */
+
+/** @brief Số kết nối HTTP đồng thời; pollfd cần = listener + các kết nối. */
+#define METRICS_HTTP_MAX_CLIENTS 4
+#define METRICS_HTTP_POLLFDS (1 + METRICS_HTTP_MAX_CLIENTS)
+
+/**
+ * @brief Mở listener HTTP tại `127.0.0.1:port`.
+ * @return 0 nếu thành công, -1 nếu lỗi (server vẫn chạy, chỉ không có /metrics).
+ */
+int metrics_http_start(int port);
+
+/**
+ * @brief Ghi các pollfd cần theo dõi vào `fds` (tối đa `max`).
+ * @return Số pollfd đã ghi (0 nếu chưa start).
+ */
+size_t metrics_http_fill_pollfds(struct pollfd *fds, size_t max);
+
+/**
+ * @brief Xử lý kết quả poll cho các pollfd đã ghi bởi `metrics_http_fill_pollfds()`.
+ */
+void metrics_http_process(const struct pollfd *fds, size_t count);
+
+#endif  /* SERVER_METRICS_HTTP_H */
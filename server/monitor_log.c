@@ -1,22 +1,74 @@
 #include "monitor_log.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 /**
  * @file monitor_log.c
  * @brief Ghi log sự kiện thiết bị ra file.
+ *
+ * Các dòng log được gom trong RAM và ghi ra file một lần mỗi vòng lặp server
+ * (`monitor_log_flush()`), thay vì mở/đóng file cho từng sự kiện.
  */
 
-/** @see log_device_event() */
-void log_device_event(const char *device_id, const char *message) {
-    FILE *log_file = fopen("device_log.txt", "a");
+#define MONITOR_LOG_PATH "device_log.txt"
+
+static char *g_queue;
+static size_t g_queue_len;
+static size_t g_queue_cap;
+static size_t g_queue_depth;
+
+/** @brief Ghi thẳng một dòng ra file (dùng khi không cấp phát được buffer). */
+static void write_direct(const char *line, size_t len) {
+    FILE *log_file = fopen(MONITOR_LOG_PATH, "a");
     if (!log_file) return;
+    fwrite(line, 1, len, log_file);
+    fclose(log_file);
+}
 
+/** @see log_device_event() */
+void log_device_event(const char *device_id, const char *message) {
     time_t now = time(NULL);
     struct tm *tm_info = localtime(&now);
     char time_str[20];
     strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
 
-    fprintf(log_file, "[%s] Device %s: %s\n", time_str, device_id, message);
-    fclose(log_file);
+    char line[256];
+    int written = snprintf(line, sizeof(line), "[%s] Device %s: %s\n", time_str, device_id, message);
+    if (written < 0) return;
+    size_t len = (size_t)written < sizeof(line) ? (size_t)written : sizeof(line) - 1;
+
+    if (g_queue_len + len > g_queue_cap) {
+        size_t cap = g_queue_cap ? g_queue_cap * 2 : 4096;
+        while (cap < g_queue_len + len) cap *= 2;
+        char *grown = (char *)realloc(g_queue, cap);
+        if (!grown) {
+            monitor_log_flush();
+            write_direct(line, len);
+            return;
+        }
+        g_queue = grown;
+        g_queue_cap = cap;
+    }
+    memcpy(g_queue + g_queue_len, line, len);
+    g_queue_len += len;
+    g_queue_depth++;
+
+    if (g_queue_depth >= MONITOR_LOG_QUEUE_MAX) {
+        monitor_log_flush();
+    }
+}
+
+/** @see monitor_log_flush() */
+void monitor_log_flush(void) {
+    if (g_queue_len == 0) return;
+    write_direct(g_queue, g_queue_len);
+    g_queue_len = 0;
+    g_queue_depth = 0;
+}
+
+/** @see monitor_log_queue_depth() */
+size_t monitor_log_queue_depth(void) {
+    return g_queue_depth;
 }
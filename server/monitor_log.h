@@ -1,11 +1,22 @@
 #ifndef MONITOR_LOG_H
 #define MONITOR_LOG_H
 
+#include <stddef.h>
 #include "../shared/config.h"
 
 /**
- * @brief Ghi log sự kiện của thiết bị.
+ * @brief Ghi log sự kiện của thiết bị (đưa vào hàng đợi, ghi file khi `monitor_log_flush()`).
  */
 void log_device_event(const char *device_id, const char *message);
 
+/**
+ * @brief Ghi toàn bộ log đang chờ ra file. Server gọi ở cuối mỗi vòng lặp.
+ */
+void monitor_log_flush(void);
+
+/**
+ * @brief Số dòng log đang chờ ghi.
+ */
+size_t monitor_log_queue_depth(void);
+
 #endif  /* MONITOR_LOG_H */
@@ -1,15 +1,17 @@
 #include "net_server.h"
+#include "farm_snapshot.h"
+#include "metrics.h"
+#include "state_actor.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-// Giả định handle_command từ B trả về char* (response) hoặc NULL
-extern char* handle_command(int fd, enum CommandType cmd, char *args);
-
 /**
  * @file net_server.c
- * @brief Vòng lặp network của server: accept, poll, đọc dòng và dispatch command.
+ * @brief Thread mạng của server: accept, poll, đọc dòng, đẩy lệnh cho actor và gửi response.
  */
 
 /** @see server_init() */
@@ -47,72 +49,173 @@ int server_init(int port, int backlog) {
     return server_fd;
 }
 
-/** @see server_run() */
-void server_run(int server_fd) {
-    /* fds[0] = server_fd, fds[i+1] <-> clients[i] */
-    struct pollfd fds[MAX_DEVICES + 1];
-    struct ClientConnection clients[MAX_DEVICES];
-    int nfds = MAX_DEVICES + 1;
+/* fds[0] = server_fd, g_fds[i+1] <-> g_clients[i], fd cuoi = eventfd response cua actor */
+static struct pollfd g_fds[MAX_DEVICES + 2];
+static struct ClientConnection g_clients[MAX_DEVICES];
+static int g_submitted;  /* co message moi cho actor trong vong poll nay */
+static int g_snapshot_reader = -1;  /* ma reader snapshot cua thread mang */
 
-    fds[0].fd = server_fd;
-    fds[0].events = POLLIN;
+/** @brief Đưa kết nối về trạng thái trống (giữ lại buffer gửi đã cấp phát và `gen`). */
+static void reset_connection(struct ClientConnection *conn) {
+    conn->fd = -1;
+    conn->buf_pos = 0;
+    conn->out_len = 0;
+    conn->closing = 0;
+    conn->stalled = 0;
+    conn->above_high_water = 0;
+    conn->inflight = 0;
+    conn->seen_batch = 0;
+    conn->importing = 0;
+    conn->import_wait = 0;
+    conn->import_ready = 0;
+}
 
-    for (int i = 0; i < MAX_DEVICES; ++i) {
-        clients[i].fd = -1;
-        clients[i].buf_pos = 0;
-        fds[i + 1].fd = -1;          /* poll bo qua fd am */
-        fds[i + 1].events = POLLIN;  /* dung chung */
+/** @brief Đẩy một message không có dòng lệnh (CLOSED/DRAINED) cho actor; -1 nếu hàng đợi đầy. */
+static int submit_notice(size_t slot, uint32_t gen, enum CmdMessageKind kind) {
+    struct CmdRequest *req = state_actor_reserve();
+    if (!req) {
+        return -1;
     }
+    req->kind = kind;
+    req->slot = (uint32_t)slot;
+    req->gen = gen;
+    req->cmd = CMD_UNKNOWN;
+    req->has_args = 0;
+    req->line[0] = '\0';
+    state_actor_submit(req);
+    g_submitted = 1;
+    return 0;
+}
 
-    while (1) {
-        int ret = poll(fds, nfds, -1);
-        if (ret < 0) {
-            perror("poll");
-            break;
+/** @brief Đóng socket, giải phóng buffer gửi, báo actor và sang thế hệ mới của slot. */
+static void close_connection(struct ClientConnection *conn, struct pollfd *pfd) {
+    size_t slot = (size_t)(conn - g_clients);
+    close(conn->fd);
+    metrics_connection_delta(-1);
+    free(conn->out);
+    conn->out = NULL;
+    conn->out_cap = 0;
+    reset_connection(conn);
+    /* Hang doi day thi bao lai o vong sau, truoc khi slot duoc dung lai */
+    conn->notify_closed = submit_notice(slot, conn->gen, CMD_MSG_CLOSED) != 0;
+    conn->gen++;
+    state_actor_report_out_level((uint32_t)slot, 0);
+    if (pfd) {
+        pfd->fd = -1;
+        pfd->revents = 0;
+    }
+}
+
+/** @brief Thêm dữ liệu vào buffer gửi; vượt `NET_OUT_MAX` thì đánh dấu đóng kết nối. */
+static int append_output(struct ClientConnection *conn, const char *data, size_t len) {
+    if (conn->closing) return -1;
+    if (conn->out_len + len > NET_OUT_MAX) {
+        conn->closing = 1;
+        return -1;
+    }
+    if (conn->out_len + len > conn->out_cap) {
+        size_t cap = conn->out_cap ? conn->out_cap : 4096;
+        while (cap < conn->out_len + len) cap *= 2;
+        char *grown = (char *)realloc(conn->out, cap);
+        if (!grown) {
+            conn->closing = 1;
+            return -1;
         }
+        conn->out = grown;
+        conn->out_cap = cap;
+    }
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+    return 0;
+}
 
-        // Xử lý server_fd: accept client mới
-        if (fds[0].revents & POLLIN) {
-            struct sockaddr_in client_addr;
-            socklen_t addr_len = sizeof(client_addr);
-            int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addr_len);
-            if (client_fd >= 0) {
-                // Tìm slot trống cho client
-                for (int i = 0; i < MAX_DEVICES; ++i) {
-                    if (clients[i].fd == -1) {
-                        clients[i].fd = client_fd;
-                        clients[i].buf_pos = 0;
-                        fds[i + 1].fd = client_fd;
-                        fds[i + 1].events = POLLIN;
-                        // Gửi READY
-                        char ready_line[MAX_LINE_LEN];
-                        protocol_format_ready(ready_line, sizeof(ready_line));
-                        send_line(client_fd, ready_line);
-                        break;
-                    }
-                }
-            }
+/** @brief Ghi buffer gửi ra socket (non-blocking) tới khi hết hoặc socket đầy. */
+static void flush_output(struct ClientConnection *conn) {
+    size_t sent = 0;
+    while (sent < conn->out_len) {
+        ssize_t n = send(conn->fd, conn->out + sent, conn->out_len - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
         }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        conn->closing = 1; /* client da dong ket noi */
+        break;
+    }
+    if (sent > 0) {
+        metrics_add_bytes_out(sent);
+        memmove(conn->out, conn->out + sent, conn->out_len - sent);
+        conn->out_len -= sent;
+    }
+}
 
-        // Xử lý client fds (fds[i+1] <-> clients[i])
-        for (int i = 0; i < MAX_DEVICES; ++i) {
-            if (fds[i + 1].fd < 0) {
-                continue;
-            }
-            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
-                handle_client_line(&clients[i], &fds[i + 1]);
-            }
+/** @brief Callback của `state_actor_drain_replies()`: chép response vào buffer gửi nếu kết nối còn. */
+/** @brief Mã response ở đầu `data` ("185 IMPORT_READY" -> 185), -1 nếu không có. */
+static int reply_code(const char *data, size_t len) {
+    int code = 0;
+    size_t i = 0;
+    while (i < len && i < 4 && data[i] >= '0' && data[i] <= '9') {
+        code = code * 10 + (data[i++] - '0');
+    }
+    return i > 0 ? code : -1;
+}
+
+static void deliver_reply(const struct ReplyInfo *info, const char *data, size_t len, void *user_data) {
+    (void)user_data;
+    if (info->slot >= MAX_DEVICES) return;
+    struct ClientConnection *conn = &g_clients[info->slot];
+    if (conn->fd < 0 || conn->gen != info->gen) {
+        return; /* ket noi da dong (hoac slot da sang ket noi khac) */
+    }
+    if (info->batch > conn->seen_batch) {
+        conn->seen_batch = info->batch;
+    }
+    if (info->flags & REPLY_DONE) {
+        if (conn->inflight > 0) conn->inflight--;
+        if (conn->import_wait && conn->inflight == 0) {
+            /* BEGIN la lenh cuoi da gui: actor nhan lo thi cac dong sau la du lieu */
+            conn->import_wait = 0;
+            conn->importing = conn->import_ready;
+            conn->stalled = 1;  /* xu ly tiep cac dong dang giu o vong poll sau */
         }
+        return;
+    }
+    if (conn->import_wait) {
+        conn->import_ready = reply_code(data, len) == RESP_IMPORT_READY;
     }
+    (void)append_output(conn, data, len);
 }
 
-/** @see send_line() */
-int send_line(int fd, const char *line) {
-    size_t len = strlen(line);
-    if (write(fd, line, len) != (ssize_t)len) {
-        return -1;
+/** @brief Gửi một dòng do chính thread mạng tạo (READY). */
+static void send_local_line(struct ClientConnection *conn, const char *line) {
+    if (append_output(conn, line, strlen(line)) == 0) {
+        (void)append_output(conn, "\n", 1);
+    }
+}
+
+static void emit_snapshot_line(const char *line, void *user_data) {
+    send_local_line((struct ClientConnection *)user_data, line);
+}
+
+/**
+ * @brief Trả lời lệnh chỉ đọc từ snapshot thay vì đẩy cho actor.
+ *
+ * Chỉ khi kết nối không còn lệnh nào ở actor (giữ thứ tự response) và snapshot
+ * đã phản ánh mọi lô kết nối từng thấy (đọc được thay đổi của chính mình).
+ * @return 1 nếu đã trả lời, 0 nếu phải đẩy cho actor.
+ */
+static int serve_from_snapshot(struct ClientConnection *conn, enum CommandType cmd, char *args) {
+    if (cmd != CMD_INFO && cmd != CMD_COOP_LIST && cmd != CMD_SCAN) return 0;
+    if (g_snapshot_reader < 0 || conn->inflight > 0 || farm_snapshot_valid_batch() < conn->seen_batch) return 0;
+    uint64_t started = metrics_now_ns();
+    const struct FarmSnapshot *snap = farm_snapshot_enter(g_snapshot_reader);
+    int served = farm_snapshot_serve(snap, cmd, args, emit_snapshot_line, conn);
+    farm_snapshot_exit(g_snapshot_reader);
+    if (served) {
+        metrics_record_command(cmd, metrics_now_ns() - started);
     }
-    return write(fd, "\n", 1) != 1 ? -1 : 0;
+    return served;
 }
 
 /** @brief Tách dòng input thành `cmd` và `args` (sửa in-place bằng cách chèn `\0`). */
@@ -134,49 +237,234 @@ static void parse_cmd_line(char *line, char **cmd_out, char **args_out) {
     *args_out = (*args == '\0') ? NULL : args;
 }
 
-/** @see handle_client_line() */
-void handle_client_line(struct ClientConnection *conn, struct pollfd *pfd) {
+/** @brief Đẩy nguyên văn dòng dữ liệu IMPORT dài `line_len` ở đầu buffer nhận; -1 nếu hàng đợi đầy. */
+static int submit_import_line(struct ClientConnection *conn, size_t line_len) {
+    struct CmdRequest *req = state_actor_reserve();
+    if (!req) {
+        return -1;
+    }
+    req->kind = CMD_MSG_IMPORT;
+    req->slot = (uint32_t)(conn - g_clients);
+    req->gen = conn->gen;
+    req->cmd = CMD_IMPORT;
+    req->has_args = 1;
+    memcpy(req->line, conn->buffer, line_len);
+    req->line[line_len] = '\0';
+    state_actor_submit(req);
+    g_submitted = 1;
+    return 0;
+}
+
+/**
+ * @brief Trả lời hoặc đẩy cho actor các dòng trọn vẹn trong buffer nhận.
+ *
+ * Hàng đợi đầy thì dừng và đánh dấu `stalled`; các dòng còn lại được xử lý ở vòng poll sau.
+ */
+static void submit_lines(struct ClientConnection *conn) {
     char *line_end;
-    ssize_t n = read(conn->fd, conn->buffer + conn->buf_pos, MAX_LINE_LEN - conn->buf_pos - 1);
-    if (n <= 0) {
-        // Client disconnect
-        close(conn->fd);
-        conn->fd = -1;
-        if (pfd) {
-            pfd->fd = -1;
-            pfd->revents = 0;
-        }
+    conn->stalled = 0;
+    if (conn->import_wait) {
         return;
     }
-    conn->buf_pos += n;
-    conn->buffer[conn->buf_pos] = '\0';
-
     while ((line_end = strchr(conn->buffer, '\n'))) {
-        *line_end = '\0';
+        /* Parse tren ban chep: dong chua gui duoc (hang doi day) van con nguyen trong buffer */
+        char line[MAX_LINE_LEN];
+        size_t line_len = (size_t)(line_end - conn->buffer);
+        memcpy(line, conn->buffer, line_len);
+        line[line_len] = '\0';
         // Parse lệnh (format: CMD [args...])
         char *cmd_str = NULL;
         char *args = NULL;
-        parse_cmd_line(conn->buffer, &cmd_str, &args);
+        parse_cmd_line(line, &cmd_str, &args);
         enum CommandType cmd = protocol_command_from_string(cmd_str);
-        if (cmd != CMD_UNKNOWN) {
-            // Gọi handle_command từ B và gửi response
-            char *response = handle_command(conn->fd, cmd, args);
-            if (response) {
-                send_line(conn->fd, response);
-                free(response);  // Giả định B allocate với malloc
-            } else if (cmd != CMD_SCAN && cmd != CMD_COOP_LIST) {
-                char bad_req[MAX_LINE_LEN];
-                protocol_format_bad_request(bad_req, sizeof(bad_req));
-                send_line(conn->fd, bad_req);
+        if (conn->importing && cmd != CMD_IMPORT) {
+            /* Giua IMPORT BEGIN/END moi dong (tru dong trong) la du lieu, gui nguyen van */
+            if (cmd_str && submit_import_line(conn, line_len) != 0) {
+                conn->stalled = 1;
+                return;
+            }
+        } else if (!serve_from_snapshot(conn, cmd, args)) {
+            struct CmdRequest *req = state_actor_reserve();
+            if (!req) {
+                conn->stalled = 1;
+                return;
             }
-        } else {
-            char bad_req[MAX_LINE_LEN];
-            protocol_format_bad_request(bad_req, sizeof(bad_req));
-            send_line(conn->fd, bad_req);
+            req->kind = CMD_MSG_LINE;
+            req->slot = (uint32_t)(conn - g_clients);
+            req->gen = conn->gen;
+            req->cmd = cmd;
+            req->has_args = args != NULL;
+            if (args) {
+                memcpy(req->line, args, strlen(args) + 1);
+            } else {
+                req->line[0] = '\0';
+            }
+            state_actor_submit(req);
+            conn->inflight++;
+            g_submitted = 1;
+        }
+        /* Tham so do actor kiem tra: BEGIN chi vao che do du lieu khi actor tra IMPORT_READY
+         * (BEGIN bi tu choi thi cac dong sau van la lenh), nen giu cac dong sau toi khi co ket qua */
+        int begin = 0;
+        if (cmd == CMD_IMPORT) {
+            char word[8] = "";
+            if (args) (void)sscanf(args, "%7s", word);
+            begin = strcmp(word, "BEGIN") == 0 && !conn->importing;
+            if (strcmp(word, "END") == 0) conn->importing = 0;
         }
         // Shift buffer (sửa lỗi tính toán)
         size_t shift_len = conn->buf_pos - (line_end - conn->buffer) - 1;
-        memmove(conn->buffer, line_end + 1, shift_len);
+        memmove(conn->buffer, line_end + 1, shift_len + 1);  /* ca NUL ket thuc */
         conn->buf_pos = shift_len;
+        if (begin) {
+            conn->import_wait = 1;
+            conn->import_ready = 0;
+            return;
+        }
+    }
+}
+
+/** @see server_run() */
+void server_run(int server_fd) {
+    int nfds = MAX_DEVICES + 2;
+
+    if (state_actor_start() != 0) {
+        fprintf(stderr, "Khong khoi dong duoc thread state\n");
+        return;
+    }
+    g_snapshot_reader = farm_snapshot_reader_register();
+
+    g_fds[0].fd = server_fd;
+    g_fds[0].events = POLLIN;
+    g_fds[MAX_DEVICES + 1].fd = state_actor_reply_fd();
+    g_fds[MAX_DEVICES + 1].events = POLLIN;
+
+    for (int i = 0; i < MAX_DEVICES; ++i) {
+        g_clients[i].out = NULL;
+        g_clients[i].out_cap = 0;
+        g_clients[i].gen = 0;
+        g_clients[i].notify_closed = 0;
+        reset_connection(&g_clients[i]);
+        g_fds[i + 1].fd = -1;          /* poll bo qua fd am */
+        g_fds[i + 1].events = POLLIN;
+    }
+
+    while (1) {
+        /* Thu lai nhung gi bi hang doi day chan o vong truoc */
+        int retry = 0;
+        for (int i = 0; i < MAX_DEVICES; ++i) {
+            struct ClientConnection *conn = &g_clients[i];
+            if (conn->notify_closed) {
+                conn->notify_closed = submit_notice((size_t)i, conn->gen - 1, CMD_MSG_CLOSED) != 0;
+            }
+            if (conn->fd >= 0 && conn->stalled) {
+                submit_lines(conn);
+            }
+            retry |= conn->notify_closed || conn->stalled ||
+                     (conn->above_high_water && conn->out_len < NET_OUT_HIGH_WATER);
+        }
+        if (g_submitted) {
+            state_actor_wake();
+            g_submitted = 0;
+        }
+
+        /* Client khong doc kip (buffer gui qua high-water), dang cho hang doi hoac cho ket qua IMPORT BEGIN thi ngung doc lenh moi */
+        for (int i = 0; i < MAX_DEVICES; ++i) {
+            const struct ClientConnection *conn = &g_clients[i];
+            g_fds[i + 1].events = (short)((conn->out_len < NET_OUT_HIGH_WATER && !conn->stalled && !conn->import_wait ? POLLIN : 0) |
+                                          (conn->out_len > 0 ? POLLOUT : 0));
+        }
+
+        int ret = poll(g_fds, (nfds_t)nfds, retry ? 1 : -1);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if (g_fds[MAX_DEVICES + 1].revents & POLLIN) {
+            (void)state_actor_drain_replies(deliver_reply, NULL);
+        }
+
+        // Xử lý server_fd: accept client mới
+        if (g_fds[0].revents & POLLIN) {
+            struct sockaddr_in client_addr;
+            socklen_t addr_len = sizeof(client_addr);
+            int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addr_len);
+            if (client_fd >= 0) {
+                int slot = -1;
+                // Tìm slot trống cho client (actor đã biết slot cũ đóng)
+                for (int i = 0; i < MAX_DEVICES; ++i) {
+                    if (g_clients[i].fd == -1 && !g_clients[i].notify_closed) {
+                        slot = i;
+                        break;
+                    }
+                }
+                if (slot < 0) {
+                    close(client_fd);
+                } else {
+                    fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL, 0) | O_NONBLOCK);
+                    metrics_connection_delta(1);
+                    g_clients[slot].fd = client_fd;
+                    g_fds[slot + 1].fd = client_fd;
+                    // Gửi READY
+                    char ready_line[MAX_LINE_LEN];
+                    protocol_format_ready(ready_line, sizeof(ready_line));
+                    send_local_line(&g_clients[slot], ready_line);
+                }
+            }
+        }
+
+        // Xử lý client fds (g_fds[i+1] <-> g_clients[i])
+        for (int i = 0; i < MAX_DEVICES; ++i) {
+            if (g_fds[i + 1].fd < 0) {
+                continue;
+            }
+            if (g_fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                handle_client_line(&g_clients[i], &g_fds[i + 1]);
+            }
+        }
+
+        // Gửi response + push event actor đã trả
+        for (int i = 0; i < MAX_DEVICES; ++i) {
+            struct ClientConnection *conn = &g_clients[i];
+            if (conn->fd < 0) {
+                continue;
+            }
+            if (conn->out_len > 0) {
+                flush_output(conn);
+            }
+            if (conn->closing) {
+                close_connection(conn, &g_fds[i + 1]);
+                continue;
+            }
+            state_actor_report_out_level((uint32_t)i, conn->out_len);
+            if (conn->out_len >= NET_OUT_HIGH_WATER) {
+                conn->above_high_water = 1;
+            } else if (conn->above_high_water && submit_notice((size_t)i, conn->gen, CMD_MSG_DRAINED) == 0) {
+                conn->above_high_water = 0;
+            }
+        }
+        if (g_submitted) {
+            state_actor_wake();
+            g_submitted = 0;
+        }
     }
 }
+
+/** @see handle_client_line() */
+void handle_client_line(struct ClientConnection *conn, struct pollfd *pfd) {
+    ssize_t n = read(conn->fd, conn->buffer + conn->buf_pos, MAX_LINE_LEN - conn->buf_pos - 1);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        // Client disconnect
+        close_connection(conn, pfd);
+        return;
+    }
+    metrics_add_bytes_in((size_t)n);
+    conn->buf_pos += n;
+    conn->buffer[conn->buf_pos] = '\0';
+    submit_lines(conn);
+}
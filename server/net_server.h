@@ -5,16 +5,35 @@
 #include <netinet/in.h>
 #include <poll.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "../shared/config.h"
 #include "../shared/protocol.h"
 
 /**
- * @brief Thông tin kết nối của một client đang được server quản lý.
+ * @brief Thông tin kết nối của một client do thread mạng quản lý.
+ *
+ * Subscription và event chờ gửi nằm phía actor (xem `state_actor.h`).
+ * INFO/COOPLIST/SCAN cursor được trả lời ngay từ snapshot (`farm_snapshot.h`)
+ * khi kết nối không còn lệnh ở actor và snapshot không cũ hơn `seen_batch`,
+ * nên client vẫn thấy thứ tự lệnh và mọi thay đổi mình đã nhận kết quả.
  */
 struct ClientConnection {
     int fd;  // File descriptor socket
+    uint32_t gen;  // Thế hệ của slot: tăng khi đóng, response của kết nối cũ bị bỏ
     char buffer[MAX_LINE_LEN];  // Buffer cho dòng nhận
     size_t buf_pos;  // Vị trí trong buffer
+    char *out;  // Buffer gửi (cấp phát động, gửi dần khi socket writable)
+    size_t out_len;
+    size_t out_cap;
+    int closing;  // Buffer gửi vượt NET_OUT_MAX: đóng sau vòng poll hiện tại
+    int stalled;  // Hàng đợi lệnh đầy: giữ các dòng còn lại, không đọc thêm
+    int above_high_water;  // Buffer gửi đang trên NET_OUT_HIGH_WATER (báo actor khi xuống dưới)
+    int notify_closed;  // Chưa báo được actor là slot đã đóng (chưa tái dùng slot)
+    size_t inflight;  // Số dòng đã đẩy cho actor chưa nhận REPLY_DONE
+    uint64_t seen_batch;  // Lô mới nhất mà kết nối đã nhận response/event
+    int importing;  // Actor đã nhận IMPORT BEGIN: các dòng tới IMPORT END là dữ liệu, gửi nguyên văn
+    int import_wait;  // Đã gửi IMPORT BEGIN, chờ actor trả lời: giữ các dòng sau, không đọc thêm
+    int import_ready;  // Response cuối nhận được trong lúc chờ là IMPORT_READY
 };
 
 /**
@@ -24,18 +43,12 @@ struct ClientConnection {
 int server_init(int port, int backlog);
 
 /**
- * @brief Chạy vòng lặp chính của server (accept/poll/đọc dòng).
+ * @brief Chạy thread state (`state_actor_start()`) rồi vòng lặp mạng (accept/poll/đọc dòng/gửi).
  */
 void server_run(int server_fd);
 
 /**
- * @brief Gửi một dòng (không gồm `\n`) tới client và tự thêm newline.
- * @return 0 nếu gửi thành công, -1 nếu lỗi.
- */
-int send_line(int fd, const char *line);
-
-/**
- * @brief Đọc dữ liệu từ client, tách theo newline và xử lý từng dòng.
+ * @brief Đọc dữ liệu từ client, tách theo newline và đẩy từng dòng cho actor.
  */
 void handle_client_line(struct ClientConnection *conn, struct pollfd *pfd);
 
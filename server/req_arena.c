@@ -0,0 +1,160 @@
+#include "req_arena.h"
+#include "../shared/config.h"
+
+#include <jansson.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file req_arena.c
+ * @brief Arena bump theo lượt xử lý lệnh và hook allocator cho jansson.
+ */
+
+enum { REQ_ARENA_ALIGN = 16 };
+
+/** @brief Một khối arena; dữ liệu nằm ngay sau header. */
+struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+static struct ArenaChunk *g_head;   /* khoi co dinh, giu suot doi tien trinh */
+static struct ArenaChunk *g_cur;    /* khoi dang cap (g_head hoac khoi tran cuoi) */
+static size_t g_round_bytes;
+static __thread int t_active;       /* thread nay dang trong mot luot */
+static __thread int t_owner;        /* thread nay da tung mo luot (state actor) */
+static struct ReqArenaStats g_stats;
+
+static struct ArenaChunk *chunk_new(size_t size) {
+    struct ArenaChunk *chunk = (struct ArenaChunk *)malloc(sizeof(*chunk) + size);
+    if (chunk) {
+        chunk->next = NULL;
+        chunk->used = 0;
+        chunk->size = size;
+    }
+    return chunk;
+}
+
+/** @brief Cấp `size` byte căn lề trong `chunk`, NULL nếu không đủ chỗ. */
+static void *chunk_take(struct ArenaChunk *chunk, size_t size) {
+    uintptr_t base = (uintptr_t)chunk->data;
+    uintptr_t at = (base + chunk->used + (REQ_ARENA_ALIGN - 1)) & ~(uintptr_t)(REQ_ARENA_ALIGN - 1);
+    size_t offset = (size_t)(at - base);
+    if (offset > chunk->size || chunk->size - offset < size) {
+        return NULL;
+    }
+    chunk->used = offset + size;
+    return (void *)at;
+}
+
+/** @brief Con trỏ `p` có nằm trong một khối của arena không. */
+static int arena_owns(const void *p) {
+    uintptr_t at = (uintptr_t)p;
+    for (const struct ArenaChunk *c = g_head; c; c = c->next) {
+        if (at >= (uintptr_t)c->data && at < (uintptr_t)c->data + c->size) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Hook jansson: trong luot thi lay tu arena, ngoai luot (hoac thread khac) thi malloc nhu cu */
+static void *json_arena_malloc(size_t size) {
+    return t_active ? req_arena_alloc(size) : malloc(size);
+}
+
+/* Khoi cua arena duoc thu hoi khi reset; chi free() nhung gi cap bang malloc.
+ * Thread chua tung mo luot khong the giu con tro arena, va khong duoc doc
+ * danh sach khoi (actor dang sua) */
+static void json_arena_free(void *p) {
+    if (p && !(t_owner && arena_owns(p))) {
+        free(p);
+    }
+}
+
+/** @see req_arena_init() */
+int req_arena_init(void) {
+    if (g_head) {
+        return 0;
+    }
+    g_head = chunk_new(REQ_ARENA_SIZE);
+    if (!g_head) {
+        return -1;
+    }
+    g_cur = g_head;
+    json_set_alloc_funcs(json_arena_malloc, json_arena_free);
+    return 0;
+}
+
+/** @see req_arena_begin() */
+void req_arena_begin(void) {
+    t_active = 1;
+    t_owner = 1;
+}
+
+/** @see req_arena_end() */
+void req_arena_end(void) {
+    t_active = 0;
+    if (!g_head) {
+        return;
+    }
+    if (g_round_bytes > g_stats.peak_bytes) {
+        g_stats.peak_bytes = g_round_bytes;
+    }
+    /* Binh thuong chi co khoi dau: reset la dat lai hai bien */
+    struct ArenaChunk *spill = g_head->next;
+    while (spill) {
+        struct ArenaChunk *next = spill->next;
+        free(spill);
+        spill = next;
+    }
+    g_head->next = NULL;
+    g_head->used = 0;
+    g_cur = g_head;
+    g_round_bytes = 0;
+}
+
+/** @see req_arena_alloc() */
+void *req_arena_alloc(size_t size) {
+    if (!g_head && req_arena_init() != 0) {
+        return NULL;
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    void *p = chunk_take(g_cur, size);
+    if (!p) {
+        /* Khoi tran: du cho yeu cau lon, toi thieu bang khoi dau */
+        size_t need = size + REQ_ARENA_ALIGN;
+        struct ArenaChunk *chunk = chunk_new(need > REQ_ARENA_SIZE ? need : REQ_ARENA_SIZE);
+        if (!chunk) {
+            return NULL;
+        }
+        if (!g_head->next) {
+            g_stats.overflows++;
+        }
+        g_cur->next = chunk;
+        g_cur = chunk;
+        p = chunk_take(chunk, size);
+    }
+    g_round_bytes += size;
+    return p;
+}
+
+/** @see req_arena_strdup() */
+char *req_arena_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = (char *)req_arena_alloc(len);
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+
+/** @see req_arena_get_stats() */
+void req_arena_get_stats(struct ReqArenaStats *out) {
+    *out = g_stats;
+}
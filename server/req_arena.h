@@ -0,0 +1,58 @@
+#ifndef SERVER_REQ_ARENA_H
+#define SERVER_REQ_ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @file req_arena.h
+ * @brief Arena bump cho một lượt xử lý lệnh: cấp phát tịnh tiến, reset O(1) sau mỗi lượt.
+ *
+ * Response line của `handle_command()` và mọi cấp phát của jansson trong lúc
+ * xử lý lệnh (parse payload, dựng cây JSON khi lưu farm) lấy từ arena thay vì
+ * malloc, nên một INFO/CONTROL ở trạng thái ổn định không gọi malloc lần nào.
+ *
+ * Khối đầu (`REQ_ARENA_SIZE`) được giữ suốt đời tiến trình; lượt nào vượt quá
+ * thì arena xin thêm khối tràn và giải phóng chúng ở lần reset kế tiếp.
+ * Không thread-safe: chỉ dùng từ state actor (xem `state_actor.h`). Thread
+ * khác (work pool, nạp farm lúc khởi động) dùng jansson bình thường: hook chỉ
+ * lấy từ arena trên thread đang mở lượt.
+ */
+
+/** @brief Số liệu của arena (xem `req_arena_get_stats()`). */
+struct ReqArenaStats {
+    size_t peak_bytes;          /* luong byte lon nhat da cap trong mot luot */
+    unsigned long overflows;    /* so luot phai xin them khoi tran */
+};
+
+/**
+ * @brief Cấp khối đầu và gắn allocator của jansson (`json_set_alloc_funcs`).
+ *
+ * Gọi một lần trước mọi thao tác jansson khác. Ngoài `req_arena_begin()`/
+ * `req_arena_end()` jansson vẫn dùng malloc/free như cũ.
+ * @return 0 nếu thành công, -1 nếu hết bộ nhớ.
+ */
+int req_arena_init(void);
+
+/** @brief Bắt đầu một lượt: từ đây tới `req_arena_end()` jansson cấp phát từ arena. */
+void req_arena_begin(void);
+
+/**
+ * @brief Kết thúc lượt và reset arena; mọi con trỏ đã cấp trong lượt không còn hợp lệ.
+ *
+ * Không được giữ json_t tạo trong lượt sang lượt sau.
+ */
+void req_arena_end(void);
+
+/**
+ * @brief Cấp `size` byte (căn 16) sống tới `req_arena_end()`; không cần giải phóng.
+ * @return Con trỏ, hoặc NULL nếu hết bộ nhớ.
+ */
+void *req_arena_alloc(size_t size);
+
+/** @brief Copy chuỗi `s` vào arena (NULL nếu hết bộ nhớ). */
+char *req_arena_strdup(const char *s);
+
+/** @brief Lấy số liệu arena từ khi server chạy. */
+void req_arena_get_stats(struct ReqArenaStats *out);
+
+#endif /* SERVER_REQ_ARENA_H */
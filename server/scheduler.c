@@ -0,0 +1,244 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "scheduler.h"
+#include "monitor_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file scheduler.c
+ * @brief Min-heap các mốc lịch cho ăn/uống.
+ */
+
+#define SCHEDULER_CLOCK_JUMP_S 120
+
+/** @brief Parse "HH:MM" thành phút trong ngày; -1 nếu sai format. */
+static int parse_minute(const char *hhmm) {
+    if (!hhmm || hhmm[0] < '0' || hhmm[0] > '9' || hhmm[1] < '0' || hhmm[1] > '9' || hhmm[2] != ':' ||
+        hhmm[3] < '0' || hhmm[3] > '9' || hhmm[4] < '0' || hhmm[4] > '9') {
+        return -1;
+    }
+    int h = (hhmm[0] - '0') * 10 + (hhmm[1] - '0');
+    int m = (hhmm[3] - '0') * 10 + (hhmm[4] - '0');
+    if (h > 23 || m > 59) return -1;
+    return h * 60 + m;
+}
+
+/** @brief Lần xuất hiện kế tiếp (giờ địa phương) của phút `minute` sau thời điểm `now`. */
+static long long next_occurrence(int minute, time_t now) {
+    struct tm tm;
+    localtime_r(&now, &tm);
+    int mday = tm.tm_mday;
+    for (int day = 0; day < 3; ++day) {
+        /* mktime tu chuan hoa ngay/thang va gio mua he (tm_isdst = -1) */
+        tm.tm_mday = mday + day;
+        tm.tm_hour = minute / 60;
+        tm.tm_min = minute % 60;
+        tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+        time_t t = mktime(&tm);
+        if (t > now) return (long long)t;
+        localtime_r(&now, &tm);
+    }
+    return (long long)now + 86400;
+}
+
+static long long monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec;
+}
+
+static int slot_before(const struct ScheduleSlot *a, const struct ScheduleSlot *b) {
+    return a->fire_at < b->fire_at;
+}
+
+static void sift_up(struct ScheduleSlot *heap, size_t i) {
+    struct ScheduleSlot item = heap[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!slot_before(&item, &heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = item;
+}
+
+static void sift_down(struct ScheduleSlot *heap, size_t count, size_t i) {
+    struct ScheduleSlot item = heap[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= count) break;
+        if (child + 1 < count && slot_before(&heap[child + 1], &heap[child])) child++;
+        if (!slot_before(&heap[child], &item)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = item;
+}
+
+static int heap_push(struct Scheduler *s, const struct ScheduleSlot *slot) {
+    if (s->count == s->capacity) {
+        size_t cap = s->capacity ? s->capacity * 2 : 256;
+        struct ScheduleSlot *grown = (struct ScheduleSlot *)realloc(s->heap, cap * sizeof(*grown));
+        if (!grown) return -1;
+        s->heap = grown;
+        s->capacity = cap;
+    }
+    s->heap[s->count] = *slot;
+    sift_up(s->heap, s->count++);
+    return 0;
+}
+
+static void heap_pop(struct Scheduler *s) {
+    s->heap[0] = s->heap[--s->count];
+    if (s->count > 0) sift_down(s->heap, s->count, 0);
+}
+
+/** @brief Lịch của thiết bị (NULL nếu không phải feeder/drinker). */
+static const struct ScheduleEntry *device_schedule(const struct Device *dev, size_t *count) {
+    if (dev->identity.type == DEVICE_FEEDER) {
+        *count = dev->cold->data.feeder.schedule_count;
+        return dev->cold->data.feeder.schedule;
+    }
+    if (dev->identity.type == DEVICE_DRINKER) {
+        *count = dev->cold->data.drinker.schedule_count;
+        return dev->cold->data.drinker.schedule;
+    }
+    *count = 0;
+    return NULL;
+}
+
+/** @brief Tạo các mốc của `dev`; `push` = 0 thì chỉ đếm (dùng khi dựng heap bằng heapify). */
+static size_t collect_slots(struct Scheduler *s, const struct Device *dev, time_t now, int push, int *err) {
+    size_t count = 0, made = 0;
+    const struct ScheduleEntry *schedule = device_schedule(dev, &count);
+    if (count > MAX_SCHEDULE_ENTRIES) count = MAX_SCHEDULE_ENTRIES;
+    for (size_t i = 0; i < count; ++i) {
+        int minute = parse_minute(schedule[i].time);
+        if (minute < 0) continue;
+        struct ScheduleSlot slot;
+        slot.fire_at = next_occurrence(minute, now);
+        slot.seq = dev->seq;
+        slot.gen = dev->sched_gen;
+        slot.minute = (unsigned short)minute;
+        slot.entry = (unsigned char)i;
+        if (push) {
+            if (heap_push(s, &slot) != 0) *err = 1;
+        } else {
+            s->heap[s->count++] = slot;
+        }
+        made++;
+    }
+    return made;
+}
+
+/** @see scheduler_init() */
+void scheduler_init(struct Scheduler *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+/** @see scheduler_free() */
+void scheduler_free(struct Scheduler *s) {
+    free(s->heap);
+    scheduler_init(s);
+}
+
+/** @see scheduler_rebuild() */
+int scheduler_rebuild(struct Scheduler *s, struct DevicesContext *devices, time_t now) {
+    size_t need = 0;
+    for (size_t i = 0; i < devices->count; ++i) {
+        size_t n = 0;
+        (void)device_schedule(&devices->devices[i], &n);
+        need += n > MAX_SCHEDULE_ENTRIES ? MAX_SCHEDULE_ENTRIES : n;
+    }
+    if (need > s->capacity) {
+        struct ScheduleSlot *grown = (struct ScheduleSlot *)realloc(s->heap, need * sizeof(*grown));
+        if (!grown) return -1;
+        s->heap = grown;
+        s->capacity = need;
+    }
+    /* Ghi het roi heapify O(n) thay vi n lan push */
+    s->count = 0;
+    int err = 0;
+    for (size_t i = 0; i < devices->count; ++i) {
+        (void)collect_slots(s, &devices->devices[i], now, 0, &err);
+    }
+    for (size_t i = s->count / 2; i-- > 0;) {
+        sift_down(s->heap, s->count, i);
+    }
+    s->live_at_rebuild = s->count;
+    s->last_wall = (long long)now;
+    s->last_mono = monotonic_seconds();
+    return 0;
+}
+
+/** @see scheduler_sync_device() */
+int scheduler_sync_device(struct Scheduler *s, struct Device *dev, time_t now) {
+    if (!dev) return -1;
+    dev->sched_gen++;
+    int err = 0;
+    (void)collect_slots(s, dev, now, 1, &err);
+    return err ? -1 : 0;
+}
+
+/** @see scheduler_next_fire() */
+long long scheduler_next_fire(const struct Scheduler *s) {
+    return s->count > 0 ? s->heap[0].fire_at : -1;
+}
+
+/** @brief Thực hiện một mốc lịch (bỏ qua nếu thiết bị đang OFF). */
+static int fire_entry(struct Device *dev, const struct ScheduleEntry *entry) {
+    char message[96];
+    int rc;
+    if (dev->identity.type == DEVICE_FEEDER) {
+        if (dev->data.feeder.state != DEVICE_ON) return -1;
+        rc = devices_feed_now(dev, entry->food, entry->water);
+        snprintf(message, sizeof(message), "SCHEDULE %s FEED %.2fkg %.2fL", entry->time, entry->food, entry->water);
+    } else {
+        if (dev->data.drinker.state != DEVICE_ON) return -1;
+        rc = devices_drink_now(dev, entry->water);
+        snprintf(message, sizeof(message), "SCHEDULE %s DRINK %.2fL", entry->time, entry->water);
+    }
+    if (rc != 0) return -1;
+    log_device_event(dev->identity.id, message);
+    return 0;
+}
+
+/** @see scheduler_run_due() */
+size_t scheduler_run_due(struct Scheduler *s, struct DevicesContext *devices, time_t now,
+                         void (*fired)(struct Device *dev, void *user_data), void *user_data) {
+    /* Dong ho he thong bi chinh (NTP, doi gio tay): tinh lai toan bo tu thoi diem moi */
+    long long mono = monotonic_seconds();
+    long long drift = ((long long)now - s->last_wall) - (mono - s->last_mono);
+    if (drift > SCHEDULER_CLOCK_JUMP_S || drift < -SCHEDULER_CLOCK_JUMP_S ||
+        s->count > 2 * s->live_at_rebuild + 1024) {
+        (void)scheduler_rebuild(s, devices, now);
+    }
+    s->last_wall = (long long)now;
+    s->last_mono = mono;
+
+    size_t done = 0;
+    while (s->count > 0 && s->heap[0].fire_at <= (long long)now) {
+        struct ScheduleSlot slot = s->heap[0];
+        heap_pop(s);
+
+        struct Device *dev = devices_find_seq(devices, slot.seq);
+        if (!dev || dev->sched_gen != slot.gen) {
+            continue; /* thiet bi da xoa hoac lich da doi: moc cu bi bo */
+        }
+        size_t count = 0;
+        const struct ScheduleEntry *schedule = device_schedule(dev, &count);
+        if (!schedule || slot.entry >= count) continue;
+
+        if (fire_entry(dev, &schedule[slot.entry]) == 0) {
+            done++;
+            if (fired) fired(dev, user_data);
+        }
+        slot.fire_at = next_occurrence(slot.minute, now);
+        (void)heap_push(s, &slot);
+    }
+    return done;
+}
@@ -0,0 +1,72 @@
+#ifndef SERVER_SCHEDULER_H
+#define SERVER_SCHEDULER_H
+
+#include <stddef.h>
+#include <time.h>
+#include "devices.h"
+
+/**
+ * @file scheduler.h
+ * @brief Chạy lịch cho ăn/uống (`ScheduleEntry` "HH:MM" theo giờ địa phương, lặp hằng ngày).
+ *
+ * Mọi mốc lịch nằm trong một min-heap theo thời điểm bắn kế tiếp, nên mỗi lần
+ * bắn tốn O(log n) thay vì duyệt toàn bộ thiết bị. Khi lịch của một thiết bị
+ * thay đổi, `scheduler_sync_device()` tăng `sched_gen` của thiết bị và đẩy các
+ * mốc mới; mốc cũ bị bỏ qua khi tới hạn (xoá lười) và heap được dựng lại khi
+ * rác vượt quá số mốc còn hiệu lực.
+ */
+
+/** @brief Một mốc lịch trong heap. Thiết bị được tham chiếu qua `seq` (con trỏ có thể đổi). */
+struct ScheduleSlot {
+    long long fire_at;         /* epoch giay */
+    unsigned long long seq;    /* Device.seq */
+    unsigned gen;              /* Device.sched_gen luc day vao heap */
+    unsigned short minute;     /* phut trong ngay (HH*60+MM) */
+    unsigned char entry;       /* vi tri trong schedule[] */
+};
+
+/** @brief Trạng thái scheduler. */
+struct Scheduler {
+    struct ScheduleSlot *heap;
+    size_t count;
+    size_t capacity;
+    size_t live_at_rebuild;    /* so moc hop le o lan dung heap gan nhat */
+    long long last_wall;       /* de phat hien dong ho he thong bi chinh */
+    long long last_mono;
+};
+
+/** @brief Khởi tạo scheduler rỗng. */
+void scheduler_init(struct Scheduler *s);
+
+/** @brief Giải phóng heap. */
+void scheduler_free(struct Scheduler *s);
+
+/**
+ * @brief Dựng lại heap từ toàn bộ thiết bị, tính thời điểm bắn kế tiếp sau `now`.
+ * @return 0 nếu thành công, -1 nếu hết bộ nhớ.
+ */
+int scheduler_rebuild(struct Scheduler *s, struct DevicesContext *devices, time_t now);
+
+/**
+ * @brief Lịch của `dev` vừa thay đổi (hoặc thiết bị mới): vô hiệu mốc cũ và đẩy mốc mới.
+ * @return 0 nếu thành công, -1 nếu hết bộ nhớ.
+ */
+int scheduler_sync_device(struct Scheduler *s, struct Device *dev, time_t now);
+
+/** @brief Thời điểm bắn sớm nhất (epoch giây), -1 nếu heap rỗng. */
+long long scheduler_next_fire(const struct Scheduler *s);
+
+/**
+ * @brief Bắn mọi mốc đã tới hạn tại `now` qua `devices_feed_now()`/`devices_drink_now()`,
+ *        ghi log và hẹn lại lần kế tiếp.
+ *
+ * Nếu đồng hồ hệ thống bị chỉnh (lệch với đồng hồ monotonic quá
+ * `SCHEDULER_CLOCK_JUMP_S`) thì heap được tính lại từ `now`, không bắn bù các
+ * mốc bị nhảy qua. `fired` (có thể NULL) được gọi sau mỗi thiết bị được bắn.
+ *
+ * @return Số mốc đã bắn.
+ */
+size_t scheduler_run_due(struct Scheduler *s, struct DevicesContext *devices, time_t now,
+                         void (*fired)(struct Device *dev, void *user_data), void *user_data);
+
+#endif  /* SERVER_SCHEDULER_H */
@@ -5,19 +5,25 @@
 #include <time.h>
 
 static struct Session sessions[MAX_DEVICES];
+static unsigned long g_generation;
 
 /**
  * @file session_auth.c
  * @brief Quản lý session token cho thiết bị sau khi CONNECT.
  *
- * Lưu ý: triển khai hiện tại dùng `rand()` và gọi `srand(time(NULL))` trong
- * `generate_token()`, phù hợp demo nhưng không phải mã an toàn cho production.
+ * Lưu ý: triển khai hiện tại dùng `rand()` (seed một lần bằng `time(NULL)` ở lần
+ * gọi `generate_token()` đầu tiên), phù hợp demo nhưng không phải mã an toàn cho production.
  */
 
 /** @see generate_token() */
 void generate_token(char *token, size_t len) {
     const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-    srand(time(NULL));
+    static int seeded = 0;
+    if (!seeded) {
+        /* Chi seed 1 lan: seed lai moi lan goi se sinh token trung nhau trong cung 1 giay */
+        srand((unsigned)time(NULL));
+        seeded = 1;
+    }
     for (size_t i = 0; i < len - 1; ++i) {
         token[i] = charset[rand() % (sizeof(charset) - 1)];
     }
@@ -32,6 +38,7 @@ int create_session(const char *device_id, char *token_out) {
             strcpy(sessions[i].device_id, device_id);
             sessions[i].active = 1;
             strcpy(token_out, sessions[i].token);
+            g_generation++;
             log_device_event(device_id, "Session created");  // Thêm log
             return 0;
         }
@@ -56,7 +63,44 @@ void end_session(const char *token) {
         if (sessions[i].active && strcmp(sessions[i].token, token) == 0) {
             log_device_event(sessions[i].device_id, "Session ended");  // Thêm log
             sessions[i].active = 0;
+            g_generation++;
             break;
         }
     }
 }
+
+/** @see session_count() */
+size_t session_count(void) {
+    size_t n = 0;
+    for (int i = 0; i < MAX_DEVICES; ++i) {
+        if (sessions[i].active) n++;
+    }
+    return n;
+}
+
+/** @see end_device_sessions() */
+void end_device_sessions(const char *device_id) {
+    for (int i = 0; i < MAX_DEVICES; ++i) {
+        if (sessions[i].active && strcmp(sessions[i].device_id, device_id) == 0) {
+            log_device_event(sessions[i].device_id, "Session ended");
+            sessions[i].active = 0;
+            g_generation++;
+        }
+    }
+}
+
+/** @see session_generation() */
+unsigned long session_generation(void) {
+    return g_generation;
+}
+
+/** @see session_export() */
+size_t session_export(struct Session *out, size_t max) {
+    size_t n = 0;
+    for (int i = 0; i < MAX_DEVICES && n < max; ++i) {
+        if (sessions[i].active) {
+            out[n++] = sessions[i];
+        }
+    }
+    return n;
+}
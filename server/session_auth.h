@@ -33,4 +33,27 @@ int validate_session(const char *token, char *device_id_out);
  */
 void end_session(const char *token);
 
+/**
+ * @brief Kết thúc mọi session của một thiết bị (vd khi thiết bị bị xoá).
+ */
+void end_device_sessions(const char *device_id);
+
+/**
+ * @brief Số session đang active.
+ */
+size_t session_count(void);
+
+/**
+ * @brief Bộ đếm tăng mỗi khi tập session thay đổi (tạo/kết thúc).
+ *
+ * Dùng để biết có cần chép lại session vào snapshot đọc (`farm_snapshot.h`) hay không.
+ */
+unsigned long session_generation(void);
+
+/**
+ * @brief Chép các session đang active vào `out` (tối đa `max`).
+ * @return Số session đã chép.
+ */
+size_t session_export(struct Session *out, size_t max);
+
 #endif  /* SESSION_AUTH_H */
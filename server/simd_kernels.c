@@ -0,0 +1,233 @@
+#include "simd_kernels.h"
+
+/**
+ * @file simd_kernels.c
+ * @brief Cài đặt scalar, SSE2, AVX2 và bảng dispatch.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/** @brief Bảng hàm của một mức. */
+struct SimdOps {
+    double (*sum)(const double *x, size_t n);
+    double (*min)(const double *x, size_t n);
+    double (*max)(const double *x, size_t n);
+    size_t (*count_nonzero)(const uint8_t *x, size_t n);
+};
+
+/* ---------- Scalar ---------- */
+
+static double sum_scalar(const double *x, size_t n) {
+    double s = 0.0;
+    for (size_t i = 0; i < n; ++i) s += x[i];
+    return s;
+}
+
+static double min_scalar(const double *x, size_t n) {
+    double m = x[0];
+    for (size_t i = 1; i < n; ++i) m = x[i] < m ? x[i] : m;
+    return m;
+}
+
+static double max_scalar(const double *x, size_t n) {
+    double m = x[0];
+    for (size_t i = 1; i < n; ++i) m = x[i] > m ? x[i] : m;
+    return m;
+}
+
+static size_t count_scalar(const uint8_t *x, size_t n) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; ++i) c += x[i] != 0;
+    return c;
+}
+
+static const struct SimdOps OPS_SCALAR = { sum_scalar, min_scalar, max_scalar, count_scalar };
+
+#ifdef SIMD_X86
+
+/* ---------- SSE2 (co san tren moi CPU x86-64) ---------- */
+
+__attribute__((target("sse2")))
+static double sum_sse2(const double *x, size_t n) {
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_add_pd(a0, _mm_loadu_pd(x + i));
+        a1 = _mm_add_pd(a1, _mm_loadu_pd(x + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+    double s = lanes[0] + lanes[1];
+    for (; i < n; ++i) s += x[i];
+    return s;
+}
+
+__attribute__((target("sse2")))
+static double min_sse2(const double *x, size_t n) {
+    if (n < 2) return x[0];
+    __m128d m = _mm_loadu_pd(x);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) m = _mm_min_pd(m, _mm_loadu_pd(x + i));
+    double lanes[2];
+    _mm_storeu_pd(lanes, m);
+    double r = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+    for (; i < n; ++i) r = x[i] < r ? x[i] : r;
+    return r;
+}
+
+__attribute__((target("sse2")))
+static double max_sse2(const double *x, size_t n) {
+    if (n < 2) return x[0];
+    __m128d m = _mm_loadu_pd(x);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) m = _mm_max_pd(m, _mm_loadu_pd(x + i));
+    double lanes[2];
+    _mm_storeu_pd(lanes, m);
+    double r = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    for (; i < n; ++i) r = x[i] > r ? x[i] : r;
+    return r;
+}
+
+__attribute__((target("sse2")))
+static size_t count_sse2(const uint8_t *x, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t c = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(x + i)), zero);
+        c += 16u - (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(eq));
+    }
+    for (; i < n; ++i) c += x[i] != 0;
+    return c;
+}
+
+static const struct SimdOps OPS_SSE2 = { sum_sse2, min_sse2, max_sse2, count_sse2 };
+
+/* ---------- AVX2 ---------- */
+
+__attribute__((target("avx2")))
+static double sum_avx2(const double *x, size_t n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(x + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(x + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(a0, a1));
+    double s = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; ++i) s += x[i];
+    return s;
+}
+
+__attribute__((target("avx2")))
+static double min_avx2(const double *x, size_t n) {
+    if (n < 4) return min_scalar(x, n);
+    __m256d m = _mm256_loadu_pd(x);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = _mm256_min_pd(m, _mm256_loadu_pd(x + i));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double r = min_scalar(lanes, 4);
+    for (; i < n; ++i) r = x[i] < r ? x[i] : r;
+    return r;
+}
+
+__attribute__((target("avx2")))
+static double max_avx2(const double *x, size_t n) {
+    if (n < 4) return max_scalar(x, n);
+    __m256d m = _mm256_loadu_pd(x);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = _mm256_max_pd(m, _mm256_loadu_pd(x + i));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double r = max_scalar(lanes, 4);
+    for (; i < n; ++i) r = x[i] > r ? x[i] : r;
+    return r;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t count_avx2(const uint8_t *x, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t c = 0, i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(x + i)), zero);
+        c += 32u - (size_t)__builtin_popcount((unsigned)_mm256_movemask_epi8(eq));
+    }
+    for (; i < n; ++i) c += x[i] != 0;
+    return c;
+}
+
+static const struct SimdOps OPS_AVX2 = { sum_avx2, min_avx2, max_avx2, count_avx2 };
+
+#endif /* SIMD_X86 */
+
+static const struct SimdOps *g_ops;
+static enum SimdLevel g_level;
+
+/** @brief Mức cao nhất CPU hỗ trợ. */
+static enum SimdLevel detect_level(void) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+/** @see simd_set_level() */
+enum SimdLevel simd_set_level(enum SimdLevel level) {
+    enum SimdLevel best = detect_level();
+    if (level > best) level = best;
+    switch (level) {
+#ifdef SIMD_X86
+    case SIMD_AVX2: g_ops = &OPS_AVX2; break;
+    case SIMD_SSE2: g_ops = &OPS_SSE2; break;
+#endif
+    default: g_ops = &OPS_SCALAR; level = SIMD_SCALAR; break;
+    }
+    g_level = level;
+    return level;
+}
+
+static const struct SimdOps *ops(void) {
+    if (!g_ops) (void)simd_set_level(SIMD_AVX2);
+    return g_ops;
+}
+
+/** @see simd_level() */
+enum SimdLevel simd_level(void) {
+    (void)ops();
+    return g_level;
+}
+
+/** @see simd_level_name() */
+const char *simd_level_name(enum SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX2: return "avx2";
+    case SIMD_SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+/** @see simd_sum_f64() */
+double simd_sum_f64(const double *x, size_t n) {
+    return n ? ops()->sum(x, n) : 0.0;
+}
+
+/** @see simd_min_f64() */
+double simd_min_f64(const double *x, size_t n) {
+    return ops()->min(x, n);
+}
+
+/** @see simd_max_f64() */
+double simd_max_f64(const double *x, size_t n) {
+    return ops()->max(x, n);
+}
+
+/** @see simd_count_nonzero_u8() */
+size_t simd_count_nonzero_u8(const uint8_t *x, size_t n) {
+    return ops()->count_nonzero(x, n);
+}
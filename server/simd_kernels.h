@@ -0,0 +1,48 @@
+#ifndef SERVER_SIMD_KERNELS_H
+#define SERVER_SIMD_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file simd_kernels.h
+ * @brief Kernel sum/min/max/count trên mảng liên tục, chọn AVX2/SSE2/scalar lúc chạy.
+ *
+ * Bản AVX2 được biên dịch bằng `__attribute__((target("avx2")))` nên không cần
+ * cờ `-mavx2` cho cả project; lần gọi đầu kiểm tra CPU và chọn bảng hàm.
+ * Tổng dùng nhiều accumulator nên thứ tự cộng khác vòng scalar (sai khác ở
+ * bit cuối của double).
+ */
+
+/** @brief Mức kernel. */
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+/** @brief Tổng `n` phần tử (0 nếu n = 0). */
+double simd_sum_f64(const double *x, size_t n);
+
+/** @brief Nhỏ nhất (n > 0). */
+double simd_min_f64(const double *x, size_t n);
+
+/** @brief Lớn nhất (n > 0). */
+double simd_max_f64(const double *x, size_t n);
+
+/** @brief Số byte khác 0. */
+size_t simd_count_nonzero_u8(const uint8_t *x, size_t n);
+
+/** @brief Mức đang dùng (tự phát hiện ở lần gọi đầu). */
+enum SimdLevel simd_level(void);
+
+/**
+ * @brief Ép mức kernel (dùng cho benchmark); mức cao hơn CPU hỗ trợ bị hạ xuống.
+ * @return Mức thực sự được chọn.
+ */
+enum SimdLevel simd_set_level(enum SimdLevel level);
+
+/** @brief Tên mức ("scalar", "sse2", "avx2"). */
+const char *simd_level_name(enum SimdLevel level);
+
+#endif /* SERVER_SIMD_KERNELS_H */
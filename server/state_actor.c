@@ -0,0 +1,538 @@
+#define _GNU_SOURCE
+
+#include "state_actor.h"
+#include "coop_logic.h"
+#include "intern.h"
+#include "metrics.h"
+#include "metrics_http.h"
+#include "monitor_log.h"
+#include "req_arena.h"
+#include "telemetry_udp.h"
+#include "work_pool.h"
+#include "../shared/config.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/**
+ * @file state_actor.c
+ * @brief Vòng lặp của thread state: rút lô lệnh, xử lý, render event, group commit.
+ */
+
+/** @brief Header của một bản ghi trong ring response; `len` byte dữ liệu theo ngay sau. */
+struct ReplyHeader {
+    uint32_t slot;
+    uint32_t gen;
+    uint32_t len;
+    uint32_t flags;             // REPLY_DONE, ...
+    uint64_t batch;             // Lô đã tạo bản ghi
+};
+
+/** @brief Trạng thái phía actor của một slot kết nối. */
+struct ActorConn {
+    int open;
+    uint32_t gen;
+    struct Subscription subs[MAX_SUBSCRIPTIONS];
+    size_t sub_count;
+    uint32_t pending[MAX_PENDING_EVENTS];  // Handle ID thiết bị chờ push (đã gộp trùng, mỗi handle giữ một tham chiếu)
+    size_t pending_count;
+    unsigned long lost_unreported;  // Số event bỏ chưa báo qua EVENT_LOST
+};
+
+static struct CmdQueue g_requests;
+static struct ByteRing g_replies;
+static int g_actor_wake_fd = -1;        /* thread mang -> actor */
+static int g_reply_wake_fd = -1;        /* actor -> thread mang */
+static int g_space_wake_fd = -1;        /* thread mang -> actor: da rut bot ring response */
+static int g_space_waiting;             /* actor dang cho ring response co cho (atomic) */
+static size_t g_out_level[MAX_DEVICES]; /* thread mang ghi, actor doc (atomic) */
+static struct ActorConn g_conns[MAX_DEVICES];
+static unsigned long g_events_dropped;
+static uint64_t g_batch;                /* lo dang xu ly (tang o dau run_batch) */
+static int g_snapshot_wait_ms = -1;     /* con snapshot hoan cong bo: thoi gian cho */
+static struct WorkReactor g_reactor;    /* task work pool da xong (ghi farm, ...) */
+static int g_holding;                   /* response tu g_hold_mark tro di cho ghi farm */
+static size_t g_hold_mark;              /* moc ring: phan truoc moc duoc cong bo khi ghi xong */
+static size_t g_batch_mark;             /* moc ring o dau lo hien tai */
+static struct pollfd g_actor_fds[2 + METRICS_HTTP_POLLFDS + TELEMETRY_UDP_POLLFDS];
+
+static void eventfd_signal(int fd) {
+    uint64_t one = 1;
+    ssize_t n;
+    do {
+        n = write(fd, &one, sizeof(one));
+    } while (n < 0 && errno == EINTR);
+}
+
+static void eventfd_clear(int fd) {
+    uint64_t value;
+    while (read(fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+}
+
+/** @brief Công bố response đã ghi và đánh thức thread mạng nếu có gì mới. */
+static void publish_replies(void) {
+    if (byte_ring_publish(&g_replies)) {
+        eventfd_signal(g_reply_wake_fd);
+    }
+}
+
+/**
+ * @brief Công bố response đã được phép gửi; bắt đầu lần ghi farm kế tiếp nếu cần.
+ *
+ * Gọi ở cuối mỗi lô và sau khi work pool báo ghi xong. Response của lô có
+ * lệnh cần lưu chỉ được công bố khi lần ghi chứa nó đã xong; lô không cần lưu
+ * vẫn xếp sau phần đang bị giữ (ring giữ thứ tự). Trong lúc chờ, actor vẫn xử lý lô mới.
+ */
+static void settle_replies(void) {
+    if (coop_logic_save_in_flight()) {
+        if (g_holding) {
+            return;
+        }
+        if (coop_logic_save_pending()) {
+            /* Lan ghi dang chay (flush dinh ky) khong chua thay doi cua lo nay: giu tu dau lo */
+            g_holding = 1;
+            g_hold_mark = g_batch_mark;
+            return;
+        }
+    } else {
+        if (g_holding && byte_ring_publish_to(&g_replies, g_hold_mark)) {
+            eventfd_signal(g_reply_wake_fd);
+        }
+        g_holding = 0;
+        if (coop_logic_end_batch(g_batch)) {
+            g_holding = 1;
+            g_hold_mark = byte_ring_mark(&g_replies);
+            g_snapshot_wait_ms = -1;
+            return;
+        }
+    }
+    g_snapshot_wait_ms = coop_logic_publish_snapshot(g_batch);
+    publish_replies();
+}
+
+/**
+ * @brief Chờ ring response còn `need` byte trống.
+ *
+ * Ring đầy giữa lô thì chờ lần ghi đang chạy, ghi tại chỗ phần còn cần lưu
+ * rồi công bố phần đã có để thread mạng rút bớt (response không bao giờ tới
+ * client trước khi được lưu). Actor ngủ trên eventfd mà thread mạng báo sau
+ * mỗi lần rút ring.
+ */
+static void wait_reply_space(size_t need) {
+    if (byte_ring_space(&g_replies) >= need) {
+        return;
+    }
+    coop_logic_save_now();
+    g_holding = 0;
+    publish_replies();
+    __atomic_store_n(&g_space_waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (byte_ring_space(&g_replies) < need) {
+        struct pollfd pfd = {g_space_wake_fd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            break;
+        }
+        eventfd_clear(g_space_wake_fd);
+    }
+    __atomic_store_n(&g_space_waiting, 0, __ATOMIC_RELAXED);
+}
+
+/** @brief Ghi một bản ghi (chia nhỏ nếu lớn hơn nửa ring) cho `slot`. */
+static void reply_put(uint32_t slot, uint32_t gen, const char *data, size_t len, int newline) {
+    size_t max_payload = byte_ring_capacity(&g_replies) / 2 - sizeof(struct ReplyHeader);
+    size_t total = len + (newline ? 1 : 0);
+    size_t done = 0;
+    while (done < total) {
+        size_t n = total - done < max_payload ? total - done : max_payload;
+        struct ReplyHeader hdr = {slot, gen, (uint32_t)n, 0, g_batch};
+        wait_reply_space(sizeof(hdr) + n);
+        (void)byte_ring_put(&g_replies, &hdr, sizeof(hdr));
+        size_t from_data = done < len ? (len - done < n ? len - done : n) : 0;
+        (void)byte_ring_put(&g_replies, data + done, from_data);
+        if (from_data < n) {
+            (void)byte_ring_put(&g_replies, "\n", 1);
+        }
+        done += n;
+    }
+}
+
+/** @brief Báo thread mạng lệnh vừa xử lý của `slot` đã trả xong (bản ghi rỗng `REPLY_DONE`). */
+static void reply_done(uint32_t slot, uint32_t gen) {
+    struct ReplyHeader hdr = {slot, gen, 0, REPLY_DONE, g_batch};
+    wait_reply_space(sizeof(hdr));
+    (void)byte_ring_put(&g_replies, &hdr, sizeof(hdr));
+}
+
+static struct ActorConn *conn_at(int conn) {
+    if (conn < 0 || conn >= MAX_DEVICES || !g_conns[conn].open) {
+        return NULL;
+    }
+    return &g_conns[conn];
+}
+
+static void conn_reset(struct ActorConn *c) {
+    coop_logic_import_drop((int)(c - g_conns));
+    for (size_t i = 0; i < c->sub_count; ++i) {
+        if (c->subs[i].coop_id == 0) intern_release(c->subs[i].device);
+    }
+    for (size_t i = 0; i < c->pending_count; ++i) {
+        intern_release(c->pending[i]);
+    }
+    c->open = 0;
+    c->sub_count = 0;
+    c->pending_count = 0;
+    c->lost_unreported = 0;
+}
+
+/** @see send_line() */
+int send_line(int conn, const char *line) {
+    const struct ActorConn *c = conn_at(conn);
+    if (!c || !line) {
+        return -1;
+    }
+    reply_put((uint32_t)conn, c->gen, line, strlen(line), 1);
+    return 0;
+}
+
+/**
+ * @brief Render các event đang chờ (trạng thái mới nhất) khi buffer gửi dưới mức high-water.
+ *
+ * Event bị bỏ được báo một lần bằng EVENT_LOST sau khi hàng đợi đã gửi hết.
+ */
+static void deliver_pending_events(int slot) {
+    struct ActorConn *c = &g_conns[slot];
+    char line[MAX_LINE_LEN];
+    size_t level = __atomic_load_n(&g_out_level[slot], __ATOMIC_ACQUIRE);
+    size_t done = 0;
+    while (done < c->pending_count && level < NET_OUT_HIGH_WATER) {
+        /* Event giu tham chieu toi ID nen EVENT_GONE van doc duoc ID cua thiet bi da xoa */
+        if (coop_logic_format_event(c->pending[done], line, sizeof(line)) == 0) {
+            send_line(slot, line);
+            level += strlen(line) + 1;
+        }
+        intern_release(c->pending[done]);
+        done++;
+    }
+    if (done > 0) {
+        memmove(c->pending, c->pending + done, (c->pending_count - done) * sizeof(c->pending[0]));
+        c->pending_count -= done;
+    }
+    if (c->pending_count == 0 && c->lost_unreported > 0 && level < NET_OUT_HIGH_WATER) {
+        protocol_format_event_lost(line, sizeof(line), c->lost_unreported);
+        send_line(slot, line);
+        c->lost_unreported = 0;
+    }
+}
+
+/** @brief Xử lý một message từ thread mạng. */
+static void process_request(struct CmdRequest *req) {
+    if (req->slot >= MAX_DEVICES) {
+        return;
+    }
+    struct ActorConn *c = &g_conns[req->slot];
+    int current = c->open && c->gen == req->gen;
+    if (req->kind == CMD_MSG_CLOSED) {
+        if (current) conn_reset(c);
+        return;
+    }
+    if (req->kind == CMD_MSG_DRAINED) {
+        if (current) deliver_pending_events((int)req->slot);
+        return;
+    }
+    if (req->kind == CMD_MSG_IMPORT) {
+        if (current) coop_logic_import_line((int)req->slot, req->line);
+        return;
+    }
+    if (!current) {
+        /* Lenh dau tien cua ket noi moi tren slot nay */
+        conn_reset(c);
+        c->open = 1;
+        c->gen = req->gen;
+    }
+
+    char line[MAX_LINE_LEN];
+    if (req->cmd == CMD_UNKNOWN) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line((int)req->slot, line);
+        return;
+    }
+    /* O hang doi thuoc actor toi khi release: handle_command tach args tai cho */
+    uint64_t started = metrics_now_ns();
+    char *response = handle_command((int)req->slot, req->cmd, req->has_args ? req->line : NULL);
+    metrics_record_command(req->cmd, metrics_now_ns() - started);
+    if (response) {
+        send_line((int)req->slot, response);
+    } else if (!protocol_command_is_streamed(req->cmd)) {
+        protocol_format_bad_request(line, sizeof(line));
+        send_line((int)req->slot, line);
+    }
+}
+
+/**
+ * @brief Xử lý tối đa `ACTOR_BATCH_MAX` message, render event, lưu farm một lần rồi công bố.
+ *
+ * Snapshot đọc được công bố trước response của lô, nên khi thread mạng thấy
+ * response của lô B thì snapshot (nếu đã đánh dấu tới B) đã chứa mọi thay đổi của B.
+ * Cả hai chờ lần ghi farm chứa lô (xem `settle_replies()`).
+ * @return Số message đã xử lý.
+ */
+static size_t run_batch(void) {
+    size_t processed = 0;
+    g_batch++;
+    g_batch_mark = byte_ring_mark(&g_replies);
+    req_arena_begin();
+    struct CmdRequest *req;
+    while (processed < ACTOR_BATCH_MAX && (req = cmd_queue_peek(&g_requests)) != NULL) {
+        process_request(req);
+        if (req->kind == CMD_MSG_LINE && req->slot < MAX_DEVICES) {
+            reply_done(req->slot, req->gen);
+        }
+        cmd_queue_release(&g_requests);
+        processed++;
+    }
+    for (int i = 0; i < MAX_DEVICES; ++i) {
+        if (g_conns[i].open && (g_conns[i].pending_count > 0 || g_conns[i].lost_unreported > 0)) {
+            deliver_pending_events(i);
+        }
+    }
+    settle_replies();
+    req_arena_end();
+    return processed;
+}
+
+/** @brief Vòng lặp của thread actor. */
+static void *actor_main(void *arg) {
+    (void)arg;
+    uint64_t next_dump_ns = metrics_now_ns() + (uint64_t)STATS_DUMP_INTERVAL_S * 1000000000ull;
+    int backlog = 0;
+    while (1) {
+        /* Timeout poll = thoi gian con lai toi lan dump STATS hoac moc lich ke tiep */
+        int timeout_ms = backlog ? 0 : coop_logic_next_timeout_ms();
+        if (STATS_DUMP_INTERVAL_S > 0 && !backlog) {
+            uint64_t now = metrics_now_ns();
+            int dump_ms = now >= next_dump_ns ? 0 : (int)((next_dump_ns - now) / 1000000ull) + 1;
+            if (timeout_ms < 0 || dump_ms < timeout_ms) timeout_ms = dump_ms;
+        }
+        if (g_snapshot_wait_ms >= 0 && (timeout_ms < 0 || g_snapshot_wait_ms < timeout_ms)) {
+            timeout_ms = g_snapshot_wait_ms;
+        }
+
+        g_actor_fds[0].fd = g_actor_wake_fd;
+        g_actor_fds[0].events = POLLIN;
+        g_actor_fds[1].fd = g_reactor.fd;
+        g_actor_fds[1].events = POLLIN;
+        size_t http_fds = metrics_http_fill_pollfds(&g_actor_fds[2], METRICS_HTTP_POLLFDS);
+        struct pollfd *udp_pfd = &g_actor_fds[2 + http_fds];
+        size_t udp_fds = telemetry_udp_fill_pollfds(udp_pfd, TELEMETRY_UDP_POLLFDS);
+        int ret = poll(g_actor_fds, (nfds_t)(2 + http_fds + udp_fds), timeout_ms);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            perror("poll(actor)");
+            break;
+        }
+        if (g_actor_fds[0].revents & POLLIN) {
+            eventfd_clear(g_actor_wake_fd);
+        }
+        if ((g_actor_fds[1].revents & POLLIN) && work_reactor_run(&g_reactor) > 0) {
+            /* Ghi farm xong: cong bo response dang giu, ghi tiep phan da doi trong luc cho */
+            settle_replies();
+        }
+        if (STATS_DUMP_INTERVAL_S > 0 && metrics_now_ns() >= next_dump_ns) {
+            coop_logic_dump_stats();
+            next_dump_ns = metrics_now_ns() + (uint64_t)STATS_DUMP_INTERVAL_S * 1000000000ull;
+        }
+        coop_logic_tick();
+        metrics_http_process(&g_actor_fds[2], http_fds);
+        telemetry_udp_process(udp_pfd, udp_fds);
+
+        /* Con message sau mot lo day thi vong sau khong ngu trong poll */
+        backlog = run_batch() == ACTOR_BATCH_MAX && cmd_queue_peek(&g_requests) != NULL;
+        monitor_log_flush();
+    }
+    return NULL;
+}
+
+/** @see state_actor_start() */
+int state_actor_start(void) {
+    if (cmd_queue_init(&g_requests, ACTOR_QUEUE_DEPTH) != 0) {
+        return -1;
+    }
+    if (byte_ring_init(&g_replies, ACTOR_REPLY_RING_BYTES) != 0) {
+        cmd_queue_free(&g_requests);
+        return -1;
+    }
+    g_actor_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    g_reply_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    g_space_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int reactor_rc = work_reactor_init(&g_reactor);
+    pthread_t thread;
+    if (g_actor_wake_fd < 0 || g_reply_wake_fd < 0 || g_space_wake_fd < 0 || reactor_rc != 0 ||
+        pthread_create(&thread, NULL, actor_main, NULL) != 0) {
+        perror("state_actor_start");
+        if (g_actor_wake_fd >= 0) close(g_actor_wake_fd);
+        if (g_reply_wake_fd >= 0) close(g_reply_wake_fd);
+        if (g_space_wake_fd >= 0) close(g_space_wake_fd);
+        if (g_reactor.fd >= 0) close(g_reactor.fd);
+        g_actor_wake_fd = g_reply_wake_fd = g_space_wake_fd = g_reactor.fd = -1;
+        byte_ring_free(&g_replies);
+        cmd_queue_free(&g_requests);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+/** @see state_actor_reserve() */
+struct CmdRequest *state_actor_reserve(void) {
+    return cmd_queue_reserve(&g_requests);
+}
+
+/** @see state_actor_submit() */
+void state_actor_submit(struct CmdRequest *req) {
+    cmd_queue_commit(&g_requests, req);
+}
+
+/** @see state_actor_wake() */
+void state_actor_wake(void) {
+    eventfd_signal(g_actor_wake_fd);
+}
+
+/** @see state_actor_reply_fd() */
+int state_actor_reply_fd(void) {
+    return g_reply_wake_fd;
+}
+
+/** @see state_actor_drain_replies() */
+size_t state_actor_drain_replies(void (*deliver)(const struct ReplyInfo *info, const char *data, size_t len,
+                                                 void *user_data),
+                                 void *user_data) {
+    eventfd_clear(g_reply_wake_fd);
+    size_t drained = 0;
+    struct ReplyHeader hdr;
+    /* Actor chi cong bo o ranh gioi ban ghi nen doc duoc header la doc duoc ca ban ghi */
+    while (byte_ring_read(&g_replies, &hdr, sizeof(hdr)) == 0) {
+        struct ReplyInfo info = {hdr.slot, hdr.gen, hdr.flags, hdr.batch};
+        if (hdr.len == 0) {
+            deliver(&info, NULL, 0, user_data);
+        }
+        size_t left = hdr.len;
+        while (left > 0) {
+            const char *p;
+            size_t n = byte_ring_peek(&g_replies, &p, left);
+            deliver(&info, p, n, user_data);
+            byte_ring_consume(&g_replies, n);
+            left -= n;
+        }
+        drained += sizeof(hdr) + hdr.len;
+    }
+    if (drained > 0) {
+        /* Cap voi fence trong wait_reply_space: actor thay cho trong hoac thay co bao */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&g_space_waiting, __ATOMIC_RELAXED)) eventfd_signal(g_space_wake_fd);
+    }
+    return drained;
+}
+
+/** @see state_actor_report_out_level() */
+void state_actor_report_out_level(uint32_t slot, size_t out_len) {
+    if (slot < MAX_DEVICES) {
+        __atomic_store_n(&g_out_level[slot], out_len, __ATOMIC_RELEASE);
+    }
+}
+
+/** @see state_actor_reactor() */
+struct WorkReactor *state_actor_reactor(void) {
+    return &g_reactor;
+}
+
+/** @see server_subscribe() */
+int server_subscribe(int conn, uint32_t device, int coop_id) {
+    struct ActorConn *c = conn_at(conn);
+    if (!c) return -1;
+    for (size_t i = 0; i < c->sub_count; ++i) {
+        const struct Subscription *s = &c->subs[i];
+        if (coop_id > 0 ? s->coop_id == coop_id : (s->coop_id == 0 && s->device == device)) {
+            return (int)c->sub_count; /* da dang ky */
+        }
+    }
+    if (c->sub_count >= MAX_SUBSCRIPTIONS) return -2;
+    struct Subscription *s = &c->subs[c->sub_count++];
+    memset(s, 0, sizeof(*s));
+    s->coop_id = coop_id > 0 ? coop_id : 0;
+    if (coop_id <= 0) {
+        s->device = device;
+        intern_retain(device);
+    }
+    return (int)c->sub_count;
+}
+
+/** @see server_unsubscribe() */
+int server_unsubscribe(int conn, const char *device_id, int coop_id) {
+    struct ActorConn *c = conn_at(conn);
+    if (!c) return -1;
+    int all = coop_id <= 0 && (!device_id || device_id[0] == '\0');
+    uint32_t device = 0;
+    /* ID khong con trong bang intern (khong ai giu tham chieu) thi khong the co subscription nao khop */
+    int known = !all && coop_id <= 0 && intern_lookup(device_id, &device) == 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < c->sub_count; ++i) {
+        const struct Subscription *s = &c->subs[i];
+        int match = all ||
+                    (coop_id > 0 && s->coop_id == coop_id) ||
+                    (known && s->coop_id == 0 && s->device == device);
+        if (!match) {
+            c->subs[kept++] = *s;
+        } else if (s->coop_id == 0) {
+            intern_release(s->device);
+        }
+    }
+    c->sub_count = kept;
+    return (int)kept;
+}
+
+/** @brief Kết nối có đang theo dõi thiết bị này không. */
+static int is_subscribed(const struct ActorConn *c, uint32_t device, int coop_id) {
+    for (size_t i = 0; i < c->sub_count; ++i) {
+        const struct Subscription *s = &c->subs[i];
+        if (s->coop_id > 0 ? s->coop_id == coop_id : s->device == device) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** @see server_publish_device_change() */
+void server_publish_device_change(uint32_t device, int coop_id) {
+    for (int i = 0; i < MAX_DEVICES; ++i) {
+        struct ActorConn *c = &g_conns[i];
+        if (!c->open || c->sub_count == 0 || !is_subscribed(c, device, coop_id)) {
+            continue;
+        }
+        int queued = 0;
+        for (size_t j = 0; j < c->pending_count; ++j) {
+            if (c->pending[j] == device) {
+                queued = 1; /* gop: chi gui trang thai moi nhat mot lan */
+                break;
+            }
+        }
+        if (queued) continue;
+        if (c->pending_count >= MAX_PENDING_EVENTS) {
+            c->lost_unreported++;
+            g_events_dropped++;
+            continue;
+        }
+        intern_retain(device);
+        c->pending[c->pending_count++] = device;
+    }
+}
+
+/** @see server_events_dropped() */
+unsigned long server_events_dropped(void) {
+    return g_events_dropped;
+}
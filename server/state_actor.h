@@ -0,0 +1,115 @@
+#ifndef SERVER_STATE_ACTOR_H
+#define SERVER_STATE_ACTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cmd_queue.h"
+#include "work_pool.h"
+
+/**
+ * @file state_actor.h
+ * @brief Thread state duy nhất sở hữu farm (`g_coops`, `g_devices`, session, lịch, lịch sử).
+ *
+ * Thread mạng chỉ đọc/ghi socket: nó tách dòng lệnh và đẩy vào `CmdQueue`,
+ * actor xử lý cả lô message mỗi lần thức dậy rồi trả response/event qua
+ * `ByteRing`. Trong một lô, các lệnh cần lưu farm chỉ đánh dấu, actor render
+ * farm một lần ở cuối lô, giao việc ghi file cho work pool và chỉ công bố
+ * response khi ghi xong (group commit); trong lúc đó actor vẫn xử lý lô mới.
+ * Vì vậy coop_logic không cần khoá nào.
+ *
+ * Actor cũng sở hữu `/metrics`, UDP telemetry, lịch chạy định kỳ và dump STATS
+ * (đều đọc/ghi state). Hàm "thread mạng" chỉ gọi từ thread chạy `server_run()`;
+ * các hàm còn lại chỉ gọi từ actor (trong `handle_command()` và callback của nó).
+ */
+
+/** @brief Một subscription của kết nối: theo dõi một thiết bị hoặc cả chuồng. */
+struct Subscription {
+    int coop_id;                 // >0: ca chuong, 0: mot thiet bi
+    uint32_t device;             // handle intern cua ID thiet bi (khi coop_id == 0, giu mot tham chieu)
+};
+
+/** @brief Cờ của một bản ghi response. */
+enum ReplyFlag {
+    REPLY_DONE = 1      /* ban ghi rong: lenh cu nhat dang cho cua slot da tra xong */
+};
+
+/** @brief Thông tin kèm theo một đoạn response actor trả cho thread mạng. */
+struct ReplyInfo {
+    uint32_t slot;
+    uint32_t gen;
+    uint32_t flags;              // REPLY_DONE, ...
+    uint64_t batch;              // Lô tạo ra bản ghi (so với `farm_snapshot_valid_batch()`)
+};
+
+/**
+ * @brief Tạo hàng đợi và chạy thread actor. Gọi sau `coop_logic_init()`.
+ * @return 0 nếu thành công, -1 nếu lỗi.
+ */
+int state_actor_start(void);
+
+/* --- Thread mang --- */
+
+/** @brief Giữ một ô trong hàng đợi lệnh (NULL nếu đầy: thử lại sau). */
+struct CmdRequest *state_actor_reserve(void);
+
+/** @brief Đẩy ô đã ghi cho actor (chưa đánh thức, xem `state_actor_wake()`). */
+void state_actor_submit(struct CmdRequest *req);
+
+/** @brief Đánh thức actor; gọi một lần sau mỗi đợt `state_actor_submit()`. */
+void state_actor_wake(void);
+
+/** @brief FD (eventfd) báo có response mới; thread mạng poll fd này. */
+int state_actor_reply_fd(void);
+
+/**
+ * @brief Rút mọi response/event đã công bố và gọi `deliver` cho từng đoạn byte.
+ *
+ * Một bản ghi lớn có thể tới qua nhiều lần gọi `deliver` liên tiếp cùng slot.
+ * Mỗi dòng lệnh đã đẩy cho actor kết thúc bằng một bản ghi rỗng có `REPLY_DONE`
+ * (`data` NULL, `len` 0) sau mọi response của nó.
+ * @return Số byte đã rút.
+ */
+size_t state_actor_drain_replies(void (*deliver)(const struct ReplyInfo *info, const char *data, size_t len,
+                                                 void *user_data),
+                                 void *user_data);
+
+/** @brief Báo số byte đang chờ gửi của slot (actor dùng để gộp event khi client đọc chậm). */
+void state_actor_report_out_level(uint32_t slot, size_t out_len);
+
+/* --- Actor --- */
+
+/**
+ * @brief Gửi một dòng (không gồm `\n`) tới kết nối `conn` (slot nhận từ `handle_command()`).
+ *
+ * Dòng được ghi vào ring response và công bố ở cuối lô.
+ * @return 0 nếu thành công, -1 nếu slot không hợp lệ.
+ */
+int send_line(int conn, const char *line);
+
+/** @brief Reactor nhận task work pool đã xong của actor (callback `done` chạy trên actor). */
+struct WorkReactor *state_actor_reactor(void);
+
+/**
+ * @brief Thêm subscription cho kết nối `conn` (thiết bị có handle ID `device` hoặc chuồng `coop_id > 0`).
+ * @return Số subscription hiện có (>0), -1 nếu không có kết nối, -2 nếu đã đủ `MAX_SUBSCRIPTIONS`.
+ */
+int server_subscribe(int conn, uint32_t device, int coop_id);
+
+/**
+ * @brief Bỏ subscription khớp `device_id`/`coop_id`; cả hai rỗng thì bỏ hết.
+ * @return Số subscription còn lại, -1 nếu không có kết nối.
+ */
+int server_unsubscribe(int conn, const char *device_id, int coop_id);
+
+/**
+ * @brief Đánh dấu thiết bị thay đổi cho mọi kết nối đang theo dõi nó.
+ *
+ * Event được gộp theo thiết bị và render ở cuối lô (trạng thái mới nhất);
+ * hàng đợi của kết nối đầy thì event bị bỏ và tăng bộ đếm.
+ */
+void server_publish_device_change(uint32_t device, int coop_id);
+
+/** @brief Tổng số push event đã bị bỏ trên mọi kết nối từ khi server chạy. */
+unsigned long server_events_dropped(void);
+
+#endif /* SERVER_STATE_ACTOR_H */
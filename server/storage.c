@@ -1,8 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "storage.h"
+#include "farm_stream.h"
+#include "metrics.h"
+#include "work_pool.h"
 #include <jansson.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static void copy_string(char *dst, size_t dst_len, const char *src) {
     if (!dst || dst_len == 0) return;
@@ -14,6 +25,77 @@ static void copy_string(char *dst, size_t dst_len, const char *src) {
     dst[dst_len - 1] = '\0';
 }
 
+/** @brief Chuỗi (đơn vị, mode) không phải chuỗi có sẵn khi parse trên worker; intern lúc merge. */
+struct StringFixup {
+    size_t device;                  /* index trong DeviceBuffer */
+    size_t offset;                  /* vi tri (byte) cua truong handle trong Device/DeviceCold */
+    int cold;
+    size_t text;                    /* vi tri chuoi trong DeviceBuffer.strings */
+};
+
+/**
+ * @brief Thiết bị đã parse, chờ merge vào registry trên thread sở hữu.
+ *
+ * `colds[i]` là phần lạnh của `devices[i]` (con trỏ `cold` gắn lại lúc merge vì mảng có thể realloc).
+ */
+struct DeviceBuffer {
+    struct Device *devices;
+    struct DeviceCold *colds;
+    size_t count;
+    size_t capacity;
+    struct StringFixup *fixups;
+    size_t fixup_count;
+    size_t fixup_capacity;
+    char *strings;                  /* chuoi cua cac fixup, noi tiep nhau (ket thuc bang NUL) */
+    size_t strings_len;
+    size_t strings_capacity;
+};
+
+/**
+ * @brief Intern chuỗi JSON vào `*out`; giữ nguyên giá trị cũ nếu không phải chuỗi hoặc hết bộ nhớ.
+ *
+ * `defer` khác NULL (parse trên worker): không chạm bảng intern; chuỗi không
+ * phải chuỗi có sẵn được ghi lại cho thiết bị đang parse (`defer->devices[defer->count]`).
+ */
+static void intern_json_string(struct DeviceBuffer *defer, json_t *value, uint32_t *out) {
+    uint32_t handle;
+    if (!json_is_string(value)) return;
+    const char *text = json_string_value(value);
+    if (!defer) {
+        if (intern_string(text, &handle) == 0) *out = handle;
+        return;
+    }
+    if (intern_well_known(text, &handle) == 0) {
+        *out = handle;
+        return;
+    }
+    size_t len = strlen(text);
+    if (len > INTERN_MAX_LEN) return;
+    if (defer->fixup_count == defer->fixup_capacity) {
+        size_t cap = defer->fixup_capacity ? defer->fixup_capacity * 2 : 8;
+        struct StringFixup *grown = (struct StringFixup *)realloc(defer->fixups, cap * sizeof(*grown));
+        if (!grown) return;
+        defer->fixups = grown;
+        defer->fixup_capacity = cap;
+    }
+    if (defer->strings_len + len + 1 > defer->strings_capacity) {
+        size_t cap = defer->strings_capacity ? defer->strings_capacity * 2 : 256;
+        while (cap < defer->strings_len + len + 1) cap *= 2;
+        char *grown = (char *)realloc(defer->strings, cap);
+        if (!grown) return;
+        defer->strings = grown;
+        defer->strings_capacity = cap;
+    }
+    struct Device *dev = &defer->devices[defer->count];
+    struct StringFixup *f = &defer->fixups[defer->fixup_count++];
+    f->device = defer->count;
+    f->cold = (char *)out < (char *)dev || (char *)out >= (char *)(dev + 1);
+    f->offset = f->cold ? (size_t)((char *)out - (char *)dev->cold) : (size_t)((char *)out - (char *)dev);
+    f->text = defer->strings_len;
+    memcpy(defer->strings + defer->strings_len, text, len + 1);
+    defer->strings_len += len + 1;
+}
+
 static enum DevicePowerState parse_state_or_default(const char *state, enum DevicePowerState def) {
     if (!state) return def;
     /* Project luon ghi "ON"/"OFF" (in hoa), nen khong can so sanh khong phan biet hoa/thuong. */
@@ -71,7 +153,7 @@ static json_t *build_schedule(const struct ScheduleEntry *schedule, size_t sched
     return arr;
 }
 
-static int parse_device_info_object(struct Device *dev, json_t *info) {
+static int parse_device_info_object(struct Device *dev, json_t *info, struct DeviceBuffer *defer) {
     if (!dev || !json_is_object(info)) return -1;
 
     json_t *type_val = json_object_get(info, "type");
@@ -98,8 +180,8 @@ static int parse_device_info_object(struct Device *dev, json_t *info) {
 
         json_t *ut = json_object_get(info, "unit_temperature");
         json_t *uh = json_object_get(info, "unit_humidity");
-        if (json_is_string(ut)) copy_string(dev->data.sensor.unit_temperature, sizeof(dev->data.sensor.unit_temperature), json_string_value(ut));
-        if (json_is_string(uh)) copy_string(dev->data.sensor.unit_humidity, sizeof(dev->data.sensor.unit_humidity), json_string_value(uh));
+        intern_json_string(defer, ut, &dev->cold->data.sensor.unit_temperature);
+        intern_json_string(defer, uh, &dev->cold->data.sensor.unit_humidity);
         break;
     }
     case DEVICE_EGG_COUNTER: {
@@ -127,10 +209,10 @@ static int parse_device_info_object(struct Device *dev, json_t *info) {
         if (json_is_number(tp2)) dev->data.heater.Tp2 = json_number_value(tp2);
 
         json_t *mode = json_object_get(info, "mode");
-        if (json_is_string(mode)) copy_string(dev->data.heater.mode, sizeof(dev->data.heater.mode), json_string_value(mode));
+        intern_json_string(defer, mode, &dev->data.heater.mode);
 
         json_t *unit = json_object_get(info, "unit_temp");
-        if (json_is_string(unit)) copy_string(dev->data.heater.unit_temp, sizeof(dev->data.heater.unit_temp), json_string_value(unit));
+        intern_json_string(defer, unit, &dev->cold->data.heater.unit_temp);
 
         json_t *state = json_object_get(info, "state");
         dev->data.heater.state = parse_state_or_default(json_is_string(state) ? json_string_value(state) : NULL, DEVICE_OFF);
@@ -146,8 +228,8 @@ static int parse_device_info_object(struct Device *dev, json_t *info) {
 
         json_t *uh = json_object_get(info, "unit_humidity");
         json_t *uf = json_object_get(info, "unit_flow");
-        if (json_is_string(uh)) copy_string(dev->data.sprayer.unit_humidity, sizeof(dev->data.sprayer.unit_humidity), json_string_value(uh));
-        if (json_is_string(uf)) copy_string(dev->data.sprayer.unit_flow, sizeof(dev->data.sprayer.unit_flow), json_string_value(uf));
+        intern_json_string(defer, uh, &dev->cold->data.sprayer.unit_humidity);
+        intern_json_string(defer, uf, &dev->cold->data.sprayer.unit_flow);
 
         json_t *state = json_object_get(info, "state");
         dev->data.sprayer.state = parse_state_or_default(json_is_string(state) ? json_string_value(state) : NULL, DEVICE_OFF);
@@ -161,15 +243,15 @@ static int parse_device_info_object(struct Device *dev, json_t *info) {
 
         json_t *uf = json_object_get(info, "unit_food");
         json_t *uw = json_object_get(info, "unit_water");
-        if (json_is_string(uf)) copy_string(dev->data.feeder.unit_food, sizeof(dev->data.feeder.unit_food), json_string_value(uf));
-        if (json_is_string(uw)) copy_string(dev->data.feeder.unit_water, sizeof(dev->data.feeder.unit_water), json_string_value(uw));
+        intern_json_string(defer, uf, &dev->cold->data.feeder.unit_food);
+        intern_json_string(defer, uw, &dev->cold->data.feeder.unit_water);
 
 	        json_t *state = json_object_get(info, "state");
 	        dev->data.feeder.state = parse_state_or_default(json_is_string(state) ? json_string_value(state) : NULL, DEVICE_OFF);
 
 	        parse_schedule(json_object_get(info, "schedule"),
-	                       dev->data.feeder.schedule,
-	                       &dev->data.feeder.schedule_count,
+	                       dev->cold->data.feeder.schedule,
+	                       &dev->cold->data.feeder.schedule_count,
 	                       1);
 	        break;
 	    }
@@ -178,14 +260,14 @@ static int parse_device_info_object(struct Device *dev, json_t *info) {
         if (json_is_number(vw)) dev->data.drinker.Vw = json_number_value(vw);
 
         json_t *uw = json_object_get(info, "unit_water");
-        if (json_is_string(uw)) copy_string(dev->data.drinker.unit_water, sizeof(dev->data.drinker.unit_water), json_string_value(uw));
+        intern_json_string(defer, uw, &dev->cold->data.drinker.unit_water);
 
 	        json_t *state = json_object_get(info, "state");
 	        dev->data.drinker.state = parse_state_or_default(json_is_string(state) ? json_string_value(state) : NULL, DEVICE_OFF);
 
 	        parse_schedule(json_object_get(info, "schedule"),
-	                       dev->data.drinker.schedule,
-	                       &dev->data.drinker.schedule_count,
+	                       dev->cold->data.drinker.schedule,
+	                       &dev->cold->data.drinker.schedule_count,
 	                       0);
 	        break;
 	    }
@@ -212,8 +294,8 @@ static json_t *build_device_info_value(const struct Device *dev) {
     case DEVICE_SENSOR:
         (void)json_object_set_new(info, "temperature", json_real(dev->data.sensor.temperature));
         (void)json_object_set_new(info, "humidity", json_real(dev->data.sensor.humidity));
-        (void)json_object_set_new(info, "unit_temperature", json_string(dev->data.sensor.unit_temperature));
-        (void)json_object_set_new(info, "unit_humidity", json_string(dev->data.sensor.unit_humidity));
+        (void)json_object_set_new(info, "unit_temperature", json_string(intern_cstr(dev->cold->data.sensor.unit_temperature)));
+        (void)json_object_set_new(info, "unit_humidity", json_string(intern_cstr(dev->cold->data.sensor.unit_humidity)));
         break;
     case DEVICE_EGG_COUNTER:
         (void)json_object_set_new(info, "egg_count", json_integer(dev->data.egg_counter.egg_count));
@@ -226,25 +308,25 @@ static json_t *build_device_info_value(const struct Device *dev) {
         (void)json_object_set_new(info, "state", json_string(dev->data.heater.state == DEVICE_ON ? "ON" : "OFF"));
         (void)json_object_set_new(info, "nhiet_do_bat_c", json_real(dev->data.heater.Tmin));
         (void)json_object_set_new(info, "nhiet_do_tat_c", json_real(dev->data.heater.Tp2));
-        (void)json_object_set_new(info, "mode", json_string(dev->data.heater.mode));
-        (void)json_object_set_new(info, "unit_temp", json_string(dev->data.heater.unit_temp));
+        (void)json_object_set_new(info, "mode", json_string(intern_cstr(dev->data.heater.mode)));
+        (void)json_object_set_new(info, "unit_temp", json_string(intern_cstr(dev->cold->data.heater.unit_temp)));
         break;
     case DEVICE_SPRAYER:
         (void)json_object_set_new(info, "state", json_string(dev->data.sprayer.state == DEVICE_ON ? "ON" : "OFF"));
         (void)json_object_set_new(info, "do_am_bat_pct", json_real(dev->data.sprayer.Hmin));
         (void)json_object_set_new(info, "do_am_muc_tieu_pct", json_real(dev->data.sprayer.Hp));
         (void)json_object_set_new(info, "luu_luong_lph", json_real(dev->data.sprayer.Vh));
-        (void)json_object_set_new(info, "unit_humidity", json_string(dev->data.sprayer.unit_humidity));
-        (void)json_object_set_new(info, "unit_flow", json_string(dev->data.sprayer.unit_flow));
+        (void)json_object_set_new(info, "unit_humidity", json_string(intern_cstr(dev->cold->data.sprayer.unit_humidity)));
+        (void)json_object_set_new(info, "unit_flow", json_string(intern_cstr(dev->cold->data.sprayer.unit_flow)));
         break;
 	    case DEVICE_FEEDER: {
         (void)json_object_set_new(info, "state", json_string(dev->data.feeder.state == DEVICE_ON ? "ON" : "OFF"));
         (void)json_object_set_new(info, "thuc_an_kg", json_real(dev->data.feeder.W));
         (void)json_object_set_new(info, "nuoc_l", json_real(dev->data.feeder.Vw));
-        (void)json_object_set_new(info, "unit_food", json_string(dev->data.feeder.unit_food));
-        (void)json_object_set_new(info, "unit_water", json_string(dev->data.feeder.unit_water));
+        (void)json_object_set_new(info, "unit_food", json_string(intern_cstr(dev->cold->data.feeder.unit_food)));
+        (void)json_object_set_new(info, "unit_water", json_string(intern_cstr(dev->cold->data.feeder.unit_water)));
 
-	        json_t *sched = build_schedule(dev->data.feeder.schedule, dev->data.feeder.schedule_count, 1);
+	        json_t *sched = build_schedule(dev->cold->data.feeder.schedule, dev->cold->data.feeder.schedule_count, 1);
 	        if (!sched) {
 	            json_decref(info);
 	            return NULL;
@@ -255,9 +337,9 @@ static json_t *build_device_info_value(const struct Device *dev) {
 	    case DEVICE_DRINKER: {
         (void)json_object_set_new(info, "state", json_string(dev->data.drinker.state == DEVICE_ON ? "ON" : "OFF"));
         (void)json_object_set_new(info, "nuoc_l", json_real(dev->data.drinker.Vw));
-        (void)json_object_set_new(info, "unit_water", json_string(dev->data.drinker.unit_water));
+        (void)json_object_set_new(info, "unit_water", json_string(intern_cstr(dev->cold->data.drinker.unit_water)));
 
-	        json_t *sched = build_schedule(dev->data.drinker.schedule, dev->data.drinker.schedule_count, 0);
+	        json_t *sched = build_schedule(dev->cold->data.drinker.schedule, dev->cold->data.drinker.schedule_count, 0);
 	        if (!sched) {
 	            json_decref(info);
 	            return NULL;
@@ -272,123 +354,782 @@ static json_t *build_device_info_value(const struct Device *dev) {
     return info;
 }
 
-int storage_save_farm(const struct CoopsContext *coops, const struct DevicesContext *devices, const char *path) {
-    if (!coops || !devices || !path) return -1;
+/** @brief Buffer tăng dần cho `json_dump_callback()` (malloc thường, sống quá arena). */
+struct RenderBuffer {
+    char *data;
+    size_t len;
+    size_t cap;
+};
 
-    json_t *root = json_object();
-    if (!root) return -1;
-    json_t *coops_arr = json_array();
-    if (!coops_arr) {
-        json_decref(root);
+static int render_append(const char *buffer, size_t size, void *data) {
+    struct RenderBuffer *out = (struct RenderBuffer *)data;
+    if (out->len + size + 1 > out->cap) {
+        size_t cap = out->cap ? out->cap : 64 * 1024;
+        while (cap < out->len + size + 1) cap *= 2;
+        char *grown = (char *)realloc(out->data, cap);
+        if (!grown) return -1;
+        out->data = grown;
+        out->cap = cap;
+    }
+    memcpy(out->data + out->len, buffer, size);
+    out->len += size;
+    out->data[out->len] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Dump object `root` ra text malloc thường (format file farm), NULL nếu lỗi.
+ *
+ * Thành viên cuối là trailer CRC (xem `farm_stream.h`) để lúc nạp phát hiện file hỏng.
+ */
+static char *dump_json(json_t *root, size_t *out_len) {
+    struct RenderBuffer out = {NULL, 0, 0};
+    if (json_dump_callback(root, render_append, &out, JSON_INDENT(2) | JSON_REAL_PRECISION(4)) != 0) {
+        free(out.data);
+        return NULL;
+    }
+    /* Bo "}" cuoi (va khoang trang truoc no), tinh CRC phan con lai roi dong object bang trailer */
+    size_t body = out.len;
+    if (body > 0 && out.data[body - 1] == '}') body--;
+    while (body > 0 && (out.data[body - 1] == '\n' || out.data[body - 1] == ' ')) body--;
+    if (body > 1) {
+        char trailer[48];
+        int n = snprintf(trailer, sizeof(trailer), ",\n  \"%s\": \"%08x\"\n}", FARM_STREAM_CRC_KEY,
+                         (unsigned)farm_stream_crc32(0, out.data, body));
+        out.len = body;
+        if (render_append(trailer, (size_t)n, &out) != 0) {
+            free(out.data);
+            return NULL;
+        }
+    }
+    if (out_len) *out_len = out.len;
+    return out.data ? out.data : (char *)calloc(1, 1);
+}
+
+/**
+ * @brief Số thiết bị, version lớn nhất và tổng counter telemetry của từng chuồng (theo index chuồng).
+ *
+ * Đi theo danh sách thiết bị của từng chuồng trong devices.c; thiết bị thuộc
+ * chuồng không tồn tại không được tính (và không được ghi ra file).
+ */
+struct CoopGroups {
+    size_t *counts;
+    unsigned long long *max_version;
+    unsigned long long *counters;
+};
+
+static void coop_groups_free(struct CoopGroups *g) {
+    free(g->counts);
+    free(g->max_version);
+    free(g->counters);
+}
+
+static int coop_groups_build(struct CoopGroups *g, const struct CoopsContext *coops,
+                             const struct DevicesContext *devices) {
+    size_t nc = coops->count ? coops->count : 1;
+    g->counts = (size_t *)calloc(nc, sizeof(*g->counts));
+    g->max_version = (unsigned long long *)calloc(nc, sizeof(*g->max_version));
+    g->counters = (unsigned long long *)calloc(nc, sizeof(*g->counters));
+    if (!g->counts || !g->max_version || !g->counters) {
+        coop_groups_free(g);
         return -1;
     }
-    (void)json_object_set_new(root, "coops", coops_arr);
+    for (size_t i = 0; i < coops->count; ++i) {
+        const struct DeviceCoopList *members = devices_coop_list(devices, coops->coops[i].id);
+        if (!members) continue;
+        g->counts[i] = members->count;
+        for (uint32_t k = members->head; k != 0; k = devices->devices[k - 1].coop_next) {
+            const struct Device *d = &devices->devices[k - 1];
+            if (d->version > g->max_version[i]) g->max_version[i] = d->version;
+            g->counters[i] += d->telemetry_counter;
+        }
+    }
+    return 0;
+}
+
+static json_t *build_device_entry(const struct Device *d) {
+    json_t *info_val = build_device_info_value(d);
+    if (!info_val) return NULL;
+    json_t *entry = json_object();
+    (void)json_object_set_new(entry, "password", json_string(d->cold->password));
+    if (d->telemetry_counter > 0) {
+        (void)json_object_set_new(entry, "telemetry_counter", json_integer((json_int_t)d->telemetry_counter));
+    }
+    (void)json_object_set_new(entry, "info", info_val);
+    return entry;
+}
 
+/**
+ * @brief Dựng object chuồng {id, name, devices} cho mọi chuồng có `want[i]` (NULL: tất cả).
+ *
+ * Thiết bị của mỗi chuồng lấy từ danh sách chuồng của devices.c, nên chỉ
+ * các chuồng cần ghi bị duyệt (thứ tự thiết bị vẫn theo `seq` như registry).
+ */
+static void build_coop_values(const struct CoopsContext *coops, const struct DevicesContext *devices,
+                              const unsigned char *want, json_t **out) {
     for (size_t i = 0; i < coops->count; ++i) {
+        out[i] = NULL;
+        if (want && !want[i]) continue;
         const struct CoopMeta *c = &coops->coops[i];
+        out[i] = json_object();
+        (void)json_object_set_new(out[i], "id", json_integer(c->id));
+        (void)json_object_set_new(out[i], "name", json_string(c->name));
+        json_t *devs = json_array();
+        (void)json_object_set_new(out[i], "devices", devs);
+        const struct DeviceCoopList *members = devices_coop_list(devices, c->id);
+        for (uint32_t k = members ? members->head : 0; k != 0; k = devices->devices[k - 1].coop_next) {
+            json_t *entry = build_device_entry(&devices->devices[k - 1]);
+            if (entry) (void)json_array_append_new(devs, entry);
+        }
+    }
+}
 
-        json_t *coop = json_object();
-        (void)json_object_set_new(coop, "id", json_integer(c->id));
-        (void)json_object_set_new(coop, "name", json_string(c->name));
+char *storage_render_farm(const struct CoopsContext *coops, const struct DevicesContext *devices, size_t *out_len) {
+    if (!coops || !devices) return NULL;
 
-        json_t *devs_arr = json_array();
-        (void)json_object_set_new(coop, "devices", devs_arr);
+    json_t **values = (json_t **)calloc(coops->count ? coops->count : 1, sizeof(*values));
+    json_t *root = json_object();
+    json_t *coops_arr = json_array();
+    char *text = NULL;
+    if (values && root && coops_arr) {
+        build_coop_values(coops, devices, NULL, values);
+        for (size_t i = 0; i < coops->count; ++i) {
+            (void)json_array_append_new(coops_arr, values[i]);
+        }
+        (void)json_object_set_new(root, "coops", coops_arr);
+        coops_arr = NULL;
+        text = dump_json(root, out_len);
+    }
+    json_decref(coops_arr);
+    json_decref(root);
+    free(values);
+    return text;
+}
 
-        for (size_t j = 0; j < devices->count; ++j) {
-            const struct Device *d = &devices->devices[j];
-            if (d->identity.coop_id != c->id) continue;
+/** @brief fsync thư mục `dir`, để file vừa tạo/rename trong đó còn sau khi mất điện. */
+static int sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    if (close(fd) != 0) rc = -1;
+    return rc == 0 ? 0 : -1;
+}
 
-            json_t *entry = json_object();
-            (void)json_object_set_new(entry, "password", json_string(d->password));
+/** @brief fsync thư mục chứa `path`. */
+static int sync_parent_dir(const char *path) {
+    char dir[STORAGE_PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (!slash) return sync_dir(".");
+    size_t len = slash == path ? 1 : (size_t)(slash - path);
+    if (len >= sizeof(dir)) return -1;
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+    return sync_dir(dir);
+}
 
-            json_t *info_val = build_device_info_value(d);
-            if (!info_val) {
-                json_decref(entry);
-                continue;
-            }
-            (void)json_object_set_new(entry, "info", info_val);
-            (void)json_array_append_new(devs_arr, entry);
+/**
+ * @brief Ghi `<path>.tmp` (fsync theo `FARM_FSYNC_POLICY`) rồi rename đè `path`.
+ *
+ * Rename chỉ chạy khi nội dung đã ghi đủ, nên người đọc chỉ thấy file cũ hoặc
+ * file mới đầy đủ; bản thân rename chỉ bền sau khi fsync thư mục (caller).
+ */
+static int replace_file(const char *path, const char *text, size_t len) {
+    char tmp[STORAGE_PATH_MAX + 8];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (n < 0 || (size_t)n >= sizeof(tmp)) return -1;
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+    int rc = fwrite(text, 1, len, f) == len ? 0 : -1;
+    /* Khong fsync thi sau mat dien rename co the da len dia con noi dung thi chua */
+    if (rc == 0 && FARM_FSYNC_POLICY >= STORAGE_SYNC_FILE && (fflush(f) != 0 || fsync(fileno(f)) != 0)) rc = -1;
+    if (fclose(f) != 0) rc = -1;
+    if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+    if (rc != 0) (void)remove(tmp);
+    return rc;
+}
+
+int storage_write_file(const char *path, const char *text, size_t len) {
+    if (!path || (!text && len > 0)) return -1;
+    if (replace_file(path, text, len) != 0) return -1;
+    return FARM_FSYNC_POLICY >= STORAGE_SYNC_DIR ? sync_parent_dir(path) : 0;
+}
+
+int storage_stamp(const char *path, struct StorageStamp *out) {
+    struct stat st;
+    if (!path || !out || stat(path, &st) != 0) return -1;
+    out->mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    out->size = (long long)st.st_size;
+    out->inode = (unsigned long long)st.st_ino;
+    return 0;
+}
+
+int storage_save_farm(const struct CoopsContext *coops, const struct DevicesContext *devices, const char *path) {
+    if (!coops || !devices || !path) return -1;
+    uint64_t started = metrics_now_ns();
+    size_t len = 0;
+    char *text = storage_render_farm(coops, devices, &len);
+    if (!text) return -1;
+    int rc = storage_write_file(path, text, len);
+    free(text);
+    metrics_record_flush(metrics_now_ns() - started);
+    return rc;
+}
+
+/** @brief Tên chuồng đọc từ file; rỗng/"0" thì dùng mặc định "Chuong <id>". */
+static void coop_name_from_json(json_t *name_val, int coop_id, char *out, size_t out_len) {
+    const char *name = json_is_string(name_val) ? json_string_value(name_val) : NULL;
+    if (!name || name[0] == '\0' || strcmp(name, "0") == 0) {
+        snprintf(out, out_len, "Chuong %d", coop_id);
+    } else {
+        copy_string(out, out_len, name);
+    }
+}
+
+static void device_buffer_free(struct DeviceBuffer *buf) {
+    free(buf->devices);
+    free(buf->colds);
+    free(buf->fixups);
+    free(buf->strings);
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int device_buffer_reserve(struct DeviceBuffer *buf, size_t count) {
+    if (count <= buf->capacity) return 0;
+    size_t cap = buf->capacity ? buf->capacity * 2 : 64;
+    while (cap < count) cap *= 2;
+    struct Device *devs = (struct Device *)realloc(buf->devices, cap * sizeof(*devs));
+    if (!devs) return -1;
+    buf->devices = devs;
+    struct DeviceCold *colds = (struct DeviceCold *)realloc(buf->colds, cap * sizeof(*colds));
+    if (!colds) return -1;
+    buf->colds = colds;
+    buf->capacity = cap;
+    return 0;
+}
+
+/** @brief Bỏ các thiết bị từ index `count` trở đi (cùng fixup của chúng). */
+static void device_buffer_truncate(struct DeviceBuffer *buf, size_t count) {
+    buf->count = count;
+    while (buf->fixup_count > 0 && buf->fixups[buf->fixup_count - 1].device >= count) {
+        buf->fixup_count--;
+    }
+}
+
+/**
+ * @brief Parse một mục {password, info} của mảng "devices" vào cuối `buf` (mục hỏng bị bỏ qua).
+ *
+ * `defer` khác 0 (worker): không chạm bảng intern hay registry (xem `intern_json_string()`).
+ * @return 0 nếu xong, -1 nếu hết bộ nhớ.
+ */
+static int buffer_device(struct DeviceBuffer *buf, int coop_id, json_t *entry, int defer) {
+    if (!json_is_object(entry)) return 0;
+    json_t *info = json_object_get(entry, "info");
+    if (!json_is_object(info)) return 0;
+    if (device_buffer_reserve(buf, buf->count + 1) != 0) return -1;
+
+    struct Device *dev = &buf->devices[buf->count];
+    struct DeviceCold *cold = &buf->colds[buf->count];
+    memset(dev, 0, sizeof(*dev));
+    memset(cold, 0, sizeof(*cold));
+    dev->cold = cold;
+    dev->identity.coop_id = coop_id;
+    json_t *pw_val = json_object_get(entry, "password");
+    if (json_is_string(pw_val)) {
+        copy_string(cold->password, sizeof(cold->password), json_string_value(pw_val));
+    }
+    if (cold->password[0] == '\0') {
+        copy_string(cold->password, sizeof(cold->password), "123456");
+    }
+    json_t *counter_val = json_object_get(entry, "telemetry_counter");
+    if (json_is_integer(counter_val) && json_integer_value(counter_val) > 0) {
+        dev->telemetry_counter = (unsigned long long)json_integer_value(counter_val);
+    }
+    size_t fixups = buf->fixup_count;
+    if (parse_device_info_object(dev, info, defer ? buf : NULL) != 0) {
+        buf->fixup_count = fixups;
+        return 0;
+    }
+    buf->count++;
+    return 0;
+}
+
+/**
+ * @brief Merge `buf` vào registry trên thread sở hữu: intern chuỗi còn thiếu rồi chèn theo thứ tự.
+ *
+ * ID đã có trong registry bị bỏ qua (bản nạp trước thắng).
+ * @return 0 nếu xong, -1 nếu registry đầy.
+ */
+static int merge_device_buffer(struct DevicesContext *devices, struct DeviceBuffer *buf) {
+    for (size_t i = 0; i < buf->fixup_count; ++i) {
+        const struct StringFixup *f = &buf->fixups[i];
+        char *base = f->cold ? (char *)&buf->colds[f->device] : (char *)&buf->devices[f->device];
+        uint32_t handle;
+        if (intern_string(buf->strings + f->text, &handle) == 0) {
+            memcpy(base + f->offset, &handle, sizeof(handle));
+        }
+    }
+    for (size_t i = 0; i < buf->count; ++i) {
+        struct Device *dev = &buf->devices[i];
+        dev->cold = &buf->colds[i];
+        if (devices_find(devices, dev->identity.id) != NULL) {
+            continue;
         }
+        if (!devices_insert(devices, dev)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Handler của `farm_stream_file()` khi nạp farm.
+ *
+ * Trên thread sở hữu registry (`devices` khác NULL), thiết bị của các chuồng
+ * đã biết ID được merge mỗi khi gom đủ `FARM_LOAD_CHUNK`, nên bộ nhớ tạm không
+ * tăng theo kích thước file (trừ khi "id" của chuồng đứng sau "devices": thiết
+ * bị của chuồng đó phải giữ tới khi biết ID). Trên worker (`devices` NULL) cả
+ * shard nằm trong `buf`, chờ caller merge.
+ */
+struct FarmLoader {
+    struct CoopsContext *coops;     /* NULL: danh sach chuong lay tu manifest */
+    struct DevicesContext *devices;
+    struct DeviceBuffer buf;
+    int forced_coop_id;             /* >0: shard, moi thiet bi thuoc chuong nay */
+    int coop_id;                    /* chuong dang doc: 0 chua gap "id", -1 khong hop le */
+    json_t *name;                   /* "name" cua chuong dang doc */
+    size_t coop_from;               /* thiet bi dau tien cua chuong dang doc trong buf */
+    int full;                       /* registry day/het bo nho: bo phan con lai */
+};
+
+static void farm_loader_flush(struct FarmLoader *l) {
+    if (!l->full && merge_device_buffer(l->devices, &l->buf) != 0) l->full = 1;
+    l->buf.count = 0;
+    l->buf.fixup_count = 0;
+    l->buf.strings_len = 0;
+    l->coop_from = 0;
+}
+
+static int farm_loader_coop_begin(void *user) {
+    struct FarmLoader *l = (struct FarmLoader *)user;
+    l->coop_id = 0;
+    json_decref(l->name);
+    l->name = NULL;
+    l->coop_from = l->buf.count;
+    return 0;
+}
 
-        (void)json_array_append_new(coops_arr, coop);
+static int farm_loader_coop_field(void *user, const char *key, json_t *value) {
+    struct FarmLoader *l = (struct FarmLoader *)user;
+    if (l->forced_coop_id > 0) return 0;
+    if (strcmp(key, "name") == 0) {
+        json_decref(l->name);
+        l->name = json_incref(value);
+        return 0;
+    }
+    int id = json_is_integer(value) ? (int)json_integer_value(value) : 0;
+    l->coop_id = id > 0 ? id : -1;
+    /* "id" dung sau "devices": gan chuong cho thiet bi da doc cua chuong nay */
+    for (size_t i = l->coop_from; i < l->buf.count; ++i) {
+        l->buf.devices[i].identity.coop_id = id > 0 ? id : 0;
     }
+    return 0;
+}
 
-    int rc = json_dump_file(root, path, JSON_INDENT(2) | JSON_REAL_PRECISION(4)) == 0 ? 0 : -1;
-    json_decref(root);
+static int farm_loader_device(void *user, json_t *entry) {
+    struct FarmLoader *l = (struct FarmLoader *)user;
+    if (l->full || l->coop_id < 0) return 0;
+    int coop_id = l->forced_coop_id > 0 ? l->forced_coop_id : l->coop_id;
+    if (buffer_device(&l->buf, coop_id, entry, l->devices == NULL) != 0) {
+        l->full = 1;
+        return 0;
+    }
+    if (l->devices && coop_id > 0 && l->buf.count >= FARM_LOAD_CHUNK) farm_loader_flush(l);
+    return 0;
+}
+
+static int farm_loader_coop_end(void *user) {
+    struct FarmLoader *l = (struct FarmLoader *)user;
+    if (l->forced_coop_id <= 0) {
+        if (l->coop_id > 0) {
+            char coop_name[MAX_COOP_NAME];
+            coop_name_from_json(l->name, l->coop_id, coop_name, sizeof(coop_name));
+            (void)coops_upsert(l->coops, l->coop_id, coop_name);
+        } else {
+            /* Chuong khong co ID hop le bi bo ca thiet bi */
+            device_buffer_truncate(&l->buf, l->coop_from);
+        }
+    }
+    json_decref(l->name);
+    l->name = NULL;
+    l->coop_from = l->buf.count;
+    if (l->devices && l->buf.count >= FARM_LOAD_CHUNK) farm_loader_flush(l);
+    return 0;
+}
+
+/**
+ * @brief Đọc `path` theo luồng vào `l` (đã khởi tạo); thành công thì merge phần còn lại.
+ * @return 0 nếu thành công, -1 nếu không đọc được/JSON sai.
+ */
+static int farm_loader_run(struct FarmLoader *l, const char *path, enum FarmStreamRoot root) {
+    struct FarmStreamHandler handler = {
+        farm_loader_coop_begin, farm_loader_coop_field, farm_loader_device, farm_loader_coop_end, l
+    };
+    int rc = farm_stream_file(path, root, &handler);
+    json_decref(l->name);
+    l->name = NULL;
+    if (rc == 0 && l->devices) farm_loader_flush(l);
     return rc;
 }
 
+/**
+ * @brief Báo file farm không đọc được; file có mà hỏng (JSON/CRC sai) được đổi tên
+ *        thành `<path>.corrupt` để lần ghi sau không đè mất.
+ */
+static void keep_corrupt(const char *path) {
+    char kept[STORAGE_PATH_MAX + 16];
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "storage: thieu %s\n", path);
+        return;
+    }
+    snprintf(kept, sizeof(kept), "%s.corrupt", path);
+    if (rename(path, kept) == 0) {
+        fprintf(stderr, "storage: %s hong (JSON/CRC sai), giu lai o %s\n", path, kept);
+    } else {
+        fprintf(stderr, "storage: %s hong (JSON/CRC sai)\n", path);
+    }
+}
+
+/** @brief Một shard cho work pool: đọc file và dựng thiết bị vào buffer riêng. */
+struct LoadChunk {
+    struct WorkTask task;
+    char path[STORAGE_PATH_MAX];
+    int coop_id;                    /* 0: bo qua */
+    int done;
+    int unreadable;                 /* shard thieu/hong */
+    struct DeviceBuffer buf;
+};
+
+static void load_chunk_run(struct WorkTask *task) {
+    struct LoadChunk *chunk = (struct LoadChunk *)((char *)task - offsetof(struct LoadChunk, task));
+    struct FarmLoader loader;
+    memset(&loader, 0, sizeof(loader));
+    loader.forced_coop_id = chunk->coop_id;
+    if (farm_loader_run(&loader, chunk->path, FARM_STREAM_COOP) != 0) {
+        /* Shard hong bi bo ca, nhu khi parse ca file mot lan */
+        chunk->unreadable = 1;
+        device_buffer_free(&loader.buf);
+    }
+    chunk->buf = loader.buf;
+}
+
+static void load_chunk_done(struct WorkTask *task) {
+    struct LoadChunk *chunk = (struct LoadChunk *)((char *)task - offsetof(struct LoadChunk, task));
+    chunk->done = 1;
+}
+
+/**
+ * @brief Chạy các shard trên work pool (pool không chạy thì tại chỗ) và merge theo thứ tự.
+ *
+ * Shard i được merge ngay khi nó và mọi shard trước nó xong, nên merge
+ * (intern, chèn registry) chạy song song với parse các shard sau; worker không
+ * chạm bảng intern/registry. Registry đầy thì phần còn lại bị bỏ như khi nạp tuần tự.
+ */
+static void load_chunks(struct DevicesContext *devices, struct LoadChunk *chunks, size_t n) {
+    struct WorkReactor reactor;
+    int pooled = n > 1 && work_reactor_init(&reactor) == 0;
+    for (size_t i = 0; i < n; ++i) {
+        struct LoadChunk *chunk = &chunks[i];
+        if (chunk->coop_id == 0) continue;
+        chunk->task.run = load_chunk_run;
+        chunk->task.done = load_chunk_done;
+        if (!pooled || work_pool_submit(&reactor, &chunk->task) != 0) {
+            load_chunk_run(&chunk->task);
+            chunk->done = 1;
+        }
+    }
+
+    int full = 0;
+    for (size_t i = 0; i < n; ++i) {
+        struct LoadChunk *chunk = &chunks[i];
+        if (chunk->coop_id == 0) continue;
+        while (!chunk->done) {
+            (void)work_reactor_wait(&reactor, 100);
+        }
+        if (chunk->unreadable) {
+            keep_corrupt(chunk->path);
+        }
+        if (!full && merge_device_buffer(devices, &chunk->buf) != 0) {
+            full = 1;
+        }
+        device_buffer_free(&chunk->buf);
+    }
+    if (pooled) work_reactor_close(&reactor);
+}
+
 int storage_load_farm(struct CoopsContext *coops, struct DevicesContext *devices, const char *path) {
     if (!coops || !devices || !path) return -1;
 
-    json_t *root = json_load_file(path, 0, NULL);
-    if (!root) return -1;
-    if (!json_is_object(root)) {
-        json_decref(root);
+    /* Nap vao context tam: file hong giua chung thi context cua caller giu nguyen */
+    struct CoopsContext loaded_coops;
+    struct DevicesContext loaded_devices;
+    coops_init(&loaded_coops);
+    devices_context_init(&loaded_devices);
+
+    struct FarmLoader loader;
+    memset(&loader, 0, sizeof(loader));
+    loader.coops = &loaded_coops;
+    loader.devices = &loaded_devices;
+    int rc = farm_loader_run(&loader, path, FARM_STREAM_FARM);
+    device_buffer_free(&loader.buf);
+    if (rc != 0) {
+        coops_free(&loaded_coops);
+        devices_context_free(&loaded_devices);
         return -1;
     }
+    *coops = loaded_coops;
+    *devices = loaded_devices;
+    return 0;
+}
 
-    json_t *coops_arr = json_object_get(root, "coops");
-    if (!json_is_array(coops_arr)) {
-        json_decref(root);
-        return -1;
+/* --- Layout chia theo chuong --- */
+
+/** @brief Ghép `<dir>/<name>` vào `out`; -1 nếu quá dài. */
+static int shard_path(char *out, size_t out_len, const char *dir, const char *name) {
+    int n = snprintf(out, out_len, "%s/%s", dir, name);
+    return n < 0 || (size_t)n >= out_len ? -1 : 0;
+}
+
+/** @brief Đảm bảo có bookkeeping cho `count` chuồng đầu (phần mới: chưa ghi). */
+static int shards_reserve(struct StorageShards *s, size_t count) {
+    if (count <= s->count) return 0;
+    struct StorageShard *grown = (struct StorageShard *)realloc(s->shards, count * sizeof(*grown));
+    if (!grown) return -1;
+    memset(grown + s->count, 0, (count - s->count) * sizeof(*grown));
+    s->shards = grown;
+    s->count = count;
+    return 0;
+}
+
+int storage_shards_init(struct StorageShards *s, const char *dir) {
+    if (!s || !dir) return -1;
+    memset(s, 0, sizeof(*s));
+    size_t len = strlen(dir);
+    /* Con cho cho "/manifest.json" va "/coop-<id>.json.tmp" */
+    if (len == 0 || len + 32 >= sizeof(s->dir)) return -1;
+    memcpy(s->dir, dir, len + 1);
+    return 0;
+}
+
+void storage_shards_free(struct StorageShards *s) {
+    if (!s) return;
+    free(s->shards);
+    s->shards = NULL;
+    s->count = 0;
+}
+
+void storage_shards_invalidate(struct StorageShards *s) {
+    if (!s) return;
+    for (size_t i = 0; i < s->count; ++i) {
+        s->shards[i].written = 0;
     }
+}
 
-    coops_init(coops);
-    memset(devices, 0, sizeof(*devices));
+int storage_shards_sync(struct StorageShards *s, const struct CoopsContext *coops,
+                        const struct DevicesContext *devices) {
+    if (!s || !coops || !devices || shards_reserve(s, coops->count) != 0) return -1;
+    struct CoopGroups groups;
+    if (coop_groups_build(&groups, coops, devices) != 0) return -1;
+    for (size_t i = 0; i < coops->count; ++i) {
+        struct StorageShard *sh = &s->shards[i];
+        sh->devices = groups.counts[i];
+        sh->max_version = groups.max_version[i];
+        sh->counters = groups.counters[i];
+        memcpy(sh->name, coops->coops[i].name, sizeof(sh->name));
+        sh->written = 1;
+    }
+    coop_groups_free(&groups);
+    return 0;
+}
 
-    size_t coop_count = json_array_size(coops_arr);
-    for (size_t i = 0; i < coop_count; ++i) {
-        json_t *coop = json_array_get(coops_arr, i);
-        if (!json_is_object(coop)) continue;
+static json_t *build_manifest(const struct CoopsContext *coops) {
+    json_t *root = json_object();
+    json_t *arr = json_array();
+    (void)json_object_set_new(root, "format", json_integer(STORAGE_SHARD_FORMAT));
+    (void)json_object_set_new(root, "coops", arr);
+    for (size_t i = 0; i < coops->count; ++i) {
+        char file[32];
+        snprintf(file, sizeof(file), "coop-%d.json", coops->coops[i].id);
+        json_t *entry = json_object();
+        (void)json_object_set_new(entry, "id", json_integer(coops->coops[i].id));
+        (void)json_object_set_new(entry, "name", json_string(coops->coops[i].name));
+        (void)json_object_set_new(entry, "file", json_string(file));
+        (void)json_array_append_new(arr, entry);
+    }
+    return root;
+}
 
-        json_t *id_val = json_object_get(coop, "id");
-        if (!json_is_integer(id_val)) continue;
-        int coop_id = (int)json_integer_value(id_val);
-        if (coop_id <= 0) continue;
+int storage_shards_render(struct StorageShards *s, const struct CoopsContext *coops,
+                          const struct DevicesContext *devices, struct StorageWrite *out) {
+    if (!s || !coops || !devices || !out) return -1;
+    memset(out, 0, sizeof(*out));
+    memcpy(out->dir, s->dir, sizeof(out->dir));
+    if (shards_reserve(s, coops->count) != 0) return -1;
 
-        const char *name = NULL;
-        json_t *name_val = json_object_get(coop, "name");
-        if (json_is_string(name_val)) name = json_string_value(name_val);
-        char coop_name[MAX_COOP_NAME];
-        if (!name || name[0] == '\0' || strcmp(name, "0") == 0) {
-            snprintf(coop_name, sizeof(coop_name), "Chuong %d", coop_id);
-        } else {
-            copy_string(coop_name, sizeof(coop_name), name);
+    struct CoopGroups groups;
+    if (coop_groups_build(&groups, coops, devices) != 0) return -1;
+    unsigned char *want = (unsigned char *)calloc(coops->count ? coops->count : 1, 1);
+    json_t **values = (json_t **)calloc(coops->count ? coops->count : 1, sizeof(*values));
+    if (!want || !values) {
+        free(want);
+        free(values);
+        coop_groups_free(&groups);
+        return -1;
+    }
+
+    /* Shard doi khi so thiet bi, version lon nhat, tong counter hoac ten chuong khac lan
+     * ghi truoc: them/xoa/chuyen thiet bi doi so luong, moi sua doi deu nang version,
+     * counter telemetry chi tang nen tong cua chuong cung tang */
+    size_t dirty = 0;
+    int manifest = 0;
+    for (size_t i = 0; i < coops->count; ++i) {
+        const struct StorageShard *sh = &s->shards[i];
+        int renamed = strncmp(sh->name, coops->coops[i].name, sizeof(sh->name)) != 0;
+        if (!sh->written || renamed) manifest = 1;
+        if (!sh->written || renamed || sh->devices != groups.counts[i] || sh->max_version != groups.max_version[i] ||
+            sh->counters != groups.counters[i]) {
+            want[i] = 1;
+            dirty++;
+        }
+    }
+
+    int rc = 0;
+    if (dirty > 0 || manifest) {
+        out->files = (struct StorageFile *)calloc(dirty + (size_t)manifest, sizeof(*out->files));
+        rc = out->files ? 0 : -1;
+        if (rc == 0) build_coop_values(coops, devices, want, values);
+        for (size_t i = 0; i < coops->count; ++i) {
+            if (!values[i]) continue;
+            if (rc == 0) {
+                struct StorageFile *f = &out->files[out->count];
+                char file[32];
+                snprintf(file, sizeof(file), "coop-%d.json", coops->coops[i].id);
+                f->text = dump_json(values[i], &f->len);
+                if (!f->text || shard_path(f->path, sizeof(f->path), s->dir, file) != 0) rc = -1;
+                out->count++;
+            }
+            json_decref(values[i]);
+        }
+        out->shards = out->count;
+        if (rc == 0 && manifest) {
+            struct StorageFile *f = &out->files[out->count++];
+            json_t *root = build_manifest(coops);
+            f->text = dump_json(root, &f->len);
+            json_decref(root);
+            if (!f->text || shard_path(f->path, sizeof(f->path), s->dir, "manifest.json") != 0) rc = -1;
+        }
+    }
+
+    if (rc == 0) {
+        for (size_t i = 0; i < coops->count; ++i) {
+            if (!want[i]) continue;
+            struct StorageShard *sh = &s->shards[i];
+            sh->devices = groups.counts[i];
+            sh->max_version = groups.max_version[i];
+            sh->counters = groups.counters[i];
+            memcpy(sh->name, coops->coops[i].name, sizeof(sh->name));
+            sh->written = 1;
         }
-        (void)coops_upsert(coops, coop_id, coop_name);
+    } else {
+        storage_write_free(out);
+    }
+    free(want);
+    free(values);
+    coop_groups_free(&groups);
+    return rc == 0 ? (int)out->count : -1;
+}
 
-        json_t *devs_arr = json_object_get(coop, "devices");
-        if (!json_is_array(devs_arr)) continue;
+int storage_write_files(const struct StorageWrite *w) {
+    if (!w) return -1;
+    if (w->count == 0) return 0;
+    int sync = FARM_FSYNC_POLICY >= STORAGE_SYNC_DIR;
+    if (mkdir(w->dir, 0755) == 0) {
+        /* Thu muc moi: entry cua no nam o thu muc cha */
+        if (sync && sync_parent_dir(w->dir) != 0) return -1;
+    } else if (errno != EEXIST) {
+        return -1;
+    }
+    /* Manifest nam cuoi va chi rename khi cac shard da ben tren dia: chuong moi
+     * chi xuat hien khi shard cua no da co. Moi lo mot lan fsync thu muc. */
+    for (size_t i = 0; i < w->count; ++i) {
+        if (sync && i == w->shards && i > 0 && sync_dir(w->dir) != 0) return -1;
+        if (replace_file(w->files[i].path, w->files[i].text, w->files[i].len) != 0) return -1;
+    }
+    return sync ? sync_dir(w->dir) : 0;
+}
 
-        size_t dev_count = json_array_size(devs_arr);
-        for (size_t j = 0; j < dev_count && devices->count < MAX_DEVICES; ++j) {
-            json_t *entry = json_array_get(devs_arr, j);
-            if (!json_is_object(entry)) continue;
+void storage_write_free(struct StorageWrite *w) {
+    if (!w) return;
+    for (size_t i = 0; i < w->count; ++i) {
+        free(w->files[i].text);
+    }
+    free(w->files);
+    w->files = NULL;
+    w->count = 0;
+    w->shards = 0;
+}
 
-            json_t *info = json_object_get(entry, "info");
-            if (!json_is_object(info)) continue;
+int storage_shards_load(struct StorageShards *s, struct CoopsContext *coops, struct DevicesContext *devices) {
+    if (!s || !coops || !devices) return -1;
+    char path[STORAGE_PATH_MAX];
+    struct stat st;
+    if (shard_path(path, sizeof(path), s->dir, "manifest.json") != 0 || stat(path, &st) != 0) return -1;
+    /* Manifest nho: kiem tra cu phap/CRC theo luong roi moi parse ca cay */
+    struct FarmStreamHandler check;
+    memset(&check, 0, sizeof(check));
+    json_t *manifest = farm_stream_file(path, FARM_STREAM_FARM, &check) == 0 ? json_load_file(path, 0, NULL) : NULL;
+    json_t *coops_arr = json_is_object(manifest) ? json_object_get(manifest, "coops") : NULL;
+    json_t *format = json_is_object(manifest) ? json_object_get(manifest, "format") : NULL;
+    if (!json_is_array(coops_arr) || (format && json_integer_value(format) != STORAGE_SHARD_FORMAT)) {
+        json_decref(manifest);
+        keep_corrupt(path);
+        return -2;
+    }
+    size_t n = json_array_size(coops_arr);
+    struct LoadChunk *chunks = (struct LoadChunk *)calloc(n ? n : 1, sizeof(*chunks));
+    if (!chunks) {
+        json_decref(manifest);
+        return -1;
+    }
 
-            struct Device dev_tmp;
-            memset(&dev_tmp, 0, sizeof(dev_tmp));
-            dev_tmp.identity.coop_id = coop_id;
-            json_t *pw_val = json_object_get(entry, "password");
-            if (json_is_string(pw_val)) {
-                copy_string(dev_tmp.password, sizeof(dev_tmp.password), json_string_value(pw_val));
-            }
-            if (dev_tmp.password[0] == '\0') {
-                copy_string(dev_tmp.password, sizeof(dev_tmp.password), "123456");
-            }
-            if (parse_device_info_object(&dev_tmp, info) != 0) {
-                continue;
-            }
-            if (devices_find(devices, dev_tmp.identity.id) != NULL) {
-                continue;
-            }
-            devices->devices[devices->count++] = dev_tmp;
+    coops_init(coops);
+    devices_context_init(devices);
+
+    /* Moi shard mot phan viec: doc file va dung thiet bi tren worker */
+    for (size_t i = 0; i < n; ++i) {
+        json_t *entry = json_array_get(coops_arr, i);
+        json_t *id_val = json_object_get(entry, "id");
+        if (!json_is_integer(id_val) || json_integer_value(id_val) <= 0) continue;
+        int coop_id = (int)json_integer_value(id_val);
+
+        char coop_name[MAX_COOP_NAME];
+        coop_name_from_json(json_object_get(entry, "name"), coop_id, coop_name, sizeof(coop_name));
+        if (coops_upsert(coops, coop_id, coop_name) != 0) continue;
+
+        char file[32];
+        json_t *file_val = json_object_get(entry, "file");
+        const char *name = json_is_string(file_val) ? json_string_value(file_val) : NULL;
+        if (!name || name[0] == '\0' || strchr(name, '/') || strlen(name) >= sizeof(file)) {
+            snprintf(file, sizeof(file), "coop-%d.json", coop_id);
+        } else {
+            copy_string(file, sizeof(file), name);
         }
+        if (shard_path(chunks[i].path, sizeof(chunks[i].path), s->dir, file) != 0) continue;
+        chunks[i].coop_id = coop_id;
     }
+    load_chunks(devices, chunks, n);
 
-    json_decref(root);
+    free(chunks);
+    json_decref(manifest);
     return 0;
 }
@@ -1,9 +1,29 @@
 #ifndef SERVER_STORAGE_H
 #define SERVER_STORAGE_H
 
+#include <stddef.h>
 #include "devices.h"
 #include "coops.h"
 
+enum {
+    STORAGE_PATH_MAX = 256,     /* duong dan toi da cua file farm/shard */
+    STORAGE_SHARD_FORMAT = 1    /* gia tri "format" cua manifest */
+};
+
+/** @brief Mức đồng bộ đĩa khi ghi file farm (giá trị của `FARM_FSYNC_POLICY`). */
+enum StorageSync {
+    STORAGE_SYNC_NONE = 0,      /* chi rename: mat dien co the mat lan ghi cuoi hoac de lai file rong */
+    STORAGE_SYNC_FILE = 1,      /* fsync noi dung truoc rename: khong bao gio thay file do */
+    STORAGE_SYNC_DIR = 2        /* them fsync thu muc sau rename: lan ghi da xong thi con sau mat dien */
+};
+
+/** @brief Dấu của file trên đĩa, để biết file có bị sửa từ lần đọc/ghi trước không. */
+struct StorageStamp {
+    long long mtime_ns;
+    long long size;
+    unsigned long long inode;
+};
+
 /**
  * @brief Lưu toàn bộ farm (chuồng + thiết bị) ra file JSON.
  *
@@ -13,11 +33,139 @@
  */
 int storage_save_farm(const struct CoopsContext *coops, const struct DevicesContext *devices, const char *path);
 
+/**
+ * @brief Render farm ra text JSON (cùng format với `storage_save_farm()`) mà chưa ghi file.
+ *
+ * Dùng khi việc ghi file chạy trên thread khác: text là buffer malloc thường
+ * (không thuộc arena), caller `free()` khi xong.
+ * @return Text kết thúc bằng `\0` (độ dài vào `*out_len`), NULL nếu lỗi.
+ */
+char *storage_render_farm(const struct CoopsContext *coops, const struct DevicesContext *devices, size_t *out_len);
+
+/**
+ * @brief Ghi đè `path` bằng `len` byte của `text` (không dùng jansson, an toàn trên thread bất kỳ).
+ *
+ * Ghi ra `<path>.tmp` rồi rename: người đọc chỉ thấy file cũ hoặc file mới đầy
+ * đủ. Đồng bộ đĩa theo `FARM_FSYNC_POLICY` (`StorageSync`).
+ * @return 0 nếu thành công, -1 nếu lỗi (file cũ giữ nguyên).
+ */
+int storage_write_file(const char *path, const char *text, size_t len);
+
+/**
+ * @brief Lấy dấu (mtime, kích thước, inode) hiện tại của `path`.
+ * @return 0 nếu thành công, -1 nếu không stat được.
+ */
+int storage_stamp(const char *path, struct StorageStamp *out);
+
 /**
  * @brief Tải toàn bộ farm (chuồng + thiết bị) từ file JSON.
  *
- * @return 0 nếu thành công, -1 nếu lỗi/không có file.
+ * File được đọc theo luồng (`farm_stream_file()`) trên thread gọi: thiết bị
+ * được chèn vào registry theo lô `FARM_LOAD_CHUNK`, theo thứ tự file, nên bộ
+ * nhớ tạm không tăng theo kích thước file. Thread gọi phải là thread sở hữu
+ * registry/bảng intern.
+ *
+ * Khi thành công, `coops`/`devices` được khởi tạo lại (không giải phóng dữ liệu
+ * cũ) và caller phải gọi `coops_free()`/`devices_context_free()` khi xong.
+ *
+ * File có trailer CRC (mọi file server ghi) thì CRC phải khớp.
+ *
+ * @return 0 nếu thành công, -1 nếu lỗi/không có file/JSON hoặc CRC sai (context giữ nguyên).
  */
 int storage_load_farm(struct CoopsContext *coops, struct DevicesContext *devices, const char *path);
 
+/* --- Layout chia theo chuong --- */
+
+/** @brief Trạng thái đã ghi của shard một chuồng, để chỉ ghi lại shard có thay đổi. */
+struct StorageShard {
+    size_t devices;                 // So thiet bi cua chuong luc ghi
+    unsigned long long max_version; // Version lon nhat cua cac thiet bi do
+    unsigned long long counters;    // Tong telemetry_counter cua cac thiet bi do
+    char name[MAX_COOP_NAME];
+    int written;                    // 0: chua co tren dia (hoac lan ghi truoc loi)
+};
+
+/**
+ * @brief Farm chia theo chuồng: `<dir>/manifest.json` + một file `<dir>/coop-<id>.json` mỗi chuồng.
+ *
+ * Manifest { "format": 1, "coops": [ {id, name, file}, ...] } quyết định danh
+ * sách chuồng; mỗi shard là một object chuồng như trong format một file
+ * ({id, name, devices:[...]}). `shards[i]` ứng với `coops[i]` của CoopsContext
+ * (chuồng không bị xoá nên index ổn định).
+ */
+struct StorageShards {
+    char dir[STORAGE_PATH_MAX];
+    struct StorageShard *shards;
+    size_t count;
+};
+
+/** @brief Một file đã render, chờ ghi. */
+struct StorageFile {
+    char path[STORAGE_PATH_MAX];
+    char *text;                     // malloc thuong
+    size_t len;
+};
+
+/** @brief Các file của một lần lưu theo chuồng: shard thay đổi trước, manifest (nếu đổi) cuối. */
+struct StorageWrite {
+    char dir[STORAGE_PATH_MAX];
+    struct StorageFile *files;
+    size_t count;
+    size_t shards;                  // So file shard (khong tinh manifest)
+};
+
+/**
+ * @brief Khởi tạo layout chia chuồng ở thư mục `dir` (chưa đọc/ghi gì).
+ * @return 0 nếu thành công, -1 nếu đường dẫn quá dài.
+ */
+int storage_shards_init(struct StorageShards *s, const char *dir);
+
+/** @brief Giải phóng bookkeeping của layout. */
+void storage_shards_free(struct StorageShards *s);
+
+/**
+ * @brief Tải farm từ manifest và các shard; mỗi shard được đọc theo luồng và dựng thiết bị trên work pool (nếu chạy).
+ *
+ * Như `storage_load_farm()`: thành công thì `coops`/`devices` được khởi tạo
+ * lại. Shard hỏng/thiếu bị bỏ qua (chuồng vẫn có trong danh sách); file hỏng
+ * (JSON/CRC sai, kể cả manifest) được đổi tên thành `<file>.corrupt` và báo ra stderr.
+ * @return 0 nếu thành công, -1 nếu chưa có manifest, -2 nếu manifest hỏng (context giữ nguyên).
+ */
+int storage_shards_load(struct StorageShards *s, struct CoopsContext *coops, struct DevicesContext *devices);
+
+/**
+ * @brief Đánh dấu mọi shard khớp với farm hiện tại (vd ngay sau khi tải từ chính layout này).
+ * @return 0 nếu thành công, -1 nếu hết bộ nhớ.
+ */
+int storage_shards_sync(struct StorageShards *s, const struct CoopsContext *coops,
+                        const struct DevicesContext *devices);
+
+/**
+ * @brief Render các shard đổi từ lần render trước (và manifest nếu danh sách/tên chuồng đổi).
+ *
+ * Shard được coi là đổi khi số thiết bị, version lớn nhất của thiết bị hoặc
+ * tên chuồng khác lần trước. Bookkeeping được cập nhật ngay (coi như sẽ ghi
+ * thành công); ghi lỗi thì gọi `storage_shards_invalidate()`. Chạy trên thread
+ * sở hữu farm; caller `storage_write_free(out)` khi xong.
+ * @return Số file trong `out` (0: không có gì đổi), -1 nếu lỗi.
+ */
+int storage_shards_render(struct StorageShards *s, const struct CoopsContext *coops,
+                          const struct DevicesContext *devices, struct StorageWrite *out);
+
+/** @brief Quên trạng thái đã ghi: lần render sau ghi lại mọi shard và manifest. */
+void storage_shards_invalidate(struct StorageShards *s);
+
+/**
+ * @brief Ghi các file đã render (tạo thư mục nếu chưa có), mỗi file qua file tạm + rename.
+ *
+ * Với `STORAGE_SYNC_DIR`, thư mục được fsync một lần sau các shard (trước khi
+ * manifest thay đổi) và một lần ở cuối, thay vì sau từng file. Không dùng
+ * jansson, an toàn trên thread bất kỳ.
+ * @return 0 nếu thành công, -1 ở file lỗi đầu tiên.
+ */
+int storage_write_files(const struct StorageWrite *w);
+
+/** @brief Giải phóng text của một lần lưu. */
+void storage_write_free(struct StorageWrite *w);
+
 #endif /* SERVER_STORAGE_H */
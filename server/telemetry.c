@@ -0,0 +1,259 @@
+#include "telemetry.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file telemetry.c
+ * @brief Parser số đo không cấp phát, dùng chung cho các đường nhận số đo.
+ */
+
+/* 10^0..10^15: chia mot lan so nguyen chinh xac cho luy thua 10 chinh xac
+ * cho ket qua lam tron dung nhu strtod */
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+enum {
+    TELEMETRY_MAX_FAST_DIGITS = 15
+};
+
+/** @see telemetry_parse_number() */
+int telemetry_parse_number(const char *s, const char **end, double *out) {
+    const char *p = s;
+    int negative = 0;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+    unsigned long long mantissa = 0;
+    int digits = 0, frac_digits = 0, seen = 0;
+    for (; *p >= '0' && *p <= '9'; ++p, ++seen) {
+        if (digits > 0 || *p != '0') {
+            mantissa = mantissa * 10u + (unsigned)(*p - '0');
+            digits++;
+        }
+    }
+    if (*p == '.') {
+        for (++p; *p >= '0' && *p <= '9'; ++p, ++seen) {
+            mantissa = mantissa * 10u + (unsigned)(*p - '0');
+            if (digits > 0 || *p != '0') digits++;
+            frac_digits++;
+            if (digits > TELEMETRY_MAX_FAST_DIGITS || frac_digits > TELEMETRY_MAX_FAST_DIGITS) break;
+        }
+    }
+    if (seen == 0) {
+        return -1;
+    }
+    if (digits > TELEMETRY_MAX_FAST_DIGITS || frac_digits > TELEMETRY_MAX_FAST_DIGITS) {
+        /* Qua nhieu chu so cho duong nhanh: nhuong cho strtod */
+        char *slow_end = NULL;
+        *out = strtod(s, &slow_end);
+        if (end) *end = slow_end;
+        return 0;
+    }
+    double value = (double)mantissa / POW10[frac_digits];
+    *out = negative ? -value : value;
+    if (end) *end = p;
+    return 0;
+}
+
+/** @brief So khớp key có độ dài `len` với một trong hai tên. */
+static int key_is(const char *key, size_t len, const char *short_name, const char *long_name) {
+    return (strlen(short_name) == len && memcmp(key, short_name, len) == 0) ||
+           (strlen(long_name) == len && memcmp(key, long_name, len) == 0);
+}
+
+/** @see telemetry_parse_readings() */
+int telemetry_parse_readings(const char *s, size_t len, struct TelemetryReading *out) {
+    memset(out, 0, sizeof(*out));
+    out->temperature = NAN;
+    out->humidity = NAN;
+    if (!s) {
+        return -1;
+    }
+    const char *p = s;
+    const char *limit = s + len;
+    while (p < limit && *p != '\0') {
+        if (*p == ',' || *p == ' ') {
+            p++;
+            continue;
+        }
+        const char *key = p;
+        while (p < limit && *p != '=' && *p != '\0' && *p != ',' && *p != ' ') p++;
+        if (p >= limit || *p != '=') {
+            return -1;
+        }
+        size_t key_len = (size_t)(p - key);
+        p++;
+        double value = 0.0;
+        const char *num_end = p;
+        if (telemetry_parse_number(p, &num_end, &value) != 0 || num_end > limit) {
+            return -1;
+        }
+        p = num_end;
+        if (p < limit && *p != '\0' && *p != ',' && *p != ' ') {
+            return -1;
+        }
+        if (key_is(key, key_len, "t", "temperature")) {
+            out->temperature = value;
+            out->fields |= TELEMETRY_TEMPERATURE;
+        } else if (key_is(key, key_len, "h", "humidity")) {
+            out->humidity = value;
+            out->fields |= TELEMETRY_HUMIDITY;
+        } else if (key_is(key, key_len, "eggs", "egg_count")) {
+            if (value < 0.0 || value > 2147483647.0 || value != (double)(long long)value) {
+                return -1;
+            }
+            out->egg_count = (int)value;
+            out->fields |= TELEMETRY_EGGS;
+        } else {
+            return -1;
+        }
+    }
+    return out->fields != 0 ? 0 : -1;
+}
+
+/** @see telemetry_apply() */
+int telemetry_apply(struct Device *dev, const struct TelemetryReading *reading) {
+    if (!dev || !reading) {
+        return -1;
+    }
+    if (dev->identity.type == DEVICE_SENSOR) {
+        if (reading->fields & TELEMETRY_EGGS) return -1;
+        return devices_report_sensor(dev, reading->temperature, reading->humidity);
+    }
+    if (dev->identity.type == DEVICE_EGG_COUNTER) {
+        if (reading->fields != TELEMETRY_EGGS) return -1;
+        return devices_report_eggs(dev, reading->egg_count);
+    }
+    return -1;
+}
+
+/** @see telemetry_parse_datagram() */
+int telemetry_parse_datagram(const char *buf, size_t len, struct TelemetryDatagram *out) {
+    memset(out, 0, sizeof(*out));
+    while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r')) len--;
+
+    /* Tag la tu cuoi cung: dung 16 chu so hex */
+    size_t tag_start = len;
+    while (tag_start > 0 && buf[tag_start - 1] != ' ') tag_start--;
+    if (tag_start == 0 || len - tag_start != 16) {
+        return -1;
+    }
+    uint64_t tag = 0;
+    for (size_t i = tag_start; i < len; ++i) {
+        char c = buf[i];
+        unsigned v;
+        if (c >= '0' && c <= '9') v = (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f') v = (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v = (unsigned)(c - 'A' + 10);
+        else return -1;
+        tag = (tag << 4) | v;
+    }
+    out->tag = tag;
+    out->signed_len = tag_start - 1;
+
+    size_t p = 0;
+    size_t id_len = 0;
+    while (p < out->signed_len && buf[p] != ' ') {
+        if (id_len + 1 >= sizeof(out->id)) return -1;
+        out->id[id_len++] = buf[p++];
+    }
+    if (id_len == 0 || p >= out->signed_len) {
+        return -1;
+    }
+    p++;
+    if (p >= out->signed_len || buf[p] < '0' || buf[p] > '9') {
+        return -1;
+    }
+    unsigned long long counter = 0;
+    for (; p < out->signed_len && buf[p] >= '0' && buf[p] <= '9'; ++p) {
+        unsigned digit = (unsigned)(buf[p] - '0');
+        if (counter > (TELEMETRY_COUNTER_MAX - digit) / 10u) return -1;
+        counter = counter * 10u + digit;
+    }
+    if (p >= out->signed_len || buf[p] != ' ') {
+        return -1;
+    }
+    out->counter = counter;
+    out->readings = buf + p + 1;
+    out->readings_len = out->signed_len - (p + 1);
+    return out->readings_len > 0 ? 0 : -1;
+}
+
+#define SIP_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND(v0, v1, v2, v3) \
+    do { \
+        v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32); \
+        v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32); \
+    } while (0)
+
+static uint64_t load_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+/** @see telemetry_siphash24() */
+uint64_t telemetry_siphash24(const unsigned char key[16], const void *data, size_t len) {
+    const unsigned char *in = (const unsigned char *)data;
+    uint64_t k0 = load_le64(key), k1 = load_le64(key + 8);
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ull;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dull;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ull;
+    uint64_t v3 = k1 ^ 0x7465646279746573ull;
+    size_t blocks = len / 8;
+    for (size_t i = 0; i < blocks; ++i) {
+        uint64_t m = load_le64(in + i * 8);
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    uint64_t b = (uint64_t)len << 56;
+    const unsigned char *tail = in + blocks * 8;
+    for (size_t i = 0; i < (len & 7); ++i) {
+        b |= (uint64_t)tail[i] << (8 * i);
+    }
+    v3 ^= b;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/** @see telemetry_tag_equal() */
+int telemetry_tag_equal(uint64_t expected, uint64_t actual) {
+    /* Gom XOR tung byte roi moi so sanh, khong thoat som theo byte dau tien khac */
+    volatile uint64_t diff = expected ^ actual;
+    unsigned acc = 0;
+    for (int i = 0; i < 8; ++i) {
+        acc |= (unsigned)(diff >> (8 * i)) & 0xffu;
+    }
+    return acc == 0;
+}
+
+/** @see telemetry_device_key() */
+void telemetry_device_key(const char *password, unsigned char key[16]) {
+    /* Hai khoa co dinh "coopfarm-telem-0/1": khoa thiet bi = SipHash(pw) | SipHash(pw) */
+    static const unsigned char salt[2][16] = {
+        { 'c', 'o', 'o', 'p', 'f', 'a', 'r', 'm', '-', 't', 'e', 'l', 'e', 'm', '-', '0' },
+        { 'c', 'o', 'o', 'p', 'f', 'a', 'r', 'm', '-', 't', 'e', 'l', 'e', 'm', '-', '1' }
+    };
+    size_t len = password ? strlen(password) : 0;
+    for (int half = 0; half < 2; ++half) {
+        uint64_t h = telemetry_siphash24(salt[half], password ? password : "", len);
+        for (int i = 0; i < 8; ++i) {
+            key[half * 8 + i] = (unsigned char)(h >> (8 * i));
+        }
+    }
+}
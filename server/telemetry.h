@@ -0,0 +1,102 @@
+#ifndef SERVER_TELEMETRY_H
+#define SERVER_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "devices.h"
+
+/**
+ * @file telemetry.h
+ * @brief Parse và áp dụng số đo do thiết bị gửi lên (REPORT/MREPORT).
+ *
+ * Một bản ghi là chuỗi các cặp `key=value`, ngăn cách bằng `,` hoặc dấu cách:
+ *  - `t` / `temperature`: nhiệt độ cảm biến (C)
+ *  - `h` / `humidity`: độ ẩm cảm biến (%)
+ *  - `eggs` / `egg_count`: số trứng của bộ đếm trứng
+ */
+
+/**
+ * Datagram UDP (xem `telemetry_udp.h`): `<id> <counter> <readings> <tag>`.
+ * `tag` là 16 ký tự hex của SipHash-2-4 trên phần trước dấu cách cuối cùng,
+ * khoá 128 bit suy ra từ mật khẩu thiết bị bằng `telemetry_device_key()`.
+ * `counter` (tối đa `TELEMETRY_COUNTER_MAX`) phải tăng dần theo từng thiết bị
+ * (chống phát lại); counter cuối được lưu cùng farm nên vẫn có hiệu lực sau
+ * restart, trừ các datagram nhận sau lần lưu cuối. Thiết bị nên dùng thời gian
+ * (ms) làm counter để khe hở đó không phát lại được datagram cũ hơn.
+ */
+
+#define TELEMETRY_TEMPERATURE 0x1u
+#define TELEMETRY_HUMIDITY 0x2u
+#define TELEMETRY_EGGS 0x4u
+
+/** Counter lớn nhất của datagram (vừa số nguyên JSON có dấu khi lưu farm). */
+#define TELEMETRY_COUNTER_MAX 9223372036854775807ULL
+
+/** @brief Một bản ghi số đo; `fields` cho biết trường nào có mặt. */
+struct TelemetryReading {
+    unsigned fields;
+    double temperature;
+    double humidity;
+    int egg_count;
+};
+
+/** @brief Kết quả xử lý một datagram telemetry. */
+enum TelemetryVerdict {
+    TELEMETRY_APPLIED = 0,
+    TELEMETRY_PARSE_ERROR,
+    TELEMETRY_UNKNOWN_DEVICE,
+    TELEMETRY_AUTH_FAILED,
+    TELEMETRY_REPLAY,
+    TELEMETRY_REJECTED        /* dung format nhung so do khong hop voi thiet bi */
+};
+
+/** @brief Các phần của một datagram đã tách (trỏ vào buffer gốc, không copy). */
+struct TelemetryDatagram {
+    char id[MAX_ID_LEN];
+    unsigned long long counter;
+    const char *readings;
+    size_t readings_len;
+    size_t signed_len;        /* so byte duoc ky: tu dau toi truoc tag */
+    uint64_t tag;
+};
+
+/**
+ * @brief Parse số thập phân dạng `[-+]digits[.digits]` (không dùng locale, không cấp phát).
+ *
+ * Dừng ở ký tự đầu tiên không thuộc số; `*end` trỏ tới ký tự đó.
+ * @return 0 nếu thành công, -1 nếu không có chữ số nào.
+ */
+int telemetry_parse_number(const char *s, const char **end, double *out);
+
+/**
+ * @brief Parse bản ghi `key=value[,key=value...]` (hết chuỗi hoặc hết `len` ký tự thì dừng).
+ * @return 0 nếu hợp lệ và có ít nhất một trường, -1 nếu sai format.
+ */
+int telemetry_parse_readings(const char *s, size_t len, struct TelemetryReading *out);
+
+/**
+ * @brief Tách datagram `<id> <counter> <readings> <tag>` (cho phép `\n` cuối).
+ * @return 0 nếu đúng format, -1 nếu sai.
+ */
+int telemetry_parse_datagram(const char *buf, size_t len, struct TelemetryDatagram *out);
+
+/** @brief SipHash-2-4 với khoá 16 byte. */
+uint64_t telemetry_siphash24(const unsigned char key[16], const void *data, size_t len);
+
+/**
+ * @brief So tag tính được với tag trong datagram, thời gian không phụ thuộc vị trí byte khác nhau.
+ * @return 1 nếu bằng nhau, 0 nếu khác.
+ */
+int telemetry_tag_equal(uint64_t expected, uint64_t actual);
+
+/** @brief Suy khoá ký datagram (16 byte) từ mật khẩu thiết bị. */
+void telemetry_device_key(const char *password, unsigned char key[16]);
+
+/**
+ * @brief Ghi bản ghi vào thiết bị tại chỗ (`devices_report_sensor/eggs`).
+ * @return 1 nếu giá trị thay đổi, 0 nếu không đổi, -1 nếu trường không hợp với loại thiết bị,
+ *         -2 nếu ngoài giới hạn.
+ */
+int telemetry_apply(struct Device *dev, const struct TelemetryReading *reading);
+
+#endif /* SERVER_TELEMETRY_H */
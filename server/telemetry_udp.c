@@ -0,0 +1,141 @@
+#define _GNU_SOURCE
+
+#include "telemetry_udp.h"
+#include "coop_logic.h"
+#include "../shared/config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * @file telemetry_udp.c
+ * @brief Rút datagram theo lô bằng `recvmmsg` vào buffer tĩnh.
+ */
+
+#define UDP_BATCH 64
+#define UDP_MAX_DATAGRAM 512
+#define UDP_MAX_BATCHES_PER_POLL 16     /* gioi han de client TCP khong bi bo doi */
+#define UDP_RCVBUF_BYTES (1 << 20)
+
+static int g_udp_fd = -1;
+static struct TelemetryUdpStats g_stats;
+static char g_bufs[UDP_BATCH][UDP_MAX_DATAGRAM];
+static struct iovec g_iov[UDP_BATCH];
+static struct mmsghdr g_msgs[UDP_BATCH];
+static char g_ctrl[UDP_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+
+/** @see telemetry_udp_start() */
+int telemetry_udp_start(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("telemetry udp socket");
+        return -1;
+    }
+    int rcvbuf = UDP_RCVBUF_BYTES;
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+#ifdef SO_RXQ_OVFL
+    /* Kernel gan so goi bi bo do day buffer vao cmsg cua moi datagram */
+    int on = 1;
+    (void)setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("telemetry udp bind");
+        close(fd);
+        return -1;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) (void)fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    for (int i = 0; i < UDP_BATCH; ++i) {
+        g_iov[i].iov_base = g_bufs[i];
+        g_iov[i].iov_len = UDP_MAX_DATAGRAM;
+    }
+    g_udp_fd = fd;
+    return 0;
+}
+
+/** @see telemetry_udp_fill_pollfds() */
+size_t telemetry_udp_fill_pollfds(struct pollfd *fds, size_t max) {
+    if (g_udp_fd < 0 || max < TELEMETRY_UDP_POLLFDS) {
+        return 0;
+    }
+    fds[0].fd = g_udp_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    return TELEMETRY_UDP_POLLFDS;
+}
+
+/** @brief Đọc bộ đếm drop của kernel từ cmsg (giá trị tích luỹ, lấy lớn nhất). */
+static void note_kernel_drops(const struct msghdr *msg) {
+#ifdef SO_RXQ_OVFL
+    for (struct cmsghdr *c = CMSG_FIRSTHDR((struct msghdr *)msg); c; c = CMSG_NXTHDR((struct msghdr *)msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+            if (drops > g_stats.kernel_drops) g_stats.kernel_drops = drops;
+        }
+    }
+#else
+    (void)msg;
+#endif
+}
+
+/** @see telemetry_udp_process() */
+void telemetry_udp_process(const struct pollfd *fds, size_t count) {
+    if (g_udp_fd < 0 || count < TELEMETRY_UDP_POLLFDS || !(fds[0].revents & POLLIN)) {
+        return;
+    }
+    for (int round = 0; round < UDP_MAX_BATCHES_PER_POLL; ++round) {
+        for (int i = 0; i < UDP_BATCH; ++i) {
+            memset(&g_msgs[i].msg_hdr, 0, sizeof(g_msgs[i].msg_hdr));
+            g_msgs[i].msg_hdr.msg_iov = &g_iov[i];
+            g_msgs[i].msg_hdr.msg_iovlen = 1;
+            g_msgs[i].msg_hdr.msg_control = g_ctrl[i];
+            g_msgs[i].msg_hdr.msg_controllen = sizeof(g_ctrl[i]);
+        }
+        int n = recvmmsg(g_udp_fd, g_msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("recvmmsg");
+            }
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            g_stats.datagrams++;
+            note_kernel_drops(&g_msgs[i].msg_hdr);
+            if (g_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                g_stats.parse_errors++;
+                continue;
+            }
+            switch (coop_logic_ingest_datagram(g_bufs[i], g_msgs[i].msg_len)) {
+            case TELEMETRY_APPLIED: g_stats.applied++; break;
+            case TELEMETRY_PARSE_ERROR: g_stats.parse_errors++; break;
+            case TELEMETRY_UNKNOWN_DEVICE: g_stats.unknown_devices++; break;
+            case TELEMETRY_AUTH_FAILED: g_stats.auth_failures++; break;
+            case TELEMETRY_REPLAY: g_stats.replays++; break;
+            case TELEMETRY_REJECTED: g_stats.rejected++; break;
+            }
+        }
+        if (n < UDP_BATCH) {
+            break;
+        }
+    }
+    coop_logic_ingest_end();
+}
+
+/** @see telemetry_udp_stats() */
+void telemetry_udp_stats(struct TelemetryUdpStats *out) {
+    *out = g_stats;
+}
@@ -0,0 +1,52 @@
+#ifndef SERVER_TELEMETRY_UDP_H
+#define SERVER_TELEMETRY_UDP_H
+
+#include <poll.h>
+#include <stddef.h>
+
+/**
+ * @file telemetry_udp.h
+ * @brief Listener UDP nhận datagram số đo có xác thực (format xem `telemetry.h`).
+ *
+ * Cảm biến không cần phiên TCP/CONNECT: mỗi datagram tự mang ID, counter và
+ * tag SipHash. Giống `metrics_http`, module chạy trong vòng poll chung của
+ * `server_run()`; mỗi lần socket readable, datagram được rút theo lô bằng
+ * `recvmmsg` vào buffer tĩnh (không cấp phát theo gói).
+ */
+
+/** @brief Số pollfd module cần trong vòng poll chung. */
+#define TELEMETRY_UDP_POLLFDS 1
+
+/** @brief Bộ đếm của đường UDP (tích luỹ từ lúc start). */
+struct TelemetryUdpStats {
+    unsigned long long datagrams;       /* tong datagram da doc */
+    unsigned long long applied;
+    unsigned long long parse_errors;    /* sai format hoac bi cat ngan */
+    unsigned long long auth_failures;
+    unsigned long long replays;
+    unsigned long long unknown_devices;
+    unsigned long long rejected;        /* so do khong hop voi thiet bi / ngoai gioi han */
+    unsigned long long kernel_drops;    /* SO_RXQ_OVFL: bo dem socket day */
+};
+
+/**
+ * @brief Mở socket UDP tại `0.0.0.0:port`.
+ * @return 0 nếu thành công, -1 nếu lỗi (server vẫn chạy, chỉ không nhận UDP).
+ */
+int telemetry_udp_start(int port);
+
+/**
+ * @brief Ghi pollfd cần theo dõi vào `fds` (tối đa `max`).
+ * @return Số pollfd đã ghi (0 nếu chưa start).
+ */
+size_t telemetry_udp_fill_pollfds(struct pollfd *fds, size_t max);
+
+/**
+ * @brief Rút datagram đang chờ (giới hạn số lô mỗi lần gọi) và áp dụng vào farm.
+ */
+void telemetry_udp_process(const struct pollfd *fds, size_t count);
+
+/** @brief Đọc bộ đếm hiện tại. */
+void telemetry_udp_stats(struct TelemetryUdpStats *out);
+
+#endif  /* SERVER_TELEMETRY_UDP_H */
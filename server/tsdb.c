@@ -0,0 +1,636 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tsdb.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @file tsdb.c
+ * @brief Encoder/decoder Gorilla và quản lý slot chunk trong file.
+ */
+
+#define TSDB_MAGIC 0x31435354u      /* "TSC1" little-endian */
+#define TSDB_PAYLOAD_BITS (sizeof(((struct TsdbChunk *)0)->data) * 8)
+#define TSDB_MAX_SAMPLE_BITS (4 + 32 + 2 + 5 + 6 + 64)
+#define TSDB_NO_WINDOW 0xff
+
+static const char *const METRIC_NAMES[TSDB_METRIC_COUNT] = {
+    "temperature", "humidity", "eggs", "feed", "water"
+};
+
+/* So o ban dau cua ring rollup moi bac; nhan doi toi TIERS[t].len */
+#define TSDB_ROLLUP_MIN_POINTS 8
+
+/** @brief Độ rộng bucket và độ dài tối đa của ring từng bậc. */
+static const struct {
+    int64_t width;
+    uint32_t len;
+} TIERS[TSDB_TIER_COUNT] = {
+    { 60, TSDB_MINUTE_POINTS },
+    { 3600, TSDB_HOUR_POINTS },
+    { 86400, TSDB_DAY_POINTS }
+};
+
+/* ---------- Bitstream (MSB truoc) ---------- */
+
+static void put_bits(unsigned char *data, uint32_t *pos, uint64_t value, unsigned n) {
+    while (n > 0) {
+        uint32_t byte = *pos >> 3;
+        unsigned room = 8 - (*pos & 7);
+        unsigned take = n < room ? n : room;
+        unsigned bits = (unsigned)((value >> (n - take)) & ((1u << take) - 1u));
+        data[byte] |= (unsigned char)(bits << (room - take));
+        *pos += take;
+        n -= take;
+    }
+}
+
+static uint64_t get_bits(const unsigned char *data, uint32_t *pos, unsigned n) {
+    uint64_t value = 0;
+    while (n > 0) {
+        uint32_t byte = *pos >> 3;
+        unsigned room = 8 - (*pos & 7);
+        unsigned take = n < room ? n : room;
+        unsigned bits = (unsigned)(data[byte] >> (room - take)) & ((1u << take) - 1u);
+        value = (value << take) | bits;
+        *pos += take;
+        n -= take;
+    }
+    return value;
+}
+
+static uint64_t double_bits(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static double bits_double(uint64_t bits) {
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+/* ---------- Chunk ---------- */
+
+static void chunk_reset(struct TsdbChunk *c, const char *id, enum TsdbMetric metric) {
+    memset(c, 0, sizeof(*c));
+    c->h.magic = TSDB_MAGIC;
+    c->h.metric = (uint8_t)metric;
+    c->h.leading = TSDB_NO_WINDOW;
+    strncpy(c->h.id, id, sizeof(c->h.id) - 1);
+}
+
+/** @brief Ghi một mẫu vào chunk. @return 0 nếu ghi được, -1 nếu chunk đầy hoặc delta quá lớn. */
+static int chunk_append(struct TsdbChunk *c, int64_t ts, double value) {
+    struct TsdbChunkHeader *h = &c->h;
+    uint64_t bits = double_bits(value);
+    if (h->count == 0) {
+        h->t_first = ts;
+        h->t_last = ts;
+        h->last_delta = 0;
+        put_bits(c->data, &h->bit_len, bits, 64);
+        h->last_value = bits;
+        h->count = 1;
+        return 0;
+    }
+    if (h->bit_len + TSDB_MAX_SAMPLE_BITS > TSDB_PAYLOAD_BITS) {
+        return -1;
+    }
+    int64_t delta = ts - h->t_last;
+    int64_t dod = delta - h->last_delta;
+    if (dod == 0) {
+        put_bits(c->data, &h->bit_len, 0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        put_bits(c->data, &h->bit_len, 0x2, 2);
+        put_bits(c->data, &h->bit_len, (uint64_t)(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+        put_bits(c->data, &h->bit_len, 0x6, 3);
+        put_bits(c->data, &h->bit_len, (uint64_t)(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        put_bits(c->data, &h->bit_len, 0xe, 4);
+        put_bits(c->data, &h->bit_len, (uint64_t)(dod + 2047), 12);
+    } else if (dod >= INT32_MIN && dod <= INT32_MAX) {
+        put_bits(c->data, &h->bit_len, 0xf, 4);
+        put_bits(c->data, &h->bit_len, (uint32_t)(int32_t)dod, 32);
+    } else {
+        return -1; /* khoang trong qua lon: bat dau chunk moi */
+    }
+
+    uint64_t x = bits ^ h->last_value;
+    if (x == 0) {
+        put_bits(c->data, &h->bit_len, 0, 1);
+    } else {
+        unsigned lead = (unsigned)__builtin_clzll(x);
+        unsigned trail = (unsigned)__builtin_ctzll(x);
+        if (lead > 31) lead = 31;
+        if (h->leading != TSDB_NO_WINDOW && lead >= h->leading && trail >= h->trailing) {
+            /* Nam trong cua so cu: chi ghi phan co nghia */
+            put_bits(c->data, &h->bit_len, 0x2, 2);
+            put_bits(c->data, &h->bit_len, x >> h->trailing, 64u - h->leading - h->trailing);
+        } else {
+            unsigned meaningful = 64u - lead - trail;
+            put_bits(c->data, &h->bit_len, 0x3, 2);
+            put_bits(c->data, &h->bit_len, lead, 5);
+            put_bits(c->data, &h->bit_len, meaningful & 63u, 6);
+            put_bits(c->data, &h->bit_len, x >> trail, meaningful);
+            h->leading = (uint8_t)lead;
+            h->trailing = (uint8_t)trail;
+        }
+    }
+    h->last_delta = delta;
+    h->t_last = ts;
+    h->last_value = bits;
+    h->count++;
+    return 0;
+}
+
+/** @brief Giải mã toàn bộ chunk, gọi `visit` cho mẫu trong `[from, to]`. */
+static long chunk_scan(const struct TsdbChunk *c, int64_t from, int64_t to,
+                       void (*visit)(int64_t ts, double value, void *user_data), void *user_data) {
+    const struct TsdbChunkHeader *h = &c->h;
+    if (h->count == 0 || h->t_last < from || h->t_first > to) {
+        return 0;
+    }
+    long emitted = 0;
+    uint32_t pos = 0;
+    int64_t ts = h->t_first, delta = 0;
+    uint64_t bits = get_bits(c->data, &pos, 64);
+    unsigned leading = 0, trailing = 0;
+    for (uint32_t i = 0; i < h->count; ++i) {
+        if (i > 0) {
+            int64_t dod;
+            if (get_bits(c->data, &pos, 1) == 0) dod = 0;
+            else if (get_bits(c->data, &pos, 1) == 0) dod = (int64_t)get_bits(c->data, &pos, 7) - 63;
+            else if (get_bits(c->data, &pos, 1) == 0) dod = (int64_t)get_bits(c->data, &pos, 9) - 255;
+            else if (get_bits(c->data, &pos, 1) == 0) dod = (int64_t)get_bits(c->data, &pos, 12) - 2047;
+            else dod = (int32_t)(uint32_t)get_bits(c->data, &pos, 32);
+            delta += dod;
+            ts += delta;
+
+            if (get_bits(c->data, &pos, 1) != 0) {
+                if (get_bits(c->data, &pos, 1) != 0) {
+                    leading = (unsigned)get_bits(c->data, &pos, 5);
+                    unsigned meaningful = (unsigned)get_bits(c->data, &pos, 6);
+                    if (meaningful == 0) meaningful = 64;
+                    trailing = 64u - leading - meaningful;
+                }
+                bits ^= get_bits(c->data, &pos, 64u - leading - trailing) << trailing;
+            }
+        }
+        if (ts > to) break;
+        if (ts >= from) {
+            visit(ts, bits_double(bits), user_data);
+            emitted++;
+        }
+    }
+    return emitted;
+}
+
+/* ---------- Series index ---------- */
+
+static size_t series_hash(const char *id, enum TsdbMetric metric) {
+    size_t h = (size_t)2166136261u ^ (size_t)metric;
+    for (size_t i = 0; i < MAX_ID_LEN && id[i] != '\0'; ++i) {
+        h ^= (unsigned char)id[i];
+        h *= (size_t)16777619u;
+    }
+    return h;
+}
+
+static int index_rebuild(struct Tsdb *db) {
+    size_t slots = 64;
+    while (slots < db->series_cap * 2) slots *= 2;
+    uint32_t *index = (uint32_t *)calloc(slots, sizeof(*index));
+    if (!index) return -1;
+    for (size_t i = 0; i < db->series_count; ++i) {
+        size_t slot = series_hash(db->series[i].id, db->series[i].metric) & (slots - 1);
+        while (index[slot] != 0) slot = (slot + 1) & (slots - 1);
+        index[slot] = (uint32_t)(i + 1);
+    }
+    free(db->index);
+    db->index = index;
+    db->index_mask = slots - 1;
+    return 0;
+}
+
+static struct TsdbSeries *series_find(struct Tsdb *db, const char *id, enum TsdbMetric metric) {
+    if (!db->index) return NULL;
+    for (size_t slot = series_hash(id, metric) & db->index_mask; db->index[slot] != 0;
+         slot = (slot + 1) & db->index_mask) {
+        struct TsdbSeries *s = &db->series[db->index[slot] - 1];
+        if (s->metric == metric && strncmp(s->id, id, sizeof(s->id)) == 0) return s;
+    }
+    return NULL;
+}
+
+static struct TsdbSeries *series_get(struct Tsdb *db, const char *id, enum TsdbMetric metric) {
+    struct TsdbSeries *s = series_find(db, id, metric);
+    if (s) return s;
+    if (db->series_count == db->series_cap) {
+        size_t cap = db->series_cap ? db->series_cap * 2 : 64;
+        struct TsdbSeries *grown = (struct TsdbSeries *)realloc(db->series, cap * sizeof(*grown));
+        if (!grown) return NULL;
+        db->series = grown;
+        db->series_cap = cap;
+        if (index_rebuild(db) != 0) return NULL;
+    }
+    s = &db->series[db->series_count++];
+    memset(s, 0, sizeof(*s));
+    strncpy(s->id, id, sizeof(s->id) - 1);
+    s->metric = metric;
+    size_t slot = series_hash(s->id, metric) & db->index_mask;
+    while (db->index[slot] != 0) slot = (slot + 1) & db->index_mask;
+    db->index[slot] = (uint32_t)db->series_count;
+    db->stats.series = db->series_count;
+    return s;
+}
+
+static int series_push_sealed(struct TsdbSeries *s, uint32_t slot) {
+    if (s->sealed_count == s->sealed_cap) {
+        size_t cap = s->sealed_cap ? s->sealed_cap * 2 : 8;
+        uint32_t *grown = (uint32_t *)realloc(s->sealed, cap * sizeof(*grown));
+        if (!grown) return -1;
+        s->sealed = grown;
+        s->sealed_cap = cap;
+    }
+    s->sealed[s->sealed_count++] = slot;
+    return 0;
+}
+
+/* ---------- Rollup ---------- */
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+/** @brief Map lại file nếu slot cần đọc nằm ngoài vùng đã map. */
+static const struct TsdbChunk *mapped_chunk(struct Tsdb *db, uint32_t slot) {
+    size_t need = ((size_t)slot + 1) * TSDB_CHUNK_BYTES;
+    if (need > db->map_len) {
+        struct stat st;
+        if (fstat(db->fd, &st) != 0 || (size_t)st.st_size < need) return NULL;
+        if (db->map) munmap((void *)db->map, db->map_len);
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, db->fd, 0);
+        if (map == MAP_FAILED) {
+            db->map = NULL;
+            db->map_len = 0;
+            return NULL;
+        }
+        db->map = (const unsigned char *)map;
+        db->map_len = (size_t)st.st_size;
+    }
+    return (const struct TsdbChunk *)(db->map + (size_t)slot * TSDB_CHUNK_BYTES);
+}
+
+/**
+ * @brief Nới ring của bậc `t` để chứa `span` bucket liên tiếp (tối đa `TIERS[t].len`).
+ *
+ * Hết bộ nhớ thì giữ ring cũ: bucket cũ nhất bị đè như khi ring đã đầy.
+ */
+static void rollup_grow(struct TsdbRollups *r, int t, int64_t span, size_t *bytes) {
+    uint32_t cap = r->cap[t];
+    if (span <= (int64_t)cap || cap >= TIERS[t].len) return;
+    uint32_t new_cap = cap ? cap : TSDB_ROLLUP_MIN_POINTS;
+    while ((int64_t)new_cap < span && new_cap < TIERS[t].len) new_cap *= 2;
+    if (new_cap > TIERS[t].len) new_cap = TIERS[t].len;
+    struct TsdbRollupPoint *pts = (struct TsdbRollupPoint *)calloc(new_cap, sizeof(*pts));
+    if (!pts) return;
+    if (r->head[t] >= 0) {
+        /* Dat lai cac bucket con trong ring cu theo chi so moi */
+        int64_t lo = r->head[t] - (int64_t)cap + 1;
+        if (lo < r->first[t]) lo = r->first[t];
+        for (int64_t b = lo; b <= r->head[t]; ++b) pts[b % new_cap] = r->points[t][b % cap];
+    }
+    free(r->points[t]);
+    r->points[t] = pts;
+    r->cap[t] = new_cap;
+    *bytes += (size_t)(new_cap - cap) * sizeof(*pts);
+}
+
+/** @brief Cộng một số đo vào mọi bậc; bucket cũ hơn ring bị bỏ qua. */
+static void rollup_add(struct TsdbRollups *r, int64_t ts, double value, size_t *bytes) {
+    if (ts < 0) return;
+    for (int t = 0; t < TSDB_TIER_COUNT; ++t) {
+        int64_t b = ts / TIERS[t].width;
+        if (r->head[t] < 0) {
+            rollup_grow(r, t, 1, bytes);
+        } else {
+            int64_t lo = b < r->first[t] ? b : r->first[t];
+            int64_t hi = b > r->head[t] ? b : r->head[t];
+            rollup_grow(r, t, hi - lo + 1, bytes);
+        }
+        int64_t len = (int64_t)r->cap[t];
+        struct TsdbRollupPoint *pts = r->points[t];
+        if (len == 0) continue;
+        if (r->head[t] < 0 || b > r->head[t]) {
+            /* Tien head: xoa cac o cua bucket vua bi day ra khoi ring */
+            int64_t gap = r->head[t] < 0 ? len : b - r->head[t];
+            if (gap >= len) {
+                memset(pts, 0, (size_t)len * sizeof(*pts));
+            } else {
+                for (int64_t k = 1; k <= gap; ++k) memset(&pts[(r->head[t] + k) % len], 0, sizeof(*pts));
+            }
+            if (r->head[t] < 0) r->first[t] = b;
+            r->head[t] = b;
+        } else if (b <= r->head[t] - len) {
+            continue;
+        }
+        if (b < r->first[t]) r->first[t] = b;
+        struct TsdbRollupPoint *p = &pts[b % len];
+        if (p->count == 0 || value < p->min) p->min = value;
+        if (p->count == 0 || value > p->max) p->max = value;
+        p->sum += value;
+        p->count++;
+    }
+}
+
+struct RollupBackfill {
+    struct TsdbRollups *r;
+    size_t *bytes;
+};
+
+static void backfill_visit(int64_t ts, double value, void *user_data) {
+    struct RollupBackfill *bf = (struct RollupBackfill *)user_data;
+    rollup_add(bf->r, ts, value, bf->bytes);
+}
+
+/**
+ * @brief Rollup của series, cấp phát ở lần ghi hoặc truy vấn đầu.
+ *
+ * Từ lúc cấp phát, `tsdb_append()` cộng mọi số đo mới vào rollup; phần dữ
+ * liệu thô có trước (`since`) được dựng lại ở lần truy vấn đầu.
+ */
+static struct TsdbRollups *series_rollups(struct Tsdb *db, struct TsdbSeries *s) {
+    if (!s->rollups) {
+        struct TsdbRollups *r = (struct TsdbRollups *)calloc(1, sizeof(*r));
+        if (!r) return NULL;
+        for (int t = 0; t < TSDB_TIER_COUNT; ++t) r->head[t] = -1;
+        r->since = -1;
+        if (s->head && s->head->h.count > 0) {
+            r->since = s->head->h.t_last;
+        } else if (s->sealed_count > 0) {
+            const struct TsdbChunk *c = mapped_chunk(db, s->sealed[s->sealed_count - 1]);
+            if (c) r->since = c->h.t_last;
+        }
+        r->last = r->since;
+        s->rollups = r;
+        db->stats.rollup_bytes += sizeof(*r);
+    }
+    return s->rollups;
+}
+
+/** @brief Gộp một điểm vào bucket kết quả. */
+static void bucket_merge(struct TsdbBucket *b, double min, double max, double sum, unsigned long count) {
+    if (count == 0) return;
+    if (b->count == 0 || min < b->min) b->min = min;
+    if (b->count == 0 || max > b->max) b->max = max;
+    b->sum += sum;
+    b->count += count;
+}
+
+/** @brief Ngữ cảnh gộp dữ liệu thô vào bucket. */
+struct RawAggregate {
+    struct TsdbBucket *out;
+    int64_t first;
+    int64_t step;
+    long count;
+};
+
+static void raw_visit(int64_t ts, double value, void *user_data) {
+    struct RawAggregate *a = (struct RawAggregate *)user_data;
+    int64_t i = floor_div(ts, a->step) - a->first;
+    if (i >= 0 && i < a->count) bucket_merge(&a->out[i], value, value, value, 1);
+}
+
+/* ---------- File ---------- */
+
+static int write_slot(struct Tsdb *db, uint32_t slot, const struct TsdbChunk *c) {
+    off_t off = (off_t)slot * TSDB_CHUNK_BYTES;
+    return pwrite(db->fd, c, sizeof(*c), off) == (ssize_t)sizeof(*c) ? 0 : -1;
+}
+
+/** @see tsdb_open() */
+int tsdb_open(struct Tsdb *db, const char *path) {
+    memset(db, 0, sizeof(*db));
+    db->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (db->fd < 0) {
+        perror("tsdb open");
+        return -1;
+    }
+    if (index_rebuild(db) != 0) {
+        tsdb_close(db);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(db->fd, &st) != 0) {
+        tsdb_close(db);
+        return -1;
+    }
+    db->slot_count = (uint32_t)((size_t)st.st_size / TSDB_CHUNK_BYTES);
+    for (uint32_t slot = 0; slot < db->slot_count; ++slot) {
+        const struct TsdbChunk *c = mapped_chunk(db, slot);
+        if (!c) break;
+        if (c->h.magic != TSDB_MAGIC || c->h.metric >= TSDB_METRIC_COUNT || c->h.count == 0) {
+            continue; /* slot trong (head chua tung flush) */
+        }
+        char id[MAX_ID_LEN];
+        memcpy(id, c->h.id, sizeof(id));
+        id[sizeof(id) - 1] = '\0';
+        struct TsdbSeries *s = series_get(db, id, (enum TsdbMetric)c->h.metric);
+        if (!s) break;
+        if (c->h.sealed) {
+            (void)series_push_sealed(s, slot);
+            continue;
+        }
+        /* Head cu cua series (slot nho hon) coi nhu sealed, head moi nhat duoc ghi tiep */
+        if (s->head) {
+            (void)series_push_sealed(s, s->head_slot);
+        } else {
+            s->head = (struct TsdbChunk *)malloc(sizeof(*s->head));
+            if (!s->head) continue;
+        }
+        memcpy(s->head, c, sizeof(*c));
+        s->head_slot = slot;
+    }
+    db->stats.chunks = db->slot_count;
+    return 0;
+}
+
+/** @see tsdb_close() */
+void tsdb_close(struct Tsdb *db) {
+    if (db->fd >= 0) {
+        (void)tsdb_flush(db);
+    }
+    for (size_t i = 0; i < db->series_count; ++i) {
+        free(db->series[i].head);
+        free(db->series[i].sealed);
+        if (db->series[i].rollups) {
+            for (int t = 0; t < TSDB_TIER_COUNT; ++t) free(db->series[i].rollups->points[t]);
+            free(db->series[i].rollups);
+        }
+    }
+    free(db->series);
+    free(db->index);
+    if (db->map) munmap((void *)db->map, db->map_len);
+    if (db->fd >= 0) close(db->fd);
+    memset(db, 0, sizeof(*db));
+    db->fd = -1;
+}
+
+/** @see tsdb_append() */
+int tsdb_append(struct Tsdb *db, const char *id, enum TsdbMetric metric, int64_t ts, double value) {
+    if (!db || db->fd < 0 || !id || metric >= TSDB_METRIC_COUNT) {
+        return -1;
+    }
+    struct TsdbSeries *s = series_get(db, id, metric);
+    if (!s) return -1;
+    /* Rollup nhan moi so do tang dan, ke ca so do qua day ma du lieu tho bo */
+    struct TsdbRollups *r = series_rollups(db, s);
+    if (r && ts > r->last) {
+        rollup_add(r, ts, value, &db->stats.rollup_bytes);
+        r->last = ts;
+    }
+    if (s->head && s->head->h.count > 0 && ts < s->head->h.t_last + TSDB_RESOLUTION_S) {
+        db->stats.skipped++;
+        return 1;
+    }
+    if (!s->head) {
+        s->head = (struct TsdbChunk *)malloc(sizeof(*s->head));
+        if (!s->head) return -1;
+        chunk_reset(s->head, id, metric);
+        s->head_slot = db->slot_count++;
+    }
+    if (chunk_append(s->head, ts, value) != 0) {
+        /* Head day: ghi ban sealed mot lan, head moi nhan slot moi */
+        s->head->h.sealed = 1;
+        if (write_slot(db, s->head_slot, s->head) != 0 || series_push_sealed(s, s->head_slot) != 0) {
+            s->head->h.sealed = 0;
+            return -1;
+        }
+        chunk_reset(s->head, id, metric);
+        s->head_slot = db->slot_count++;
+        (void)chunk_append(s->head, ts, value);
+    }
+    s->dirty = 1;
+    db->stats.samples++;
+    db->stats.chunks = db->slot_count;
+    return 0;
+}
+
+/** @see tsdb_flush() */
+int tsdb_flush(struct Tsdb *db) {
+    int rc = 0;
+    for (size_t i = 0; i < db->series_count; ++i) {
+        struct TsdbSeries *s = &db->series[i];
+        if (!s->dirty || !s->head) continue;
+        if (write_slot(db, s->head_slot, s->head) != 0) {
+            rc = -1;
+            continue;
+        }
+        s->dirty = 0;
+    }
+    return rc;
+}
+
+/** @see tsdb_query() */
+long tsdb_query(struct Tsdb *db, const char *id, enum TsdbMetric metric, int64_t from, int64_t to,
+                void (*visit)(int64_t ts, double value, void *user_data), void *user_data) {
+    struct TsdbSeries *s = series_find(db, id, metric);
+    if (!s) return -1;
+    long emitted = 0;
+    for (size_t i = 0; i < s->sealed_count; ++i) {
+        const struct TsdbChunk *c = mapped_chunk(db, s->sealed[i]);
+        if (c) emitted += chunk_scan(c, from, to, visit, user_data);
+    }
+    if (s->head) emitted += chunk_scan(s->head, from, to, visit, user_data);
+    return emitted;
+}
+
+/** @see tsdb_aggregate() */
+long tsdb_aggregate(struct Tsdb *db, const char *id, enum TsdbMetric metric, int64_t from, int64_t to,
+                    int64_t step, struct TsdbBucket *out, size_t max_out) {
+    if (!db || !id || !out || step <= 0 || from < 0 || to < from) {
+        return -2;
+    }
+    struct TsdbSeries *s = series_find(db, id, metric);
+    if (!s) return -1;
+    int64_t first = floor_div(from, step);
+    int64_t last = floor_div(to, step);
+    if (last - first + 1 > (int64_t)max_out) {
+        return -2;
+    }
+    long n = (long)(last - first + 1);
+    memset(out, 0, (size_t)n * sizeof(*out));
+    for (long i = 0; i < n; ++i) out[i].start = (first + i) * step;
+
+    /* Bac tho nhat co do rong chia het step; bucket ket qua nao con trong ring thi lay tu do */
+    int tier = -1;
+    for (int t = TSDB_TIER_COUNT - 1; t >= 0; --t) {
+        if (step % TIERS[t].width == 0) {
+            tier = t;
+            break;
+        }
+    }
+    struct TsdbRollups *r = tier >= 0 ? series_rollups(db, s) : NULL;
+    if (r && !r->backfilled) {
+        /* Lan truy van dau: dung lai phan truoc luc cap phat tu du lieu tho */
+        struct RollupBackfill bf = { r, &db->stats.rollup_bytes };
+        if (r->since >= 0) (void)tsdb_query(db, id, metric, 0, r->since, backfill_visit, &bf);
+        r->backfilled = 1;
+    }
+
+    long raw_buckets = n;
+    if (r && r->head[tier] >= 0) {
+        int64_t width = TIERS[tier].width;
+        int64_t len = (int64_t)r->cap[tier];
+        int64_t oldest = r->head[tier] - len + 1;
+        const struct TsdbRollupPoint *pts = r->points[tier];
+        raw_buckets = 0;
+        for (long i = 0; i < n; ++i) {
+            int64_t tb = out[i].start / width;
+            int64_t te = tb + step / width;
+            if (tb < oldest) {
+                raw_buckets = i + 1;
+                continue;
+            }
+            for (; tb < te && tb <= r->head[tier]; ++tb) {
+                const struct TsdbRollupPoint *p = &pts[tb % len];
+                bucket_merge(&out[i], p->min, p->max, p->sum, p->count);
+            }
+        }
+    }
+    if (raw_buckets > 0) {
+        struct RawAggregate agg = { out, first, step, raw_buckets };
+        (void)tsdb_query(db, id, metric, first * step, (first + raw_buckets) * step - 1, raw_visit, &agg);
+    }
+    return n;
+}
+
+/** @see tsdb_get_stats() */
+void tsdb_get_stats(const struct Tsdb *db, struct TsdbStats *out) {
+    *out = db->stats;
+}
+
+/** @see tsdb_metric_name() */
+const char *tsdb_metric_name(enum TsdbMetric metric) {
+    return metric < TSDB_METRIC_COUNT ? METRIC_NAMES[metric] : "unknown";
+}
+
+/** @see tsdb_metric_from_string() */
+int tsdb_metric_from_string(const char *name) {
+    if (!name) return -1;
+    if (strcmp(name, "t") == 0) return TSDB_METRIC_TEMPERATURE;
+    if (strcmp(name, "h") == 0) return TSDB_METRIC_HUMIDITY;
+    for (int i = 0; i < TSDB_METRIC_COUNT; ++i) {
+        if (strcmp(name, METRIC_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,198 @@
+#ifndef SERVER_TSDB_H
+#define SERVER_TSDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../shared/config.h"
+
+/**
+ * @file tsdb.h
+ * @brief Lưu lịch sử số đo theo (thiết bị, metric) kiểu Gorilla.
+ *
+ * Mỗi series là chuỗi các chunk kích thước cố định `TSDB_CHUNK_BYTES`. Trong
+ * chunk, timestamp mã hoá delta-of-delta và giá trị mã hoá XOR với giá trị
+ * trước, nên số đo theo phút ổn định chỉ tốn vài bit mỗi mẫu.
+ *
+ * File là mảng slot chunk, mỗi chunk tự mô tả (header chứa ID, metric, trạng
+ * thái encoder). Chunk đã đầy (sealed) được ghi một lần và đọc lại qua mmap;
+ * chỉ chunk đang ghi (head) của mỗi series nằm trong RAM và được ghi đè tại
+ * chỗ mỗi lần `tsdb_flush()`. Khi mở lại, head chưa sealed được nạp tiếp.
+ *
+ * Ngoài dữ liệu thô, mỗi series giữ rollup (min/max/sum/count) theo phút, giờ
+ * và ngày. Mọi bậc được cập nhật cùng lúc từ `tsdb_append()` với mọi số đo,
+ * kể cả số đo dày hơn `TSDB_RESOLUTION_S` mà dữ liệu thô bỏ, nên min/max theo
+ * phút không mất và các bậc luôn khớp nhau; chỉ phần cũ hơn ring mới được gộp
+ * từ dữ liệu thô (một mẫu mỗi phút). Ring của mỗi bậc bắt đầu nhỏ và nhân đôi
+ * tới độ dài tối đa khi series đủ cũ. Rollup chỉ ở RAM: phần trước lúc khởi
+ * động được dựng lại từ dữ liệu thô ở lần truy vấn đầu.
+ */
+
+#define TSDB_CHUNK_BYTES 1024
+#define TSDB_RESOLUTION_S 60        /* toi da mot mau moi series moi phut */
+
+/* Do dai toi da cua ring rollup: 6 gio theo phut, 14 ngay theo gio, 400 ngay theo ngay */
+#define TSDB_MINUTE_POINTS 360
+#define TSDB_HOUR_POINTS (14 * 24)
+#define TSDB_DAY_POINTS 400
+
+/** @brief Các metric được lưu. */
+enum TsdbMetric {
+    TSDB_METRIC_TEMPERATURE = 0,
+    TSDB_METRIC_HUMIDITY,
+    TSDB_METRIC_EGGS,
+    TSDB_METRIC_FEED,               /* kg thuc an moi lan cho an */
+    TSDB_METRIC_WATER,              /* L nuoc moi lan cho uong/cho an */
+    TSDB_METRIC_COUNT
+};
+
+/** @brief Header của chunk (nằm đầu mỗi slot trong file). */
+struct TsdbChunkHeader {
+    uint32_t magic;
+    uint16_t sealed;
+    uint8_t metric;
+    uint8_t leading;                /* cua so XOR hien tai (0xff = chua co) */
+    uint8_t trailing;
+    uint8_t reserved[3];
+    uint32_t count;                 /* so mau trong chunk */
+    uint32_t bit_len;               /* so bit da dung trong data */
+    char id[MAX_ID_LEN];
+    int64_t t_first;
+    int64_t t_last;
+    int64_t last_delta;
+    uint64_t last_value;            /* bit cua double cuoi */
+};
+
+/** @brief Một chunk: header + bitstream. */
+struct TsdbChunk {
+    struct TsdbChunkHeader h;
+    unsigned char data[TSDB_CHUNK_BYTES - sizeof(struct TsdbChunkHeader)];
+};
+
+/** @brief Một điểm rollup (32 byte), cùng kiểu double với dữ liệu thô. */
+struct TsdbRollupPoint {
+    double min;
+    double max;
+    double sum;
+    uint32_t count;
+};
+
+/** @brief Bậc rollup. */
+enum TsdbTier {
+    TSDB_TIER_MINUTE = 0,
+    TSDB_TIER_HOUR,
+    TSDB_TIER_DAY,
+    TSDB_TIER_COUNT
+};
+
+/**
+ * @brief Rollup của một series: mỗi bậc là ring `cap` ô, `head` là chỉ số bucket mới nhất (-1 = rỗng).
+ *
+ * Ring giữ các bucket `[head - cap + 1, head]`; `first` là bucket cũ nhất từng
+ * ghi, để biết khi nào cần nới ring (tới độ dài tối đa của bậc) thay vì đè.
+ */
+struct TsdbRollups {
+    int64_t head[TSDB_TIER_COUNT];
+    int64_t first[TSDB_TIER_COUNT];
+    uint32_t cap[TSDB_TIER_COUNT];
+    struct TsdbRollupPoint *points[TSDB_TIER_COUNT];
+    int64_t since;                  /* ts mau tho moi nhat luc cap phat; tu do tro ve truoc lay tu du lieu tho */
+    int64_t last;                   /* ts so do moi nhat da cong, so do khong moi hon bi bo */
+    int backfilled;
+};
+
+/** @brief Một bucket kết quả của `tsdb_aggregate()`. */
+struct TsdbBucket {
+    int64_t start;
+    double min;
+    double max;
+    double sum;
+    unsigned long count;
+};
+
+/** @brief Một series trong bộ nhớ: head đang ghi + danh sách slot đã sealed (theo thời gian). */
+struct TsdbSeries {
+    char id[MAX_ID_LEN];
+    enum TsdbMetric metric;
+    struct TsdbChunk *head;
+    uint32_t head_slot;
+    uint32_t *sealed;
+    size_t sealed_count;
+    size_t sealed_cap;
+    int dirty;
+    struct TsdbRollups *rollups;    /* cap phat o lan ghi/truy van dau */
+};
+
+/** @brief Số liệu tổng của store. */
+struct TsdbStats {
+    size_t series;
+    size_t chunks;                  /* slot da cap phat trong file */
+    unsigned long long samples;     /* mau da ghi tu luc mo */
+    unsigned long long skipped;     /* mau bi bo do day hon TSDB_RESOLUTION_S hoac lui thoi gian */
+    size_t rollup_bytes;
+};
+
+/** @brief Store time-series. */
+struct Tsdb {
+    int fd;
+    const unsigned char *map;       /* mmap read-only cua file (chunk sealed) */
+    size_t map_len;
+    uint32_t slot_count;
+    struct TsdbSeries *series;
+    size_t series_count;
+    size_t series_cap;
+    uint32_t *index;                /* bang bam (id, metric) -> vi tri series + 1 */
+    size_t index_mask;
+    struct TsdbStats stats;
+};
+
+/**
+ * @brief Mở (hoặc tạo) store tại `path` và nạp danh sách chunk.
+ * @return 0 nếu thành công, -1 nếu lỗi.
+ */
+int tsdb_open(struct Tsdb *db, const char *path);
+
+/** @brief Flush head rồi đóng file, giải phóng bộ nhớ. */
+void tsdb_close(struct Tsdb *db);
+
+/**
+ * @brief Thêm một mẫu. Mẫu cách mẫu trước ít hơn `TSDB_RESOLUTION_S` (hoặc lùi thời gian) bị bỏ.
+ * @return 0 nếu đã ghi, 1 nếu bị bỏ, -1 nếu lỗi (hết bộ nhớ/IO).
+ */
+int tsdb_append(struct Tsdb *db, const char *id, enum TsdbMetric metric, int64_t ts, double value);
+
+/**
+ * @brief Ghi các head đã thay đổi xuống file.
+ * @return 0 nếu thành công, -1 nếu có lỗi IO.
+ */
+int tsdb_flush(struct Tsdb *db);
+
+/**
+ * @brief Duyệt các mẫu trong `[from, to]` theo thứ tự thời gian.
+ * @return Số mẫu đã gọi `visit`, -1 nếu không có series.
+ */
+long tsdb_query(struct Tsdb *db, const char *id, enum TsdbMetric metric, int64_t from, int64_t to,
+                void (*visit)(int64_t ts, double value, void *user_data), void *user_data);
+
+/**
+ * @brief Gộp min/max/sum/count theo bucket `step` giây (căn theo epoch) trong `[from, to]`.
+ *
+ * Mỗi bucket lấy từ bậc rollup thô nhất có độ rộng chia hết `step` và còn giữ
+ * bucket đó; `step` không chia hết cho phút và phần cũ hơn ring được giải mã
+ * từ dữ liệu thô. `out` nhận mọi
+ * bucket từ bucket chứa `from` tới bucket chứa `to` (bucket rỗng có count 0).
+ *
+ * @return Số bucket, -1 nếu không có series, -2 nếu tham số sai hoặc vượt `max_out`.
+ */
+long tsdb_aggregate(struct Tsdb *db, const char *id, enum TsdbMetric metric, int64_t from, int64_t to,
+                    int64_t step, struct TsdbBucket *out, size_t max_out);
+
+/** @brief Đọc số liệu tổng. */
+void tsdb_get_stats(const struct Tsdb *db, struct TsdbStats *out);
+
+/** @brief Tên metric ("temperature", "humidity", "eggs", "feed", "water"). */
+const char *tsdb_metric_name(enum TsdbMetric metric);
+
+/** @brief Parse tên metric (chấp nhận cả "t"/"h"). @return metric hoặc -1. */
+int tsdb_metric_from_string(const char *name);
+
+#endif /* SERVER_TSDB_H */
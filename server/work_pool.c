@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+
+#include "work_pool.h"
+#include "../shared/config.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/**
+ * @file work_pool.c
+ * @brief Deque Chase-Lev cố định dung lượng, inbox lock-free, đỗ worker bằng mutex/cond.
+ */
+
+enum {
+    WORK_POOL_MAX_THREADS = 16
+};
+
+/** @brief Deque của một worker; `top` (kẻ trộm) và `bottom` (chủ) trên hai cache line. */
+struct WorkDeque {
+    long top;
+    char pad0[64 - sizeof(long)];
+    long bottom;
+    char pad1[64 - sizeof(long)];
+    struct WorkTask *slots[WORK_DEQUE_CAPACITY];
+};
+
+/** @brief Trạng thái của một worker. */
+struct Worker {
+    struct WorkDeque deque;
+    struct WorkTask *inbox;         // Stack lock-free: thread ngoai pool day vao
+    char pad[64 - sizeof(void *)];
+    struct WorkTask *backlog;       // Chi worker nay: phan inbox chua vua deque (FIFO)
+    struct WorkTask *backlog_tail;
+    unsigned index;
+    unsigned long executed;
+    unsigned long stolen;
+};
+
+static struct Worker g_workers[WORK_POOL_MAX_THREADS] __attribute__((aligned(64)));
+static unsigned g_worker_count;
+static unsigned g_next_inbox;
+static unsigned long g_submitted;
+static unsigned g_idle;             /* so worker dang (sap) ngu */
+static pthread_mutex_t g_park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_park_cond = PTHREAD_COND_INITIALIZER;
+static __thread struct Worker *t_worker;
+
+/** @brief Chủ deque: đẩy vào đáy. @return 0, hoặc -1 nếu đầy. */
+static int deque_push(struct WorkDeque *d, struct WorkTask *task) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    if (b - t >= WORK_DEQUE_CAPACITY) {
+        return -1;
+    }
+    __atomic_store_n(&d->slots[b & (WORK_DEQUE_CAPACITY - 1)], task, __ATOMIC_RELAXED);
+    /* seq_cst: worker sap ngu kiem tra deque sau khi tang g_idle (xem wake_one) */
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+/** @brief Chủ deque: lấy ở đáy; chỉ tranh với kẻ trộm khi còn đúng một phần tử. */
+static struct WorkTask *deque_pop(struct WorkDeque *d) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    struct WorkTask *task = __atomic_load_n(&d->slots[b & (WORK_DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        /* Phan tu cuoi: gianh voi ke trom qua top */
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            task = NULL;
+        }
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+/** @brief Kẻ trộm: lấy ở đỉnh (NULL nếu rỗng hoặc thua tranh chấp). */
+static struct WorkTask *deque_steal(struct WorkDeque *d) {
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return NULL;
+    }
+    struct WorkTask *task = __atomic_load_n(&d->slots[t & (WORK_DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return task;
+}
+
+static int deque_nonempty(struct WorkDeque *d) {
+    return __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST) - __atomic_load_n(&d->top, __ATOMIC_SEQ_CST) > 0;
+}
+
+static void eventfd_signal(int fd) {
+    uint64_t one = 1;
+    ssize_t n;
+    do {
+        n = write(fd, &one, sizeof(one));
+    } while (n < 0 && errno == EINTR);
+}
+
+static void eventfd_clear(int fd) {
+    uint64_t value;
+    while (read(fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+}
+
+/** @brief Đánh thức một worker đang ngủ (nếu có) sau khi vừa thêm việc. */
+static void wake_one(void) {
+    if (__atomic_load_n(&g_idle, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&g_park_lock);
+    pthread_cond_signal(&g_park_cond);
+    pthread_mutex_unlock(&g_park_lock);
+}
+
+/** @brief Trả task đã chạy cho reactor sở hữu; không chạm vào task sau khi đẩy. */
+static void complete(struct WorkTask *task) {
+    struct WorkReactor *r = task->owner;
+    if (!r || !task->done) {
+        return;
+    }
+    int fd = r->fd;
+    struct WorkTask *head = __atomic_load_n(&r->completed, __ATOMIC_RELAXED);
+    do {
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&r->completed, &head, task, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    /* Danh sach dang rong thi reactor chua duoc bao: bao mot lan cho ca dot */
+    if (!head) {
+        eventfd_signal(fd);
+    }
+}
+
+static void run_task(struct Worker *w, struct WorkTask *task) {
+    task->run(task);
+    __atomic_add_fetch(&w->executed, 1, __ATOMIC_RELAXED);
+    complete(task);
+}
+
+/** @brief Nối cả stack `list` (mới nhất trước) vào cuối backlog của `w` theo thứ tự submit. */
+static void backlog_append(struct Worker *w, struct WorkTask *list) {
+    struct WorkTask *fifo = NULL;
+    struct WorkTask *last = list;
+    while (list) {
+        struct WorkTask *next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    if (!fifo) {
+        return;
+    }
+    if (w->backlog) {
+        w->backlog_tail->next = fifo;
+    } else {
+        w->backlog = fifo;
+    }
+    w->backlog_tail = last;
+}
+
+/** @brief Lấy việc đầu backlog; phần còn lại vào deque (vừa tới đâu) để worker khác lấy trộm được. */
+static struct WorkTask *backlog_take(struct Worker *w) {
+    struct WorkTask *first = w->backlog;
+    if (!first) {
+        return NULL;
+    }
+    w->backlog = first->next;
+    while (w->backlog) {
+        /* Doc next truoc khi day: ke trom co the chay xong (va dung lai next) ngay sau do */
+        struct WorkTask *next = w->backlog->next;
+        if (deque_push(&w->deque, w->backlog) != 0) {
+            break;
+        }
+        w->backlog = next;
+    }
+    if (!w->backlog) {
+        w->backlog_tail = NULL;
+    }
+    if (deque_nonempty(&w->deque)) {
+        wake_one();
+    }
+    return first;
+}
+
+/**
+ * @brief Thử lấy trộm từ worker khác, bắt đầu từ worker kế tiếp: trước ở deque, sau cả inbox.
+ *
+ * Lời đánh thức có thể tới worker khác với chủ inbox, nên worker rảnh phải lấy
+ * được inbox của nhau; consumer luôn lấy cả stack nên nhiều consumer vẫn an toàn.
+ */
+static struct WorkTask *steal_any(struct Worker *w) {
+    unsigned n = __atomic_load_n(&g_worker_count, __ATOMIC_ACQUIRE);
+    for (unsigned k = 1; k < n; ++k) {
+        struct Worker *victim = &g_workers[(w->index + k) % n];
+        struct WorkTask *task = deque_steal(&victim->deque);
+        if (task) {
+            __atomic_add_fetch(&w->stolen, 1, __ATOMIC_RELAXED);
+            return task;
+        }
+    }
+    for (unsigned k = 1; k < n; ++k) {
+        struct Worker *victim = &g_workers[(w->index + k) % n];
+        if (!__atomic_load_n(&victim->inbox, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        struct WorkTask *list = __atomic_exchange_n(&victim->inbox, NULL, __ATOMIC_ACQUIRE);
+        if (list) {
+            __atomic_add_fetch(&w->stolen, 1, __ATOMIC_RELAXED);
+            backlog_append(w, list);
+            return backlog_take(w);
+        }
+    }
+    return NULL;
+}
+
+static int pool_has_work(void) {
+    unsigned n = __atomic_load_n(&g_worker_count, __ATOMIC_ACQUIRE);
+    for (unsigned i = 0; i < n; ++i) {
+        if (__atomic_load_n(&g_workers[i].inbox, __ATOMIC_SEQ_CST) || deque_nonempty(&g_workers[i].deque)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** @brief Ngủ tới khi có việc; kiểm tra lại sau khi tăng `g_idle` để không lỡ lời đánh thức. */
+static void park(void) {
+    pthread_mutex_lock(&g_park_lock);
+    __atomic_add_fetch(&g_idle, 1, __ATOMIC_SEQ_CST);
+    if (!pool_has_work()) {
+        pthread_cond_wait(&g_park_cond, &g_park_lock);
+    }
+    __atomic_sub_fetch(&g_idle, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&g_park_lock);
+}
+
+static void *worker_main(void *arg) {
+    struct Worker *w = (struct Worker *)arg;
+    t_worker = w;
+    for (;;) {
+        struct WorkTask *task = deque_pop(&w->deque);
+        if (!task) {
+            backlog_append(w, __atomic_exchange_n(&w->inbox, NULL, __ATOMIC_ACQUIRE));
+            task = backlog_take(w);
+        }
+        if (!task) task = steal_any(w);
+        if (task) {
+            run_task(w, task);
+        } else if (!w->backlog) {
+            park();
+        }
+    }
+    return NULL;
+}
+
+/** @see work_pool_start() */
+int work_pool_start(unsigned threads) {
+    if (threads > WORK_POOL_MAX_THREADS) threads = WORK_POOL_MAX_THREADS;
+    for (unsigned i = 0; i < threads; ++i) {
+        struct Worker *w = &g_workers[g_worker_count];
+        memset(w, 0, sizeof(*w));
+        w->index = g_worker_count;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, w) != 0) {
+            perror("work_pool_start");
+            return g_worker_count > 0 ? 0 : -1;
+        }
+        pthread_detach(thread);
+        /* Worker moi chi bi trom/nhan viec sau khi da dem vao g_worker_count */
+        __atomic_store_n(&g_worker_count, g_worker_count + 1, __ATOMIC_RELEASE);
+    }
+    return threads > 0 ? 0 : -1;
+}
+
+/** @see work_reactor_init() */
+int work_reactor_init(struct WorkReactor *r) {
+    r->completed = NULL;
+    r->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return r->fd >= 0 ? 0 : -1;
+}
+
+/** @see work_reactor_close() */
+void work_reactor_close(struct WorkReactor *r) {
+    if (r->fd >= 0) {
+        close(r->fd);
+        r->fd = -1;
+    }
+}
+
+/** @see work_pool_submit() */
+int work_pool_submit(struct WorkReactor *owner, struct WorkTask *task) {
+    unsigned n = __atomic_load_n(&g_worker_count, __ATOMIC_ACQUIRE);
+    if (n == 0 || !task || !task->run) {
+        return -1;
+    }
+    task->owner = owner;
+    struct Worker *w = &g_workers[__atomic_fetch_add(&g_next_inbox, 1, __ATOMIC_RELAXED) % n];
+    struct WorkTask *head = __atomic_load_n(&w->inbox, __ATOMIC_RELAXED);
+    do {
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&w->inbox, &head, task, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&g_submitted, 1, __ATOMIC_RELAXED);
+    wake_one();
+    return 0;
+}
+
+/** @see work_pool_spawn() */
+void work_pool_spawn(struct WorkReactor *owner, struct WorkTask *task) {
+    struct Worker *w = t_worker;
+    if (!w) {
+        if (work_pool_submit(owner, task) != 0) {
+            task->owner = owner;
+            task->run(task);
+            if (task->done) task->done(task);
+        }
+        return;
+    }
+    task->owner = owner;
+    if (deque_push(&w->deque, task) != 0) {
+        run_task(w, task);
+        return;
+    }
+    wake_one();
+}
+
+/** @see work_reactor_run() */
+size_t work_reactor_run(struct WorkReactor *r) {
+    /* Xoa eventfd truoc khi lay danh sach: task xong sau do se bao lai */
+    eventfd_clear(r->fd);
+    struct WorkTask *list = __atomic_exchange_n(&r->completed, NULL, __ATOMIC_ACQUIRE);
+    struct WorkTask *fifo = NULL;
+    while (list) {
+        struct WorkTask *next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    size_t count = 0;
+    while (fifo) {
+        struct WorkTask *next = fifo->next;
+        fifo->done(fifo);
+        fifo = next;
+        count++;
+    }
+    return count;
+}
+
+/** @see work_reactor_wait() */
+size_t work_reactor_wait(struct WorkReactor *r, int timeout_ms) {
+    struct pollfd pfd = {r->fd, POLLIN, 0};
+    if (!__atomic_load_n(&r->completed, __ATOMIC_ACQUIRE)) {
+        while (poll(&pfd, 1, timeout_ms) < 0 && errno == EINTR) {
+        }
+    }
+    return work_reactor_run(r);
+}
+
+/** @see work_pool_get_stats() */
+void work_pool_get_stats(struct WorkPoolStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    out->workers = __atomic_load_n(&g_worker_count, __ATOMIC_ACQUIRE);
+    out->submitted = __atomic_load_n(&g_submitted, __ATOMIC_RELAXED);
+    for (unsigned i = 0; i < out->workers; ++i) {
+        out->executed += __atomic_load_n(&g_workers[i].executed, __ATOMIC_RELAXED);
+        out->stolen += __atomic_load_n(&g_workers[i].stolen, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef SERVER_WORK_POOL_H
+#define SERVER_WORK_POOL_H
+
+#include <stddef.h>
+
+/**
+ * @file work_pool.h
+ * @brief Pool thread làm việc nặng (ghi file farm, ...) ngoài reactor, chia việc bằng work stealing.
+ *
+ * Mỗi worker có một deque Chase-Lev: chính nó đẩy/lấy ở đáy (LIFO, không
+ * atomic RMW trừ khi tranh phần tử cuối), worker rảnh lấy trộm ở đỉnh (FIFO).
+ * Việc từ thread ngoài pool vào inbox của một worker (xoay vòng); worker rảnh
+ * lấy trộm được cả inbox của worker khác. Việc do một task sinh ra
+ * (`work_pool_spawn()`) vào thẳng deque của worker đang chạy nó.
+ *
+ * Xong việc, task được trả về reactor sở hữu (`WorkReactor`) qua danh sách
+ * lock-free + eventfd; reactor poll fd đó và chạy callback `done` trên thread
+ * của mình, nên không bao giờ phải chờ worker.
+ */
+
+struct WorkReactor;
+
+/**
+ * @brief Một việc cho pool; nhúng vào struct lớn hơn và lấy lại bằng `offsetof`.
+ *
+ * Thuộc pool từ lúc submit tới khi `done` được gọi; `done` có thể free task.
+ */
+struct WorkTask {
+    void (*run)(struct WorkTask *task);     // Chạy trên worker
+    void (*done)(struct WorkTask *task);    // Chạy trên thread reactor (NULL: không báo lại)
+    struct WorkReactor *owner;
+    struct WorkTask *next;                  // Nội bộ
+};
+
+/** @brief Điểm nhận task đã xong của một thread reactor. */
+struct WorkReactor {
+    int fd;                                 // eventfd: đọc được khi có task xong
+    struct WorkTask *completed;             // Stack lock-free (worker đẩy, reactor lấy hết)
+};
+
+/** @brief Số liệu của pool từ khi server chạy. */
+struct WorkPoolStats {
+    unsigned workers;
+    unsigned long submitted;    /* task tu thread ngoai pool */
+    unsigned long executed;     /* task da chay xong */
+    unsigned long stolen;       /* task lay trom tu deque cua worker khac */
+};
+
+/**
+ * @brief Chạy `threads` worker (gọi một lần trước mọi submit).
+ * @return 0 nếu thành công, -1 nếu lỗi (pool không có worker nào: submit trả -1).
+ */
+int work_pool_start(unsigned threads);
+
+/**
+ * @brief Tạo eventfd cho reactor (thread gọi `work_reactor_run()`).
+ * @return 0 nếu thành công, -1 nếu lỗi.
+ */
+int work_reactor_init(struct WorkReactor *r);
+
+/** @brief Đóng eventfd của reactor tạm (mọi task giao cho nó phải đã xong). */
+void work_reactor_close(struct WorkReactor *r);
+
+/**
+ * @brief Giao `task` cho pool từ thread ngoài pool; `done` sẽ chạy trên reactor `owner`.
+ * @return 0 nếu đã giao, -1 nếu pool không chạy (caller tự làm việc đó).
+ */
+int work_pool_submit(struct WorkReactor *owner, struct WorkTask *task);
+
+/**
+ * @brief Tách việc con từ trong một task: vào deque của worker hiện tại để worker rảnh lấy trộm.
+ *
+ * Deque đầy thì chạy luôn tại chỗ; gọi ngoài pool thì tương đương `work_pool_submit()`
+ * (pool không chạy thì chạy tại chỗ).
+ */
+void work_pool_spawn(struct WorkReactor *owner, struct WorkTask *task);
+
+/**
+ * @brief Reactor: chạy `done` của mọi task đã xong (theo thứ tự xong).
+ * @return Số task đã xử lý.
+ */
+size_t work_reactor_run(struct WorkReactor *r);
+
+/**
+ * @brief Reactor: chờ tối đa `timeout_ms` tới khi có task xong rồi chạy `work_reactor_run()`.
+ *
+ * Chỉ dùng khi reactor bắt buộc phải có kết quả mới đi tiếp được.
+ * @return Số task đã xử lý.
+ */
+size_t work_reactor_wait(struct WorkReactor *r, int timeout_ms);
+
+/** @brief Lấy số liệu pool (gọi từ thread bất kỳ). */
+void work_pool_get_stats(struct WorkPoolStats *out);
+
+#endif /* SERVER_WORK_POOL_H */
@@ -10,14 +10,62 @@
 #define MAX_LINE_LEN 2048        // TĂNG từ 1024
 #define MAX_JSON_LEN 2048        // TĂNG từ 1024
 #define MAX_ACTION_LEN 16
+#define MAX_BATCH_DEVICES 256    // Số cặp <id>:<token> tối đa trong MINFO/MCONTROL (độc lập với số kết nối)
 
 // Cấu hình mạng
 #define DEFAULT_PORT 8888
 #define DEFAULT_BACKLOG 8
+#define METRICS_HTTP_PORT 9100      // Cổng /metrics (chỉ 127.0.0.1), 0 = tắt
+#define TELEMETRY_UDP_PORT 8889     // Cổng UDP nhận số đo có ký, 0 = tắt
+
+// Buffer gửi và push event theo từng kết nối
+#define NET_OUT_HIGH_WATER (64 * 1024)      // Trên mức này event bị gộp vào hàng đợi
+#define NET_OUT_MAX (16 * 1024 * 1024)      // Vượt mức này kết nối bị đóng
+#define MAX_SUBSCRIPTIONS 32                // Số SUBSCRIBE tối đa mỗi kết nối
+#define MAX_PENDING_EVENTS 64               // Số thiết bị chờ gửi event mỗi kết nối
+#define REQ_ARENA_SIZE (256 * 1024)         // Khối arena cho response/jansson trong một lượt xử lý lệnh
+
+// Thread mạng <-> state actor (dung lượng là lũy thừa của 2)
+#define ACTOR_QUEUE_DEPTH 256               // Số lệnh chờ actor xử lý (mỗi ô chứa một dòng)
+#define ACTOR_REPLY_RING_BYTES (1024 * 1024)  // Ring response/event actor trả cho thread mạng
+#define ACTOR_BATCH_MAX 128                 // Số lệnh tối đa actor xử lý trước một lần lưu farm + công bố
+
+// Snapshot đọc (RCU) cho INFO/COOPLIST/SCAN cursor
+#define FARM_SNAPSHOT_MAX_READERS 16        // Số thread đọc snapshot tối đa
+#define FARM_SNAPSHOT_COST_RATIO 4          // Nghỉ ít nhất N lần thời gian dựng snapshot giữa hai lần công bố
+
+// Pool worker cho việc nặng ngoài actor (ghi file farm, ...)
+#define WORK_POOL_THREADS 2                 // Số worker (0 = làm tại chỗ trên actor như trước)
+#define WORK_DEQUE_CAPACITY 256             // Số task tối đa trong deque của một worker (lũy thừa của 2)
+#define FARM_LOAD_CHUNK 1024                // Số thiết bị đã parse gom lại trước mỗi lần chèn vào registry khi nạp farm
+#define FARM_STREAM_BUFFER (64 * 1024)      // Buffer đọc file farm theo luồng (byte)
+#define FARM_STREAM_MAX_ENTRY (1024 * 1024) // Văn bản tối đa của một mục thiết bị khi nạp farm (byte)
+
+// Thống kê và log
+#define STATS_DUMP_INTERVAL_S 60            // Chu kỳ in STATS ra stdout (0 = tắt)
+#define MONITOR_LOG_QUEUE_MAX 1024          // Số dòng log gom trong RAM trước khi buộc ghi file
 
 // Quản lý session và chuồng
 #define MAX_COOPS 10
 
+// Giới hạn registry phía server (mảng cấp phát động, tăng dần khi cần)
+#define MAX_FARM_DEVICES 262144
+#define MAX_FARM_COOPS 65536
+#define IMPORT_MAX_RECORDS 65536            // Số bản ghi tối đa của một lô IMPORT
+#define IMPORT_MAX_RECORD_LEN 4096          // Văn bản tối đa của một bản ghi IMPORT (byte)
+
+// Số đo REPORT/MREPORT chỉ đánh dấu farm bẩn; ghi file gom theo chu kỳ này
+#define FARM_FLUSH_INTERVAL_S 2
+
+// Đồng bộ đĩa khi ghi file farm: 0 không fsync, 1 fsync file, 2 fsync file + thư mục (xem StorageSync)
+#define FARM_FSYNC_POLICY 2
+
+// Phân trang SCAN/COOPLIST: limit=N tối đa mỗi trang
+#define SCAN_PAGE_MAX 4096
+
+// Số bucket tối đa của một lệnh HISTORY
+#define HISTORY_MAX_POINTS 4096
+
 // Cấu hình thiết bị
 #define MAX_SCHEDULE_ENTRIES 10
 
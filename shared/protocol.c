@@ -30,7 +30,21 @@ static const struct command_entry COMMAND_TABLE[] = {
     { "SETCOOP", CMD_ASSIGN_DEVICE },
     { "COOPLIST", CMD_COOP_LIST },
     { "COOP_ADD", CMD_COOP_ADD },
-    { "COOPADD", CMD_COOP_ADD }
+    { "COOPADD", CMD_COOP_ADD },
+    { "MINFO", CMD_MINFO },
+    { "MCONTROL", CMD_MCONTROL },
+    { "REMOVE", CMD_REMOVE_DEVICE },
+    { "REMOVEDEVICE", CMD_REMOVE_DEVICE },
+    { "SUBSCRIBE", CMD_SUBSCRIBE },
+    { "UNSUBSCRIBE", CMD_UNSUBSCRIBE },
+    { "STATS", CMD_STATS },
+    { "REPORT", CMD_REPORT },
+    { "MREPORT", CMD_MREPORT },
+    { "HISTORY", CMD_HISTORY },
+    { "COOPSTATS", CMD_COOPSTATS },
+    { "IMPORT", CMD_IMPORT },
+    { "EXPORT", CMD_EXPORT },
+    { "COOPDEVICES", CMD_COOPDEVICES }
 };
 
 /** @see protocol_command_from_string() */
@@ -48,6 +62,35 @@ enum CommandType protocol_command_from_string(const char *word) {
     return CMD_UNKNOWN;
 }
 
+/** @see protocol_command_name() */
+const char *protocol_command_name(enum CommandType cmd) {
+    for (size_t i = 0; i < sizeof(COMMAND_TABLE) / sizeof(COMMAND_TABLE[0]); ++i) {
+        if (COMMAND_TABLE[i].cmd == cmd) {
+            return COMMAND_TABLE[i].name;
+        }
+    }
+    return "UNKNOWN";
+}
+
+/** @see protocol_command_is_streamed() */
+int protocol_command_is_streamed(enum CommandType cmd) {
+    switch (cmd) {
+    case CMD_SCAN:
+    case CMD_COOP_LIST:
+    case CMD_MINFO:
+    case CMD_MCONTROL:
+    case CMD_STATS:
+    case CMD_MREPORT:
+    case CMD_HISTORY:
+    case CMD_IMPORT:
+    case CMD_EXPORT:
+    case CMD_COOPDEVICES:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 /** @see protocol_format_line() */
 int protocol_format_line(char *out, size_t len, int code, const char *text, const char *payload) {
     if (!out || len == 0 || !text) {
@@ -86,6 +129,76 @@ int protocol_format_device_ex(char *out, size_t len, const char *id, enum Device
     return protocol_format_line(out, len, RESP_DEVICE, payload, NULL);
 }
 
+/** @see protocol_format_device_delta() */
+int protocol_format_device_delta(char *out, size_t len, const char *id, enum DeviceType type, int coop_id, unsigned long long version) {
+    if (!id) {
+        return -1;
+    }
+    char payload[MAX_LINE_LEN];
+    int written = snprintf(payload, sizeof(payload), "DEVICE %s %s %d %llu", id, device_type_to_string(type), coop_id, version);
+    if (written < 0 || (size_t)written >= sizeof(payload)) {
+        return -1;
+    }
+    return protocol_format_line(out, len, RESP_DEVICE, payload, NULL);
+}
+
+/** @see protocol_format_removed() */
+int protocol_format_removed(char *out, size_t len, const char *id, unsigned long long version) {
+    if (!id) {
+        return -1;
+    }
+    char payload[MAX_LINE_LEN];
+    int written = snprintf(payload, sizeof(payload), "%s %llu", id, version);
+    if (written < 0 || (size_t)written >= sizeof(payload)) {
+        return -1;
+    }
+    return protocol_format_line(out, len, RESP_REMOVED, "REMOVED", payload);
+}
+
+/** @see protocol_format_scan_reset() */
+int protocol_format_scan_reset(char *out, size_t len) {
+    return protocol_format_line(out, len, RESP_SCAN_RESET, "SCAN_RESET", NULL);
+}
+
+/** @see protocol_format_scan_end() */
+int protocol_format_scan_end(char *out, size_t len, unsigned long long version) {
+    char payload[32];
+    int written = snprintf(payload, sizeof(payload), "%llu", version);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_SCAN_END, "SCAN_END", payload);
+}
+
+/** @see protocol_format_scan_more() */
+int protocol_format_scan_more(char *out, size_t len, unsigned long long after_seq, unsigned long long version) {
+    char payload[48];
+    int written = snprintf(payload, sizeof(payload), "%llu:%llu", after_seq, version);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_SCAN_MORE, "SCAN_MORE", payload);
+}
+
+/** @see protocol_format_event() */
+int protocol_format_event(char *out, size_t len, const char *device_id, const char *json) {
+    if (!device_id || !json) return -1;
+    char payload[MAX_LINE_LEN];
+    int written = snprintf(payload, sizeof(payload), "%s %s", device_id, json);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_EVENT, "EVENT", payload);
+}
+
+/** @see protocol_format_event_gone() */
+int protocol_format_event_gone(char *out, size_t len, const char *device_id) {
+    if (!device_id) return -1;
+    return protocol_format_line(out, len, RESP_EVENT_GONE, "EVENT_GONE", device_id);
+}
+
+/** @see protocol_format_event_lost() */
+int protocol_format_event_lost(char *out, size_t len, unsigned long dropped) {
+    char payload[32];
+    int written = snprintf(payload, sizeof(payload), "%lu", dropped);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_EVENT_LOST, "EVENT_LOST", payload);
+}
+
 /** @see protocol_format_no_device_scan() */
 int protocol_format_no_device_scan(char *out, size_t len) {
     return protocol_format_line(out, len, RESP_NO_DEVICE_SCAN, "NO_DEVICE", NULL);
@@ -111,16 +224,75 @@ int protocol_format_info_ok(char *out, size_t len, const char *json) {
     return protocol_format_line(out, len, RESP_INFO_OK, "INFO_OK", json);
 }
 
+/** @brief Format header batch "<code> <text> <count>". */
+static int format_batch_header(char *out, size_t len, int code, const char *text, size_t count) {
+    char payload[32];
+    int written = snprintf(payload, sizeof(payload), "%zu", count);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, code, text, payload);
+}
+
+/** @see protocol_format_minfo_ok() */
+int protocol_format_minfo_ok(char *out, size_t len, size_t count) {
+    return format_batch_header(out, len, RESP_MINFO_OK, "MINFO_OK", count);
+}
+
+/** @see protocol_format_history() */
+int protocol_format_history(char *out, size_t len, size_t count) {
+    return format_batch_header(out, len, RESP_HISTORY, "HISTORY", count);
+}
+
+/** @see protocol_format_point() */
+int protocol_format_point(char *out, size_t len, long long start, double min, double max, double avg,
+                          unsigned long count) {
+    char payload[128];
+    int written = snprintf(payload, sizeof(payload), "%lld %.6g %.6g %.6g %lu", start, min, max, avg, count);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_POINT, "POINT", payload);
+}
+
 /** @see protocol_format_control_ok() */
 int protocol_format_control_ok(char *out, size_t len) {
     return protocol_format_line(out, len, RESP_CONTROL_OK, "CONTROL_OK", NULL);
 }
 
+/** @see protocol_format_mcontrol_ok() */
+int protocol_format_mcontrol_ok(char *out, size_t len, size_t count) {
+    return format_batch_header(out, len, RESP_MCONTROL_OK, "MCONTROL_OK", count);
+}
+
+/** @see protocol_format_device_result() */
+int protocol_format_device_result(char *out, size_t len, enum ResponseCode code, const char *device_id) {
+    const char *text = NULL;
+    switch (code) {
+    case RESP_CONTROL_OK: text = "CONTROL_OK"; break;
+    case RESP_NO_DEVICE: text = "NO_DEVICE"; break;
+    case RESP_NOT_CONNECTED: text = "NOT_CONNECTED"; break;
+    case RESP_NO_COOP: text = "NO_COOP"; break;
+    case RESP_BAD_REQUEST: text = "BAD_REQUEST"; break;
+    default: return -1;
+    }
+    return protocol_format_line(out, len, code, text, device_id);
+}
+
 /** @see protocol_format_setcfg_ok() */
 int protocol_format_setcfg_ok(char *out, size_t len, const char *json) {
     return protocol_format_line(out, len, RESP_SETCFG_OK, "SETCFG_OK", json);
 }
 
+/** @see protocol_format_report_ok() */
+int protocol_format_report_ok(char *out, size_t len) {
+    return protocol_format_line(out, len, RESP_REPORT_OK, "REPORT_OK", NULL);
+}
+
+/** @see protocol_format_mreport_ok() */
+int protocol_format_mreport_ok(char *out, size_t len, size_t applied, size_t failed) {
+    char payload[48];
+    int written = snprintf(payload, sizeof(payload), "%zu %zu", applied, failed);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_MREPORT_OK, "MREPORT_OK", payload);
+}
+
 /** @see protocol_format_pass_ok() */
 int protocol_format_pass_ok(char *out, size_t len) {
     return protocol_format_line(out, len, RESP_PASS_OK, "PASS_OK", NULL);
@@ -136,11 +308,69 @@ int protocol_format_add_ok(char *out, size_t len) {
     return protocol_format_line(out, len, RESP_ADD_OK, "ADD_OK", NULL);
 }
 
+/** @see protocol_format_remove_ok() */
+int protocol_format_remove_ok(char *out, size_t len) {
+    return protocol_format_line(out, len, RESP_REMOVE_OK, "REMOVE_OK", NULL);
+}
+
 /** @see protocol_format_assign_ok() */
 int protocol_format_assign_ok(char *out, size_t len) {
     return protocol_format_line(out, len, RESP_ASSIGN_OK, "ASSIGN_OK", NULL);
 }
 
+/** @see protocol_format_stats() */
+int protocol_format_stats(char *out, size_t len, size_t count) {
+    return format_batch_header(out, len, RESP_STATS, "STATS", count);
+}
+
+/** @see protocol_format_stat() */
+int protocol_format_stat(char *out, size_t len, const char *metric) {
+    if (!metric) return -1;
+    return protocol_format_line(out, len, RESP_STAT, "STAT", metric);
+}
+
+/** @see protocol_format_subscribe_ok() */
+int protocol_format_subscribe_ok(char *out, size_t len, size_t active) {
+    return format_batch_header(out, len, RESP_SUBSCRIBE_OK, "SUBSCRIBE_OK", active);
+}
+
+/** @see protocol_format_unsubscribe_ok() */
+int protocol_format_unsubscribe_ok(char *out, size_t len, size_t active) {
+    return format_batch_header(out, len, RESP_UNSUBSCRIBE_OK, "UNSUBSCRIBE_OK", active);
+}
+
+/** @see protocol_format_import_ready() */
+int protocol_format_import_ready(char *out, size_t len) {
+    return protocol_format_line(out, len, RESP_IMPORT_READY, "IMPORT_READY", NULL);
+}
+
+/** @see protocol_format_import_ok() */
+int protocol_format_import_ok(char *out, size_t len, size_t added, size_t failed) {
+    char payload[48];
+    int written = snprintf(payload, sizeof(payload), "%zu %zu", added, failed);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_IMPORT_OK, "IMPORT_OK", payload);
+}
+
+/** @see protocol_format_record() */
+int protocol_format_record(char *out, size_t len, const char *json) {
+    if (!json) return -1;
+    return protocol_format_line(out, len, RESP_RECORD, "RECORD", json);
+}
+
+/** @see protocol_format_export_more() */
+int protocol_format_export_more(char *out, size_t len, unsigned long long after_seq) {
+    char payload[32];
+    int written = snprintf(payload, sizeof(payload), "%llu", after_seq);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_EXPORT_MORE, "EXPORT_MORE", payload);
+}
+
+/** @see protocol_format_export_end() */
+int protocol_format_export_end(char *out, size_t len, size_t count) {
+    return format_batch_header(out, len, RESP_EXPORT_END, "EXPORT_END", count);
+}
+
 /** @see protocol_format_coop() */
 int protocol_format_coop(char *out, size_t len, int coop_id, const char *name) {
     if (!name) return -1;
@@ -163,6 +393,32 @@ int protocol_format_no_coop(char *out, size_t len) {
     return protocol_format_line(out, len, RESP_NO_COOP, "NO_COOP", NULL);
 }
 
+/** @see protocol_format_coop_more() */
+int protocol_format_coop_more(char *out, size_t len, size_t cursor) {
+    char payload[32];
+    int written = snprintf(payload, sizeof(payload), "%zu", cursor);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_COOP_MORE, "COOP_MORE", payload);
+}
+
+/** @see protocol_format_coop_end() */
+int protocol_format_coop_end(char *out, size_t len) {
+    return protocol_format_line(out, len, RESP_COOP_END, "COOP_END", NULL);
+}
+
+/** @see protocol_format_coopstats() */
+int protocol_format_coopstats(char *out, size_t len, const char *json) {
+    return protocol_format_line(out, len, RESP_COOPSTATS, "COOPSTATS", json);
+}
+
+/** @see protocol_format_coopdevices() */
+int protocol_format_coopdevices(char *out, size_t len, size_t count, unsigned long long next) {
+    char payload[48];
+    int written = snprintf(payload, sizeof(payload), "%zu %llu", count, next);
+    if (written < 0 || (size_t)written >= sizeof(payload)) return -1;
+    return protocol_format_line(out, len, RESP_COOPDEVICES, "COOPDEVICES", payload);
+}
+
 /** @see protocol_format_not_connected() */
 int protocol_format_not_connected(char *out, size_t len) {
     return protocol_format_line(out, len, RESP_NOT_CONNECTED, "NOT_CONNECTED", NULL);
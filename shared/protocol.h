@@ -17,6 +17,19 @@ enum CommandType {
     CMD_ASSIGN_DEVICE,
     CMD_COOP_LIST,
     CMD_COOP_ADD,
+    CMD_MINFO,
+    CMD_MCONTROL,
+    CMD_REMOVE_DEVICE,
+    CMD_SUBSCRIBE,
+    CMD_UNSUBSCRIBE,
+    CMD_STATS,
+    CMD_REPORT,
+    CMD_MREPORT,
+    CMD_HISTORY,
+    CMD_COOPSTATS,
+    CMD_IMPORT,
+    CMD_EXPORT,
+    CMD_COOPDEVICES,
     CMD_UNKNOWN
 };
 
@@ -26,17 +39,44 @@ enum ResponseCode {
     RESP_READY = 100,
     RESP_DEVICE = 110,
     RESP_NO_DEVICE_SCAN = 111,
+    RESP_REMOVED = 112,
+    RESP_SCAN_RESET = 113,
+    RESP_SCAN_END = 114,
+    RESP_SCAN_MORE = 115,
+    RESP_EVENT = 116,
+    RESP_EVENT_GONE = 117,
+    RESP_EVENT_LOST = 118,
     RESP_CONNECT_OK = 120,
     RESP_INFO_OK = 130,
+    RESP_MINFO_OK = 135,
+    RESP_HISTORY = 136,
+    RESP_POINT = 137,
     RESP_CONTROL_OK = 140,
+    RESP_MCONTROL_OK = 145,
     RESP_SETCFG_OK = 150,
+    RESP_REPORT_OK = 155,
+    RESP_MREPORT_OK = 156,
     RESP_PASS_OK = 160,
     RESP_BYE_OK = 170,
+    RESP_STATS = 175,
+    RESP_STAT = 176,
     RESP_ADD_OK = 180,
     RESP_ASSIGN_OK = 181,
+    RESP_REMOVE_OK = 182,
+    RESP_SUBSCRIBE_OK = 183,
+    RESP_UNSUBSCRIBE_OK = 184,
+    RESP_IMPORT_READY = 185,
+    RESP_IMPORT_OK = 186,
+    RESP_RECORD = 187,
+    RESP_EXPORT_MORE = 188,
+    RESP_EXPORT_END = 189,
     RESP_COOP = 190,
     RESP_COOPADD_OK = 191,
     RESP_NO_COOP = 192,
+    RESP_COOP_MORE = 193,
+    RESP_COOP_END = 194,
+    RESP_COOPSTATS = 195,
+    RESP_COOPDEVICES = 196,
     
     // Client errors (2xx-3xx)
     RESP_WRONG_PASSWORD = 221,
@@ -53,6 +93,15 @@ enum ResponseCode {
  */
 enum CommandType protocol_command_from_string(const char *word);
 
+/**
+ * @brief Command có tự gửi nhiều dòng response (server không trả 1 dòng duy nhất).
+ * @return 1 nếu là command dạng stream (vd `SCAN`, `COOPLIST`, `MINFO`), 0 nếu không.
+ */
+int protocol_command_is_streamed(enum CommandType cmd);
+
+/** @brief Tên chuẩn của command (vd "SCAN"); "UNKNOWN" nếu không có. */
+const char *protocol_command_name(enum CommandType cmd);
+
 /**
  * @brief Format một dòng response theo mẫu: "<code> <text> [payload]".
  * @return 0 nếu format thành công, -1 nếu lỗi/buffer không đủ.
@@ -65,6 +114,46 @@ int protocol_format_ready(char *out, size_t len);
 /** @brief Response cho một thiết bị (kèm coop_id). */
 int protocol_format_device_ex(char *out, size_t len, const char *id, enum DeviceType type, int coop_id);
 
+/** @brief Dòng SCAN SINCE cho thiết bị mới/thay đổi (kèm version thay đổi cuối). */
+int protocol_format_device_delta(char *out, size_t len, const char *id, enum DeviceType type, int coop_id, unsigned long long version);
+
+/** @brief Dòng SCAN SINCE cho thiết bị đã bị xoá. */
+int protocol_format_removed(char *out, size_t len, const char *id, unsigned long long version);
+
+/** @brief Dòng SCAN SINCE báo client bỏ cache: version cũ không còn so sánh được. */
+int protocol_format_scan_reset(char *out, size_t len);
+
+/** @brief Dòng kết thúc SCAN SINCE/SCAN phân trang (payload = state version mới). */
+int protocol_format_scan_end(char *out, size_t len, unsigned long long version);
+
+/**
+ * @brief Dòng cuối trang SCAN khi còn thiết bị: "SCAN_MORE <seq>:<version>".
+ *
+ * Client coi cursor là chuỗi opaque và gửi lại nguyên văn qua `cursor=`.
+ */
+int protocol_format_scan_more(char *out, size_t len, unsigned long long after_seq, unsigned long long version);
+
+/** @brief Push event khi thiết bị được theo dõi thay đổi: "EVENT <id> <json>". */
+int protocol_format_event(char *out, size_t len, const char *device_id, const char *json);
+
+/** @brief Push event khi thiết bị được theo dõi bị xoá. */
+int protocol_format_event_gone(char *out, size_t len, const char *device_id);
+
+/** @brief Báo client đã mất `dropped` event (cần INFO/SCAN SINCE lại). */
+int protocol_format_event_lost(char *out, size_t len, unsigned long dropped);
+
+/** @brief Header STATS: "175 STATS <n>", theo sau là n dòng STAT. */
+int protocol_format_stats(char *out, size_t len, size_t count);
+
+/** @brief Một dòng số liệu: "176 STAT <tên> <giá trị...>". */
+int protocol_format_stat(char *out, size_t len, const char *metric);
+
+/** @brief Response SUBSCRIBE thành công (payload = số subscription của kết nối). */
+int protocol_format_subscribe_ok(char *out, size_t len, size_t active);
+
+/** @brief Response UNSUBSCRIBE thành công (payload = số subscription còn lại). */
+int protocol_format_unsubscribe_ok(char *out, size_t len, size_t active);
+
 /** @brief Response khi SCAN không tìm thấy thiết bị. */
 int protocol_format_no_device_scan(char *out, size_t len);
 
@@ -80,12 +169,40 @@ int protocol_format_no_device_err(char *out, size_t len);
 /** @brief Response INFO thành công (payload = JSON). */
 int protocol_format_info_ok(char *out, size_t len, const char *json);
 
+/** @brief Header của response MINFO: theo sau là `count` dòng kết quả từng thiết bị. */
+int protocol_format_minfo_ok(char *out, size_t len, size_t count);
+
+/** @brief Header của response HISTORY: theo sau là `count` dòng POINT. */
+int protocol_format_history(char *out, size_t len, size_t count);
+
+/** @brief Một bucket HISTORY: "137 POINT <start> <min> <max> <avg> <count>". */
+int protocol_format_point(char *out, size_t len, long long start, double min, double max, double avg,
+                          unsigned long count);
+
 /** @brief Response CONTROL thành công. */
 int protocol_format_control_ok(char *out, size_t len);
 
+/** @brief Header của response MCONTROL: theo sau là `count` dòng kết quả từng thiết bị. */
+int protocol_format_mcontrol_ok(char *out, size_t len, size_t count);
+
+/**
+ * @brief Một dòng kết quả theo thiết bị trong batch (vd "140 CONTROL_OK FAN1", "222 NO_DEVICE FAN9").
+ * @return 0 nếu format thành công, -1 nếu `code` không phải mã kết quả theo thiết bị.
+ */
+int protocol_format_device_result(char *out, size_t len, enum ResponseCode code, const char *device_id);
+
 /** @brief Response SETCFG thành công (payload = JSON mới). */
 int protocol_format_setcfg_ok(char *out, size_t len, const char *json);
 
+/** @brief Response REPORT thành công. */
+int protocol_format_report_ok(char *out, size_t len);
+
+/**
+ * @brief Header của response MREPORT: "MREPORT_OK <applied> <failed>",
+ *        theo sau là `failed` dòng lỗi theo thiết bị (bản ghi thành công không có dòng riêng).
+ */
+int protocol_format_mreport_ok(char *out, size_t len, size_t applied, size_t failed);
+
 /** @brief Response đổi mật khẩu thành công. */
 int protocol_format_pass_ok(char *out, size_t len);
 
@@ -95,9 +212,30 @@ int protocol_format_bye_ok(char *out, size_t len);
 /** @brief Response ADD device thành công. */
 int protocol_format_add_ok(char *out, size_t len);
 
+/** @brief Response REMOVE device thành công. */
+int protocol_format_remove_ok(char *out, size_t len);
+
 /** @brief Response ASSIGN device->coop thành công. */
 int protocol_format_assign_ok(char *out, size_t len);
 
+/** @brief Response IMPORT BEGIN: mọi dòng tiếp theo của kết nối là dữ liệu, tới IMPORT END. */
+int protocol_format_import_ready(char *out, size_t len);
+
+/**
+ * @brief Header của response IMPORT END: "IMPORT_OK <added> <failed>",
+ *        theo sau là `failed` dòng lỗi theo bản ghi (vd "192 NO_COOP FAN9").
+ */
+int protocol_format_import_ok(char *out, size_t len, size_t added, size_t failed);
+
+/** @brief Một thiết bị của EXPORT: "RECORD <json>" (json cùng schema với IMPORT, không có mật khẩu). */
+int protocol_format_record(char *out, size_t len, const char *json);
+
+/** @brief Dòng cuối trang EXPORT khi còn thiết bị (payload = cursor `seq` cho trang tiếp). */
+int protocol_format_export_more(char *out, size_t len, unsigned long long after_seq);
+
+/** @brief Dòng kết thúc EXPORT (payload = số RECORD của trang cuối). */
+int protocol_format_export_end(char *out, size_t len, size_t count);
+
 /** @brief Response trả về 1 dòng chuồng: "COOP <id> <name>". */
 int protocol_format_coop(char *out, size_t len, int coop_id, const char *name);
 
@@ -107,6 +245,21 @@ int protocol_format_coopadd_ok(char *out, size_t len, int coop_id);
 /** @brief Response khi chưa có chuồng nào. */
 int protocol_format_no_coop(char *out, size_t len);
 
+/** @brief Dòng cuối trang COOPLIST khi còn chuồng (payload = cursor tiếp theo). */
+int protocol_format_coop_more(char *out, size_t len, size_t cursor);
+
+/** @brief Dòng kết thúc COOPLIST phân trang. */
+int protocol_format_coop_end(char *out, size_t len);
+
+/** @brief Response COOPSTATS (payload = JSON số liệu tổng hợp của chuồng). */
+int protocol_format_coopstats(char *out, size_t len, const char *json);
+
+/**
+ * @brief Header của response COOPDEVICES: "COOPDEVICES <count> <next>", theo sau
+ *        là `count` dòng DEVICE; `next` là cursor trang tiếp, 0 nếu đã hết.
+ */
+int protocol_format_coopdevices(char *out, size_t len, size_t count, unsigned long long next);
+
 /** @brief Response khi token chưa hợp lệ hoặc chưa CONNECT. */
 int protocol_format_not_connected(char *out, size_t len);
 
@@ -0,0 +1,157 @@
+#define _XOPEN_SOURCE 700
+
+/**
+ * @file import_test.c
+ * @brief Kiểm tra chế độ dữ liệu của IMPORT trên server thật (thread mạng + actor).
+ *
+ * Chạy `server_app` trong thư mục tạm (cổng `DEFAULT_PORT`) rồi kiểm tra:
+ * BEGIN bị từ chối thì các dòng sau vẫn là lệnh và được trả lời; BEGIN được
+ * nhận thì các dòng gửi liền sau (cùng một lần ghi) là dữ liệu của lô.
+ * Chạy: `make test` hoặc `bin/import_test [server_app]`.
+ */
+
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <ftw.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+    CONNECT_TRIES = 60,
+    CONNECT_WAIT_MS = 50,
+    REPLY_TIMEOUT_MS = 2000
+};
+
+static int g_fd = -1;
+static char g_buf[8192];
+static size_t g_len;
+static int g_failures;
+
+static void sleep_ms(long ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+/** @brief Đọc một dòng (bỏ '\n') vào `out`; -1 nếu hết thời gian hoặc mất kết nối. */
+static int read_line(char *out, size_t len) {
+    for (;;) {
+        char *nl = memchr(g_buf, '\n', g_len);
+        if (nl) {
+            size_t n = (size_t)(nl - g_buf);
+            snprintf(out, len, "%.*s", (int)n, g_buf);
+            g_len -= n + 1;
+            memmove(g_buf, nl + 1, g_len);
+            return 0;
+        }
+        struct pollfd pfd = {g_fd, POLLIN, 0};
+        if (g_len == sizeof(g_buf) || poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0) return -1;
+        ssize_t n = read(g_fd, g_buf + g_len, sizeof(g_buf) - g_len);
+        if (n <= 0) return -1;
+        g_len += (size_t)n;
+    }
+}
+
+static void send_text(const char *text) {
+    size_t len = strlen(text);
+    if (write(g_fd, text, len) != (ssize_t)len) {
+        perror("write");
+    }
+}
+
+/** @brief Dòng kế tiếp phải bắt đầu bằng `prefix`. */
+static void expect(const char *step, const char *prefix) {
+    char line[1024];
+    if (read_line(line, sizeof(line)) != 0) {
+        printf("FAIL %s: khong co response (cho \"%s\")\n", step, prefix);
+        g_failures++;
+    } else if (strncmp(line, prefix, strlen(prefix)) != 0) {
+        printf("FAIL %s: \"%s\" (cho \"%s\")\n", step, line, prefix);
+        g_failures++;
+    } else {
+        printf("ok   %s: %s\n", step, line);
+    }
+}
+
+static int connect_server(void) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(DEFAULT_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < CONNECT_TRIES; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+        if (fd >= 0) close(fd);
+        sleep_ms(CONNECT_WAIT_MS);
+    }
+    return -1;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+int main(int argc, char **argv) {
+    char server[PATH_MAX];
+    if (!realpath(argc > 1 ? argv[1] : "server_app", server)) {
+        perror("server_app");
+        return 1;
+    }
+    char dir[] = "/tmp/coopfarm-test-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (chdir(dir) != 0 || !freopen("server.log", "w", stdout) || !freopen("server.log", "a", stderr)) _exit(127);
+        execl(server, server, (char *)NULL);
+        _exit(127);
+    }
+    g_fd = pid > 0 ? connect_server() : -1;
+    if (g_fd < 0) {
+        printf("FAIL khong ket noi duoc server\n");
+        g_failures++;
+    } else {
+        expect("ready", "100 ");
+
+        /* BEGIN bi tu choi (chuong khong ton tai): lenh ke tiep phai duoc tra loi */
+        send_text("IMPORT BEGIN 999999\nCOOPADD Kiemtra\nEXPORT coop=999999\n");
+        expect("begin bi tu choi", "400 ");
+        expect("lenh sau begin bi tu choi", "191 COOPADD_OK");
+        expect("lenh doc sau begin bi tu choi", "192 NO_COOP");
+
+        /* BEGIN thua tham so cung bi tu choi */
+        send_text("IMPORT BEGIN 1 x\nCOOPLIST\n");
+        expect("begin thua tham so", "400 ");
+        expect("cooplist sau begin bi tu choi", "190 COOP 1 ");
+
+        /* BEGIN duoc nhan: dong du lieu gui lien sau la ban ghi cua lo */
+        send_text("IMPORT BEGIN\n{\"id\":\"IMP_T1\",\"type\":\"fan\",\"coop_id\":1}\nIMPORT END\nEXPORT coop=1\n");
+        expect("begin", "185 IMPORT_READY");
+        expect("end", "186 IMPORT_OK 1 0");
+        expect("export sau import", "187 RECORD {\"id\":\"IMP_T1\"");
+        expect("het export", "189 EXPORT_END 1");
+        close(g_fd);
+    }
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        (void)waitpid(pid, NULL, 0);
+    }
+    (void)nftw(dir, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+    printf("%s\n", g_failures == 0 ? "PASS" : "FAIL");
+    return g_failures == 0 ? 0 : 1;
+}
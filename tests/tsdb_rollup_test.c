@@ -0,0 +1,117 @@
+#define _XOPEN_SOURCE 700
+
+/**
+ * @file tsdb_rollup_test.c
+ * @brief Kiểm tra rollup phút/giờ/ngày của tsdb so với chính các số đo đã ghi.
+ *
+ * Ghi số đo dày hơn `TSDB_RESOLUTION_S` (dữ liệu thô bỏ bớt) rồi so
+ * min/max/avg/count của từng bucket `tsdb_aggregate()` với giá trị tính trực
+ * tiếp từ các số đo. Chạy: `make test` hoặc `bin/tsdb_rollup_test`.
+ */
+
+#include "tsdb.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    SAMPLE_EVERY_S = 17,
+    SAMPLE_COUNT = 3 * 3600 / SAMPLE_EVERY_S,
+    MAX_BUCKETS = 256
+};
+
+#define T0 ((int64_t)20000 * 86400)
+#define SERIES_ID "TS_ROLLUP"
+
+static int64_t g_ts[SAMPLE_COUNT];
+static double g_value[SAMPLE_COUNT];
+static int g_failures;
+
+/** @brief Giá trị giả ngẫu nhiên tất định trong [15, 35). */
+static double next_value(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return 15.0 + (double)((*seed >> 8) % 20000) / 1000.0;
+}
+
+/** @brief So các bucket của `step` với min/max/avg/count tính từ số đo đã ghi. */
+static void check_step(struct Tsdb *db, int64_t step, const char *name) {
+    struct TsdbBucket out[MAX_BUCKETS];
+    int64_t from = g_ts[0];
+    int64_t to = g_ts[SAMPLE_COUNT - 1];
+    long n = tsdb_aggregate(db, SERIES_ID, TSDB_METRIC_TEMPERATURE, from, to, step, out, MAX_BUCKETS);
+    if (n <= 0) {
+        printf("FAIL %s: tsdb_aggregate tra %ld\n", name, n);
+        g_failures++;
+        return;
+    }
+    int bad = 0;
+    for (long i = 0; i < n; ++i) {
+        double min = 0.0;
+        double max = 0.0;
+        double sum = 0.0;
+        unsigned long count = 0;
+        for (int k = 0; k < SAMPLE_COUNT; ++k) {
+            if (g_ts[k] < out[i].start || g_ts[k] >= out[i].start + step) continue;
+            if (count == 0 || g_value[k] < min) min = g_value[k];
+            if (count == 0 || g_value[k] > max) max = g_value[k];
+            sum += g_value[k];
+            count++;
+        }
+        if (out[i].count != count || (count > 0 && (out[i].min != min || out[i].max != max ||
+                                                    fabs(out[i].sum / count - sum / count) > 1e-9))) {
+            if (bad++ == 0) {
+                printf("FAIL %s: bucket %lld: count %lu/%lu min %g/%g max %g/%g avg %g/%g\n", name,
+                       (long long)out[i].start, out[i].count, count, out[i].min, min, out[i].max, max,
+                       out[i].count ? out[i].sum / out[i].count : 0.0, count ? sum / count : 0.0);
+            }
+        }
+    }
+    if (bad > 0) {
+        g_failures++;
+    } else {
+        printf("ok   %s: %ld bucket\n", name, n);
+    }
+}
+
+int main(void) {
+    char path[] = "/tmp/coopfarm-tsdb-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    struct Tsdb db;
+    if (tsdb_open(&db, path) != 0) {
+        unlink(path);
+        return 1;
+    }
+    uint32_t seed = 42;
+    for (int k = 0; k < SAMPLE_COUNT; ++k) {
+        g_ts[k] = T0 + (int64_t)k * SAMPLE_EVERY_S;
+        g_value[k] = next_value(&seed);
+        if (tsdb_append(&db, SERIES_ID, TSDB_METRIC_TEMPERATURE, g_ts[k], g_value[k]) < 0) {
+            printf("FAIL ghi so do %d\n", k);
+            g_failures++;
+        }
+        /* Gui lai so do cu: khong duoc cong hai lan */
+        if (k % 50 == 0) (void)tsdb_append(&db, SERIES_ID, TSDB_METRIC_TEMPERATURE, g_ts[k], 99.0);
+    }
+    struct TsdbStats stats;
+    tsdb_get_stats(&db, &stats);
+    if (stats.skipped == 0) {
+        printf("FAIL du lieu tho khong bo so do nao, kiem tra khong co y nghia\n");
+        g_failures++;
+    }
+    check_step(&db, 60, "phut");
+    check_step(&db, 300, "5 phut");
+    check_step(&db, 3600, "gio");
+    check_step(&db, 86400, "ngay");
+    tsdb_close(&db);
+    unlink(path);
+    printf("%s\n", g_failures == 0 ? "PASS" : "FAIL");
+    return g_failures == 0 ? 0 : 1;
+}
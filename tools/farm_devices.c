@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200809L
+
+/**
+ * @file farm_devices.c
+ * @brief Nhập/xuất danh sách thiết bị thẳng trên thư mục farm, không qua server.
+ *
+ * `farm_devices import <file|-> [coop_id]`: đọc NDJSON hoặc mảng JSON như
+ * `scan_devices.json` theo từng dòng (cùng bộ tách với lệnh IMPORT), nạp farm
+ * (`farm_state.d/`, chưa có thì `farm_state.json`), chèn cả lô rồi ghi
+ * `farm_state.d/` một lần, chỉ các shard có thay đổi. `coop_id` là chuồng cho
+ * bản ghi thiếu coop_id hoặc 0. Bản ghi lỗi được in ra stderr.
+ * `farm_devices export [coop_id]`: in thiết bị ra stdout, mỗi dòng một bản ghi NDJSON.
+ * Chạy trong thư mục của server và chỉ khi server đã dừng (server đang chạy sẽ
+ * ghi đè farm bằng state của nó).
+ */
+
+#include "coops.h"
+#include "device_import.h"
+#include "devices.h"
+#include "storage.h"
+#include "work_pool.h"
+#include "../shared/protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *FARM_STATE_PATH = "farm_state.json";
+static const char *FARM_SHARD_DIR = "farm_state.d";
+
+/** @brief Nạp farm như server lúc khởi động; 0 nếu thành công (farm chưa có thì rỗng). */
+static int load_farm(struct StorageShards *shards, struct CoopsContext *coops, struct DevicesContext *devices) {
+    if (storage_shards_init(shards, FARM_SHARD_DIR) != 0) return -1;
+    int rc = storage_shards_load(shards, coops, devices);
+    if (rc == 0) {
+        return storage_shards_sync(shards, coops, devices);
+    }
+    if (rc != -1) {
+        fprintf(stderr, "farm_devices: %s/manifest.json hong\n", FARM_SHARD_DIR);
+        return -1;
+    }
+    if (storage_load_farm(coops, devices, FARM_STATE_PATH) != 0) {
+        struct StorageStamp stamp;
+        if (storage_stamp(FARM_STATE_PATH, &stamp) == 0) {
+            fprintf(stderr, "farm_devices: khong doc duoc %s\n", FARM_STATE_PATH);
+            return -1;
+        }
+        coops_init(coops);
+        devices_context_init(devices);
+    }
+    return 0;
+}
+
+/** @brief Đọc `in` theo dòng vào lô; -1 nếu lô hỏng hoặc lỗi đọc. */
+static int read_records(FILE *in, struct DeviceImport *imp) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int rc = 0;
+    while (rc == 0 && (n = getline(&line, &cap, in)) >= 0) {
+        if (n > 0 && line[n - 1] == '\n') n--;
+        rc = device_import_feed(imp, line, (size_t)n);
+    }
+    free(line);
+    if (rc == 0 && ferror(in)) rc = -1;
+    return rc == 0 ? device_import_finish(imp) : -1;
+}
+
+static int run_import(const char *path, int default_coop) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    struct DeviceImport imp;
+    device_import_init(&imp, default_coop);
+    int rc = read_records(in, &imp);
+    if (in != stdin) fclose(in);
+    if (rc != 0) {
+        fprintf(stderr, "farm_devices: %s: JSON sai hoac qua %d ban ghi, khong nhap gi\n", path, IMPORT_MAX_RECORDS);
+        device_import_free(&imp);
+        return 1;
+    }
+
+    struct StorageShards shards;
+    struct CoopsContext coops;
+    struct DevicesContext devices;
+    if (load_farm(&shards, &coops, &devices) != 0) {
+        device_import_free(&imp);
+        return 1;
+    }
+    size_t added = device_import_apply(&imp, &coops, &devices, NULL, NULL);
+    size_t failed = 0;
+    char line[MAX_LINE_LEN];
+    for (size_t i = 0; i < imp.count; ++i) {
+        if (imp.records[i].status == 0) continue;
+        protocol_format_device_result(line, sizeof(line), (enum ResponseCode)imp.records[i].status, imp.records[i].id);
+        fprintf(stderr, "%s\n", line);
+        failed++;
+    }
+    device_import_free(&imp);
+
+    rc = 0;
+    if (added > 0) {
+        struct StorageWrite write;
+        int files = storage_shards_render(&shards, &coops, &devices, &write);
+        rc = files < 0 ? -1 : files > 0 ? storage_write_files(&write) : 0;
+        storage_write_free(&write);
+        if (rc != 0) fprintf(stderr, "farm_devices: khong ghi duoc %s\n", FARM_SHARD_DIR);
+    }
+    if (rc == 0) printf("added=%zu failed=%zu devices=%zu\n", added, failed, devices.count);
+    storage_shards_free(&shards);
+    coops_free(&coops);
+    devices_context_free(&devices);
+    return rc == 0 ? 0 : 1;
+}
+
+static int run_export(int coop_id) {
+    struct StorageShards shards;
+    struct CoopsContext coops;
+    struct DevicesContext devices;
+    if (load_farm(&shards, &coops, &devices) != 0) return 1;
+    char json[MAX_JSON_LEN];
+    for (size_t i = 0; i < devices.count; ++i) {
+        const struct Device *dev = &devices.devices[i];
+        if (coop_id > 0 && dev->identity.coop_id != coop_id) continue;
+        if (device_import_format(dev, 1, json, sizeof(json)) == 0) puts(json);
+    }
+    storage_shards_free(&shards);
+    coops_free(&coops);
+    devices_context_free(&devices);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    int import = argc >= 3 && argc <= 4 && strcmp(argv[1], "import") == 0;
+    int export = argc >= 2 && argc <= 3 && strcmp(argv[1], "export") == 0;
+    int coop_id = 0;
+    if (import && argc == 4) coop_id = atoi(argv[3]);
+    if (export && argc == 3) coop_id = atoi(argv[2]);
+    if ((!import && !export) || coop_id < 0) {
+        fprintf(stderr, "usage: %s import <file|-> [coop_id]\n       %s export [coop_id]\n", argv[0], argv[0]);
+        return 2;
+    }
+    /* Shard duoc doc song song nhu luc server khoi dong */
+    if (WORK_POOL_THREADS > 0) (void)work_pool_start(WORK_POOL_THREADS);
+    return import ? run_import(argv[2], coop_id) : run_export(coop_id);
+}